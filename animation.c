@@ -12,10 +12,10 @@
 #include "str.h"
 #include "animation.h"
 
-static const char *filePath;
-static buf(AnimationToken *) tokens;
-static int currentToken;
-static bool parsingStaticAnimation;
+static __thread const char *filePath;
+static __thread buf(AnimationToken *) tokens;
+static __thread int currentToken;
+static __thread bool parsingStaticAnimation;
 
 static void step_in_tokens()
 {
@@ -173,9 +173,6 @@ static Animation *parse_animation(const char *spriteName)
 			error("in %s at line %d, static animations imply only one animation phase, got another.", filePath, tokens[currentToken]->line);
 		}
 	}
-	animation->timeDuringCurrentAnimationPhase = 0.0f;
-	animation->currentAnimationPhase = 0;
-	animation->animationState = ANIMATION_STATE_STOP;
 	return animation;
 }
 
@@ -200,31 +197,31 @@ buf(Animation *) get_animations_from_file(const char *animationFilePath, const c
 	return animations;
 }
 
-void update_animation(Animation *animation)
+void update_animation(const Animation *animation, AnimationCursor *animationCursor)
 {
-	AnimationPhase *currentAnimationPhase = animation->animationPhases[animation->currentAnimationPhase];
-	if (animation->animationState != ANIMATION_STATE_STOP && animation->animationType != ANIMATION_STATIC)
+	AnimationPhase *currentAnimationPhase = animation->animationPhases[animationCursor->currentAnimationPhase];
+	if (animationCursor->animationState != ANIMATION_STATE_STOP && animation->animationType != ANIMATION_STATIC)
 	{
-		animation->timeDuringCurrentAnimationPhase += deltaTime;
-		while (animation->timeDuringCurrentAnimationPhase >= currentAnimationPhase->length)
+		animationCursor->timeDuringCurrentAnimationPhase += deltaTime;
+		while (animationCursor->timeDuringCurrentAnimationPhase >= currentAnimationPhase->length)
 		{
-			if ((unsigned int)animation->currentAnimationPhase == buf_len(animation->animationPhases) - 1)
+			if ((unsigned int)animationCursor->currentAnimationPhase == buf_len(animation->animationPhases) - 1)
 			{
 				if (animation->animationType == ANIMATION_LOOP)
 				{
-					animation->currentAnimationPhase = 0;
+					animationCursor->currentAnimationPhase = 0;
 				}
-				if (animation->animationState == ANIMATION_STATE_STOPPING)
+				if (animationCursor->animationState == ANIMATION_STATE_STOPPING)
 				{
-					animation->animationState = ANIMATION_STATE_STOP;
+					animationCursor->animationState = ANIMATION_STATE_STOP;
 				}
 			} else {
-				animation->currentAnimationPhase++;
+				animationCursor->currentAnimationPhase++;
 			}
-			if (animation->animationState != ANIMATION_STATE_STOP)
+			if (animationCursor->animationState != ANIMATION_STATE_STOP)
 			{
-				animation->timeDuringCurrentAnimationPhase -= currentAnimationPhase->length;
-				currentAnimationPhase = animation->animationPhases[animation->currentAnimationPhase];
+				animationCursor->timeDuringCurrentAnimationPhase -= currentAnimationPhase->length;
+				currentAnimationPhase = animation->animationPhases[animationCursor->currentAnimationPhase];
 			} else {
 				break;
 			}
@@ -232,11 +229,11 @@ void update_animation(Animation *animation)
 	}
 }
 
-void reset_animation(Animation *animation)
+void reset_animation(AnimationCursor *animationCursor)
 {
-	animation->timeDuringCurrentAnimationPhase = 0.0f;
-	animation->currentAnimationPhase = 0;
-	animation->animationState = ANIMATION_STATE_STOP;
+	animationCursor->timeDuringCurrentAnimationPhase = 0.0f;
+	animationCursor->currentAnimationPhase = 0;
+	animationCursor->animationState = ANIMATION_STATE_STOP;
 }
 
 void free_animation(Animation *animation)
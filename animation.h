@@ -29,14 +29,19 @@ typedef struct Animation
 	AnimationType animationType;
 	buf(char) name;
 	buf(AnimationPhase *) animationPhases;
+} Animation;
+
+// animations are shared by every sprite using them, so the playback lives with the sprite
+typedef struct AnimationCursor
+{
 	int currentAnimationPhase;
 	double timeDuringCurrentAnimationPhase;
 	AnimationState animationState;
-} Animation;
+} AnimationCursor;
 
 buf(Animation *) get_animations_from_file(const char *_animationFilePath, const char *spriteName);
-void update_animation(Animation *animation);
-void reset_animation(Animation *animation);
+void update_animation(const Animation *animation, AnimationCursor *animationCursor);
+void reset_animation(AnimationCursor *animationCursor);
 void free_animation(Animation *animation);
 
 #endif /* end of include guard: ANIMATION_H */
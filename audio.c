@@ -2,7 +2,9 @@
 #define DR_WAV_IMPLEMENTATION
 #define MINIAUDIO_IMPLEMENTATION
 
+#include <math.h>
 #include <stdbool.h>
+#include <string.h>
 #include <wchar.h>
 
 #include "dr_mp3.h"
@@ -13,15 +15,27 @@
 #include "error.h"
 #include "xalloc.h"
 #include "stretchy_buffer.h"
+#include "str.h"
+#include "thread.h"
 #include "audio.h"
 
+// handed to the device callback itself, as the table of sources may be reallocated meanwhile
 typedef struct InternalAudioSource
 {
 	ma_decoder *decoder;
 	ma_device *device;
+	AudioSource *audioSource;
 } InternalAudioSource;
 
 buf(InternalAudioSource *) internalAudioSources = NULL;
+// the sources are also opened ahead by the preloading worker, the table is only read under the lock
+static Mutex *internalAudioSourcesMutex;
+
+void init_audio()
+{
+	internalAudioSources = NULL;
+	internalAudioSourcesMutex = create_mutex();
+}
 
 static void free_internal_audio_source(InternalAudioSource *internalAudioSource)
 {
@@ -35,8 +49,8 @@ static void free_internal_audio_source(InternalAudioSource *internalAudioSource)
 
 static void audio_source_play_callback(ma_device *device, void *output, const void *input, ma_uint32 frameCount)
 {
-	AudioSource *audioSource = (AudioSource *)device->pUserData;
-	InternalAudioSource *internalAudioSource = internalAudioSources[audioSource->id];
+	InternalAudioSource *internalAudioSource = (InternalAudioSource *)device->pUserData;
+	AudioSource *audioSource = internalAudioSource->audioSource;
 
 	if (!audioSource->playing)
 	{
@@ -75,6 +89,7 @@ AudioSource *create_audio_source(const char *fileName)
 {
 	AudioSource *audioSource = xmalloc(sizeof (*audioSource));
 	InternalAudioSource *internalAudioSource = xmalloc(sizeof (*internalAudioSource));
+	lock_mutex(internalAudioSourcesMutex);
 	audioSource->id = -1;
 	for (int i = 0; i < buf_len(internalAudioSources); i++)
 	{
@@ -90,9 +105,11 @@ AudioSource *create_audio_source(const char *fileName)
 		audioSource->id = buf_len(internalAudioSources);
 		buf_add(internalAudioSources, internalAudioSource);
 	}
+	unlock_mutex(internalAudioSourcesMutex);
 	audioSource->volume = 1.0f;
 	audioSource->playing = false;
 
+	internalAudioSource->audioSource = audioSource;
 	internalAudioSource->decoder = xmalloc(sizeof (*internalAudioSource->decoder));
 	if (ma_decoder_init_file(fileName, NULL, internalAudioSource->decoder) != MA_SUCCESS)
 	{
@@ -104,7 +121,7 @@ AudioSource *create_audio_source(const char *fileName)
 	config.playback.channels = internalAudioSource->decoder->outputChannels;
 	config.sampleRate = internalAudioSource->decoder->outputSampleRate;
 	config.dataCallback = audio_source_play_callback;
-	config.pUserData = audioSource;
+	config.pUserData = internalAudioSource;
 
 	internalAudioSource->device = xmalloc(sizeof (*internalAudioSource->device));
 	if (ma_device_init(NULL, &config, internalAudioSource->device) != MA_SUCCESS)
@@ -125,14 +142,20 @@ AudioSource *create_audio_source(const char *fileName)
 
 void reset_audio_source(AudioSource *audioSource)
 {
-	ma_decoder_seek_to_pcm_frame(internalAudioSources[audioSource->id]->decoder, 0);
+	lock_mutex(internalAudioSourcesMutex);
+	InternalAudioSource *internalAudioSource = internalAudioSources[audioSource->id];
+	unlock_mutex(internalAudioSourcesMutex);
+	ma_decoder_seek_to_pcm_frame(internalAudioSource->decoder, 0);
 }
 
 void stop_audio_source(AudioSource *audioSource)
 {
-	ma_device_stop(internalAudioSources[audioSource->id]->device);
-	free_internal_audio_source(internalAudioSources[audioSource->id]);
+	lock_mutex(internalAudioSourcesMutex);
+	InternalAudioSource *internalAudioSource = internalAudioSources[audioSource->id];
 	internalAudioSources[audioSource->id] = NULL;
+	unlock_mutex(internalAudioSourcesMutex);
+	ma_device_stop(internalAudioSource->device);
+	free_internal_audio_source(internalAudioSource);
 }
 
 void free_audio()
@@ -145,4 +168,346 @@ void free_audio()
 		}
 	}
 	buf_free(internalAudioSources);
+	free_mutex(internalAudioSourcesMutex);
+}
+
+// every clip is converted to the format the voice device is opened with
+#define VOICE_CHANNELS 2
+#define VOICE_SAMPLE_RATE 48000
+// the clip playing and the ones of the next lines
+#define VOICE_CLIPS_KEPT 4
+
+typedef struct VoiceClip
+{
+	buf(char) fileName;
+	float *frames;
+	ma_uint64 nbFrames;
+	bool decoded;
+	bool failed;
+} VoiceClip;
+
+// a clip started by play_voice, the audio thread starts from the first frame whenever the playback it finds changes
+typedef struct VoicePlayback
+{
+	VoiceClip *clip;
+	// callbacks done when the playback was replaced, it is freed once the audio thread finished two more
+	unsigned int retiredAt;
+} VoicePlayback;
+
+struct VoiceChannel
+{
+	ma_device *device;
+	// decoded or waiting to be, the oldest first
+	buf(VoiceClip *) clips;
+	VoiceClip *decodingClip;
+	Thread *thread;
+	// cleared by the worker once done, so the main thread joins it without waiting
+	int decoding;
+	// published by the main thread and only read by the audio thread, so neither ever waits for the other
+	VoicePlayback *playback;
+	// replaced playbacks, the audio thread may still be reading the last one it took
+	buf(VoicePlayback *) retiredPlaybacks;
+	// counted by the audio thread, for the main thread to know when a replaced playback is not read anymore
+	unsigned int nbCallbacks;
+	// only touched by the audio thread
+	VoicePlayback *callbackPlayback;
+	ma_uint64 position;
+	// loudness of the last frames played, written by the audio thread and read by the main thread
+	float level;
+};
+
+// four partial sums, so that the compiler can keep them in one vector register
+static float get_samples_rms(const float *samples, ma_uint64 nbSamples)
+{
+	float sums[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	ma_uint64 i = 0;
+	for (; i + 4 <= nbSamples; i += 4)
+	{
+		sums[0] += samples[i] * samples[i];
+		sums[1] += samples[i + 1] * samples[i + 1];
+		sums[2] += samples[i + 2] * samples[i + 2];
+		sums[3] += samples[i + 3] * samples[i + 3];
+	}
+	for (; i < nbSamples; i++)
+	{
+		sums[0] += samples[i] * samples[i];
+	}
+	if (nbSamples == 0)
+	{
+		return 0.0f;
+	}
+	return sqrtf((sums[0] + sums[1] + sums[2] + sums[3]) / nbSamples);
+}
+
+static void voice_play_callback(ma_device *device, void *output, const void *input, ma_uint32 frameCount)
+{
+	VoiceChannel *channel = (VoiceChannel *)device->pUserData;
+	VoicePlayback *playback = __atomic_load_n(&channel->playback, __ATOMIC_ACQUIRE);
+	if (playback != channel->callbackPlayback)
+	{
+		channel->callbackPlayback = playback;
+		channel->position = 0;
+	}
+	VoiceClip *clip = playback ? playback->clip : NULL;
+	float level = 0.0f;
+	if (clip && channel->position < clip->nbFrames)
+	{
+		ma_uint64 nbFrames = clip->nbFrames - channel->position;
+		if (nbFrames > frameCount)
+		{
+			nbFrames = frameCount;
+		}
+		if (isWindowActive)
+		{
+			memcpy(output, clip->frames + channel->position * VOICE_CHANNELS, nbFrames * VOICE_CHANNELS * sizeof (float));
+		}
+		level = get_samples_rms(clip->frames + channel->position * VOICE_CHANNELS, nbFrames * VOICE_CHANNELS);
+		channel->position += nbFrames;
+	}
+	__atomic_store(&channel->level, &level, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&channel->nbCallbacks, 1, __ATOMIC_RELEASE);
+}
+
+VoiceChannel *create_voice_channel()
+{
+	VoiceChannel *channel = xmalloc(sizeof (*channel));
+	channel->clips = NULL;
+	channel->decodingClip = NULL;
+	channel->thread = NULL;
+	channel->decoding = 0;
+	channel->playback = NULL;
+	channel->retiredPlaybacks = NULL;
+	channel->nbCallbacks = 0;
+	channel->callbackPlayback = NULL;
+	channel->position = 0;
+	channel->level = 0.0f;
+
+	ma_device_config config = ma_device_config_init(ma_device_type_playback);
+	config.playback.format = ma_format_f32;
+	config.playback.channels = VOICE_CHANNELS;
+	config.sampleRate = VOICE_SAMPLE_RATE;
+	config.dataCallback = voice_play_callback;
+	config.pUserData = channel;
+
+	channel->device = xmalloc(sizeof (*channel->device));
+	if (ma_device_init(NULL, &config, channel->device) != MA_SUCCESS)
+	{
+		error("Failed to open playback device.");
+	}
+	if (ma_device_start(channel->device) != MA_SUCCESS)
+	{
+		ma_device_uninit(channel->device);
+		error("Failed to start playback device.");
+	}
+	return channel;
+}
+
+static void decode_voice_clip(VoiceClip *clip)
+{
+	ma_decoder_config config = ma_decoder_config_init(ma_format_f32, VOICE_CHANNELS, VOICE_SAMPLE_RATE);
+	void *frames;
+	clip->failed = ma_decode_file(clip->fileName, &config, &clip->nbFrames, &frames) != MA_SUCCESS;
+	clip->frames = frames;
+	clip->decoded = true;
+}
+
+static void voice_decoding_worker(void *argument)
+{
+	VoiceChannel *channel = argument;
+	decode_voice_clip(channel->decodingClip);
+	__atomic_store_n(&channel->decoding, 0, __ATOMIC_RELEASE);
+}
+
+// waits for the worker if it is still decoding
+static void finish_voice_decoding(VoiceChannel *channel)
+{
+	join_thread(channel->thread);
+	channel->thread = NULL;
+	channel->decodingClip = NULL;
+}
+
+static void start_next_voice_decoding(VoiceChannel *channel)
+{
+	if (channel->decodingClip)
+	{
+		return;
+	}
+	for (unsigned int i = 0; i < buf_len(channel->clips); i++)
+	{
+		if (!channel->clips[i]->decoded)
+		{
+			channel->decodingClip = channel->clips[i];
+			channel->decoding = 1;
+			channel->thread = create_thread(voice_decoding_worker, channel);
+			return;
+		}
+	}
+}
+
+static void free_voice_clip(VoiceClip *clip)
+{
+	buf_free(clip->fileName);
+	ma_free(clip->frames);
+	xfree(clip);
+}
+
+// the audio thread may be reading the clip of the playback published or of the replaced ones not freed yet
+static bool is_voice_clip_played(VoiceChannel *channel, VoiceClip *clip)
+{
+	if (channel->playback && channel->playback->clip == clip)
+	{
+		return true;
+	}
+	for (unsigned int i = 0; i < buf_len(channel->retiredPlaybacks); i++)
+	{
+		if (channel->retiredPlaybacks[i]->clip == clip)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static VoiceClip *get_voice_clip(VoiceChannel *channel, const char *fileName)
+{
+	for (unsigned int i = 0; i < buf_len(channel->clips); i++)
+	{
+		if (strmatch(channel->clips[i]->fileName, fileName))
+		{
+			return channel->clips[i];
+		}
+	}
+
+	// the oldest clip neither played nor being decoded makes room
+	if (buf_len(channel->clips) >= VOICE_CLIPS_KEPT)
+	{
+		for (unsigned int i = 0; i < buf_len(channel->clips); i++)
+		{
+			VoiceClip *oldClip = channel->clips[i];
+			if (!is_voice_clip_played(channel, oldClip) && oldClip != channel->decodingClip)
+			{
+				free_voice_clip(oldClip);
+				for (unsigned int j = i + 1; j < buf_len(channel->clips); j++)
+				{
+					channel->clips[j - 1] = channel->clips[j];
+				}
+				_buf_header(channel->clips)->count--;
+				break;
+			}
+		}
+	}
+
+	VoiceClip *clip = xmalloc(sizeof (*clip));
+	clip->fileName = strclone(fileName);
+	clip->frames = NULL;
+	clip->nbFrames = 0;
+	clip->decoded = false;
+	clip->failed = false;
+	buf_add(channel->clips, clip);
+	return clip;
+}
+
+void prefetch_voice(VoiceChannel *channel, const char *fileName)
+{
+	get_voice_clip(channel, fileName);
+	start_next_voice_decoding(channel);
+}
+
+// the playback replaced is freed later by update_voice_channel, once the audio thread cannot be reading it anymore
+static void publish_voice_playback(VoiceChannel *channel, VoicePlayback *playback)
+{
+	VoicePlayback *oldPlayback = __atomic_exchange_n(&channel->playback, playback, __ATOMIC_ACQ_REL);
+	if (oldPlayback)
+	{
+		oldPlayback->retiredAt = __atomic_load_n(&channel->nbCallbacks, __ATOMIC_ACQUIRE);
+		buf_add(channel->retiredPlaybacks, oldPlayback);
+	}
+}
+
+// starts on the next buffer the device asks for, a clip not decoded ahead is decoded at once
+void play_voice(VoiceChannel *channel, const char *fileName)
+{
+	VoiceClip *clip = get_voice_clip(channel, fileName);
+	if (clip == channel->decodingClip)
+	{
+		finish_voice_decoding(channel);
+	}
+	if (!clip->decoded)
+	{
+		decode_voice_clip(clip);
+	}
+	if (clip->failed)
+	{
+		error("could not decode %s.", fileName);
+	}
+	VoicePlayback *playback = xmalloc(sizeof (*playback));
+	playback->clip = clip;
+	playback->retiredAt = 0;
+	publish_voice_playback(channel, playback);
+	start_next_voice_decoding(channel);
+}
+
+void stop_voice(VoiceChannel *channel)
+{
+	publish_voice_playback(channel, NULL);
+	float level = 0.0f;
+	__atomic_store(&channel->level, &level, __ATOMIC_RELEASE);
+}
+
+float get_voice_level(VoiceChannel *channel)
+{
+	float level;
+	__atomic_load(&channel->level, &level, __ATOMIC_ACQUIRE);
+	return level;
+}
+
+void update_voice_channel(VoiceChannel *channel)
+{
+	// the callback running when a playback was replaced may have taken it, the one after cannot have
+	unsigned int nbCallbacks = __atomic_load_n(&channel->nbCallbacks, __ATOMIC_ACQUIRE);
+	unsigned int nbRetiredPlaybacks = 0;
+	for (unsigned int i = 0; i < buf_len(channel->retiredPlaybacks); i++)
+	{
+		VoicePlayback *playback = channel->retiredPlaybacks[i];
+		if (nbCallbacks - playback->retiredAt >= 2)
+		{
+			xfree(playback);
+		} else {
+			channel->retiredPlaybacks[nbRetiredPlaybacks++] = playback;
+		}
+	}
+	if (channel->retiredPlaybacks)
+	{
+		_buf_header(channel->retiredPlaybacks)->count = nbRetiredPlaybacks;
+	}
+	if (channel->decodingClip && !__atomic_load_n(&channel->decoding, __ATOMIC_ACQUIRE))
+	{
+		finish_voice_decoding(channel);
+	}
+	start_next_voice_decoding(channel);
+}
+
+void free_voice_channel(VoiceChannel *channel)
+{
+	ma_device_uninit(channel->device);
+	xfree(channel->device);
+	if (channel->decodingClip)
+	{
+		finish_voice_decoding(channel);
+	}
+	for (unsigned int i = 0; i < buf_len(channel->clips); i++)
+	{
+		free_voice_clip(channel->clips[i]);
+	}
+	buf_free(channel->clips);
+	if (channel->playback)
+	{
+		xfree(channel->playback);
+	}
+	for (unsigned int i = 0; i < buf_len(channel->retiredPlaybacks); i++)
+	{
+		xfree(channel->retiredPlaybacks[i]);
+	}
+	buf_free(channel->retiredPlaybacks);
+	xfree(channel);
 }
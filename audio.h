@@ -8,9 +8,23 @@ typedef struct AudioSource
 	bool playing;
 } AudioSource;
 
+void init_audio();
+// safe to call from any thread
 AudioSource *create_audio_source(const char *fileName);
 void reset_audio_source(AudioSource *audioSource);
 void stop_audio_source(AudioSource *audioSource);
 void free_audio();
 
+// one device for the voiced lines of a session, playing clips decoded ahead in memory by a worker
+typedef struct VoiceChannel VoiceChannel;
+
+VoiceChannel *create_voice_channel();
+void prefetch_voice(VoiceChannel *channel, const char *fileName);
+void play_voice(VoiceChannel *channel, const char *fileName);
+void stop_voice(VoiceChannel *channel);
+// root mean square of the samples played last, between 0 and 1
+float get_voice_level(VoiceChannel *channel);
+void update_voice_channel(VoiceChannel *channel);
+void free_voice_channel(VoiceChannel *channel);
+
 #endif /* end of include guard: AUDIO_H */
@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "error.h"
+#include "user_input.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "interpret.h"
+#include "thread.h"
+#include "file.h"
+#include "save.h"
+#include "autosave.h"
+
+static buf(char) get_slot_path(const char *pathPrefix, int slot, const char *suffix)
+{
+	char number[16];
+	snprintf(number, sizeof (number), "%d", slot);
+	buf(char) path = strmerge(pathPrefix, number);
+	strappend(&path, suffix);
+	return path;
+}
+
+// the most recent slot is the last one modified, the highest one among slots modified during the same second
+static int find_last_slot(const char *pathPrefix, int nbSlots)
+{
+	int lastSlot = -1;
+	time_t lastTime = 0;
+	for (int i = 0; i < nbSlots; i++)
+	{
+		buf(char) path = get_slot_path(pathPrefix, i, ".sav");
+		struct stat sb;
+		if (stat(path, &sb) == 0 && S_ISREG(sb.st_mode) && (lastSlot == -1 || sb.st_mtime >= lastTime))
+		{
+			lastSlot = i;
+			lastTime = sb.st_mtime;
+		}
+		buf_free(path);
+	}
+	return lastSlot;
+}
+
+Autosave *create_autosave(const char *pathPrefix, int nbSlots, float period)
+{
+	Autosave *autosave = xmalloc(sizeof (*autosave));
+	autosave->pathPrefix = strclone(pathPrefix);
+	autosave->nbSlots = nbSlots;
+	autosave->lastSlot = find_last_slot(pathPrefix, nbSlots);
+	autosave->nextSlot = (autosave->lastSlot + 1) % nbSlots;
+	autosave->period = period;
+	autosave->timer = 0.0f;
+	autosave->pendingSnapshots = NULL;
+	autosave->pendingSlots = NULL;
+	autosave->writingSnapshots = NULL;
+	autosave->writingSlots = NULL;
+	autosave->thread = NULL;
+	autosave->writing = 0;
+	autosave->nbAutosaves = 0;
+	return autosave;
+}
+
+// every snapshot is written to a temporary file first, then the whole batch is renamed and shares one directory sync
+static void write_autosaves(void *argument)
+{
+	Autosave *autosave = argument;
+	int nbWritings = buf_len(autosave->writingSnapshots);
+	bool written[nbWritings];
+	for (int i = 0; i < nbWritings; i++)
+	{
+		buf(unsigned char) data = serialize_session_snapshot(autosave->writingSnapshots[i]);
+		buf(char) temporaryPath = get_slot_path(autosave->pathPrefix, autosave->writingSlots[i], ".tmp");
+		written[i] = write_file_durably(temporaryPath, data, buf_len(data));
+		if (!written[i])
+		{
+			warning("could not write the autosave %s.", temporaryPath);
+		}
+		buf_free(temporaryPath);
+		buf_free(data);
+	}
+	for (int i = 0; i < nbWritings; i++)
+	{
+		buf(char) temporaryPath = get_slot_path(autosave->pathPrefix, autosave->writingSlots[i], ".tmp");
+		buf(char) path = get_slot_path(autosave->pathPrefix, autosave->writingSlots[i], ".sav");
+		if (written[i] && !replace_file(temporaryPath, path))
+		{
+			warning("could not replace the autosave %s.", path);
+		}
+		buf_free(temporaryPath);
+		buf_free(path);
+	}
+	sync_directory(autosave->pathPrefix);
+	buf_clear(autosave->writingSnapshots);
+	buf_clear(autosave->writingSlots);
+	__atomic_store_n(&autosave->writing, 0, __ATOMIC_RELEASE);
+}
+
+// joins the worker once it is done and hands it the pending snapshots, never waits for it
+static void dispatch_autosaves(Autosave *autosave)
+{
+	if (autosave->thread && !__atomic_load_n(&autosave->writing, __ATOMIC_ACQUIRE))
+	{
+		join_thread(autosave->thread);
+		autosave->thread = NULL;
+	}
+	if (!autosave->thread && buf_len(autosave->pendingSnapshots) != 0)
+	{
+		buf(SessionSnapshot *) writingSnapshots = autosave->writingSnapshots;
+		buf(int) writingSlots = autosave->writingSlots;
+		autosave->writingSnapshots = autosave->pendingSnapshots;
+		autosave->writingSlots = autosave->pendingSlots;
+		autosave->pendingSnapshots = writingSnapshots;
+		autosave->pendingSlots = writingSlots;
+		autosave->writing = 1;
+		autosave->thread = create_thread(write_autosaves, autosave);
+	}
+}
+
+static void wait_for_autosaves(Autosave *autosave)
+{
+	while (autosave->thread || buf_len(autosave->pendingSnapshots) != 0)
+	{
+		if (autosave->thread)
+		{
+			join_thread(autosave->thread);
+			autosave->thread = NULL;
+		}
+		dispatch_autosaves(autosave);
+	}
+}
+
+// the variables are only shared with the snapshot, so a large store costs the main thread little
+void request_autosave(Autosave *autosave, Session *session)
+{
+	SessionSnapshot *snapshot = snapshot_session(session);
+	int slot = autosave->nextSlot;
+	autosave->nextSlot = (slot + 1) % autosave->nbSlots;
+	autosave->lastSlot = slot;
+	autosave->timer = 0.0f;
+	autosave->nbAutosaves++;
+	for (unsigned int i = 0; i < buf_len(autosave->pendingSlots); i++)
+	{
+		if (autosave->pendingSlots[i] == slot)
+		{
+			free_session_snapshot(autosave->pendingSnapshots[i]);
+			autosave->pendingSnapshots[i] = snapshot;
+			snapshot = NULL;
+			break;
+		}
+	}
+	if (snapshot)
+	{
+		buf_add(autosave->pendingSnapshots, snapshot);
+		buf_add(autosave->pendingSlots, slot);
+	}
+	dispatch_autosaves(autosave);
+}
+
+// called every frame by the interpreter
+void update_autosave(Autosave *autosave, Session *session)
+{
+	autosave->timer += session->deltaTime;
+	if (autosave->timer >= autosave->period)
+	{
+		request_autosave(autosave, session);
+	} else {
+		dispatch_autosaves(autosave);
+	}
+}
+
+bool load_latest_autosave(Autosave *autosave, Session *session)
+{
+	wait_for_autosaves(autosave);
+	if (autosave->lastSlot == -1)
+	{
+		return false;
+	}
+	buf(char) path = get_slot_path(autosave->pathPrefix, autosave->lastSlot, ".sav");
+	bool loaded = load_session(session, path);
+	buf_free(path);
+	autosave->timer = 0.0f;
+	return loaded;
+}
+
+// waits for every snapshot taken to be written
+void free_autosave(Autosave *autosave)
+{
+	wait_for_autosaves(autosave);
+	buf_free(autosave->pathPrefix);
+	buf_free(autosave->pendingSnapshots);
+	buf_free(autosave->pendingSlots);
+	buf_free(autosave->writingSnapshots);
+	buf_free(autosave->writingSlots);
+	xfree(autosave);
+}
@@ -0,0 +1,33 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+// saves the session every period and before each choice, in slots used in turn
+// the main thread only takes snapshots, a worker serializes and writes them, replacing the files only once they are on disk
+typedef struct Autosave
+{
+	buf(char) pathPrefix;
+	int nbSlots;
+	int nextSlot;
+	// slot of the most recent autosave, -1 if there is none
+	int lastSlot;
+	float period;
+	float timer;
+	// snapshots taken while the worker is busy, a newer snapshot of a slot replaces the older one
+	buf(struct SessionSnapshot *) pendingSnapshots;
+	buf(int) pendingSlots;
+	// only touched by the worker while it runs
+	buf(struct SessionSnapshot *) writingSnapshots;
+	buf(int) writingSlots;
+	struct Thread *thread;
+	// cleared by the worker once done, so the main thread joins it without waiting
+	int writing;
+	int nbAutosaves;
+} Autosave;
+
+Autosave *create_autosave(const char *pathPrefix, int nbSlots, float period);
+void request_autosave(Autosave *autosave, Session *session);
+void update_autosave(Autosave *autosave, Session *session);
+bool load_latest_autosave(Autosave *autosave, Session *session);
+void free_autosave(Autosave *autosave);
+
+#endif /* end of include guard: AUTOSAVE_H */
@@ -0,0 +1,247 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "maths.h"
+#include "globals.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "animation.h"
+#include "graphics.h"
+#include "backlog.h"
+
+static const int BACKLOG_LINE_SPACING = 12;
+static const vec3 BACKLOG_SPEAKER_COLOR = {0.7f, 0.7f, 0.7f};
+
+Backlog *create_backlog()
+{
+	Backlog *backlog = xmalloc(sizeof (*backlog));
+	backlog->strings = NULL;
+	backlog->lines = NULL;
+	backlog->open = false;
+	backlog->bottomLine = 0;
+	backlog->bottomOffset = 0;
+	backlog->topReached = false;
+	backlog->layoutChanged = false;
+	backlog->measureText = create_text();
+	set_text_font(backlog->measureText, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_NORMAL);
+	set_text_width_limit(backlog->measureText, -1);
+	backlog->speakersTexts = NULL;
+	backlog->sentencesTexts = NULL;
+	backlog->nbSpeakersTexts = 0;
+	backlog->nbSentencesTexts = 0;
+	backlog->box = create_sprite(SPRITE_COLOR);
+	backlog->box->color = COLOR_BLACK;
+	backlog->box->opacity = 0.85f;
+	return backlog;
+}
+
+static int add_backlog_string(Backlog *backlog, const char *string)
+{
+	int start = buf_len(backlog->strings);
+	for (int i = 0; string[i] != '\0'; i++)
+	{
+		buf_add(backlog->strings, string[i]);
+	}
+	buf_add(backlog->strings, '\0');
+	return start;
+}
+
+void add_backlog_line(Backlog *backlog, const char *speaker, const char *sentence)
+{
+	BacklogLine line;
+	line.speakerStart = speaker ? add_backlog_string(backlog, speaker) : -1;
+	line.sentenceStart = add_backlog_string(backlog, sentence);
+	line.height = 0;
+	line.heightWidth = -1;
+	buf_add(backlog->lines, line);
+}
+
+// drops the lines after the first nbLines, for a rollback or a loaded save that goes back before them
+void truncate_backlog(Backlog *backlog, int nbLines)
+{
+	if (nbLines < 0 || nbLines >= (int)buf_len(backlog->lines))
+	{
+		return;
+	}
+	BacklogLine *firstDropped = &backlog->lines[nbLines];
+	_buf_header(backlog->strings)->count = firstDropped->speakerStart != -1 ? firstDropped->speakerStart : firstDropped->sentenceStart;
+	_buf_header(backlog->lines)->count = nbLines;
+	backlog->open = false;
+}
+
+static int get_text_width_limit()
+{
+	return 0.97f * windowDimensions.x;
+}
+
+static int get_speaker_height(Backlog *backlog)
+{
+	return backlog->measureText->font->ascent - backlog->measureText->font->descent;
+}
+
+// heights are measured once per window width, and only for the lines scrolled through
+static int get_backlog_line_height(Backlog *backlog, int lineIndex)
+{
+	BacklogLine *line = &backlog->lines[lineIndex];
+	if (line->heightWidth != windowDimensions.x)
+	{
+		if (backlog->measureText->widthLimit != get_text_width_limit())
+		{
+			set_text_string(backlog->measureText, NULL);
+			set_text_width_limit(backlog->measureText, get_text_width_limit());
+		}
+		set_text_string(backlog->measureText, backlog->strings + line->sentenceStart);
+		line->height = backlog->measureText->height + BACKLOG_LINE_SPACING;
+		if (line->speakerStart != -1)
+		{
+			line->height += get_speaker_height(backlog);
+		}
+		line->heightWidth = windowDimensions.x;
+	}
+	return line->height;
+}
+
+static Text *get_pool_text(buf(Text *) *texts, int *nbTexts)
+{
+	if (*nbTexts == (int)buf_len(*texts))
+	{
+		Text *text = create_text();
+		set_text_font(text, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_NORMAL);
+		buf_add(*texts, text);
+	}
+	Text *text = (*texts)[(*nbTexts)++];
+	// without codes, moving the text does not lay it out again
+	set_text_string(text, NULL);
+	return text;
+}
+
+static void layout_backlog(Backlog *backlog)
+{
+	backlog->box->width = windowDimensions.x;
+	backlog->box->height = windowDimensions.y;
+	backlog->nbSpeakersTexts = 0;
+	backlog->nbSentencesTexts = 0;
+	backlog->topReached = false;
+	int x = 0.015f * windowDimensions.x;
+	int bottom = windowDimensions.y - BACKLOG_LINE_SPACING + backlog->bottomOffset;
+	for (int i = backlog->bottomLine; i >= 0; i--)
+	{
+		BacklogLine *line = &backlog->lines[i];
+		int top = bottom - get_backlog_line_height(backlog, i);
+		if (top < windowDimensions.y)
+		{
+			int y = top + BACKLOG_LINE_SPACING;
+			if (line->speakerStart != -1)
+			{
+				Text *speakerText = get_pool_text(&backlog->speakersTexts, &backlog->nbSpeakersTexts);
+				speakerText->color = BACKLOG_SPEAKER_COLOR;
+				set_text_position(speakerText, (ivec2){x, y});
+				set_text_string(speakerText, backlog->strings + line->speakerStart);
+				y += get_speaker_height(backlog);
+			}
+			Text *sentenceText = get_pool_text(&backlog->sentencesTexts, &backlog->nbSentencesTexts);
+			sentenceText->color = COLOR_WHITE;
+			set_text_position(sentenceText, (ivec2){x, y});
+			set_text_width_limit(sentenceText, get_text_width_limit());
+			set_text_string(sentenceText, backlog->strings + line->sentenceStart);
+		}
+		if (top <= 0)
+		{
+			return;
+		}
+		bottom = top;
+	}
+	backlog->topReached = true;
+}
+
+static void scroll_backlog(Backlog *backlog, int scrollOffset)
+{
+	if (scrollOffset > 0 && backlog->topReached)
+	{
+		return;
+	}
+	backlog->bottomOffset += scrollOffset;
+	while (backlog->bottomLine > 0 && backlog->bottomOffset > get_backlog_line_height(backlog, backlog->bottomLine))
+	{
+		backlog->bottomOffset -= get_backlog_line_height(backlog, backlog->bottomLine);
+		backlog->bottomLine--;
+	}
+	while (backlog->bottomOffset < 0 && backlog->bottomLine < (int)buf_len(backlog->lines) - 1)
+	{
+		backlog->bottomLine++;
+		backlog->bottomOffset += get_backlog_line_height(backlog, backlog->bottomLine);
+	}
+	if (backlog->bottomOffset < 0)
+	{
+		backlog->bottomOffset = 0;
+	}
+	backlog->layoutChanged = true;
+}
+
+// the mouse wheel opens the backlog and scrolls it, scrolling down past the last line or the close key closes it
+// returns whether the backlog is open, the dialog waits meanwhile
+bool update_backlog(Backlog *backlog, int scrollOffset, bool closeKeyPressed, bool canOpen)
+{
+	if (!backlog->open)
+	{
+		if (scrollOffset <= 0 || !canOpen || buf_len(backlog->lines) == 0)
+		{
+			return false;
+		}
+		backlog->open = true;
+		backlog->bottomLine = buf_len(backlog->lines) - 1;
+		backlog->bottomOffset = 0;
+		backlog->topReached = false;
+		backlog->layoutChanged = true;
+		scrollOffset = 0;
+	}
+
+	if (closeKeyPressed || (scrollOffset < 0 && backlog->bottomLine == (int)buf_len(backlog->lines) - 1 && backlog->bottomOffset == 0))
+	{
+		backlog->open = false;
+		return false;
+	}
+	if (scrollOffset)
+	{
+		scroll_backlog(backlog, scrollOffset);
+	}
+	if (backlog->layoutChanged || backlog->box->width != windowDimensions.x || backlog->box->height != windowDimensions.y)
+	{
+		layout_backlog(backlog);
+		backlog->layoutChanged = false;
+	}
+	return true;
+}
+
+void draw_backlog(Backlog *backlog)
+{
+	add_sprite_to_draw_list(backlog->box, DRAW_LAYER_UI);
+	for (int i = 0; i < backlog->nbSpeakersTexts; i++)
+	{
+		add_text_to_draw_list(backlog->speakersTexts[i], DRAW_LAYER_UI);
+	}
+	for (int i = 0; i < backlog->nbSentencesTexts; i++)
+	{
+		add_text_to_draw_list(backlog->sentencesTexts[i], DRAW_LAYER_UI);
+	}
+}
+
+void free_backlog(Backlog *backlog)
+{
+	buf_free(backlog->strings);
+	buf_free(backlog->lines);
+	free_text(backlog->measureText);
+	for (unsigned int i = 0; i < buf_len(backlog->speakersTexts); i++)
+	{
+		free_text(backlog->speakersTexts[i]);
+	}
+	buf_free(backlog->speakersTexts);
+	for (unsigned int i = 0; i < buf_len(backlog->sentencesTexts); i++)
+	{
+		free_text(backlog->sentencesTexts[i]);
+	}
+	buf_free(backlog->sentencesTexts);
+	free_sprite(backlog->box);
+	xfree(backlog);
+}
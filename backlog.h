@@ -0,0 +1,40 @@
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+// a past line, its strings are kept in the backlog strings so that lines stay valid once their dialog is freed
+typedef struct BacklogLine
+{
+	int speakerStart;
+	int sentenceStart;
+	int height;
+	// window width the height was measured for, -1 before the first measure
+	int heightWidth;
+} BacklogLine;
+
+// only the lines in view are laid out, in a pool of texts reused while scrolling
+typedef struct Backlog
+{
+	buf(char) strings;
+	buf(BacklogLine) lines;
+	bool open;
+	// the bottom of the view is bottomOffset pixels above the bottom of bottomLine
+	int bottomLine;
+	int bottomOffset;
+	bool topReached;
+	bool layoutChanged;
+	Text *measureText;
+	buf(Text *) speakersTexts;
+	buf(Text *) sentencesTexts;
+	int nbSpeakersTexts;
+	int nbSentencesTexts;
+	Sprite *box;
+} Backlog;
+
+Backlog *create_backlog();
+void add_backlog_line(Backlog *backlog, const char *speaker, const char *sentence);
+void truncate_backlog(Backlog *backlog, int nbLines);
+bool update_backlog(Backlog *backlog, int scrollOffset, bool closeKeyPressed, bool canOpen);
+void draw_backlog(Backlog *backlog);
+void free_backlog(Backlog *backlog);
+
+#endif /* end of include guard: BACKLOG_H */
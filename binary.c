@@ -0,0 +1,115 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "stretchy_buffer.h"
+#include "str.h"
+#include "binary.h"
+
+// copies as many bytes as the buffer holds before growing it, large variable stores are saved at every choice
+void write_bytes(buf(unsigned char) *data, const void *bytes, size_t size)
+{
+	const unsigned char *source = bytes;
+	while (size > 0)
+	{
+		*data = sbuffer_create_or_grow_if_needed(*data, sizeof (**data), __FILE__, __LINE__);
+		size_t nbCopied = _buf_capacity(*data) - buf_len(*data);
+		if (nbCopied > size)
+		{
+			nbCopied = size;
+		}
+		memcpy(*data + buf_len(*data), source, nbCopied);
+		_buf_header(*data)->count += nbCopied;
+		source += nbCopied;
+		size -= nbCopied;
+	}
+}
+
+void write_int(buf(unsigned char) *data, int value)
+{
+	write_bytes(data, &value, sizeof (value));
+}
+
+void write_float(buf(unsigned char) *data, float value)
+{
+	write_bytes(data, &value, sizeof (value));
+}
+
+void write_double(buf(unsigned char) *data, double value)
+{
+	write_bytes(data, &value, sizeof (value));
+}
+
+// a NULL string is written as a negative length
+void write_string(buf(unsigned char) *data, const char *string)
+{
+	int length = string ? strlen(string) : -1;
+	write_int(data, length);
+	if (string)
+	{
+		write_bytes(data, string, length);
+	}
+}
+
+void read_bytes(BinaryReader *reader, void *bytes, size_t size)
+{
+	if (reader->failed || reader->size - reader->position < size)
+	{
+		reader->failed = true;
+		memset(bytes, 0, size);
+		return;
+	}
+	memcpy(bytes, reader->data + reader->position, size);
+	reader->position += size;
+}
+
+int read_int(BinaryReader *reader)
+{
+	int value;
+	read_bytes(reader, &value, sizeof (value));
+	return value;
+}
+
+float read_float(BinaryReader *reader)
+{
+	float value;
+	read_bytes(reader, &value, sizeof (value));
+	return value;
+}
+
+double read_double(BinaryReader *reader)
+{
+	double value;
+	read_bytes(reader, &value, sizeof (value));
+	return value;
+}
+
+// returns NULL for a NULL string written, and when the reader fails
+buf(char) read_string(BinaryReader *reader)
+{
+	int length = read_int(reader);
+	if (length < 0 || reader->failed)
+	{
+		return NULL;
+	}
+	if (reader->size - reader->position < (size_t)length)
+	{
+		reader->failed = true;
+		return NULL;
+	}
+	buf(char) string = strclonen((const char *)reader->data + reader->position, length);
+	reader->position += length;
+	return string;
+}
+
+// FNV-1a
+unsigned int get_checksum(const unsigned char *data, size_t size)
+{
+	unsigned int checksum = 2166136261u;
+	for (size_t i = 0; i < size; i++)
+	{
+		checksum ^= data[i];
+		checksum *= 16777619u;
+	}
+	return checksum;
+}
@@ -0,0 +1,25 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+// reads the values written by the write functions, a read past the end fails the reader and gives zeros, so the checks can wait until the end
+typedef struct BinaryReader
+{
+	const unsigned char *data;
+	size_t size;
+	size_t position;
+	bool failed;
+} BinaryReader;
+
+void write_bytes(buf(unsigned char) *data, const void *bytes, size_t size);
+void write_int(buf(unsigned char) *data, int value);
+void write_float(buf(unsigned char) *data, float value);
+void write_double(buf(unsigned char) *data, double value);
+void write_string(buf(unsigned char) *data, const char *string);
+void read_bytes(BinaryReader *reader, void *bytes, size_t size);
+int read_int(BinaryReader *reader);
+float read_float(BinaryReader *reader);
+double read_double(BinaryReader *reader);
+buf(char) read_string(BinaryReader *reader);
+unsigned int get_checksum(const unsigned char *data, size_t size);
+
+#endif /* end of include guard: BINARY_H */
@@ -0,0 +1,278 @@
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "maths.h"
+#include "stretchy_buffer.h"
+#include "str.h"
+#include "error.h"
+#include "xalloc.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "bytecode.h"
+
+static __thread Dialog *compilingDialog;
+static __thread bool compilingCue;
+static __thread bool compilingCueHasChoices;
+// source of the instructions emitted, for the profiler
+static __thread int compilingLine;
+static __thread int compilingKnot;
+
+static int emit_instruction(InstructionType type)
+{
+	Instruction instruction;
+	instruction.type = type;
+	instruction.target = -1;
+	instruction.line = compilingLine;
+	instruction.knot = compilingKnot;
+	buf_add(compilingDialog->instructions, instruction);
+	return buf_len(compilingDialog->instructions) - 1;
+}
+
+static void compile_go_to(GoTo *goTo)
+{
+	if (compilingCue)
+	{
+		emit_instruction(INSTRUCTION_SPEAKER_END);
+	}
+	int index = emit_instruction(INSTRUCTION_GO_TO);
+	compilingDialog->instructions[index].goTo = goTo;
+}
+
+static void compile_assign(Assignment *assignment)
+{
+	int index = emit_instruction(INSTRUCTION_ASSIGN);
+	compilingDialog->instructions[index].assignment = assignment;
+}
+
+static void compile_command(Command *command)
+{
+	if (command->type == COMMAND_WAIT)
+	{
+		int index = emit_instruction(INSTRUCTION_WAIT);
+		compilingDialog->instructions[index].duration = command->arguments[0]->numeric;
+	} else {
+		int index = emit_instruction(INSTRUCTION_COMMAND);
+		compilingDialog->instructions[index].command = command;
+	}
+}
+
+static int compile_condition_start(LogicExpression *logicExpression, buf(int) dependencies, int conditionIndex)
+{
+	int index = emit_instruction(INSTRUCTION_JUMP_IF_FALSE);
+	compilingDialog->instructions[index].condition.logicExpression = logicExpression;
+	compilingDialog->instructions[index].condition.dependencies = dependencies;
+	compilingDialog->instructions[index].condition.index = conditionIndex;
+	return index;
+}
+
+static void compile_cue_expressions(buf(CueExpression *) cueExpressions)
+{
+	for (unsigned int i = 0; i < buf_len(cueExpressions); i++)
+	{
+		CueExpression *cueExpression = cueExpressions[i];
+		compilingLine = cueExpression->line;
+		if (cueExpression->type == CUE_EXPRESSION_SENTENCE)
+		{
+			int index = emit_instruction(INSTRUCTION_SAY);
+			compilingDialog->instructions[index].sentence = cueExpression->sentence;
+		} else if (cueExpression->type == CUE_EXPRESSION_CHOICE) {
+			int index = emit_instruction(INSTRUCTION_CHOICE);
+			compilingDialog->instructions[index].choice = cueExpression->choice;
+			compilingCueHasChoices = true;
+		} else if (cueExpression->type == CUE_EXPRESSION_COMMAND) {
+			compile_command(cueExpression->command);
+		} else if (cueExpression->type == CUE_EXPRESSION_GO_TO) {
+			compile_go_to(cueExpression->goTo);
+		} else if (cueExpression->type == CUE_EXPRESSION_ASSIGNMENT) {
+			compile_assign(cueExpression->assignment);
+		} else if (cueExpression->type == CUE_EXPRESSION_CUE_CONDITION) {
+			CueCondition *cueCondition = cueExpression->cueCondition;
+			int jumpToElse = compile_condition_start(cueCondition->logicExpression, cueCondition->dependencies, cueCondition->conditionIndex);
+			compile_cue_expressions(cueCondition->cueExpressionsIf);
+			if (cueCondition->cueExpressionsElse)
+			{
+				compilingLine = cueExpression->line;
+				int jumpToEnd = emit_instruction(INSTRUCTION_JUMP);
+				compilingDialog->instructions[jumpToElse].target = buf_len(compilingDialog->instructions);
+				compile_cue_expressions(cueCondition->cueExpressionsElse);
+				compilingDialog->instructions[jumpToEnd].target = buf_len(compilingDialog->instructions);
+			} else {
+				compilingDialog->instructions[jumpToElse].target = buf_len(compilingDialog->instructions);
+			}
+		} else {
+			error("unknown cue expression type %d.", cueExpression->type);
+		}
+	}
+}
+
+static void compile_cue(Cue *cue)
+{
+	int cueLine = compilingLine;
+	int index = emit_instruction(INSTRUCTION_SPEAKER);
+	compilingDialog->instructions[index].cue = cue;
+	compilingCue = true;
+	compilingCueHasChoices = false;
+	compile_cue_expressions(cue->cueExpressions);
+	compilingLine = cueLine;
+	if (compilingCueHasChoices)
+	{
+		emit_instruction(INSTRUCTION_CHOOSE);
+	}
+	emit_instruction(INSTRUCTION_SPEAKER_END);
+	compilingCue = false;
+}
+
+static void compile_knot_expressions(buf(KnotExpression *) knotExpressions)
+{
+	for (unsigned int i = 0; i < buf_len(knotExpressions); i++)
+	{
+		KnotExpression *knotExpression = knotExpressions[i];
+		compilingLine = knotExpression->line;
+		if (knotExpression->type == KNOT_EXPRESSION_CUE)
+		{
+			compile_cue(knotExpression->cue);
+		} else if (knotExpression->type == KNOT_EXPRESSION_COMMAND) {
+			compile_command(knotExpression->command);
+		} else if (knotExpression->type == KNOT_EXPRESSION_GO_TO) {
+			compile_go_to(knotExpression->goTo);
+		} else if (knotExpression->type == KNOT_EXPRESSION_ASSIGNMENT) {
+			compile_assign(knotExpression->assignment);
+		} else if (knotExpression->type == KNOT_EXPRESSION_KNOT_CONDITION) {
+			KnotCondition *knotCondition = knotExpression->knotCondition;
+			int jumpToElse = compile_condition_start(knotCondition->logicExpression, knotCondition->dependencies, knotCondition->conditionIndex);
+			compile_knot_expressions(knotCondition->knotExpressionsIf);
+			if (knotCondition->knotExpressionsElse)
+			{
+				compilingLine = knotExpression->line;
+				int jumpToEnd = emit_instruction(INSTRUCTION_JUMP);
+				compilingDialog->instructions[jumpToElse].target = buf_len(compilingDialog->instructions);
+				compile_knot_expressions(knotCondition->knotExpressionsElse);
+				compilingDialog->instructions[jumpToEnd].target = buf_len(compilingDialog->instructions);
+			} else {
+				compilingDialog->instructions[jumpToElse].target = buf_len(compilingDialog->instructions);
+			}
+		} else {
+			error("unknown knot expression type %d", knotExpression->type);
+		}
+	}
+}
+
+static int get_go_to_target(GoTo *goTo, int endInstruction)
+{
+	if (goTo->dialogFile)
+	{
+		return -1;
+	}
+	if (strmatch(goTo->knotToGo, "end"))
+	{
+		return endInstruction;
+	}
+	for (unsigned int i = 0; i < buf_len(compilingDialog->knots); i++)
+	{
+		if (strmatch(compilingDialog->knots[i]->name, goTo->knotToGo))
+		{
+			return compilingDialog->knots[i]->firstInstruction;
+		}
+	}
+	// reported when the go to is executed, as an unreachable one is harmless
+	return -1;
+}
+
+static void add_unique_index(buf(int) *indices, int index)
+{
+	for (unsigned int i = 0; i < buf_len(*indices); i++)
+	{
+		if ((*indices)[i] == index)
+		{
+			return;
+		}
+	}
+	buf_add(*indices, index);
+}
+
+static int get_go_to_dialog_index(GoTo *goTo)
+{
+	buf(char) dialogPath = strclone("Dialogs/");
+	strappend(&dialogPath, goTo->dialogFile);
+	for (unsigned int i = 0; i < buf_len(compilingDialog->goToDialogsPaths); i++)
+	{
+		if (strmatch(compilingDialog->goToDialogsPaths[i], dialogPath))
+		{
+			buf_free(dialogPath);
+			return i;
+		}
+	}
+	buf_add(compilingDialog->goToDialogsPaths, dialogPath);
+	return buf_len(compilingDialog->goToDialogsPaths) - 1;
+}
+
+// the files a knot leaves for and the knots it leads to, through its go tos, its choices and its end
+static void link_knots(Dialog *dialog)
+{
+	dialog->goToDialogsPaths = NULL;
+	dialog->knotsGoToDialogs = NULL;
+	dialog->knotsNextKnots = NULL;
+	for (unsigned int i = 0; i < buf_len(dialog->knots); i++)
+	{
+		buf_add(dialog->knotsGoToDialogs, NULL);
+		buf_add(dialog->knotsNextKnots, NULL);
+	}
+	for (unsigned int i = 0; i < buf_len(dialog->instructions); i++)
+	{
+		Instruction *instruction = &dialog->instructions[i];
+		int knot = instruction->knot;
+		if (knot == -1)
+		{
+			continue;
+		}
+		GoTo *goTo = NULL;
+		if (instruction->type == INSTRUCTION_GO_TO)
+		{
+			goTo = instruction->goTo;
+		} else if (instruction->type == INSTRUCTION_CHOICE) {
+			goTo = instruction->choice->goToCommand;
+		}
+		if (goTo && goTo->dialogFile)
+		{
+			add_unique_index(&dialog->knotsGoToDialogs[knot], get_go_to_dialog_index(goTo));
+		} else if (goTo && instruction->target != -1 && dialog->instructions[instruction->target].knot != -1) {
+			add_unique_index(&dialog->knotsNextKnots[knot], dialog->instructions[instruction->target].knot);
+		}
+		if (dialog->instructions[i + 1].knot != knot && instruction->type != INSTRUCTION_GO_TO && knot + 1 < (int)buf_len(dialog->knots))
+		{
+			add_unique_index(&dialog->knotsNextKnots[knot], knot + 1);
+		}
+	}
+}
+
+void compile_dialog(Dialog *dialog)
+{
+	compilingDialog = dialog;
+	compilingCue = false;
+	dialog->instructions = NULL;
+
+	// knots are laid out in order, so the end of a knot falls through to the next one
+	for (unsigned int i = 0; i < buf_len(dialog->knots); i++)
+	{
+		dialog->knots[i]->firstInstruction = buf_len(dialog->instructions);
+		compilingKnot = i;
+		compile_knot_expressions(dialog->knots[i]->knotExpressions);
+	}
+	compilingLine = 0;
+	compilingKnot = -1;
+	int endInstruction = emit_instruction(INSTRUCTION_END);
+
+	for (unsigned int i = 0; i < buf_len(dialog->instructions); i++)
+	{
+		Instruction *instruction = &dialog->instructions[i];
+		if (instruction->type == INSTRUCTION_GO_TO)
+		{
+			instruction->target = get_go_to_target(instruction->goTo, endInstruction);
+		} else if (instruction->type == INSTRUCTION_CHOICE) {
+			instruction->target = get_go_to_target(instruction->choice->goToCommand, endInstruction);
+		}
+	}
+	link_knots(dialog);
+}
@@ -0,0 +1,48 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+typedef enum InstructionType
+{
+	INSTRUCTION_SPEAKER,
+	INSTRUCTION_SPEAKER_END,
+	INSTRUCTION_SAY,
+	INSTRUCTION_CHOICE,
+	INSTRUCTION_CHOOSE,
+	INSTRUCTION_COMMAND,
+	INSTRUCTION_WAIT,
+	INSTRUCTION_ASSIGN,
+	INSTRUCTION_JUMP,
+	INSTRUCTION_JUMP_IF_FALSE,
+	INSTRUCTION_GO_TO,
+	INSTRUCTION_END
+} InstructionType;
+
+typedef struct Instruction
+{
+	InstructionType type;
+	union
+	{
+		Cue *cue;
+		Sentence *sentence;
+		Choice *choice;
+		Command *command;
+		Assignment *assignment;
+		GoTo *goTo;
+		float duration;
+		struct
+		{
+			LogicExpression *logicExpression;
+			buf(int) dependencies;
+			int index;
+		} condition;
+	};
+	// instruction index for jumps, go tos and choices, -1 if the go to leaves the dialog or its knot does not exist
+	int target;
+	// where the instruction comes from, the final end instruction has line 0 and knot -1
+	int line;
+	int knot;
+} Instruction;
+
+void compile_dialog(Dialog *dialog);
+
+#endif /* end of include guard: BYTECODE_H */
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <ctype.h>
 
 #include "audio.h"
 #include "maths.h"
@@ -13,18 +14,21 @@
 #include "str.h"
 #include "error.h"
 #include "xalloc.h"
+#include "file.h"
 #include "animation.h"
 #include "graphics.h"
 #include "variable.h"
 #include "dialog.h"
+#include "bytecode.h"
 #include "globals_dialog.h"
 
-static const char *filePath;
-static buf(DialogToken *) tokens;
-static Dialog *currentDialog;
-static int currentToken;
-static int currentIndentationLevel;
-static bool firstKnot;
+// parsing state is per thread, so a dialog can be parsed ahead by a worker
+static __thread const char *filePath;
+static __thread buf(DialogToken *) tokens;
+static __thread Dialog *currentDialog;
+static __thread int currentToken;
+static __thread int currentIndentationLevel;
+static __thread bool firstKnot;
 
 typedef enum CueMode
 {
@@ -32,7 +36,9 @@ typedef enum CueMode
 	CUE_MODE_CHOICE
 } CueMode;
 
-static CueMode currentCueMode;
+static __thread CueMode currentCueMode;
+// the #preload and #unload of packs, which leave them to the session
+static __thread buf(Command *) leftOutPacksCommands;
 
 static void step_in_tokens()
 {
@@ -141,6 +147,7 @@ static LogicExpression *create_logic_expression_literal_identifier(const char *i
 	logicExpression->literal = xmalloc(sizeof (*logicExpression->literal));
 	logicExpression->literal->type = LOGIC_EXPRESSION_LITERAL_IDENTIFIER;
 	logicExpression->literal->string = strclone(identifier);
+	logicExpression->literal->variableSlot = get_variable_slot(identifier);
 	return logicExpression;
 }
 
@@ -312,26 +319,80 @@ static LogicExpression *parse_logic_expression(int line)
 	return parse_logic_expression_or(line);
 }
 
-Variable *get_variable(const char *variableName)
+// a dialog parsed by a worker cannot add to the variables names, it resolves them against a copy instead
+// the names met for the first time get the slots following the copied ones
+static __thread bool parsingInBackground = false;
+static __thread char **backgroundVariablesNames;
+static __thread int nbBackgroundVariablesNames;
+static __thread buf(buf(char)) newVariablesNames;
+
+void begin_background_parsing(char **variablesNames, int nbVariablesNames)
 {
-	Variable *variable = xmalloc(sizeof (*variable));
-	for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+	parsingInBackground = true;
+	backgroundVariablesNames = variablesNames;
+	nbBackgroundVariablesNames = nbVariablesNames;
+	newVariablesNames = NULL;
+}
+
+// the new names, to append to the variables names only if nothing was added to them meanwhile
+buf(buf(char)) end_background_parsing()
+{
+	parsingInBackground = false;
+	buf(buf(char)) result = newVariablesNames;
+	newVariablesNames = NULL;
+	return result;
+}
+
+int get_variable_slot(const char *variableName)
+{
+	if (parsingInBackground)
 	{
-		if (strmatch(variablesNames[i], variableName))
+		for (int i = 0; i < nbBackgroundVariablesNames; i++)
 		{
-			variable->type = variablesValues[i]->type;
-			if (variable->type == VARIABLE_NUMERIC)
+			if (strmatch(backgroundVariablesNames[i], variableName))
 			{
-				variable->numeric = variablesValues[i]->numeric;
-			} else if (variable->type == VARIABLE_STRING) {
-				variable->string = strclone(variablesValues[i]->string);
-			} else {
-				error("unknown variable type %d.", variablesValues[i]->type);
+				return i;
+			}
+		}
+		for (unsigned int i = 0; i < buf_len(newVariablesNames); i++)
+		{
+			if (strmatch(newVariablesNames[i], variableName))
+			{
+				return nbBackgroundVariablesNames + i;
 			}
-			return variable;
 		}
+		buf_add(newVariablesNames, strclone(variableName));
+		return nbBackgroundVariablesNames + buf_len(newVariablesNames) - 1;
 	}
-	error("variable %s not found.", variableName);
+	for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+	{
+		if (strmatch(variablesNames[i], variableName))
+		{
+			return i;
+		}
+	}
+	buf_add(variablesNames, strclone(variableName));
+	return buf_len(variablesNames) - 1;
+}
+
+static Variable *get_variable_from_slot(VariableStore *variables, int variableSlot)
+{
+	Variable *value = get_variable_store_value(variables, variableSlot);
+	if (!value)
+	{
+		error("variable %s not found.", variablesNames[variableSlot]);
+	}
+	return clone_variable(value);
+}
+
+Variable *get_variable(VariableStore *variables, const char *variableName)
+{
+	return get_variable_from_slot(variables, get_variable_slot(variableName));
+}
+
+void set_variable(VariableStore *variables, int variableSlot, Variable *variable)
+{
+	set_variable_store_value(variables, variableSlot, variable);
 }
 
 static Variable *convert_variable_content_to_bool(Variable *variable)
@@ -360,7 +421,7 @@ static Variable *convert_variable_content_to_bool(Variable *variable)
 	return variable;
 }
 
-Variable *resolve_logic_expression(LogicExpression *logicExpression)
+Variable *resolve_logic_expression(VariableStore *variables, LogicExpression *logicExpression)
 {
 	if (logicExpression->type == LOGIC_EXPRESSION_LITERAL)
 	{
@@ -371,7 +432,7 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			variable->string = strclone(logicExpression->literal->string);
 			return variable;
 		} else if (logicExpression->literal->type == LOGIC_EXPRESSION_LITERAL_IDENTIFIER) {
-			return get_variable(logicExpression->literal->string);
+			return get_variable_from_slot(variables, logicExpression->literal->variableSlot);
 		} else if (logicExpression->literal->type == LOGIC_EXPRESSION_LITERAL_NUMERIC) {
 			Variable *variable = xmalloc(sizeof (*variable));
 			variable->type = VARIABLE_NUMERIC;
@@ -383,7 +444,7 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 	} else if (logicExpression->type == LOGIC_EXPRESSION_UNARY) {
 		if (logicExpression->unary->type == LOGIC_EXPRESSION_UNARY_NEGATION)
 		{
-			Variable *variable = convert_variable_content_to_bool(resolve_logic_expression(logicExpression));
+			Variable *variable = convert_variable_content_to_bool(resolve_logic_expression(variables, logicExpression));
 			variable->numeric = !variable->numeric;
 			return variable;
 		} else {
@@ -394,20 +455,20 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 		Variable *right;
 		if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_OR)
 		{
-			left = convert_variable_content_to_bool(resolve_logic_expression(logicExpression->binary->left));
-			right = convert_variable_content_to_bool(resolve_logic_expression(logicExpression->binary->right));
+			left = convert_variable_content_to_bool(resolve_logic_expression(variables, logicExpression->binary->left));
+			right = convert_variable_content_to_bool(resolve_logic_expression(variables, logicExpression->binary->right));
 			left->numeric = left->numeric || right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_AND) {
-			left = convert_variable_content_to_bool(resolve_logic_expression(logicExpression->binary->left));
-			right = convert_variable_content_to_bool(resolve_logic_expression(logicExpression->binary->right));
+			left = convert_variable_content_to_bool(resolve_logic_expression(variables, logicExpression->binary->left));
+			right = convert_variable_content_to_bool(resolve_logic_expression(variables, logicExpression->binary->right));
 			left->numeric = left->numeric && right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_ADD) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_NUMERIC)
 			{
-				right = resolve_logic_expression(logicExpression->binary->right);
+				right = resolve_logic_expression(variables, logicExpression->binary->right);
 				if (right->type == VARIABLE_STRING)
 				{
 					error("cannot compute \"%f + %s\".", left->numeric, right->string);
@@ -417,7 +478,7 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 				left->numeric += right->numeric;
 				free_variable(right);
 			} else if (left->type == VARIABLE_STRING) {
-				right = resolve_logic_expression(logicExpression->binary->right);
+				right = resolve_logic_expression(variables, logicExpression->binary->right);
 				if (right->type == VARIABLE_NUMERIC)
 				{
 					error("cannot compute \"%s + %f\".", left->string, right->numeric);
@@ -430,14 +491,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 				error("unknown variable type %d.", left->type);
 			}
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_DIVISE) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute a division on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute a division on a string : \"%s\".", right->string);
@@ -447,10 +508,10 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			left->numeric /= right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_EQUALS) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_NUMERIC)
 			{
-				right = resolve_logic_expression(logicExpression->binary->right);
+				right = resolve_logic_expression(variables, logicExpression->binary->right);
 				if (right->type == VARIABLE_STRING)
 				{
 					error("cannot compute \"%f == %s\".", left->numeric, right->string);
@@ -460,7 +521,7 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 				left->numeric = left->numeric == right->numeric;
 				free_variable(right);
 			} else if (left->type == VARIABLE_STRING) {
-				right = resolve_logic_expression(logicExpression->binary->right);
+				right = resolve_logic_expression(variables, logicExpression->binary->right);
 				if (right->type == VARIABLE_NUMERIC)
 				{
 					error("cannot compute \"%s == %f\".", left->string, right->numeric);
@@ -476,10 +537,10 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 				error("unknown variable type %d.", left->type);
 			}
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_DIFFERS) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_NUMERIC)
 			{
-				right = resolve_logic_expression(logicExpression->binary->right);
+				right = resolve_logic_expression(variables, logicExpression->binary->right);
 				if (right->type == VARIABLE_STRING)
 				{
 					error("cannot compute \"%f != %s\".", left->numeric, right->string);
@@ -489,7 +550,7 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 				left->numeric = left->numeric != right->numeric;
 				free_variable(right);
 			} else if (left->type == VARIABLE_STRING) {
-				right = resolve_logic_expression(logicExpression->binary->right);
+				right = resolve_logic_expression(variables, logicExpression->binary->right);
 				if (right->type == VARIABLE_NUMERIC)
 				{
 					error("cannot compute \"%s != %f\".", left->string, right->numeric);
@@ -504,14 +565,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 				error("unknown variable type %d.", left->type);
 			}
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_INFERIOR) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute an inferior comparison on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute an inferior comparison on a string : \"%s\".", right->string);
@@ -521,14 +582,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			left->numeric = left->numeric < right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_MULTIPLY) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute a multiplication on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute a multiplication on a string : \"%s\".", right->string);
@@ -538,14 +599,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			left->numeric *= right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_SUBTRACT) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute a subtraction on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute a subtraction on a string : \"%s\".", right->string);
@@ -555,14 +616,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			left->numeric -= right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_SUPERIOR) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute a superior comparison on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute a superior comparison on a string : \"%s\".", right->string);
@@ -572,14 +633,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			left->numeric = left->numeric > right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_SUPERIOR_EQUALS) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute a superior or equals comparison on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute a superior or equals comparison on a string : \"%s\".", right->string);
@@ -589,14 +650,14 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 			left->numeric = left->numeric >= right->numeric;
 			free_variable(right);
 		} else if (logicExpression->binary->operation == LOGIC_EXPRESSION_BINARY_INFERIOR_EQUALS) {
-			left = resolve_logic_expression(logicExpression->binary->left);
+			left = resolve_logic_expression(variables, logicExpression->binary->left);
 			if (left->type == VARIABLE_STRING)
 			{
 				error("cannot compute an inferior or equals comparison on a string : \"%s\".", left->string);
 			} else if (left->type != VARIABLE_NUMERIC) {
 				error("unknown variable type %d.", left->type);
 			}
-			right = resolve_logic_expression(logicExpression->binary->right);
+			right = resolve_logic_expression(variables, logicExpression->binary->right);
 			if (right->type == VARIABLE_STRING)
 			{
 				error("cannot compute an inferior or equals comparison on a string : \"%s\".", right->string);
@@ -610,12 +671,358 @@ Variable *resolve_logic_expression(LogicExpression *logicExpression)
 		}
 		return left;
 	} else if (logicExpression->type == LOGIC_EXPRESSION_GROUPING) {
-		return resolve_logic_expression(logicExpression->grouping->expression);
+		return resolve_logic_expression(variables, logicExpression->grouping->expression);
 	} else {
 		error("unknown logic expression type %d.", logicExpression->type);
 	}
 }
 
+static void collect_logic_expression_dependencies(LogicExpression *logicExpression, buf(int) *dependencies)
+{
+	if (logicExpression->type == LOGIC_EXPRESSION_LITERAL)
+	{
+		if (logicExpression->literal->type == LOGIC_EXPRESSION_LITERAL_IDENTIFIER)
+		{
+			for (unsigned int i = 0; i < buf_len(*dependencies); i++)
+			{
+				if ((*dependencies)[i] == logicExpression->literal->variableSlot)
+				{
+					return;
+				}
+			}
+			buf_add(*dependencies, logicExpression->literal->variableSlot);
+		}
+	} else if (logicExpression->type == LOGIC_EXPRESSION_UNARY) {
+		collect_logic_expression_dependencies(logicExpression->unary->expression, dependencies);
+	} else if (logicExpression->type == LOGIC_EXPRESSION_BINARY) {
+		collect_logic_expression_dependencies(logicExpression->binary->left, dependencies);
+		collect_logic_expression_dependencies(logicExpression->binary->right, dependencies);
+	} else if (logicExpression->type == LOGIC_EXPRESSION_GROUPING) {
+		collect_logic_expression_dependencies(logicExpression->grouping->expression, dependencies);
+	} else {
+		error("unknown logic expression type %d.", logicExpression->type);
+	}
+}
+
+bool resolve_condition(VariableStore *variables, LogicExpression *logicExpression, buf(int) dependencies, ConditionCache *conditionCache)
+{
+	if (conditionCache->resolved)
+	{
+		bool upToDate = true;
+		for (unsigned int i = 0; i < buf_len(dependencies); i++)
+		{
+			if (conditionCache->dependenciesVersions[i] != get_variable_store_version(variables, dependencies[i]))
+			{
+				upToDate = false;
+				break;
+			}
+		}
+		if (upToDate)
+		{
+			return conditionCache->result;
+		}
+	}
+
+	Variable *variable = resolve_logic_expression(variables, logicExpression);
+	if (variable->type == VARIABLE_NUMERIC)
+	{
+		conditionCache->result = (bool)variable->numeric;
+	} else if (variable->type == VARIABLE_STRING) {
+		if (buf_len(variable->string) == 1)
+		{
+			if (variable->string[0] == '\0')
+			{
+				conditionCache->result = false;
+			} else {
+				conditionCache->result = true;
+			}
+		} else {
+			conditionCache->result = false;
+		}
+	} else {
+		error("unknown logic expression type %d.", variable->type);
+	}
+	free_variable(variable);
+
+	buf_clear(conditionCache->dependenciesVersions);
+	for (unsigned int i = 0; i < buf_len(dependencies); i++)
+	{
+		buf_add(conditionCache->dependenciesVersions, get_variable_store_version(variables, dependencies[i]));
+	}
+	conditionCache->resolved = true;
+	return conditionCache->result;
+}
+
+static Interpolation *parse_interpolation(const char *string, int *nbInterpolations)
+{
+	Interpolation *interpolation = NULL;
+	buf(char) literal = NULL;
+	int index = 0;
+	while (string[index] != '\0')
+	{
+		if (string[index] == '{' && (isalpha(string[index + 1]) || string[index + 1] == '_'))
+		{
+			int identifierLength = 1;
+			while (isalnum(string[index + 1 + identifierLength]) || string[index + 1 + identifierLength] == '_' || string[index + 1 + identifierLength] == '-' || string[index + 1 + identifierLength] == '\'')
+			{
+				identifierLength++;
+			}
+			if (string[index + 1 + identifierLength] == '}')
+			{
+				if (!interpolation)
+				{
+					interpolation = xmalloc(sizeof (*interpolation));
+					interpolation->literals = NULL;
+					interpolation->variablesSlots = NULL;
+					interpolation->index = (*nbInterpolations)++;
+				}
+				buf_add(literal, '\0');
+				buf_add(interpolation->literals, literal);
+				literal = NULL;
+				buf(char) identifier = strclonen(string + index + 1, identifierLength);
+				buf_add(interpolation->variablesSlots, get_variable_slot(identifier));
+				buf_free(identifier);
+				index += identifierLength + 2;
+				continue;
+			}
+		}
+		buf_add(literal, string[index]);
+		index++;
+	}
+	buf_add(literal, '\0');
+	if (interpolation)
+	{
+		buf_add(interpolation->literals, literal);
+	} else {
+		buf_free(literal);
+	}
+	return interpolation;
+}
+
+bool update_interpolation(VariableStore *variables, const Interpolation *interpolation, InterpolationCache *interpolationCache)
+{
+	if (interpolationCache->string)
+	{
+		bool upToDate = true;
+		for (unsigned int i = 0; i < buf_len(interpolation->variablesSlots); i++)
+		{
+			if (interpolationCache->variablesVersions[i] != get_variable_store_version(variables, interpolation->variablesSlots[i]))
+			{
+				upToDate = false;
+				break;
+			}
+		}
+		if (upToDate)
+		{
+			return false;
+		}
+	}
+
+	strcopy(&interpolationCache->string, interpolation->literals[0]);
+	buf_clear(interpolationCache->variablesVersions);
+	buf_clear(interpolationCache->literalsStarts);
+	buf_add(interpolationCache->literalsStarts, 0);
+	for (unsigned int i = 0; i < buf_len(interpolation->variablesSlots); i++)
+	{
+		Variable *variable = get_variable_store_value(variables, interpolation->variablesSlots[i]);
+		if (!variable)
+		{
+			error("variable %s not found.", variablesNames[interpolation->variablesSlots[i]]);
+		}
+		if (variable->type == VARIABLE_NUMERIC)
+		{
+			char numericString[32];
+			snprintf(numericString, 32, "%g", variable->numeric);
+			strappend(&interpolationCache->string, numericString);
+		} else if (variable->type == VARIABLE_STRING) {
+			strappend(&interpolationCache->string, variable->string);
+		} else {
+			error("unknown variable type %d.", variable->type);
+		}
+		buf_add(interpolationCache->literalsStarts, buf_len(interpolationCache->string) - 1);
+		strappend(&interpolationCache->string, interpolation->literals[i + 1]);
+		buf_add(interpolationCache->variablesVersions, get_variable_store_version(variables, interpolation->variablesSlots[i]));
+	}
+	return true;
+}
+
+static const float WAIT_TIME_NORMAL_CHARACTER = 0.02f;
+static const float WAIT_TIME_COMMA = 0.15f;
+static const float WAIT_TIME_DOT = 0.4f;
+static const float BLIP_PERIOD = 0.075f;
+
+// strips the reveal tags of a sentence, tags can be NULL to drop them
+static buf(char) parse_reveal_tags(const char *string, int literal, buf(RevealTag) *tags, int line)
+{
+	buf(char) strippedString = NULL;
+	int index = 0;
+	while (string[index] != '\0')
+	{
+		if (string[index] == '{' && (string[index + 1] == 'p' || string[index + 1] == 's') && string[index + 2] == '=')
+		{
+			char *end;
+			float value = strtof(string + index + 3, &end);
+			if (end == string + index + 3 || *end != '}' || (string[index + 1] == 's' && value <= 0.0f) || value < 0.0f)
+			{
+				error("in %s at line %d, invalid reveal tag in \"%s\", the syntax is {p=seconds} or {s=speed factor}.", filePath, line, string);
+			}
+			if (tags)
+			{
+				RevealTag tag = {string[index + 1] == 'p' ? REVEAL_TAG_PAUSE : REVEAL_TAG_SPEED, value, buf_len(strippedString), literal};
+				buf_add(*tags, tag);
+			}
+			index = end + 1 - string;
+			continue;
+		}
+		buf_add(strippedString, string[index]);
+		index++;
+	}
+	buf_add(strippedString, '\0');
+	return strippedString;
+}
+
+static void parse_sentence_string(Sentence *sentence, const char *string, int line, int *nbInterpolations)
+{
+	sentence->stringId = strhash(string);
+	sentence->revealTags = NULL;
+	sentence->timeline = (RevealTimeline){NULL, NULL, NULL};
+	sentence->interpolation = parse_interpolation(string, nbInterpolations);
+	sentence->string = parse_reveal_tags(string, 0, sentence->interpolation ? NULL : &sentence->revealTags, line);
+	if (sentence->interpolation)
+	{
+		for (unsigned int i = 0; i < buf_len(sentence->interpolation->literals); i++)
+		{
+			buf(char) literal = parse_reveal_tags(sentence->interpolation->literals[i], i, &sentence->revealTags, line);
+			buf_free(sentence->interpolation->literals[i]);
+			sentence->interpolation->literals[i] = literal;
+		}
+	} else {
+		compile_reveal_timeline(&sentence->timeline, sentence->string, sentence->revealTags, NULL);
+	}
+}
+
+// a translation is parsed like the sentence it replaces, its errors being reported at the line of its strings table
+Sentence *parse_translated_sentence(const char *string, const char *tablePath, int line)
+{
+	const char *dialogPath = filePath;
+	filePath = tablePath;
+	Sentence *sentence = xmalloc(sizeof (*sentence));
+	sentence->id = -1;
+	int nbInterpolations = 0;
+	parse_sentence_string(sentence, string, line, &nbInterpolations);
+	sentence->autoSkip = false;
+	sentence->voiceName = NULL;
+	filePath = dialogPath;
+	return sentence;
+}
+
+static float get_character_wait_time(char character, bool lastCharacters)
+{
+	if ((character == '.' || character == '?' || character == '!' || character == ';') && !lastCharacters)
+	{
+		return WAIT_TIME_DOT;
+	} else if (character == ',' && !lastCharacters) {
+		return WAIT_TIME_COMMA;
+	}
+	return WAIT_TIME_NORMAL_CHARACTER;
+}
+
+static void set_mouth_open(RevealTimeline *timeline, bool open, float time)
+{
+	if (open != (buf_len(timeline->mouthTimes) % 2 == 1))
+	{
+		buf_add(timeline->mouthTimes, time);
+	}
+}
+
+// a character waits after the previous one for as long as the previous one asks, a punctuation mark stops the blips and closes the mouth
+void compile_reveal_timeline(RevealTimeline *timeline, const char *string, const RevealTag *tags, const int *literalsStarts)
+{
+	buf_clear(timeline->charactersTimes);
+	buf_clear(timeline->blipsTimes);
+	buf_clear(timeline->mouthTimes);
+
+	int nbCharacters = 0;
+	for (int i = 0; string[i] != '\0'; i++)
+	{
+		nbCharacters += (string[i] & 0xC0) != 0x80;
+	}
+
+	float time = 0.0f;
+	float speed = 1.0f;
+	float timeSinceBlip = 0.0f;
+	unsigned int currentTag = 0;
+	int character = 0;
+	int previousCharacterStart = 0;
+	for (int i = 0; string[i] != '\0'; i++)
+	{
+		if ((string[i] & 0xC0) == 0x80)
+		{
+			continue;
+		}
+		float pause = 0.0f;
+		while (currentTag < buf_len(tags) && (literalsStarts ? literalsStarts[tags[currentTag].literal] : 0) + tags[currentTag].position <= i)
+		{
+			if (tags[currentTag].type == REVEAL_TAG_PAUSE)
+			{
+				pause += tags[currentTag].value;
+			} else {
+				speed = tags[currentTag].value;
+			}
+			currentTag++;
+		}
+		// the first character waits as long as it would after itself, the last two never pause
+		int waitingCharacter = character == 0 ? 0 : character - 1;
+		float waitTime = get_character_wait_time(string[character == 0 ? i : previousCharacterStart], waitingCharacter >= nbCharacters - 2);
+		bool talking = waitTime == WAIT_TIME_NORMAL_CHARACTER && pause == 0.0f;
+		set_mouth_open(timeline, talking, time);
+		float start = time;
+		time += pause + waitTime / speed;
+		if (talking)
+		{
+			float nextBlip = start + BLIP_PERIOD - timeSinceBlip;
+			while (nextBlip <= time)
+			{
+				buf_add(timeline->blipsTimes, nextBlip);
+				nextBlip += BLIP_PERIOD;
+			}
+			timeSinceBlip = BLIP_PERIOD - (nextBlip - time);
+		} else {
+			timeSinceBlip = 0.0f;
+		}
+		buf_add(timeline->charactersTimes, time);
+		previousCharacterStart = i;
+		character++;
+	}
+	set_mouth_open(timeline, false, time);
+}
+
+// number of times before the given time, times being sorted
+int count_reveal_times(const float *times, float time)
+{
+	int low = 0;
+	int high = buf_len(times);
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (times[middle] <= time)
+		{
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+void free_reveal_timeline(RevealTimeline *timeline)
+{
+	buf_free(timeline->charactersTimes);
+	buf_free(timeline->blipsTimes);
+	buf_free(timeline->mouthTimes);
+}
+
+// the packs are loaded once the whole dialog is parsed, as a #preload or #unload further down leaves them out
 static void add_to_background_list(const char *backgroundPackName)
 {
 	bool foundPack = false;
@@ -630,11 +1037,7 @@ static void add_to_background_list(const char *backgroundPackName)
 	if (!foundPack)
 	{
 		buf_add(currentDialog->backgroundPacksNames, strclone(backgroundPackName));
-		buf(char) animationFilePath = strclone("Animation files/");
-		strappend(&animationFilePath, backgroundPackName);
-		strappend(&animationFilePath, ".anm");
-		buf_add(currentDialog->backgroundPacks, get_animations_from_file(animationFilePath, backgroundPackName));
-		buf_free(animationFilePath);
+		buf_add(currentDialog->backgroundPacks, NULL);
 	}
 }
 
@@ -652,11 +1055,7 @@ static void add_to_character_list(const char *characterName)
 	if (!foundCharacter)
 	{
 		buf_add(currentDialog->charactersNames, strclone(characterName));
-		buf(char) animationFilePath = strclone("Animation files/");
-		strappend(&animationFilePath, characterName);
-		strappend(&animationFilePath, ".anm");
-		buf_add(currentDialog->charactersAnimations, get_animations_from_file(animationFilePath, characterName));
-		buf_free(animationFilePath);
+		buf_add(currentDialog->charactersAnimations, NULL);
 	}
 }
 
@@ -694,6 +1093,79 @@ static void add_to_music_list(const char *musicName)
 	buf_free(musicFilePath);
 }
 
+int get_asset_type(const char *name)
+{
+	if (strmatch(name, "background"))
+	{
+		return ASSET_BACKGROUND;
+	} else if (strmatch(name, "character")) {
+		return ASSET_CHARACTER;
+	} else if (strmatch(name, "music")) {
+		return ASSET_MUSIC;
+	} else if (strmatch(name, "sound")) {
+		return ASSET_SOUND;
+	}
+	return -1;
+}
+
+buf(char) get_asset_path(AssetType type, const char *name)
+{
+	buf(char) path = NULL;
+	if (type == ASSET_BACKGROUND || type == ASSET_CHARACTER)
+	{
+		path = strmerge("Animation files/", name);
+		strappend(&path, ".anm");
+	} else if (type == ASSET_MUSIC) {
+		path = strmerge("Musics/", name);
+	} else if (type == ASSET_SOUND) {
+		path = strmerge("Sounds/", name);
+	}
+	return path;
+}
+
+static void add_to_asset_list(Command *command, int line)
+{
+	const char *name = command->arguments[1]->string;
+	int type = get_asset_type(command->arguments[0]->string);
+	if (type == -1)
+	{
+		error("in %s at line %d, expected background, character, music or sound after #%s, got %s instead.", filePath, line, command->type == COMMAND_PRELOAD ? "preload" : "unload", command->arguments[0]->string);
+	}
+	if (type == ASSET_BACKGROUND)
+	{
+		add_to_background_list(name);
+	} else if (type == ASSET_CHARACTER) {
+		add_to_character_list(name);
+	} else if (type == ASSET_MUSIC) {
+		add_to_music_list(name);
+	} else if (type == ASSET_SOUND) {
+		add_to_sound_list(name);
+	}
+	if (type == ASSET_BACKGROUND || type == ASSET_CHARACTER)
+	{
+		// the pack is only loaded when a #preload runs or it is shown, a missing file is still reported with the dialog as before
+		buf(char) path = get_asset_path(type, name);
+		if (!check_file(path))
+		{
+			error("in %s at line %d, could not find %s.", filePath, line, path);
+		}
+		buf_free(path);
+		buf_add(leftOutPacksCommands, command);
+	}
+}
+
+static bool is_pack_left_out(AssetType type, const char *name)
+{
+	for (unsigned int i = 0; i < buf_len(leftOutPacksCommands); i++)
+	{
+		if (get_asset_type(leftOutPacksCommands[i]->arguments[0]->string) == (int)type && strmatch(leftOutPacksCommands[i]->arguments[1]->string, name))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 static GoTo *parse_go_to()
 {
 	GoTo *goTo = xmalloc(sizeof (*goTo));
@@ -719,6 +1191,7 @@ static GoTo *parse_go_to()
 static Assignment *parse_assign()
 {
 	Assignment *assignment = xmalloc(sizeof (*assignment));
+	assignment->persistent = tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN_PERSISTENT;
 
 	step_in_tokens();
 
@@ -727,6 +1200,7 @@ static Assignment *parse_assign()
 		error("in %s at line %d, expected an identifier after #assignment keyword, got %s instead.", filePath, tokens[currentToken]->line, dialog_token_to_string(tokens[currentToken]));
 	}
 	assignment->identifier = strclone(tokens[currentToken]->string);
+	assignment->variableSlot = get_variable_slot(assignment->identifier);
 	step_in_tokens();
 	assignment->logicExpression = parse_logic_expression(tokens[currentToken]->line);
 
@@ -758,6 +1232,7 @@ static const CommandPrototype commandPrototypes[] =
 	{"set_character", 4, (DialogTokenType[4]){DIALOG_TOKEN_POSITION_IDENTIFIER, DIALOG_TOKEN_STRING, DIALOG_TOKEN_SCOPE, DIALOG_TOKEN_STRING}, COMMAND_SET_CHARACTER, 3, (ArgumentType[3]){ARGUMENT_NUMERIC, ARGUMENT_STRING, ARGUMENT_STRING}},
 	{"clear_character_position", 1, (DialogTokenType[1]){DIALOG_TOKEN_POSITION_IDENTIFIER}, COMMAND_CLEAR_CHARACTER_POSITION, 1, (ArgumentType[1]){ARGUMENT_NUMERIC}},
 	{"clear_character_positions", 0, NULL, COMMAND_CLEAR_CHARACTER_POSITIONS, 0, NULL},
+	{"move_character", 2, (DialogTokenType[2]){DIALOG_TOKEN_POSITION_IDENTIFIER, DIALOG_TOKEN_POSITION_IDENTIFIER}, COMMAND_MOVE_CHARACTER, 2, (ArgumentType[2]){ARGUMENT_NUMERIC, ARGUMENT_NUMERIC}},
 
 	{"play_music", 1, (DialogTokenType[1]){DIALOG_TOKEN_STRING}, COMMAND_PLAY_MUSIC, 1, (ArgumentType[1]){ARGUMENT_STRING}},
 	{"stop_music", 0, NULL, COMMAND_STOP_MUSIC, 0, NULL},
@@ -770,10 +1245,14 @@ static const CommandPrototype commandPrototypes[] =
 	{"hide_ui", 0, NULL, COMMAND_HIDE_UI, 0, NULL},
 
 	{"wait", 1, (DialogTokenType[1]){DIALOG_TOKEN_NUMERIC}, COMMAND_WAIT, 1, (ArgumentType[1]){ARGUMENT_NUMERIC}},
+	{"wait_transitions", 0, NULL, COMMAND_WAIT_TRANSITIONS, 0, NULL},
 
 	{"set_window_name", 1, (DialogTokenType[1]){DIALOG_TOKEN_STRING}, COMMAND_SET_WINDOW_NAME, 1, (ArgumentType[1]){ARGUMENT_STRING}},
 
-	{"set_speaker_name_color", 4, (DialogTokenType[4]){DIALOG_TOKEN_STRING, DIALOG_TOKEN_NUMERIC, DIALOG_TOKEN_NUMERIC, DIALOG_TOKEN_NUMERIC}, COMMAND_SET_SPEAKER_NAME_COLOR, 4, (ArgumentType[4]){ARGUMENT_STRING, ARGUMENT_NUMERIC, ARGUMENT_NUMERIC, ARGUMENT_NUMERIC}}
+	{"set_speaker_name_color", 4, (DialogTokenType[4]){DIALOG_TOKEN_STRING, DIALOG_TOKEN_NUMERIC, DIALOG_TOKEN_NUMERIC, DIALOG_TOKEN_NUMERIC}, COMMAND_SET_SPEAKER_NAME_COLOR, 4, (ArgumentType[4]){ARGUMENT_STRING, ARGUMENT_NUMERIC, ARGUMENT_NUMERIC, ARGUMENT_NUMERIC}},
+
+	{"preload", 2, (DialogTokenType[2]){DIALOG_TOKEN_IDENTIFIER, DIALOG_TOKEN_STRING}, COMMAND_PRELOAD, 2, (ArgumentType[2]){ARGUMENT_IDENTIFIER, ARGUMENT_STRING}},
+	{"unload", 2, (DialogTokenType[2]){DIALOG_TOKEN_IDENTIFIER, DIALOG_TOKEN_STRING}, COMMAND_UNLOAD, 2, (ArgumentType[2]){ARGUMENT_IDENTIFIER, ARGUMENT_STRING}}
 };
 
 static Command *parse_command()
@@ -818,8 +1297,16 @@ static Command *parse_command()
 					add_to_music_list(command->arguments[0]->string);
 				} else if (command->type == COMMAND_PLAY_SOUND) {
 					add_to_sound_list(command->arguments[0]->string);
+				} else if (command->type == COMMAND_PRELOAD || command->type == COMMAND_UNLOAD) {
+					add_to_asset_list(command, tokens[currentToken]->line);
 				}
 				steps_in_tokens(commandPrototypes[commandPrototypeIndex].tokenNumber);
+				command->await = true;
+				if (tokens[currentToken]->type == DIALOG_TOKEN_IDENTIFIER && tokens[currentToken]->line == tokens[currentToken - 1]->line && strmatch(tokens[currentToken]->string, "nowait"))
+				{
+					command->await = false;
+					step_in_tokens();
+				}
 				foundCommand = true;
 				break;
 			} else {
@@ -854,8 +1341,10 @@ static Choice *parse_choice()
 	Choice *choice = xmalloc(sizeof (*choice));
 
 	choice->sentence = xmalloc(sizeof (*choice->sentence));
-	choice->sentence->string = strclone(tokens[currentToken]->string);
+	choice->sentence->id = currentDialog->nbSentences++;
+	parse_sentence_string(choice->sentence, tokens[currentToken]->string, tokens[currentToken]->line, &currentDialog->nbInterpolations);
 	choice->sentence->autoSkip = false;
+	choice->sentence->voiceName = NULL;
 	step_in_tokens();
 
 	if (!token_match_on_line(tokens[currentToken - 1]->line + 1, 1, DIALOG_TOKEN_GO_TO))
@@ -880,9 +1369,9 @@ static CueCondition *parse_cue_condition()
 
 	cueCondition->logicExpression = parse_logic_expression(tokens[currentToken - 1]->line);
 
-	cueCondition->resolved = false;
-
-	cueCondition->currentExpression = 0;
+	cueCondition->dependencies = NULL;
+	collect_logic_expression_dependencies(cueCondition->logicExpression, &cueCondition->dependencies);
+	cueCondition->conditionIndex = currentDialog->nbConditions++;
 
 	currentIndentationLevel++;
 
@@ -922,6 +1411,7 @@ static CueCondition *parse_cue_condition()
 static CueExpression *parse_cue_expression()
 {
 	CueExpression *cueExpression = xmalloc(sizeof (*cueExpression));
+	cueExpression->line = tokens[currentToken]->line;
 
 	if (tokens[currentToken - 1]->line == tokens[currentToken]->line)
 	{
@@ -940,7 +1430,7 @@ static CueExpression *parse_cue_expression()
 		{
 			cueExpression->type = CUE_EXPRESSION_COMMAND;
 			cueExpression->command = parse_command();
-		} else if (tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN) {
+		} else if (tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN || tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN_PERSISTENT) {
 			cueExpression->type = CUE_EXPRESSION_ASSIGNMENT;
 			cueExpression->assignment = parse_assign();
 		} else if (tokens[currentToken]->type == DIALOG_TOKEN_GO_TO) {
@@ -949,14 +1439,23 @@ static CueExpression *parse_cue_expression()
 		} else if (tokens[currentToken]->type == DIALOG_TOKEN_SENTENCE) {
 			cueExpression->type = CUE_EXPRESSION_SENTENCE;
 			cueExpression->sentence = xmalloc(sizeof (*cueExpression->sentence));
-			cueExpression->sentence->string = strclone(tokens[currentToken]->string);
+			cueExpression->sentence->id = currentDialog->nbSentences++;
+			parse_sentence_string(cueExpression->sentence, tokens[currentToken]->string, tokens[currentToken]->line, &currentDialog->nbInterpolations);
 			step_in_tokens();
-			if (token_match_on_line(tokens[currentToken - 1]->line, 1, DIALOG_TOKEN_IDENTIFIER) && strmatch(tokens[currentToken]->string, "auto"))
+			cueExpression->sentence->autoSkip = false;
+			cueExpression->sentence->voiceName = NULL;
+			while (token_match_on_line(tokens[currentToken - 1]->line, 1, DIALOG_TOKEN_IDENTIFIER))
 			{
-				cueExpression->sentence->autoSkip = true;
-				step_in_tokens();
-			} else {
-				cueExpression->sentence->autoSkip = false;
+				if (strmatch(tokens[currentToken]->string, "auto"))
+				{
+					cueExpression->sentence->autoSkip = true;
+					step_in_tokens();
+				} else if (strmatch(tokens[currentToken]->string, "voice") && token_match_on_line(tokens[currentToken]->line, 2, DIALOG_TOKEN_IDENTIFIER, DIALOG_TOKEN_STRING)) {
+					strcopy(&cueExpression->sentence->voiceName, tokens[currentToken + 1]->string);
+					steps_in_tokens(2);
+				} else {
+					break;
+				}
 			}
 		} else {
 			error("in %s at line %d, expected a cue expression, got a %s instead.", filePath, tokens[currentToken]->line, dialog_token_to_string(tokens[currentToken]));
@@ -973,16 +1472,18 @@ static Cue *parse_cue()
 
 	currentCueMode = CUE_MODE_SENTENCE;
 
-	cue->currentExpression = 0;
-
 	cue->cueExpressions = NULL;
 
 	step_in_tokens();
 	if (!tokens[currentToken - 1]->string)
 	{
 		cue->characterName = NULL;
+		cue->characterNameId = 0;
+		cue->characterNameInterpolation = NULL;
 	} else {
 		cue->characterName = strclone(tokens[currentToken - 1]->string);
+		cue->characterNameId = strhash(cue->characterName);
+		cue->characterNameInterpolation = parse_interpolation(cue->characterName, &currentDialog->nbInterpolations);
 		if (!token_match(1, DIALOG_TOKEN_POSITION_IDENTIFIER))
 		{
 			error("in %s at line %d, expected a position identifier after %s, found %s instead.", filePath, tokens[currentToken]->line, dialog_token_to_string(tokens[currentToken - 1]), dialog_token_to_string(tokens[currentToken]));
@@ -999,8 +1500,10 @@ static Cue *parse_cue()
 			cue->setCharacterCommandInDeclaration = true;
 			CueExpression *cueExpression = xmalloc(sizeof (*cueExpression));
 			cueExpression->type = CUE_EXPRESSION_COMMAND;
+			cueExpression->line = tokens[currentToken]->line;
 			Command *setCharacterCommand = xmalloc(sizeof (*setCharacterCommand));
 			setCharacterCommand->type = COMMAND_SET_CHARACTER;
+			setCharacterCommand->await = true;
 			setCharacterCommand->arguments = xmalloc(sizeof (*setCharacterCommand->arguments) * 3);
 			setCharacterCommand->arguments[0] = xmalloc(sizeof (*setCharacterCommand->arguments[0]));
 			setCharacterCommand->arguments[0]->type = ARGUMENT_NUMERIC;
@@ -1039,8 +1542,9 @@ static KnotCondition *parse_knot_condition()
 	step_in_tokens();
 
 	knotCondition->logicExpression = parse_logic_expression(tokens[currentToken - 1]->line);
-	knotCondition->resolved = false;
-	knotCondition->currentExpression = 0;
+	knotCondition->dependencies = NULL;
+	collect_logic_expression_dependencies(knotCondition->logicExpression, &knotCondition->dependencies);
+	knotCondition->conditionIndex = currentDialog->nbConditions++;
 
 	currentIndentationLevel++;
 
@@ -1081,6 +1585,7 @@ static KnotCondition *parse_knot_condition()
 static KnotExpression *parse_knot_expression()
 {
 	KnotExpression *knotExpression = xmalloc(sizeof (*knotExpression));
+	knotExpression->line = tokens[currentToken]->line;
 
 	if (currentToken != 0)
 	{
@@ -1097,7 +1602,7 @@ static KnotExpression *parse_knot_expression()
 	{
 		knotExpression->type = KNOT_EXPRESSION_COMMAND;
 		knotExpression->command = parse_command();
-	} else if (tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN) {
+	} else if (tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN || tokens[currentToken]->type == DIALOG_TOKEN_ASSIGN_PERSISTENT) {
 		knotExpression->type = KNOT_EXPRESSION_ASSIGNMENT;
 		knotExpression->assignment = parse_assign();
 	} else if (tokens[currentToken]->type == DIALOG_TOKEN_GO_TO) {
@@ -1125,7 +1630,6 @@ static Knot *parse_knot()
 		}
 	}
 	Knot *knot = xmalloc(sizeof (*knot));
-	knot->currentExpression = 0;
 	currentIndentationLevel = 0;
 	knot->name = NULL;
 	if (firstKnot)
@@ -1188,21 +1692,40 @@ Dialog *get_dialog_from_file(const char *_filePath)
 	dialog->charactersNames = NULL;
 	dialog->charactersAnimations = NULL;
 
-	dialog->namesColors = NULL;
-	dialog->coloredNames = NULL;
-
 	dialog->soundsNames = NULL;
 
 	dialog->musicsNames = NULL;
 
 	dialog->knots = NULL;
 
+	dialog->nbConditions = 0;
+	dialog->nbInterpolations = 0;
+	dialog->nbSentences = 0;
+	dialog->shared = false;
+
+	leftOutPacksCommands = NULL;
+
 	while (tokens[currentToken]->type != DIALOG_TOKEN_END_OF_FILE)
 	{
 		buf_add(dialog->knots, parse_knot());
 	}
-	dialog->currentKnot = 0;
-	dialog->end = false;
+	compile_dialog(dialog);
+
+	for (unsigned int index = 0; index < buf_len(dialog->backgroundPacksNames); index++)
+	{
+		if (!is_pack_left_out(ASSET_BACKGROUND, dialog->backgroundPacksNames[index]))
+		{
+			load_dialog_pack(dialog, ASSET_BACKGROUND, index);
+		}
+	}
+	for (unsigned int index = 0; index < buf_len(dialog->charactersNames); index++)
+	{
+		if (!is_pack_left_out(ASSET_CHARACTER, dialog->charactersNames[index]))
+		{
+			load_dialog_pack(dialog, ASSET_CHARACTER, index);
+		}
+	}
+	buf_free(leftOutPacksCommands);
 
 	for (unsigned int index = 0; index < buf_len(tokens); index++)
 	{
@@ -1280,9 +1803,27 @@ static void free_command(Command *command)
 	xfree(command);
 }
 
-static void free_sentence(Sentence *sentence)
+static void free_interpolation(Interpolation *interpolation)
+{
+	for (unsigned int i = 0; i < buf_len(interpolation->literals); i++)
+	{
+		buf_free(interpolation->literals[i]);
+	}
+	buf_free(interpolation->literals);
+	buf_free(interpolation->variablesSlots);
+	xfree(interpolation);
+}
+
+void free_sentence(Sentence *sentence)
 {
 	buf_free(sentence->string);
+	buf_free(sentence->voiceName);
+	buf_free(sentence->revealTags);
+	free_reveal_timeline(&sentence->timeline);
+	if (sentence->interpolation)
+	{
+		free_interpolation(sentence->interpolation);
+	}
 	xfree(sentence);
 }
 
@@ -1298,6 +1839,7 @@ static void free_cue_expression(CueExpression *cueExpression);
 static void free_cue_condition(CueCondition *cueCondition)
 {
 	free_logic_expression(cueCondition->logicExpression);
+	buf_free(cueCondition->dependencies);
 	for (unsigned int index = 0; index < buf_len(cueCondition->cueExpressionsIf); index++)
 	{
 		free_cue_expression(cueCondition->cueExpressionsIf[index]);
@@ -1333,6 +1875,10 @@ static void free_cue_expression(CueExpression *cueExpression)
 static void free_cue(Cue *cue)
 {
 	buf_free(cue->characterName);
+	if (cue->characterNameInterpolation)
+	{
+		free_interpolation(cue->characterNameInterpolation);
+	}
 	for (unsigned int index = 0; index < buf_len(cue->cueExpressions); index++)
 	{
 		free_cue_expression(cue->cueExpressions[index]);
@@ -1346,6 +1892,7 @@ static void free_knot_expression(KnotExpression *knotExpression);
 static void free_knot_condition(KnotCondition *knotCondition)
 {
 	free_logic_expression(knotCondition->logicExpression);
+	buf_free(knotCondition->dependencies);
 	for (unsigned int index = 0; index < buf_len(knotCondition->knotExpressionsIf); index++)
 	{
 		free_knot_expression(knotCondition->knotExpressionsIf[index]);
@@ -1391,11 +1938,7 @@ void free_dialog(Dialog *dialog)
 {
 	for (unsigned int index = 0; index < buf_len(dialog->backgroundPacks); index++)
 	{
-		for (unsigned int index2 = 0; index2 < buf_len(dialog->backgroundPacks[index]); index2++)
-		{
-			free_animation(dialog->backgroundPacks[index][index2]);
-		}
-		buf_free(dialog->backgroundPacks[index]);
+		free_pack(dialog->backgroundPacks[index]);
 	}
 	buf_free(dialog->backgroundPacks);
 	for (unsigned int index = 0; index < buf_len(dialog->backgroundPacksNames); index++)
@@ -1405,11 +1948,7 @@ void free_dialog(Dialog *dialog)
 	buf_free(dialog->backgroundPacksNames);
 	for (unsigned int index = 0; index < buf_len(dialog->charactersAnimations); index++)
 	{
-		for (unsigned int index2 = 0; index2 < buf_len(dialog->charactersAnimations[index]); index2++)
-		{
-			free_animation(dialog->charactersAnimations[index][index2]);
-		}
-		buf_free(dialog->charactersAnimations[index]);
+		free_pack(dialog->charactersAnimations[index]);
 	}
 	buf_free(dialog->charactersAnimations);
 	for (unsigned int index = 0; index < buf_len(dialog->charactersNames); index++)
@@ -1417,12 +1956,6 @@ void free_dialog(Dialog *dialog)
 		buf_free(dialog->charactersNames[index]);
 	}
 	buf_free(dialog->charactersNames);
-	buf_free(dialog->namesColors);
-	for (unsigned int index = 0; index < buf_len(dialog->coloredNames); index++)
-	{
-		buf_free(dialog->coloredNames[index]);
-	}
-	buf_free(dialog->coloredNames);
 	for (unsigned int index = 0; index < buf_len(dialog->soundsNames); index++)
 	{
 		buf_free(dialog->soundsNames[index]);
@@ -1438,5 +1971,108 @@ void free_dialog(Dialog *dialog)
 		free_knot(dialog->knots[index]);
 	}
 	buf_free(dialog->knots);
+	buf_free(dialog->instructions);
+	for (unsigned int index = 0; index < buf_len(dialog->goToDialogsPaths); index++)
+	{
+		buf_free(dialog->goToDialogsPaths[index]);
+	}
+	buf_free(dialog->goToDialogsPaths);
+	for (unsigned int index = 0; index < buf_len(dialog->knotsGoToDialogs); index++)
+	{
+		buf_free(dialog->knotsGoToDialogs[index]);
+		buf_free(dialog->knotsNextKnots[index]);
+	}
+	buf_free(dialog->knotsGoToDialogs);
+	buf_free(dialog->knotsNextKnots);
 	xfree(dialog);
 }
+
+static buf(buf(char)) get_dialog_assets_names(Dialog *dialog, AssetType type)
+{
+	if (type == ASSET_BACKGROUND)
+	{
+		return dialog->backgroundPacksNames;
+	} else if (type == ASSET_CHARACTER) {
+		return dialog->charactersNames;
+	} else if (type == ASSET_MUSIC) {
+		return dialog->musicsNames;
+	} else {
+		return dialog->soundsNames;
+	}
+}
+
+int find_dialog_asset(Dialog *dialog, AssetType type, const char *name)
+{
+	buf(buf(char)) names = get_dialog_assets_names(dialog, type);
+	for (unsigned int index = 0; index < buf_len(names); index++)
+	{
+		if (strmatch(names[index], name))
+		{
+			return index;
+		}
+	}
+	return -1;
+}
+
+// loads the pack at once if it is not yet
+buf(Animation *) load_dialog_pack(Dialog *dialog, AssetType type, int index)
+{
+	buf(buf(Animation *)) packs = type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations;
+	if (!packs[index])
+	{
+		const char *name = get_dialog_assets_names(dialog, type)[index];
+		if (dialog->shared)
+		{
+			error("%s is not loaded in a dialog shared by several sessions.", name);
+		}
+		buf(char) path = get_asset_path(type, name);
+		packs[index] = get_animations_from_file(path, name);
+		buf_free(path);
+	}
+	return packs[index];
+}
+
+void load_dialog_packs(Dialog *dialog)
+{
+	for (unsigned int index = 0; index < buf_len(dialog->backgroundPacks); index++)
+	{
+		load_dialog_pack(dialog, ASSET_BACKGROUND, index);
+	}
+	for (unsigned int index = 0; index < buf_len(dialog->charactersAnimations); index++)
+	{
+		load_dialog_pack(dialog, ASSET_CHARACTER, index);
+	}
+}
+
+// the ids of the textures a worker deferred, in the order it took them
+void patch_pack_textures(buf(Animation *) pack, const unsigned int *texturesIds)
+{
+	for (unsigned int i = 0; i < buf_len(pack); i++)
+	{
+		for (unsigned int j = 0; j < buf_len(pack[i]->animationPhases); j++)
+		{
+			AnimationPhase *animationPhase = pack[i]->animationPhases[j];
+			if (animationPhase->textureId & DEFERRED_TEXTURE_FLAG)
+			{
+				animationPhase->textureId = texturesIds[animationPhase->textureId & ~DEFERRED_TEXTURE_FLAG];
+			}
+		}
+	}
+}
+
+// the textures are shared with the other packs, only the last one using a texture deletes it
+void free_pack(buf(Animation *) pack)
+{
+	for (unsigned int i = 0; i < buf_len(pack); i++)
+	{
+		for (unsigned int j = 0; j < buf_len(pack[i]->animationPhases); j++)
+		{
+			if (!(pack[i]->animationPhases[j]->textureId & DEFERRED_TEXTURE_FLAG))
+			{
+				release_texture(pack[i]->animationPhases[j]->textureId);
+			}
+		}
+		free_animation(pack[i]);
+	}
+	buf_free(pack);
+}
@@ -49,6 +49,7 @@ typedef struct LogicExpression
 		{
 			LogicExpressionLiteralType type;
 			union {double numeric; buf(char) string;};
+			int variableSlot;
 		} *literal;
 
 		struct
@@ -71,7 +72,7 @@ typedef struct LogicExpression
 	};
 } LogicExpression;
 
-Variable *resolve_logic_expression(LogicExpression *logicExpression);
+Variable *resolve_logic_expression(VariableStore *variables, LogicExpression *logicExpression);
 
 typedef struct GoTo
 {
@@ -84,7 +85,10 @@ void free_go_to(GoTo *goTo);
 typedef struct Assignment
 {
 	buf(char) identifier;
+	int variableSlot;
 	LogicExpression *logicExpression;
+	// kept across playthroughs by the persistent store, if the session has one
+	bool persistent;
 } Assignment;
 
 extern const char *argumentTypeDescriptions[];
@@ -110,6 +114,7 @@ typedef enum CommandType
 	COMMAND_SET_CHARACTER,
 	COMMAND_CLEAR_CHARACTER_POSITION,
 	COMMAND_CLEAR_CHARACTER_POSITIONS,
+	COMMAND_MOVE_CHARACTER,
 
 	COMMAND_PLAY_MUSIC,
 	COMMAND_STOP_MUSIC,
@@ -122,42 +127,124 @@ typedef enum CommandType
 	COMMAND_HIDE_UI,
 
 	COMMAND_WAIT,
+	COMMAND_WAIT_TRANSITIONS,
 
 	COMMAND_SET_WINDOW_NAME,
 
 	COMMAND_SET_SPEAKER_NAME_COLOR,
 
+	COMMAND_PRELOAD,
+	COMMAND_UNLOAD,
+
 	NB_COMMANDS
 } CommandType;
 
+// the kinds of assets #preload and #unload name
+typedef enum AssetType
+{
+	ASSET_BACKGROUND,
+	ASSET_CHARACTER,
+	ASSET_MUSIC,
+	ASSET_SOUND
+} AssetType;
+
 typedef struct Command
 {
 	CommandType type;
 	Argument **arguments;
+	// false when followed by nowait, the dialog then goes on during the transitions of the command
+	bool await;
 } Command;
 
+typedef struct Interpolation
+{
+	buf(buf(char)) literals;
+	buf(int) variablesSlots;
+	int index;
+} Interpolation;
+
+typedef struct InterpolationCache
+{
+	buf(unsigned int) variablesVersions;
+	buf(char) string;
+	// offset of each literal in the string
+	buf(int) literalsStarts;
+} InterpolationCache;
+
+bool update_interpolation(VariableStore *variables, const Interpolation *interpolation, InterpolationCache *interpolationCache);
+
+typedef enum RevealTagType
+{
+	REVEAL_TAG_PAUSE,
+	REVEAL_TAG_SPEED
+} RevealTagType;
+
+// {p=seconds} pauses the reveal before the next character, {s=factor} changes the reveal speed from the next character
+typedef struct RevealTag
+{
+	RevealTagType type;
+	float value;
+	// offset of the next character in the sentence, or in its literal when the sentence is interpolated
+	int position;
+	int literal;
+} RevealTag;
+
+// when each character of a sentence appears, when the blips play and when the speaker's mouth opens and closes
+typedef struct RevealTimeline
+{
+	buf(float) charactersTimes;
+	buf(float) blipsTimes;
+	// the mouth opens at even indices and closes at odd ones
+	buf(float) mouthTimes;
+} RevealTimeline;
+
+void compile_reveal_timeline(RevealTimeline *timeline, const char *string, const RevealTag *tags, const int *literalsStarts);
+int count_reveal_times(const float *times, float time);
+void free_reveal_timeline(RevealTimeline *timeline);
+
 typedef struct Sentence
 {
+	// order of the sentence in its dialog file, choices included
+	int id;
+	// hash of the sentence as written, the key of its translations, so it does not move with the lines around it
+	unsigned long long stringId;
 	buf(char) string;
+	Interpolation *interpolation;
 	bool autoSkip;
+	// clip in Voices/ played along the sentence, none by default
+	buf(char) voiceName;
+	buf(RevealTag) revealTags;
+	// compiled with the dialog, except for interpolated sentences which are compiled when displayed
+	RevealTimeline timeline;
 } Sentence;
 
+Sentence *parse_translated_sentence(const char *string, const char *tablePath, int line);
+void free_sentence(Sentence *sentence);
+
 typedef struct Choice
 {
 	Sentence *sentence;
 	GoTo *goToCommand;
 } Choice;
 
+typedef struct ConditionCache
+{
+	buf(unsigned int) dependenciesVersions;
+	bool resolved;
+	bool result;
+} ConditionCache;
+
+bool resolve_condition(VariableStore *variables, LogicExpression *logicExpression, buf(int) dependencies, ConditionCache *conditionCache);
+
 typedef struct CueExpression CueExpression;
 
 typedef struct CueCondition
 {
 	LogicExpression *logicExpression;
-	bool resolved;
-	bool result;
+	buf(int) dependencies;
+	int conditionIndex;
 	buf(CueExpression *) cueExpressionsIf;
 	buf(CueExpression *) cueExpressionsElse;
-	int currentExpression;
 } CueCondition;
 
 typedef enum CueExpressionType
@@ -173,6 +260,8 @@ typedef enum CueExpressionType
 typedef struct CueExpression
 {
 	CueExpressionType type;
+	// source line the expression starts on
+	int line;
 	union
 	{
 		Sentence *sentence;
@@ -187,9 +276,11 @@ typedef struct CueExpression
 typedef struct Cue
 {
 	buf(char) characterName;
+	// the key of the translations of the name
+	unsigned long long characterNameId;
+	Interpolation *characterNameInterpolation;
 	int characterNamePosition;
 	buf(CueExpression *) cueExpressions;
-	int currentExpression;
 	bool setCharacterCommandInDeclaration;
 } Cue;
 
@@ -198,11 +289,10 @@ typedef struct KnotExpression KnotExpression;
 typedef struct KnotCondition
 {
 	LogicExpression *logicExpression;
-	bool resolved;
-	bool result;
+	buf(int) dependencies;
+	int conditionIndex;
 	buf(KnotExpression *) knotExpressionsIf;
 	buf(KnotExpression *) knotExpressionsElse;
-	int currentExpression;
 } KnotCondition;
 
 typedef enum KnotExpressionType
@@ -217,6 +307,8 @@ typedef enum KnotExpressionType
 typedef struct KnotExpression
 {
 	KnotExpressionType type;
+	// source line the expression starts on
+	int line;
 	union
 	{
 		Cue *cue;
@@ -231,27 +323,48 @@ typedef struct Knot
 {
 	buf(char) name;
 	buf(KnotExpression *) knotExpressions;
-	int currentExpression;
+	int firstInstruction;
 } Knot;
 
+typedef struct Instruction Instruction;
+
+// a pack named by a #preload or an #unload is NULL, the session running the dialog keeps it, the others are loaded with the dialog
+// the dialog is read only once loaded, so several sessions can share it
 typedef struct Dialog
 {
 	buf(buf(char)) backgroundPacksNames;
 	buf(buf(Animation *)) backgroundPacks;
 	buf(buf(char)) charactersNames;
 	buf(buf(Animation *)) charactersAnimations;
-	buf(buf(char)) coloredNames;
-	buf(vec3) namesColors;
 	buf(buf(char)) soundsNames;
 	buf(buf(char)) musicsNames;
 	buf(Knot *) knots;
-	int currentKnot;
-	bool end;
+	buf(Instruction) instructions;
+	int nbConditions;
+	int nbInterpolations;
+	int nbSentences;
+	// the files the go tos leave for, then for every knot the ones it leaves for and the knots it leads to
+	buf(buf(char)) goToDialogsPaths;
+	buf(buf(int)) knotsGoToDialogs;
+	buf(buf(int)) knotsNextKnots;
+	// run by several sessions, all its packs are loaded
+	bool shared;
 } Dialog;
 
 Dialog *get_dialog_from_file(const char *_filePath);
 void free_dialog(Dialog *dialog);
-
-Variable *get_variable(const char *variableName);
+int get_asset_type(const char *name);
+buf(char) get_asset_path(AssetType type, const char *name);
+int find_dialog_asset(Dialog *dialog, AssetType type, const char *name);
+buf(Animation *) load_dialog_pack(Dialog *dialog, AssetType type, int index);
+void load_dialog_packs(Dialog *dialog);
+void patch_pack_textures(buf(Animation *) pack, const unsigned int *texturesIds);
+void free_pack(buf(Animation *) pack);
+
+int get_variable_slot(const char *variableName);
+void begin_background_parsing(char **variablesNames, int nbVariablesNames);
+buf(buf(char)) end_background_parsing();
+Variable *get_variable(VariableStore *variables, const char *variableName);
+void set_variable(VariableStore *variables, int variableSlot, Variable *variable);
 
 #endif /* end of include guard: DIALOG_H */
@@ -0,0 +1,445 @@
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "error.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "dialog_cache.h"
+#include "globals_dialog.h"
+#include "thread.h"
+
+// a dialog parsed by the worker, adopted by the cache on the main thread
+typedef struct DialogPrefetch
+{
+	buf(char) path;
+	// copied when the worker starts, the slots of the names it adds follow them
+	buf(char *) variablesNames;
+	Dialog *dialog;
+	long long modificationTime;
+	long long fileSize;
+	long long memory;
+	buf(buf(char)) newVariablesNames;
+	buf(DeferredTexture) textures;
+	// cleared by the worker once done, so the main thread joins it without waiting
+	int parsing;
+} DialogPrefetch;
+
+DialogCache *create_dialog_cache(long long memoryBudget)
+{
+	DialogCache *cache = xmalloc(sizeof (*cache));
+	cache->entries = NULL;
+	cache->memoryBudget = memoryBudget;
+	cache->memory = 0;
+	cache->nbUses = 0;
+	cache->nbHits = 0;
+	cache->nbMisses = 0;
+	cache->prefetchQueue = NULL;
+	cache->prefetch = NULL;
+	cache->thread = NULL;
+	cache->nbPrefetches = 0;
+	cache->nbPrefetchHits = 0;
+	cache->nbPrefetchesDropped = 0;
+	return cache;
+}
+
+static void remove_dialog_cache_entry(DialogCache *cache, int index)
+{
+	DialogCacheEntry *entry = &cache->entries[index];
+	cache->memory -= entry->memory;
+	free_dialog(entry->dialog);
+	buf_free(entry->path);
+	cache->entries[index] = cache->entries[buf_len(cache->entries) - 1];
+	_buf_header(cache->entries)->count--;
+}
+
+// the dialogs being run stay, even over budget
+static void evict_dialogs(DialogCache *cache)
+{
+	while (cache->memory > cache->memoryBudget)
+	{
+		int oldest = -1;
+		for (unsigned int i = 0; i < buf_len(cache->entries); i++)
+		{
+			if (cache->entries[i].nbUsers == 0 && (oldest == -1 || cache->entries[i].lastUse < cache->entries[oldest].lastUse))
+			{
+				oldest = i;
+			}
+		}
+		if (oldest == -1)
+		{
+			return;
+		}
+		remove_dialog_cache_entry(cache, oldest);
+	}
+}
+
+static int find_dialog_cache_entry(DialogCache *cache, const char *dialogPath)
+{
+	for (unsigned int i = 0; i < buf_len(cache->entries); i++)
+	{
+		if (!cache->entries[i].stale && strmatch(cache->entries[i].path, dialogPath))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void prefetch_dialog_worker(void *argument)
+{
+	DialogPrefetch *prefetch = argument;
+	struct stat sb;
+	// a go to a missing file is only reported if it is run
+	if (stat(prefetch->path, &sb) == 0)
+	{
+		prefetch->modificationTime = sb.st_mtime;
+		prefetch->fileSize = sb.st_size;
+		begin_allocations_scope();
+		begin_background_parsing(prefetch->variablesNames, buf_len(prefetch->variablesNames));
+		defer_textures(true);
+		long long memoryStart = get_allocated_bytes();
+		// an error in a dialog the player may never reach is only reported by the go to running it
+		jmp_buf recoveryPoint;
+		if (setjmp(recoveryPoint) == 0)
+		{
+			set_error_recovery(&recoveryPoint);
+			prefetch->dialog = get_dialog_from_file(prefetch->path);
+			set_error_recovery(NULL);
+			prefetch->memory = get_allocated_bytes() - memoryStart;
+			defer_textures(false);
+			prefetch->textures = take_deferred_textures();
+			prefetch->newVariablesNames = end_background_parsing();
+			end_allocations_scope(false);
+		} else {
+			// the textures already uploaded keep the users the parse took, they stay loaded until the program ends
+			defer_textures(false);
+			buf(DeferredTexture) textures = take_deferred_textures();
+			for (unsigned int i = 0; i < buf_len(textures); i++)
+			{
+				free_deferred_texture(&textures[i]);
+			}
+			end_allocations_scope(true);
+		}
+	}
+	__atomic_store_n(&prefetch->parsing, 0, __ATOMIC_RELEASE);
+}
+
+// the dialog is kept only if the slots it gave to new variables are still free
+static bool adopt_prefetched_dialog(DialogCache *cache, DialogPrefetch *prefetch)
+{
+	if (buf_len(prefetch->newVariablesNames) != 0 && buf_len(variablesNames) != buf_len(prefetch->variablesNames))
+	{
+		return false;
+	}
+	if (find_dialog_cache_entry(cache, prefetch->path) != -1)
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < buf_len(prefetch->newVariablesNames); i++)
+	{
+		buf_add(variablesNames, prefetch->newVariablesNames[i]);
+	}
+	buf_free(prefetch->newVariablesNames);
+	prefetch->newVariablesNames = NULL;
+
+	buf(unsigned int) texturesIds = NULL;
+	for (unsigned int i = 0; i < buf_len(prefetch->textures); i++)
+	{
+		buf_add(texturesIds, upload_deferred_texture(&prefetch->textures[i]));
+	}
+	for (unsigned int i = 0; i < buf_len(prefetch->dialog->backgroundPacks); i++)
+	{
+		patch_pack_textures(prefetch->dialog->backgroundPacks[i], texturesIds);
+	}
+	for (unsigned int i = 0; i < buf_len(prefetch->dialog->charactersAnimations); i++)
+	{
+		patch_pack_textures(prefetch->dialog->charactersAnimations[i], texturesIds);
+	}
+	buf_free(texturesIds);
+	buf_free(prefetch->textures);
+	prefetch->textures = NULL;
+
+	DialogCacheEntry entry;
+	entry.path = prefetch->path;
+	entry.dialog = prefetch->dialog;
+	entry.modificationTime = prefetch->modificationTime;
+	entry.fileSize = prefetch->fileSize;
+	entry.memory = prefetch->memory;
+	entry.lastUse = ++cache->nbUses;
+	entry.nbUsers = 0;
+	entry.stale = false;
+	entry.prefetched = true;
+	buf_add(cache->entries, entry);
+	cache->memory += entry.memory;
+	prefetch->path = NULL;
+	prefetch->dialog = NULL;
+	evict_dialogs(cache);
+	return true;
+}
+
+// waits for the worker if it is still parsing
+static void finish_prefetch(DialogCache *cache)
+{
+	DialogPrefetch *prefetch = cache->prefetch;
+	join_thread(cache->thread);
+	cache->thread = NULL;
+	cache->prefetch = NULL;
+	if (prefetch->dialog)
+	{
+		if (adopt_prefetched_dialog(cache, prefetch))
+		{
+			cache->nbPrefetches++;
+		} else {
+			cache->nbPrefetchesDropped++;
+			free_dialog(prefetch->dialog);
+			for (unsigned int i = 0; i < buf_len(prefetch->newVariablesNames); i++)
+			{
+				buf_free(prefetch->newVariablesNames[i]);
+			}
+			buf_free(prefetch->newVariablesNames);
+			for (unsigned int i = 0; i < buf_len(prefetch->textures); i++)
+			{
+				free_deferred_texture(&prefetch->textures[i]);
+			}
+			buf_free(prefetch->textures);
+		}
+	}
+	buf_free(prefetch->path);
+	buf_free(prefetch->variablesNames);
+	xfree(prefetch);
+}
+
+static void start_next_prefetch(DialogCache *cache)
+{
+	while (!cache->prefetch && buf_len(cache->prefetchQueue) != 0)
+	{
+		buf(char) dialogPath = cache->prefetchQueue[0];
+		for (unsigned int i = 1; i < buf_len(cache->prefetchQueue); i++)
+		{
+			cache->prefetchQueue[i - 1] = cache->prefetchQueue[i];
+		}
+		_buf_header(cache->prefetchQueue)->count--;
+		if (find_dialog_cache_entry(cache, dialogPath) != -1)
+		{
+			buf_free(dialogPath);
+			continue;
+		}
+
+		DialogPrefetch *prefetch = xmalloc(sizeof (*prefetch));
+		prefetch->path = dialogPath;
+		prefetch->variablesNames = NULL;
+		for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+		{
+			buf_add(prefetch->variablesNames, variablesNames[i]);
+		}
+		prefetch->dialog = NULL;
+		prefetch->memory = 0;
+		prefetch->newVariablesNames = NULL;
+		prefetch->textures = NULL;
+		prefetch->parsing = 1;
+		cache->prefetch = prefetch;
+		cache->thread = create_thread(prefetch_dialog_worker, prefetch);
+	}
+}
+
+static void unqueue_prefetch(DialogCache *cache, const char *dialogPath)
+{
+	for (unsigned int i = 0; i < buf_len(cache->prefetchQueue); i++)
+	{
+		if (strmatch(cache->prefetchQueue[i], dialogPath))
+		{
+			buf_free(cache->prefetchQueue[i]);
+			for (unsigned int j = i + 1; j < buf_len(cache->prefetchQueue); j++)
+			{
+				cache->prefetchQueue[j - 1] = cache->prefetchQueue[j];
+			}
+			_buf_header(cache->prefetchQueue)->count--;
+			return;
+		}
+	}
+}
+
+// parses the dialog only if it is not cached or if its file changed since
+Dialog *acquire_dialog(DialogCache *cache, const char *dialogPath)
+{
+	// a dialog being parsed ahead is waited for, one only queued is parsed right away
+	if (cache->prefetch && strmatch(cache->prefetch->path, dialogPath))
+	{
+		finish_prefetch(cache);
+	}
+	unqueue_prefetch(cache, dialogPath);
+
+	struct stat sb;
+	bool found = stat(dialogPath, &sb) == 0;
+	for (unsigned int i = 0; i < buf_len(cache->entries); i++)
+	{
+		DialogCacheEntry *entry = &cache->entries[i];
+		if (entry->stale || !strmatch(entry->path, dialogPath))
+		{
+			continue;
+		}
+		if (found && entry->modificationTime == (long long)sb.st_mtime && entry->fileSize == (long long)sb.st_size)
+		{
+			if (entry->prefetched)
+			{
+				entry->prefetched = false;
+				cache->nbPrefetchHits++;
+			}
+			entry->nbUsers++;
+			entry->lastUse = ++cache->nbUses;
+			cache->nbHits++;
+			return entry->dialog;
+		}
+		// a stale dialog still run is freed once released
+		if (entry->nbUsers == 0)
+		{
+			remove_dialog_cache_entry(cache, i);
+		} else {
+			entry->stale = true;
+		}
+		break;
+	}
+
+	long long memoryStart = get_allocated_bytes();
+	Dialog *dialog = get_dialog_from_file(dialogPath);
+	DialogCacheEntry entry;
+	entry.path = strclone(dialogPath);
+	entry.dialog = dialog;
+	entry.modificationTime = found ? sb.st_mtime : 0;
+	entry.fileSize = found ? sb.st_size : -1;
+	entry.memory = get_allocated_bytes() - memoryStart;
+	entry.lastUse = ++cache->nbUses;
+	entry.nbUsers = 1;
+	entry.stale = false;
+	entry.prefetched = false;
+	buf_add(cache->entries, entry);
+	cache->memory += entry.memory;
+	cache->nbMisses++;
+	evict_dialogs(cache);
+	return dialog;
+}
+
+void release_dialog(DialogCache *cache, Dialog *dialog)
+{
+	for (unsigned int i = 0; i < buf_len(cache->entries); i++)
+	{
+		DialogCacheEntry *entry = &cache->entries[i];
+		if (entry->dialog == dialog)
+		{
+			entry->nbUsers--;
+			if (entry->nbUsers == 0 && entry->stale)
+			{
+				remove_dialog_cache_entry(cache, i);
+			} else {
+				evict_dialogs(cache);
+			}
+			return;
+		}
+	}
+	error("released a dialog not acquired from the cache.");
+}
+
+void prefetch_dialog(DialogCache *cache, const char *dialogPath)
+{
+	// nothing parsed ahead would be kept
+	if (cache->memoryBudget <= 0)
+	{
+		return;
+	}
+	if (find_dialog_cache_entry(cache, dialogPath) != -1 || (cache->prefetch && strmatch(cache->prefetch->path, dialogPath)))
+	{
+		return;
+	}
+	for (unsigned int i = 0; i < buf_len(cache->prefetchQueue); i++)
+	{
+		if (strmatch(cache->prefetchQueue[i], dialogPath))
+		{
+			return;
+		}
+	}
+	buf_add(cache->prefetchQueue, strclone(dialogPath));
+	start_next_prefetch(cache);
+}
+
+// replaces the dialogs queued by the previous knot with the nearest ones this knot leads to
+void prefetch_knot_dialogs(DialogCache *cache, Dialog *dialog, int knot)
+{
+	for (unsigned int i = 0; i < buf_len(cache->prefetchQueue); i++)
+	{
+		buf_free(cache->prefetchQueue[i]);
+	}
+	buf_clear(cache->prefetchQueue);
+
+	int nbKnots = buf_len(dialog->knots);
+	bool *visited = xmalloc(sizeof (*visited) * nbKnots);
+	for (int i = 0; i < nbKnots; i++)
+	{
+		visited[i] = false;
+	}
+	// breadth first, so the dialogs left for in fewer knots come first
+	buf(int) knots = NULL;
+	buf_add(knots, knot);
+	visited[knot] = true;
+	int nbPrefetches = 0;
+	for (unsigned int i = 0; i < buf_len(knots) && nbPrefetches < DIALOG_PREFETCH_LIMIT; i++)
+	{
+		buf(int) goToDialogs = dialog->knotsGoToDialogs[knots[i]];
+		for (unsigned int j = 0; j < buf_len(goToDialogs) && nbPrefetches < DIALOG_PREFETCH_LIMIT; j++)
+		{
+			prefetch_dialog(cache, dialog->goToDialogsPaths[goToDialogs[j]]);
+			nbPrefetches++;
+		}
+		buf(int) nextKnots = dialog->knotsNextKnots[knots[i]];
+		for (unsigned int j = 0; j < buf_len(nextKnots); j++)
+		{
+			if (!visited[nextKnots[j]])
+			{
+				visited[nextKnots[j]] = true;
+				buf_add(knots, nextKnots[j]);
+			}
+		}
+	}
+	buf_free(knots);
+	xfree(visited);
+}
+
+// adopts the dialog the worker is done with and starts it on the next one
+void update_dialog_cache(DialogCache *cache)
+{
+	if (cache->prefetch && !__atomic_load_n(&cache->prefetch->parsing, __ATOMIC_ACQUIRE))
+	{
+		finish_prefetch(cache);
+	}
+	start_next_prefetch(cache);
+}
+
+// frees every dialog, even the ones still run
+void free_dialog_cache(DialogCache *cache)
+{
+	if (cache->prefetch)
+	{
+		finish_prefetch(cache);
+	}
+	for (unsigned int i = 0; i < buf_len(cache->prefetchQueue); i++)
+	{
+		buf_free(cache->prefetchQueue[i]);
+	}
+	buf_free(cache->prefetchQueue);
+	while (buf_len(cache->entries) != 0)
+	{
+		remove_dialog_cache_entry(cache, buf_len(cache->entries) - 1);
+	}
+	buf_free(cache->entries);
+	xfree(cache);
+}
@@ -0,0 +1,52 @@
+#ifndef DIALOG_CACHE_H
+#define DIALOG_CACHE_H
+
+typedef struct DialogCacheEntry
+{
+	buf(char) path;
+	Dialog *dialog;
+	// the file as it was parsed, a change makes the entry stale
+	long long modificationTime;
+	long long fileSize;
+	// bytes allocated to parse the dialog and load its packs
+	long long memory;
+	unsigned long long lastUse;
+	int nbUsers;
+	bool stale;
+	// parsed ahead and not acquired yet
+	bool prefetched;
+} DialogCacheEntry;
+
+// dialogs a knot can lead to that are parsed ahead, nearest first
+#define DIALOG_PREFETCH_LIMIT 3
+
+// parsed dialogs kept once left, so going back to a recent one skips parsing it and loading its packs
+// the least recently used dialogs nobody runs are freed once the cache goes over its memory budget
+// a cache serves a single session, whose preloader keeps the packs its dialogs leave out
+typedef struct DialogCache
+{
+	buf(DialogCacheEntry) entries;
+	long long memoryBudget;
+	long long memory;
+	unsigned long long nbUses;
+	int nbHits;
+	int nbMisses;
+	// the dialogs the current knot can lead to are parsed ahead by a worker, one at a time
+	buf(buf(char)) prefetchQueue;
+	struct DialogPrefetch *prefetch;
+	struct Thread *thread;
+	int nbPrefetches;
+	int nbPrefetchHits;
+	// parsed while other dialogs added variables, so their slots were wrong
+	int nbPrefetchesDropped;
+} DialogCache;
+
+DialogCache *create_dialog_cache(long long memoryBudget);
+Dialog *acquire_dialog(DialogCache *cache, const char *dialogPath);
+void release_dialog(DialogCache *cache, Dialog *dialog);
+void prefetch_dialog(DialogCache *cache, const char *dialogPath);
+void prefetch_knot_dialogs(DialogCache *cache, Dialog *dialog, int knot);
+void update_dialog_cache(DialogCache *cache);
+void free_dialog_cache(DialogCache *cache);
+
+#endif /* end of include guard: DIALOG_CACHE_H */
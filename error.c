@@ -0,0 +1,22 @@
+#include <setjmp.h>
+#include <stddef.h>
+
+#include "error.h"
+
+// set by the threads only running something ahead of time
+static __thread jmp_buf *recoveryPoint = NULL;
+
+void set_error_recovery(void *point)
+{
+	recoveryPoint = point;
+}
+
+void recover_from_error()
+{
+	if (recoveryPoint)
+	{
+		jmp_buf *point = recoveryPoint;
+		recoveryPoint = NULL;
+		longjmp(*point, 1);
+	}
+}
@@ -12,5 +12,8 @@
 
 NO_RETURN void error(const char *string, ...);
 void warning(const char *string, ...);
+// until cleared with NULL, an error() of the calling thread jumps back to the jmp_buf instead of exiting
+void set_error_recovery(void *point);
+void recover_from_error();
 
 #endif /* end of include guard: ERROR_H */
\ No newline at end of file
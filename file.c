@@ -1,9 +1,22 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include <sys/stat.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include "error.h"
+#include "stretchy_buffer.h"
 #include "xalloc.h"
+#include "str.h"
 #include "file.h"
 
 bool check_file(const char *path)
@@ -46,4 +59,111 @@ char *file_to_string(const char *filePath)
 	fclose(file);
 
 	return fileString;
-}
\ No newline at end of file
+}
+
+static bool write_file_with_mode(const char *path, const char *mode, const void *data, size_t size)
+{
+	FILE *file = fopen(path, mode);
+	if (!file)
+	{
+		return false;
+	}
+	bool written = fwrite(data, 1, size, file) == size && fflush(file) == 0;
+#ifdef _WIN32
+	written = written && _commit(_fileno(file)) == 0;
+#else
+	written = written && fsync(fileno(file)) == 0;
+#endif
+	return fclose(file) == 0 && written;
+}
+
+// flushed to the disk before returning, so that a rename never exposes a partly written file
+bool write_file_durably(const char *path, const void *data, size_t size)
+{
+	return write_file_with_mode(path, "wb", data, size);
+}
+
+bool append_file_durably(const char *path, const void *data, size_t size)
+{
+	return write_file_with_mode(path, "ab", data, size);
+}
+
+bool replace_file(const char *source, const char *destination)
+{
+#ifdef _WIN32
+	return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	return rename(source, destination) == 0;
+#endif
+}
+
+// renames only last a crash once the directory holding them is synced, windows writes them through already
+void sync_directory(const char *path)
+{
+#ifndef _WIN32
+	const char *separator = strrchr(path, '/');
+	buf(char) directory = separator ? strclonen(path, separator - path + 1) : strclone(".");
+	int descriptor = open(directory, O_RDONLY);
+	if (descriptor != -1)
+	{
+		fsync(descriptor);
+		close(descriptor);
+	}
+	buf_free(directory);
+#endif
+}
+
+// maps a whole file read only, NULL if it is missing or empty
+const unsigned char *map_file(const char *path, size_t *size)
+{
+	*size = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+	LARGE_INTEGER fileSize;
+	const unsigned char *data = NULL;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+		{
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+		*size = data ? fileSize.QuadPart : 0;
+	}
+	CloseHandle(file);
+	return data;
+#else
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor == -1)
+	{
+		return NULL;
+	}
+	struct stat sb;
+	const unsigned char *data = NULL;
+	if (fstat(descriptor, &sb) == 0 && sb.st_size > 0)
+	{
+		void *mapping = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (mapping != MAP_FAILED)
+		{
+			data = mapping;
+			*size = sb.st_size;
+		}
+	}
+	close(descriptor);
+	return data;
+#endif
+}
+
+void unmap_file(const unsigned char *data, size_t size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
@@ -4,5 +4,11 @@
 bool check_file(const char *path);
 bool check_directory(const char *path);
 char *file_to_string(const char *filePath);
+bool write_file_durably(const char *path, const void *data, size_t size);
+bool append_file_durably(const char *path, const void *data, size_t size);
+bool replace_file(const char *source, const char *destination);
+void sync_directory(const char *path);
+const unsigned char *map_file(const char *path, size_t *size);
+void unmap_file(const unsigned char *data, size_t size);
 
 #endif /* end of include guard: FILE_H */
\ No newline at end of file
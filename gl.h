@@ -87,6 +87,7 @@
 	GL_FUNCTION(void,			glEnable,					int cap) \
 	GL_FUNCTION(void,			glDisable,					int cap) \
 	GL_FUNCTION(void,			glGenTextures,				int n, unsigned int *textures) \
+	GL_FUNCTION(void,			glDeleteTextures,			int n, const unsigned int *textures) \
 	GL_FUNCTION(void,			glPixelStorei,				int pname, int param) \
 	GL_FUNCTION(void,			glTexImage2D,				int target, int level,	int internalFormat, int width, int height, int border, int format, int type, const void *data) \
 	GL_FUNCTION(void,			glTexParameteri,			int target, int pname, int param) \
@@ -18,6 +18,7 @@
 #include "str.h"
 #include "animation.h"
 #include "graphics.h"
+#include "thread.h"
 
 static buf(Sprite *) backgroundSprites;
 static buf(Sprite *) middlegroundSprites;
@@ -29,6 +30,13 @@ static buf(buf(char)) texturesPaths;
 static buf(unsigned int) texturesIds;
 static buf(int) texturesWidths;
 static buf(int) texturesHeigts;
+// the references handed out to each texture, the last one released deletes it
+static buf(int) texturesUsers;
+// only the main thread adds textures, the threads deferring theirs look them up under this lock
+static Mutex *texturesMutex;
+
+static __thread bool deferringTextures = false;
+static __thread buf(DeferredTexture) deferredTextures = NULL;
 
 static buf(Font *) fonts;
 static buf(unsigned char *) ttfBuffers;
@@ -99,6 +107,8 @@ void init_graphics()
 	texturesIds = NULL;
 	texturesWidths = NULL;
 	texturesHeigts = NULL;
+	texturesUsers = NULL;
+	texturesMutex = create_mutex();
 
 	fonts = NULL;
 	ttfBuffers = NULL;
@@ -172,6 +182,8 @@ void free_graphics()
 	buf_free(texturesIds);
 	buf_free(texturesWidths);
 	buf_free(texturesHeigts);
+	buf_free(texturesUsers);
+	free_mutex(texturesMutex);
 
 	for (unsigned int i = 0; i < buf_len(fonts); i++)
 	{
@@ -180,24 +192,20 @@ void free_graphics()
 	buf_free(fonts);
 }
 
-unsigned int get_texture_id_from_path(const char *texturePath, int *_width, int *_height)
+static int find_texture(const char *texturePath)
 {
 	for (unsigned int i = 0; i < buf_len(texturesPaths); i++)
 	{
 		if(strmatch(texturesPaths[i], texturePath))
 		{
-			if (_width)
-			{
-				*_width = texturesWidths[i];
-			}
-			if (_height)
-			{
-				*_height = texturesHeigts[i];
-			}
-			return texturesIds[i];
+			return i;
 		}
 	}
+	return -1;
+}
 
+static unsigned int upload_texture(const char *texturePath, unsigned char *data, int width, int height, int nbUsers)
+{
 	unsigned int textureId;
 	glGenTextures(1, &textureId);
 	glBindTexture(GL_TEXTURE_2D, textureId);
@@ -207,13 +215,105 @@ unsigned int get_texture_id_from_path(const char *texturePath, int *_width, int
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+
+	lock_mutex(texturesMutex);
+	buf_add(texturesPaths, strclone(texturePath));
+	buf_add(texturesIds, textureId);
+	buf_add(texturesWidths, width);
+	buf_add(texturesHeigts, height);
+	buf_add(texturesUsers, nbUsers);
+	unlock_mutex(texturesMutex);
+
+	return textureId;
+}
+
+// textures already uploaded are shared, the others are only decoded
+static unsigned int get_deferred_texture_id(const char *texturePath, int *_width, int *_height)
+{
+	unsigned int textureId = 0;
+	int width = 0;
+	int height = 0;
+	bool found = false;
+	lock_mutex(texturesMutex);
+	int index = find_texture(texturePath);
+	if (index != -1)
+	{
+		textureId = texturesIds[index];
+		width = texturesWidths[index];
+		height = texturesHeigts[index];
+		texturesUsers[index]++;
+		found = true;
+	}
+	unlock_mutex(texturesMutex);
+
+	for (unsigned int i = 0; !found && i < buf_len(deferredTextures); i++)
+	{
+		if (strmatch(deferredTextures[i].path, texturePath))
+		{
+			textureId = DEFERRED_TEXTURE_FLAG | i;
+			width = deferredTextures[i].width;
+			height = deferredTextures[i].height;
+			deferredTextures[i].nbUsers++;
+			found = true;
+		}
+	}
+
+	if (!found)
+	{
+		int nrChannels;
+		unsigned char *data = stbi_load(texturePath, &width, &height, &nrChannels, 4);
+		if (!data)
+		{
+			error("failed to load texture %s.", texturePath);
+		}
+		DeferredTexture deferredTexture = {strclone(texturePath), data, width, height, 1};
+		buf_add(deferredTextures, deferredTexture);
+		textureId = DEFERRED_TEXTURE_FLAG | (buf_len(deferredTextures) - 1);
+	}
+
+	if (_width)
+	{
+		*_width = width;
+	}
+	if (_height)
+	{
+		*_height = height;
+	}
+	return textureId;
+}
+
+unsigned int get_texture_id_from_path(const char *texturePath, int *_width, int *_height)
+{
+	if (deferringTextures)
+	{
+		return get_deferred_texture_id(texturePath, _width, _height);
+	}
+
+	int index = find_texture(texturePath);
+	if (index != -1)
+	{
+		if (_width)
+		{
+			*_width = texturesWidths[index];
+		}
+		if (_height)
+		{
+			*_height = texturesHeigts[index];
+		}
+		lock_mutex(texturesMutex);
+		texturesUsers[index]++;
+		unlock_mutex(texturesMutex);
+		return texturesIds[index];
+	}
+
 	int width;
 	int height;
 	int nrChannels;
 	unsigned char *data = stbi_load(texturePath, &width, &height, &nrChannels, 4);
 	if (data)
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		unsigned int textureId = upload_texture(texturePath, data, width, height, 1);
 		stbi_image_free(data);
 		if (_width)
 		{
@@ -223,18 +323,81 @@ unsigned int get_texture_id_from_path(const char *texturePath, int *_width, int
 		{
 			*_height = height;
 		}
-
-		buf_add(texturesPaths, strclone(texturePath));
-		buf_add(texturesIds, textureId);
-		buf_add(texturesWidths, width);
-		buf_add(texturesHeigts, height);
-
 		return textureId;
 	} else {
 		error("failed to load texture %s.", texturePath);
 	}
 }
 
+// the textures the calling thread loads from now on are only decoded, until it takes them
+void defer_textures(bool defer)
+{
+	deferringTextures = defer;
+}
+
+buf(DeferredTexture) take_deferred_textures()
+{
+	buf(DeferredTexture) result = deferredTextures;
+	deferredTextures = NULL;
+	return result;
+}
+
+// on the main thread, the texture may have been loaded since it was decoded
+unsigned int upload_deferred_texture(DeferredTexture *texture)
+{
+	unsigned int textureId;
+	int index = find_texture(texture->path);
+	if (index != -1)
+	{
+		textureId = texturesIds[index];
+		lock_mutex(texturesMutex);
+		texturesUsers[index] += texture->nbUsers;
+		unlock_mutex(texturesMutex);
+	} else {
+		textureId = upload_texture(texture->path, texture->pixels, texture->width, texture->height, texture->nbUsers);
+	}
+	free_deferred_texture(texture);
+	return textureId;
+}
+
+// on the main thread, once for every time the id was handed out
+void release_texture(unsigned int textureId)
+{
+	lock_mutex(texturesMutex);
+	for (unsigned int i = 0; i < buf_len(texturesIds); i++)
+	{
+		if (texturesIds[i] == textureId)
+		{
+			texturesUsers[i]--;
+			if (texturesUsers[i] == 0)
+			{
+				glDeleteTextures(1, &texturesIds[i]);
+				buf_free(texturesPaths[i]);
+				unsigned int last = buf_len(texturesIds) - 1;
+				texturesPaths[i] = texturesPaths[last];
+				texturesIds[i] = texturesIds[last];
+				texturesWidths[i] = texturesWidths[last];
+				texturesHeigts[i] = texturesHeigts[last];
+				texturesUsers[i] = texturesUsers[last];
+				_buf_header(texturesPaths)->count--;
+				_buf_header(texturesIds)->count--;
+				_buf_header(texturesWidths)->count--;
+				_buf_header(texturesHeigts)->count--;
+				_buf_header(texturesUsers)->count--;
+			}
+			break;
+		}
+	}
+	unlock_mutex(texturesMutex);
+}
+
+void free_deferred_texture(DeferredTexture *texture)
+{
+	stbi_image_free(texture->pixels);
+	texture->pixels = NULL;
+	buf_free(texture->path);
+}
+
 Sprite *create_sprite(SpriteType spriteType)
 {
 	Sprite *sprite = xmalloc(sizeof (*sprite));
@@ -262,6 +425,8 @@ Sprite *create_sprite(SpriteType spriteType)
 		sprite->type = SPRITE_ANIMATED;
 		sprite->animations = NULL;
 		sprite->currentAnimation = 0;
+		reset_animation(&sprite->animationCursor);
+		sprite->lipSyncPhase = -1;
 	} else {
 		error("sprite type %d not supported.", spriteType);
 	}
@@ -374,20 +539,36 @@ Text *create_text()
 	text->font = NULL;
 	text->codes = NULL;
 	text->sprites = NULL;
+	text->lineStarts = NULL;
 	text->widthLimit = -1;
 	text->position.x = 0;
 	text->position.y = 0;
+	text->nbCharToDisplay = 0;
+	text->nbMaxCharToDisplay = 0;
 	return text;
 }
 
-static void update_text(Text *text)
+// the lines ending before firstChangedCode keep their sprites, the layout starts again at the first line the change can move
+static void update_text(Text *text, int firstChangedCode)
 {
-	text->width = 0;
+	unsigned int nbLineStarts = 0;
+	bool sameColor = text->laidOutColor.x == text->color.x && text->laidOutColor.y == text->color.y && text->laidOutColor.z == text->color.z;
+	while (nbLineStarts < buf_len(text->lineStarts) && sameColor && text->lineStarts[nbLineStarts].lastCodeIndex + 1 < firstChangedCode)
+	{
+		nbLineStarts++;
+	}
+	if (text->lineStarts)
+	{
+		_buf_header(text->lineStarts)->count = nbLineStarts;
+	}
+	TextLineStart start = nbLineStarts == 0 ? (TextLineStart){0, 0, 0, 1, 0} : text->lineStarts[nbLineStarts - 1];
+	text->width = start.width;
 	int currentLineWidth = 0;
-	int currentLine = 1;
-	int displayedSpriteCount = 0;
+	int currentLine = start.line;
+	int displayedSpriteCount = start.spriteIndex;
+	text->laidOutColor = text->color;
 
-	for (unsigned int currentCodeIndex = 0; currentCodeIndex < buf_len(text->codes); currentCodeIndex++)
+	for (unsigned int currentCodeIndex = start.codeIndex; currentCodeIndex < buf_len(text->codes); currentCodeIndex++)
 	{
 		int currentCode = text->codes[currentCodeIndex];
 
@@ -478,6 +659,8 @@ static void update_text(Text *text)
 				}
 				currentLineWidth = 0;
 				currentLine++;
+				TextLineStart lineStart = {currentCodeIndex + 1, oldCodeIndex, displayedSpriteCount, currentLine, text->width};
+				buf_add(text->lineStarts, lineStart);
 			}
 		}
 	}
@@ -494,7 +677,7 @@ void set_text_width_limit(Text *text, int limit)
 	text->widthLimit = limit;
 	if (text->codes)
 	{
-		update_text(text);
+		update_text(text, 0);
 	}
 }
 
@@ -504,7 +687,7 @@ void set_text_position(Text *text, ivec2 position)
 	text->position.y -= 2;
 	if (text->codes)
 	{
-		update_text(text);
+		update_text(text, 0);
 	}
 }
 
@@ -543,23 +726,25 @@ void set_text_font(Text *text, const char *fontPath, int textHeight)
 
 	if (text->codes)
 	{
-		update_text(text);
+		update_text(text, 0);
 	}
 }
 
 void set_text_string(Text *text, const char *string)
 {
-	buf_free(text->codes);
-	text->codes = NULL;
-
-	if (string)
+	int *codes = string ? utf8_decode(string) : NULL;
+	// a string interpolated again only changes from its first variable on
+	int firstChangedCode = 0;
+	while (firstChangedCode < (int)buf_len(codes) && firstChangedCode < (int)buf_len(text->codes) && codes[firstChangedCode] == text->codes[firstChangedCode])
 	{
-		text->codes = utf8_decode(string);
+		firstChangedCode++;
 	}
+	buf_free(text->codes);
+	text->codes = codes;
 
 	if (text->codes)
 	{
-		update_text(text);
+		update_text(text, firstChangedCode);
 		text->nbCharToDisplay = text->nbMaxCharToDisplay;
 	}
 }
@@ -567,6 +752,7 @@ void set_text_string(Text *text, const char *string)
 void free_text(Text *text)
 {
 	buf_free(text->codes);
+	buf_free(text->lineStarts);
 	for (unsigned int i = 0; i < buf_len(text->sprites); i++)
 	{
 		free_sprite(text->sprites[i]);
@@ -610,7 +796,7 @@ static void draw(Sprite *sprite)
 	AnimationPhase *currentAnimationPhase;
 	if (sprite->type == SPRITE_ANIMATED)
 	{
-		currentAnimationPhase = sprite->animations[sprite->currentAnimation]->animationPhases[sprite->animations[sprite->currentAnimation]->currentAnimationPhase];
+		currentAnimationPhase = sprite->animations[sprite->currentAnimation]->animationPhases[sprite->lipSyncPhase != -1 ? sprite->lipSyncPhase : sprite->animationCursor.currentAnimationPhase];
 		if (!sprite->fixedSize)
 		{
 			if (currentAnimationPhase->responsiveHeight)
@@ -622,7 +808,7 @@ static void draw(Sprite *sprite)
 				sprite->height = currentAnimationPhase->pixelHeight;
 			}
 		}
-		update_animation(sprite->animations[sprite->currentAnimation]);
+		update_animation(sprite->animations[sprite->currentAnimation], &sprite->animationCursor);
 	}
 
 	mat4 model = mat4_identity();
@@ -20,6 +20,10 @@ typedef struct Sprite
 	int textureId;
 	buf(Animation *) animations;
 	int currentAnimation;
+	AnimationCursor animationCursor;
+	// drawn instead of the phase of the cursor while the sprite lip-syncs a voice, -1 otherwise
+	// never saved, so that saves and replays do not depend on the audio device
+	int lipSyncPhase;
 	bool fixedSize;
 } Sprite;
 
@@ -50,11 +54,25 @@ typedef	struct Font
 	bool *loaded;
 } Font;
 
+// the layout where a wrapped line starts, kept so a string changed past it is laid out from there
+typedef struct TextLineStart
+{
+	int codeIndex;
+	// the last code the wrap depended on
+	int lastCodeIndex;
+	int spriteIndex;
+	int line;
+	int width;
+} TextLineStart;
+
 typedef struct Text
 {
 	Font *font;
 	int *codes;
 	buf(Sprite *) sprites;
+	buf(TextLineStart) lineStarts;
+	// the color the sprites were given at the last layout
+	vec3 laidOutColor;
 	ivec2 position;
 	int width;
 	int height;
@@ -96,4 +114,24 @@ void draw_all();
 
 unsigned int get_texture_id_from_path(const char *texturePath, int *width, int *height);
 
+// a texture decoded by a thread without the graphics context, uploaded later by the main thread
+typedef struct DeferredTexture
+{
+	buf(char) path;
+	unsigned char *pixels;
+	int width;
+	int height;
+	// the animation phases of the thread using it
+	int nbUsers;
+} DeferredTexture;
+
+// set on the ids handed out for deferred textures, along with their index in the deferred textures
+#define DEFERRED_TEXTURE_FLAG 0x40000000
+
+void defer_textures(bool defer);
+buf(DeferredTexture) take_deferred_textures();
+unsigned int upload_deferred_texture(DeferredTexture *texture);
+void release_texture(unsigned int textureId);
+void free_deferred_texture(DeferredTexture *texture);
+
 #endif /* end of include guard: GRAPHICS_H */
@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../error.h"
+#include "../xalloc.h"
+#include "../file.h"
+#include "../audio.h"
+
+// nothing is decoded or played, a missing file is only a warning as the musics are not shipped with the repository
+
+void init_audio()
+{
+}
+
+AudioSource *create_audio_source(const char *fileName)
+{
+	if (!check_file(fileName))
+	{
+		warning("could not decode %s.", fileName);
+	}
+	AudioSource *audioSource = xmalloc(sizeof (*audioSource));
+	audioSource->id = -1;
+	audioSource->volume = 1.0f;
+	audioSource->playing = false;
+	return audioSource;
+}
+
+void reset_audio_source(AudioSource *audioSource)
+{
+}
+
+void stop_audio_source(AudioSource *audioSource)
+{
+}
+
+void free_audio()
+{
+}
+
+struct VoiceChannel
+{
+	int nbPlays;
+};
+
+VoiceChannel *create_voice_channel()
+{
+	VoiceChannel *channel = xmalloc(sizeof (*channel));
+	channel->nbPlays = 0;
+	return channel;
+}
+
+void prefetch_voice(VoiceChannel *channel, const char *fileName)
+{
+}
+
+void play_voice(VoiceChannel *channel, const char *fileName)
+{
+	if (!check_file(fileName))
+	{
+		warning("could not decode %s.", fileName);
+	}
+	channel->nbPlays++;
+}
+
+void stop_voice(VoiceChannel *channel)
+{
+}
+
+float get_voice_level(VoiceChannel *channel)
+{
+	return 0.0f;
+}
+
+void update_voice_channel(VoiceChannel *channel)
+{
+}
+
+void free_voice_channel(VoiceChannel *channel)
+{
+	xfree(channel);
+}
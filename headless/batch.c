@@ -0,0 +1,174 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../audio.h"
+#include "../maths.h"
+#include "../user_input.h"
+#include "../stretchy_buffer.h"
+#include "../xalloc.h"
+#include "../error.h"
+#include "../str.h"
+#include "../animation.h"
+#include "../graphics.h"
+#include "../variable.h"
+#include "../dialog.h"
+#include "../bytecode.h"
+#include "../interpret.h"
+#include "library.h"
+#include "batch.h"
+
+static int nbBatchSessions;
+static float batchTimestep;
+static int batchMaxFrames;
+static unsigned int batchSeed;
+static volatile int nextSessionIndex;
+
+typedef struct WorkerReport
+{
+	int nbSessions;
+	int nbEndedSessions;
+	long long nbFrames;
+} WorkerReport;
+
+static unsigned int next_random(unsigned int *random)
+{
+	*random ^= *random << 13;
+	*random ^= *random >> 17;
+	*random ^= *random << 5;
+	return *random;
+}
+
+// goes through sentences as fast as the reveal allows, and picks a random answer to every choice
+static void run_session(int sessionIndex, WorkerReport *report)
+{
+	Session *session = create_session();
+	set_session_dialog(session, loadedDialogs[0], loadedDialogsPaths[0]);
+	unsigned int random = batchSeed + sessionIndex * 2654435761u;
+	if (!random)
+	{
+		random = 1;
+	}
+	int choiceTarget = -1;
+	bool ended = false;
+	int frame;
+
+	for (frame = 0; frame < batchMaxFrames; frame++)
+	{
+		for (int i = 0; i < INPUT_KEY_COUNT; i++)
+		{
+			session->inputKeysPressed[i] = false;
+		}
+		if (session->state && session->state->choosing)
+		{
+			if (choiceTarget == -1)
+			{
+				choiceTarget = next_random(&random) % session->state->nbChoices;
+			}
+			if (session->state->currentChoice != choiceTarget)
+			{
+				session->inputKeysPressed[INPUT_KEY_DOWN_ARROW] = true;
+			} else {
+				session->inputKeysPressed[INPUT_KEY_ENTER] = true;
+				choiceTarget = -1;
+			}
+		} else if (frame % 2) {
+			session->inputKeysPressed[INPUT_KEY_SPACE] = true;
+		} else {
+			session->inputKeysPressed[INPUT_KEY_ENTER] = true;
+		}
+		session->deltaTime = batchTimestep;
+
+		if (session->nextDialogName)
+		{
+			int dialogIndex = find_loaded_dialog(session->nextDialogName);
+			if (dialogIndex == -1)
+			{
+				error("dialog %s was not loaded before the batch started.", session->nextDialogName);
+			}
+			set_session_dialog(session, loadedDialogs[dialogIndex], session->nextDialogName);
+		}
+		if (!update_session(session))
+		{
+			ended = true;
+			frame++;
+			break;
+		}
+	}
+
+	free_session(session);
+	report->nbSessions++;
+	report->nbFrames += frame;
+	if (ended)
+	{
+		report->nbEndedSessions++;
+	}
+}
+
+static void *run_worker(void *workerReport)
+{
+	WorkerReport *report = workerReport;
+	while (true)
+	{
+		int sessionIndex = __sync_fetch_and_add(&nextSessionIndex, 1);
+		if (sessionIndex >= nbBatchSessions)
+		{
+			break;
+		}
+		run_session(sessionIndex, report);
+	}
+	return NULL;
+}
+
+void run_batch(const char *dialogPath, int nbSessions, int nbThreads, float timestep, int maxFrames, unsigned int seed)
+{
+	load_reachable_dialogs(dialogPath);
+
+	nbBatchSessions = nbSessions;
+	batchTimestep = timestep;
+	batchMaxFrames = maxFrames;
+	batchSeed = seed;
+	nextSessionIndex = 0;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_t *threads = xmalloc(nbThreads * sizeof (*threads));
+	WorkerReport *reports = xmalloc(nbThreads * sizeof (*reports));
+	for (int i = 0; i < nbThreads; i++)
+	{
+		reports[i] = (WorkerReport){0, 0, 0};
+		if (pthread_create(&threads[i], NULL, run_worker, &reports[i]))
+		{
+			error("could not start worker thread %d.", i);
+		}
+	}
+	WorkerReport total = {0, 0, 0};
+	for (int i = 0; i < nbThreads; i++)
+	{
+		pthread_join(threads[i], NULL);
+		total.nbSessions += reports[i].nbSessions;
+		total.nbEndedSessions += reports[i].nbEndedSessions;
+		total.nbFrames += reports[i].nbFrames;
+	}
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double runTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("---Batch run---\n");
+	printf("%d sessions on %d threads, %d dialogs shared.\n", total.nbSessions, nbThreads, (int)buf_len(loadedDialogs));
+	printf("%d sessions ended, %d stopped after %d frames.\n", total.nbEndedSessions, total.nbSessions - total.nbEndedSessions, maxFrames);
+	printf("%lld frames in %.3fs, %.0f frames/s, %.1f sessions/s.\n", total.nbFrames, runTime, runTime > 0.0 ? total.nbFrames / runTime : 0.0, runTime > 0.0 ? total.nbSessions / runTime : 0.0);
+	for (int i = 0; i < nbThreads; i++)
+	{
+		printf("	-thread %d : %d sessions, %lld frames\n", i, reports[i].nbSessions, reports[i].nbFrames);
+	}
+	printf("\n");
+
+	xfree(threads);
+	xfree(reports);
+	free_loaded_dialogs();
+}
@@ -0,0 +1,6 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+void run_batch(const char *dialogPath, int nbSessions, int nbThreads, float timestep, int maxFrames, unsigned int seed);
+
+#endif /* end of include guard: BATCH_H */
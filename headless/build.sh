@@ -0,0 +1,3 @@
+#!/bin/sh
+# run from the repository root, the interpreter loads Dialogs/, Images/, Fonts/ and Sounds/ relatively to it
+gcc -Wall -Werror -O2 -g -o headless/VisualNovelInterpreterHeadless headless/*.c animation.c autosave.c backlog.c bytecode.c dialog.c dialog_cache.c error.c file.c history.c interpret.c save.c binary.c lex.c maths.c localization.c persistent.c preload.c profile.c read_status.c replay.c str.c stretchy_buffer.c thread.c token.c tween.c variable.c xalloc.c -std=c99 -D_POSIX_C_SOURCE=199309L -lm -pthread
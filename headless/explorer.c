@@ -0,0 +1,695 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "../maths.h"
+#include "../stretchy_buffer.h"
+#include "../xalloc.h"
+#include "../error.h"
+#include "../str.h"
+#include "../animation.h"
+#include "../graphics.h"
+#include "../variable.h"
+#include "../dialog.h"
+#include "../bytecode.h"
+#include "../globals_dialog.h"
+#include "library.h"
+#include "explorer.h"
+
+// The explorer only follows what decides a route : assignments, conditions, choices and go tos.
+// Every state where the player has to choose is a node, keyed by its dialog, instruction and variables values,
+// so a state reached through different routes is only expanded once.
+
+typedef enum ExplorerNodeType
+{
+	EXPLORER_NODE_CHOICE,
+	EXPLORER_NODE_ENDING,
+	EXPLORER_NODE_DEAD_END
+} ExplorerNodeType;
+
+typedef struct ExplorerNode ExplorerNode;
+
+typedef struct ExplorerNode
+{
+	ExplorerNodeType type;
+	unsigned long long hash;
+	buf(unsigned char) key;
+	int dialogIndex;
+	// choose instruction for a choice, ending knot for an ending, failing instruction for a dead end
+	int programCounter;
+	VariableStore *variables;
+	buf(int) choices;
+	buf(ExplorerNode *) children;
+	buf(char) deadEndReason;
+	ExplorerNode *next;
+	int index;
+} ExplorerNode;
+
+typedef struct ExplorerWorker
+{
+	pthread_t thread;
+	pthread_mutex_t pendingLock;
+	buf(ExplorerNode *) pending;
+	unsigned int pendingStart;
+	buf(bool) knotsReached;
+	unsigned int random;
+} ExplorerWorker;
+
+#define EXPLORER_BUCKETS_COUNT (1 << 16)
+#define EXPLORER_LOCKS_COUNT 64
+
+static const int MAX_INSTRUCTIONS_WITHOUT_CHOICE = 1000000;
+static const int MAX_NODES = 2000000;
+
+static ExplorerNode *buckets[EXPLORER_BUCKETS_COUNT];
+static pthread_mutex_t bucketsLocks[EXPLORER_LOCKS_COUNT];
+static volatile int nbNodes;
+static volatile int nbPendingNodes;
+static volatile bool truncated;
+
+static ExplorerWorker *workers;
+static int nbWorkers;
+
+// for every instruction of every loaded dialog, the knot it belongs to
+static buf(buf(int)) knotsOfInstructions;
+static buf(int) knotsOffsets;
+static int nbKnots;
+
+static void add_key_bytes(buf(unsigned char) *key, const void *bytes, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		buf_add(*key, ((const unsigned char *)bytes)[i]);
+	}
+}
+
+static buf(unsigned char) create_key(ExplorerNodeType type, int dialogIndex, int programCounter, VariableStore *variables)
+{
+	buf(unsigned char) key = NULL;
+	unsigned char keyType = type;
+	add_key_bytes(&key, &keyType, sizeof (keyType));
+	add_key_bytes(&key, &dialogIndex, sizeof (dialogIndex));
+	add_key_bytes(&key, &programCounter, sizeof (programCounter));
+	if (variables)
+	{
+		for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+		{
+			Variable *variable = get_variable_store_value(variables, i);
+			if (!variable)
+			{
+				continue;
+			}
+			int slot = i;
+			add_key_bytes(&key, &slot, sizeof (slot));
+			if (variable->type == VARIABLE_NUMERIC)
+			{
+				add_key_bytes(&key, &variable->numeric, sizeof (variable->numeric));
+			} else {
+				add_key_bytes(&key, variable->string, buf_len(variable->string));
+			}
+		}
+	}
+	return key;
+}
+
+static unsigned long long hash_key(buf(unsigned char) key)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned int i = 0; i < buf_len(key); i++)
+	{
+		hash ^= key[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static void push_pending_node(ExplorerWorker *worker, ExplorerNode *node)
+{
+	__sync_fetch_and_add(&nbPendingNodes, 1);
+	pthread_mutex_lock(&worker->pendingLock);
+	buf_add(worker->pending, node);
+	pthread_mutex_unlock(&worker->pendingLock);
+}
+
+// the owner takes its newest node, thieves take the oldest one, which usually has the biggest subtree left
+static ExplorerNode *pop_pending_node(ExplorerWorker *worker, bool steal)
+{
+	ExplorerNode *node = NULL;
+	pthread_mutex_lock(&worker->pendingLock);
+	if (worker->pendingStart < buf_len(worker->pending))
+	{
+		if (steal)
+		{
+			node = worker->pending[worker->pendingStart++];
+		} else {
+			node = worker->pending[--_buf_header(worker->pending)->count];
+		}
+		if (worker->pendingStart == buf_len(worker->pending))
+		{
+			buf_clear(worker->pending);
+			worker->pendingStart = 0;
+		}
+	}
+	pthread_mutex_unlock(&worker->pendingLock);
+	return node;
+}
+
+// takes ownership of the variables and choices
+static ExplorerNode *get_node(ExplorerWorker *worker, ExplorerNodeType type, int dialogIndex, int programCounter, VariableStore *variables, buf(int) choices)
+{
+	buf(unsigned char) key = create_key(type, dialogIndex, programCounter, type == EXPLORER_NODE_CHOICE ? variables : NULL);
+	unsigned long long hash = hash_key(key);
+	int bucket = hash % EXPLORER_BUCKETS_COUNT;
+	pthread_mutex_t *lock = &bucketsLocks[bucket % EXPLORER_LOCKS_COUNT];
+
+	pthread_mutex_lock(lock);
+	for (ExplorerNode *node = buckets[bucket]; node; node = node->next)
+	{
+		if (node->hash == hash && buf_len(node->key) == buf_len(key) && !memcmp(node->key, key, buf_len(key)))
+		{
+			pthread_mutex_unlock(lock);
+			buf_free(key);
+			buf_free(choices);
+			free_variable_store(variables);
+			return node;
+		}
+	}
+	ExplorerNode *node = xmalloc(sizeof (*node));
+	node->type = type;
+	node->hash = hash;
+	node->key = key;
+	node->dialogIndex = dialogIndex;
+	node->programCounter = programCounter;
+	node->variables = NULL;
+	node->choices = choices;
+	node->children = NULL;
+	node->deadEndReason = NULL;
+	node->next = buckets[bucket];
+	node->index = -1;
+	buckets[bucket] = node;
+	pthread_mutex_unlock(lock);
+
+	if (__sync_add_and_fetch(&nbNodes, 1) >= MAX_NODES)
+	{
+		truncated = true;
+	}
+	if (type == EXPLORER_NODE_CHOICE)
+	{
+		node->variables = variables;
+		push_pending_node(worker, node);
+	} else {
+		free_variable_store(variables);
+	}
+	return node;
+}
+
+static ExplorerNode *get_dead_end(ExplorerWorker *worker, int dialogIndex, int programCounter, VariableStore *variables, const char *reason)
+{
+	ExplorerNode *node = get_node(worker, EXPLORER_NODE_DEAD_END, dialogIndex, programCounter, variables, NULL);
+	pthread_mutex_lock(&bucketsLocks[(node->hash % EXPLORER_BUCKETS_COUNT) % EXPLORER_LOCKS_COUNT]);
+	if (!node->deadEndReason)
+	{
+		node->deadEndReason = strclone(reason);
+	}
+	pthread_mutex_unlock(&bucketsLocks[(node->hash % EXPLORER_BUCKETS_COUNT) % EXPLORER_LOCKS_COUNT]);
+	return node;
+}
+
+static void mark_knots_reached(ExplorerWorker *worker, int dialogIndex, int programCounter)
+{
+	Dialog *dialog = loadedDialogs[dialogIndex];
+	for (int knotIndex = knotsOfInstructions[dialogIndex][programCounter]; knotIndex >= 0 && dialog->knots[knotIndex]->firstInstruction == programCounter; knotIndex--)
+	{
+		worker->knotsReached[knotsOffsets[dialogIndex] + knotIndex] = true;
+	}
+}
+
+static bool follow_go_to(GoTo *goTo, int target, int *dialogIndex, int *programCounter)
+{
+	if (goTo->dialogFile)
+	{
+		buf(char) dialogPath = strmerge("Dialogs/", goTo->dialogFile);
+		int nextDialogIndex = find_loaded_dialog(dialogPath);
+		buf_free(dialogPath);
+		Dialog *nextDialog = loadedDialogs[nextDialogIndex];
+		for (unsigned int i = 0; i < buf_len(nextDialog->knots); i++)
+		{
+			if (strmatch(nextDialog->knots[i]->name, goTo->knotToGo))
+			{
+				*dialogIndex = nextDialogIndex;
+				*programCounter = nextDialog->knots[i]->firstInstruction;
+				return true;
+			}
+		}
+		return false;
+	} else if (target == -1) {
+		return false;
+	}
+	*programCounter = target;
+	return true;
+}
+
+// runs the instructions the player has no say on, until the next choice, ending or dead end
+static ExplorerNode *run_until_decision(ExplorerWorker *worker, int dialogIndex, int programCounter, VariableStore *variables, int previousDialogIndex, int previousProgramCounter)
+{
+	buf(int) choices = NULL;
+	char reason[256];
+	for (int i = 0; i < MAX_INSTRUCTIONS_WITHOUT_CHOICE; i++)
+	{
+		Instruction *instruction = &loadedDialogs[dialogIndex]->instructions[programCounter];
+		mark_knots_reached(worker, dialogIndex, programCounter);
+		int currentDialogIndex = dialogIndex;
+		int currentProgramCounter = programCounter;
+
+		if (instruction->type == INSTRUCTION_ASSIGN)
+		{
+			set_variable(variables, instruction->assignment->variableSlot, resolve_logic_expression(variables, instruction->assignment->logicExpression));
+			programCounter++;
+		} else if (instruction->type == INSTRUCTION_JUMP) {
+			programCounter = instruction->target;
+		} else if (instruction->type == INSTRUCTION_JUMP_IF_FALSE) {
+			ConditionCache conditionCache = {NULL, false, false};
+			if (resolve_condition(variables, instruction->condition.logicExpression, instruction->condition.dependencies, &conditionCache))
+			{
+				programCounter++;
+			} else {
+				programCounter = instruction->target;
+			}
+			buf_free(conditionCache.dependenciesVersions);
+		} else if (instruction->type == INSTRUCTION_CHOICE) {
+			buf_add(choices, programCounter);
+			programCounter++;
+		} else if (instruction->type == INSTRUCTION_CHOOSE) {
+			if (choices)
+			{
+				return get_node(worker, EXPLORER_NODE_CHOICE, dialogIndex, programCounter, variables, choices);
+			}
+			programCounter++;
+		} else if (instruction->type == INSTRUCTION_GO_TO) {
+			if (!follow_go_to(instruction->goTo, instruction->target, &dialogIndex, &programCounter))
+			{
+				buf_free(choices);
+				snprintf(reason, sizeof (reason), "could not find knot %s", instruction->goTo->knotToGo);
+				return get_dead_end(worker, dialogIndex, programCounter, variables, reason);
+			}
+		} else if (instruction->type == INSTRUCTION_END) {
+			buf_free(choices);
+			if (previousDialogIndex != dialogIndex)
+			{
+				previousProgramCounter = programCounter;
+			}
+			return get_node(worker, EXPLORER_NODE_ENDING, dialogIndex, knotsOfInstructions[dialogIndex][previousProgramCounter], variables, NULL);
+		} else {
+			programCounter++;
+		}
+		previousDialogIndex = currentDialogIndex;
+		previousProgramCounter = currentProgramCounter;
+	}
+	buf_free(choices);
+	snprintf(reason, sizeof (reason), "no choice nor ending after %d instructions", MAX_INSTRUCTIONS_WITHOUT_CHOICE);
+	return get_dead_end(worker, dialogIndex, programCounter, variables, reason);
+}
+
+static void expand_node(ExplorerWorker *worker, ExplorerNode *node)
+{
+	Dialog *dialog = loadedDialogs[node->dialogIndex];
+	char reason[256];
+	for (unsigned int i = 0; i < buf_len(node->choices) && !truncated; i++)
+	{
+		Instruction *choiceInstruction = &dialog->instructions[node->choices[i]];
+		int dialogIndex = node->dialogIndex;
+		int programCounter;
+		VariableStore *variables = snapshot_variable_store(node->variables);
+		ExplorerNode *child;
+		if (follow_go_to(choiceInstruction->choice->goToCommand, choiceInstruction->target, &dialogIndex, &programCounter))
+		{
+			child = run_until_decision(worker, dialogIndex, programCounter, variables, node->dialogIndex, node->choices[i]);
+		} else {
+			snprintf(reason, sizeof (reason), "could not find knot %s", choiceInstruction->choice->goToCommand->knotToGo);
+			child = get_dead_end(worker, node->dialogIndex, node->choices[i], variables, reason);
+		}
+		buf_add(node->children, child);
+	}
+	free_variable_store(node->variables);
+	node->variables = NULL;
+}
+
+static void *run_explorer_worker(void *explorerWorker)
+{
+	ExplorerWorker *worker = explorerWorker;
+	while (true)
+	{
+		ExplorerNode *node = pop_pending_node(worker, false);
+		for (int i = 0; !node && i < nbWorkers; i++)
+		{
+			ExplorerWorker *victim = &workers[(worker->random = worker->random * 1103515245 + 12345) % nbWorkers];
+			if (victim != worker)
+			{
+				node = pop_pending_node(victim, true);
+			}
+		}
+		if (node)
+		{
+			if (!truncated)
+			{
+				expand_node(worker, node);
+			} else {
+				free_variable_store(node->variables);
+				node->variables = NULL;
+			}
+			__sync_fetch_and_sub(&nbPendingNodes, 1);
+		} else if (__sync_fetch_and_add(&nbPendingNodes, 0) == 0) {
+			break;
+		} else {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static const unsigned long long MAX_PATHS_COUNT = ~0ull;
+
+static void count_paths(ExplorerNode *node, int nbEndings, unsigned long long *pathsCounts, int *longestPaths, char *visits, int *nbLoops)
+{
+	visits[node->index] = 1;
+	if (node->type == EXPLORER_NODE_ENDING)
+	{
+		pathsCounts[node->index * nbEndings + node->programCounter] = 1;
+	}
+	for (unsigned int i = 0; i < buf_len(node->children); i++)
+	{
+		ExplorerNode *child = node->children[i];
+		if (visits[child->index] == 1)
+		{
+			// a route coming back to a state it went through, only the routes without loops are counted
+			(*nbLoops)++;
+			continue;
+		}
+		if (visits[child->index] == 0)
+		{
+			count_paths(child, nbEndings, pathsCounts, longestPaths, visits, nbLoops);
+		}
+		for (int j = 0; j < nbEndings; j++)
+		{
+			unsigned long long *count = &pathsCounts[node->index * nbEndings + j];
+			unsigned long long childCount = pathsCounts[child->index * nbEndings + j];
+			*count = childCount > MAX_PATHS_COUNT - *count ? MAX_PATHS_COUNT : *count + childCount;
+		}
+		if (longestPaths[child->index] + 1 > longestPaths[node->index])
+		{
+			longestPaths[node->index] = longestPaths[child->index] + 1;
+		}
+	}
+	visits[node->index] = 2;
+}
+
+static const char *get_knot_name(int dialogIndex, int programCounter)
+{
+	int knotIndex = knotsOfInstructions[dialogIndex][programCounter];
+	return knotIndex == -1 ? "" : loadedDialogs[dialogIndex]->knots[knotIndex]->name;
+}
+
+void explore_routes(const char *dialogPath, int nbThreads)
+{
+	load_reachable_dialogs(dialogPath);
+
+	knotsOfInstructions = NULL;
+	knotsOffsets = NULL;
+	nbKnots = 0;
+	for (unsigned int i = 0; i < buf_len(loadedDialogs); i++)
+	{
+		Dialog *dialog = loadedDialogs[i];
+		buf(int) knotsOfDialogInstructions = NULL;
+		int knotIndex = -1;
+		for (unsigned int j = 0; j < buf_len(dialog->instructions); j++)
+		{
+			while (knotIndex + 1 < (int)buf_len(dialog->knots) && dialog->knots[knotIndex + 1]->firstInstruction <= (int)j)
+			{
+				knotIndex++;
+			}
+			buf_add(knotsOfDialogInstructions, knotIndex);
+		}
+		buf_add(knotsOfInstructions, knotsOfDialogInstructions);
+		buf_add(knotsOffsets, nbKnots);
+		nbKnots += buf_len(dialog->knots);
+	}
+
+	for (int i = 0; i < EXPLORER_BUCKETS_COUNT; i++)
+	{
+		buckets[i] = NULL;
+	}
+	for (int i = 0; i < EXPLORER_LOCKS_COUNT; i++)
+	{
+		pthread_mutex_init(&bucketsLocks[i], NULL);
+	}
+	nbNodes = 0;
+	nbPendingNodes = 0;
+	truncated = false;
+
+	nbWorkers = nbThreads;
+	workers = xmalloc(nbWorkers * sizeof (*workers));
+	for (int i = 0; i < nbWorkers; i++)
+	{
+		pthread_mutex_init(&workers[i].pendingLock, NULL);
+		workers[i].pending = NULL;
+		workers[i].pendingStart = 0;
+		workers[i].knotsReached = NULL;
+		for (int j = 0; j < nbKnots; j++)
+		{
+			buf_add(workers[i].knotsReached, false);
+		}
+		workers[i].random = i + 1;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ExplorerNode *root = run_until_decision(&workers[0], 0, 0, create_variable_store(), 0, 0);
+	for (int i = 0; i < nbWorkers; i++)
+	{
+		if (pthread_create(&workers[i].thread, NULL, run_explorer_worker, &workers[i]))
+		{
+			error("could not start explorer thread %d.", i);
+		}
+	}
+	for (int i = 0; i < nbWorkers; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double runTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	buf(ExplorerNode *) nodes = NULL;
+	buf(ExplorerNode *) endings = NULL;
+	int nbChoicePoints = 0;
+	int nbEdges = 0;
+	for (int i = 0; i < EXPLORER_BUCKETS_COUNT; i++)
+	{
+		for (ExplorerNode *node = buckets[i]; node; node = node->next)
+		{
+			node->index = buf_len(nodes);
+			buf_add(nodes, node);
+			if (node->type == EXPLORER_NODE_ENDING)
+			{
+				buf_add(endings, node);
+			} else if (node->type == EXPLORER_NODE_CHOICE) {
+				nbChoicePoints++;
+				nbEdges += buf_len(node->children);
+			}
+		}
+	}
+	int nbNodesFound = buf_len(nodes);
+	int nbEndings = buf_len(endings);
+
+	// an ending knot is stored as the program counter of ending nodes, replace it by the ending index for counting
+	buf(int) endingsKnots = NULL;
+	for (int i = 0; i < nbEndings; i++)
+	{
+		buf_add(endingsKnots, endings[i]->programCounter);
+		endings[i]->programCounter = i;
+	}
+
+	// states able to reach an ending, found backward from the endings so that loops do not matter
+	buf(buf(int)) parents = NULL;
+	buf(bool) reachesEnding = NULL;
+	for (int i = 0; i < nbNodesFound; i++)
+	{
+		buf_add(parents, NULL);
+		buf_add(reachesEnding, nodes[i]->type == EXPLORER_NODE_ENDING);
+	}
+	for (int i = 0; i < nbNodesFound; i++)
+	{
+		for (unsigned int j = 0; j < buf_len(nodes[i]->children); j++)
+		{
+			buf_add(parents[nodes[i]->children[j]->index], i);
+		}
+	}
+	buf(int) stack = NULL;
+	for (int i = 0; i < nbEndings; i++)
+	{
+		buf_add(stack, endings[i]->index);
+	}
+	while (buf_len(stack))
+	{
+		int nodeIndex = stack[--_buf_header(stack)->count];
+		for (unsigned int i = 0; i < buf_len(parents[nodeIndex]); i++)
+		{
+			if (!reachesEnding[parents[nodeIndex][i]])
+			{
+				reachesEnding[parents[nodeIndex][i]] = true;
+				buf_add(stack, parents[nodeIndex][i]);
+			}
+		}
+	}
+
+	unsigned long long *pathsCounts = xmalloc((nbNodesFound * nbEndings + 1) * sizeof (*pathsCounts));
+	int *longestPaths = xmalloc(nbNodesFound * sizeof (*longestPaths));
+	char *visits = xmalloc(nbNodesFound * sizeof (*visits));
+	for (int i = 0; i < nbNodesFound; i++)
+	{
+		for (int j = 0; j < nbEndings; j++)
+		{
+			pathsCounts[i * nbEndings + j] = 0;
+		}
+		longestPaths[i] = 0;
+		visits[i] = 0;
+	}
+	int nbLoops = 0;
+	count_paths(root, nbEndings, pathsCounts, longestPaths, visits, &nbLoops);
+
+	printf("---Routes exploration---\n");
+	printf("%d states, %d choice points and %d choices explored in %.3fs on %d threads, %d dialogs.\n", nbNodesFound, nbChoicePoints, nbEdges, runTime, nbWorkers, (int)buf_len(loadedDialogs));
+	if (truncated)
+	{
+		printf("stopped after %d states, the results below are partial.\n", MAX_NODES);
+	}
+
+	printf("\n---Knots---\n");
+	for (unsigned int i = 0; i < buf_len(loadedDialogs); i++)
+	{
+		Dialog *dialog = loadedDialogs[i];
+		int nbReached = 0;
+		for (unsigned int j = 0; j < buf_len(dialog->knots); j++)
+		{
+			for (int k = 0; k < nbWorkers; k++)
+			{
+				if (workers[k].knotsReached[knotsOffsets[i] + j])
+				{
+					workers[0].knotsReached[knotsOffsets[i] + j] = true;
+					nbReached++;
+					break;
+				}
+			}
+		}
+		printf("%s : %d/%d knots reachable.\n", loadedDialogsPaths[i], nbReached, (int)buf_len(dialog->knots));
+		for (unsigned int j = 0; j < buf_len(dialog->knots); j++)
+		{
+			if (!workers[0].knotsReached[knotsOffsets[i] + j])
+			{
+				printf("	-unreachable : %s\n", dialog->knots[j]->name);
+			}
+		}
+	}
+
+	printf("\n---Dead-end choices---\n");
+	buf(Instruction *) reportedChoices = NULL;
+	for (int i = 0; i < nbNodesFound; i++)
+	{
+		ExplorerNode *node = nodes[i];
+		for (unsigned int j = 0; j < buf_len(node->children); j++)
+		{
+			ExplorerNode *child = node->children[j];
+			if (reachesEnding[child->index])
+			{
+				continue;
+			}
+			Instruction *choiceInstruction = &loadedDialogs[node->dialogIndex]->instructions[node->choices[j]];
+			bool reported = false;
+			for (unsigned int k = 0; k < buf_len(reportedChoices); k++)
+			{
+				if (reportedChoices[k] == choiceInstruction)
+				{
+					reported = true;
+					break;
+				}
+			}
+			if (reported)
+			{
+				continue;
+			}
+			buf_add(reportedChoices, choiceInstruction);
+			printf("	-%s, knot %s, \"%s\" : %s\n", loadedDialogsPaths[node->dialogIndex], get_knot_name(node->dialogIndex, node->choices[j]), choiceInstruction->choice->sentence->string, child->type == EXPLORER_NODE_DEAD_END ? child->deadEndReason : "no ending reachable");
+		}
+	}
+	printf("%d dead-end choices.\n", (int)buf_len(reportedChoices));
+	buf_free(reportedChoices);
+
+	printf("\n---Paths---\n");
+	printf("longest path : %d choices.\n", longestPaths[root->index]);
+	if (nbLoops)
+	{
+		printf("%d choices lead back to an earlier state, paths going through a loop are not counted.\n", nbLoops);
+	}
+	for (int i = 0; i < nbEndings; i++)
+	{
+		unsigned long long count = pathsCounts[root->index * nbEndings + i];
+		const char *knotName = endingsKnots[i] == -1 ? "" : loadedDialogs[endings[i]->dialogIndex]->knots[endingsKnots[i]]->name;
+		printf("	-%s, knot %s : %llu%s paths\n", loadedDialogsPaths[endings[i]->dialogIndex], knotName, count, count == MAX_PATHS_COUNT ? "+" : "");
+	}
+	if (root->type == EXPLORER_NODE_DEAD_END)
+	{
+		printf("the dialog never reaches a choice nor an ending : %s.\n", root->deadEndReason);
+	}
+	printf("\n");
+
+	xfree(pathsCounts);
+	xfree(longestPaths);
+	xfree(visits);
+	buf_free(stack);
+	for (int i = 0; i < nbNodesFound; i++)
+	{
+		buf_free(parents[i]);
+	}
+	buf_free(parents);
+	buf_free(reachesEnding);
+	buf_free(endingsKnots);
+	buf_free(endings);
+	for (int i = 0; i < nbNodesFound; i++)
+	{
+		if (nodes[i]->variables)
+		{
+			free_variable_store(nodes[i]->variables);
+		}
+		buf_free(nodes[i]->key);
+		buf_free(nodes[i]->choices);
+		buf_free(nodes[i]->children);
+		buf_free(nodes[i]->deadEndReason);
+		xfree(nodes[i]);
+	}
+	buf_free(nodes);
+
+	for (int i = 0; i < nbWorkers; i++)
+	{
+		pthread_mutex_destroy(&workers[i].pendingLock);
+		buf_free(workers[i].pending);
+		buf_free(workers[i].knotsReached);
+	}
+	xfree(workers);
+	for (int i = 0; i < EXPLORER_LOCKS_COUNT; i++)
+	{
+		pthread_mutex_destroy(&bucketsLocks[i]);
+	}
+	for (unsigned int i = 0; i < buf_len(knotsOfInstructions); i++)
+	{
+		buf_free(knotsOfInstructions[i]);
+	}
+	buf_free(knotsOfInstructions);
+	buf_free(knotsOffsets);
+	free_loaded_dialogs();
+}
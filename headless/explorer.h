@@ -0,0 +1,6 @@
+#ifndef EXPLORER_H
+#define EXPLORER_H
+
+void explore_routes(const char *dialogPath, int nbThreads);
+
+#endif /* end of include guard: EXPLORER_H */
@@ -0,0 +1,600 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_TRUETYPE_IMPLEMENTATION
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "../stb_image.h"
+#include "../stb_truetype.h"
+#include "../maths.h"
+#include "../globals.h"
+#include "../error.h"
+#include "../xalloc.h"
+#include "../stretchy_buffer.h"
+#include "../file.h"
+#include "../str.h"
+#include "../animation.h"
+#include "../graphics.h"
+
+// same layout and asset checks as graphics.c, without any texture upload or drawing
+
+static buf(buf(char)) texturesPaths;
+static buf(unsigned int) texturesIds;
+static buf(int) texturesWidths;
+static buf(int) texturesHeigts;
+static buf(int) texturesUsers;
+static unsigned int nbTexturesIds;
+
+static buf(Font *) fonts;
+static buf(unsigned char *) ttfBuffers;
+static buf(buf(char)) ttfFilesPaths;
+
+// fonts, glyphs and textures are shared by every session, whatever the thread interpreting it
+static pthread_mutex_t cachesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void init_graphics()
+{
+	texturesPaths = NULL;
+	texturesIds = NULL;
+	texturesWidths = NULL;
+	texturesHeigts = NULL;
+	texturesUsers = NULL;
+	nbTexturesIds = 0;
+
+	fonts = NULL;
+	ttfBuffers = NULL;
+	ttfFilesPaths = NULL;
+}
+
+static void free_font(Font *font)
+{
+	buf_free(font->fontPath);
+	xfree(font->fontInfo);
+	for (unsigned int i = 0; i < 0xFFFF; i++)
+	{
+		if (font->loaded[i])
+		{
+			xfree(font->glyphs[i]);
+		}
+	}
+	xfree(font->glyphs);
+	xfree(font->loaded);
+	xfree(font);
+}
+
+void free_graphics()
+{
+	for (unsigned int i = 0; i < buf_len(ttfBuffers); i++)
+	{
+		xfree(ttfBuffers[i]);
+		buf_free(ttfFilesPaths[i]);
+	}
+	buf_free(ttfBuffers);
+	buf_free(ttfFilesPaths);
+
+	for (unsigned int i = 0; i < buf_len(texturesPaths); i++)
+	{
+		buf_free(texturesPaths[i]);
+	}
+	buf_free(texturesPaths);
+	buf_free(texturesIds);
+	buf_free(texturesWidths);
+	buf_free(texturesHeigts);
+	buf_free(texturesUsers);
+
+	for (unsigned int i = 0; i < buf_len(fonts); i++)
+	{
+		free_font(fonts[i]);
+	}
+	buf_free(fonts);
+}
+
+static unsigned int get_texture_id_from_path_unlocked(const char *texturePath, int *_width, int *_height)
+{
+	for (unsigned int i = 0; i < buf_len(texturesPaths); i++)
+	{
+		if(strmatch(texturesPaths[i], texturePath))
+		{
+			if (_width)
+			{
+				*_width = texturesWidths[i];
+			}
+			if (_height)
+			{
+				*_height = texturesHeigts[i];
+			}
+			texturesUsers[i]++;
+			return texturesIds[i];
+		}
+	}
+
+	int width;
+	int height;
+	int nrChannels;
+	unsigned char *data = stbi_load(texturePath, &width, &height, &nrChannels, 4);
+	if (data)
+	{
+		stbi_image_free(data);
+		if (_width)
+		{
+			*_width = width;
+		}
+		if (_height)
+		{
+			*_height = height;
+		}
+
+		unsigned int textureId = ++nbTexturesIds;
+		buf_add(texturesPaths, strclone(texturePath));
+		buf_add(texturesIds, textureId);
+		buf_add(texturesWidths, width);
+		buf_add(texturesHeigts, height);
+		buf_add(texturesUsers, 1);
+
+		return textureId;
+	} else {
+		error("failed to load texture %s.", texturePath);
+	}
+}
+
+Sprite *create_sprite(SpriteType spriteType)
+{
+	Sprite *sprite = xmalloc(sizeof (*sprite));
+	sprite->position.x = 0;
+	sprite->position.y = 0;
+	sprite->width = 0;
+	sprite->height = 0;
+	sprite->opacity = 1.0f;
+	if (spriteType == SPRITE_COLOR)
+	{
+		sprite->type = SPRITE_COLOR;
+		sprite->color.x = 0.0f;
+		sprite->color.y = 0.0f;
+		sprite->color.z = 0.0f;
+	} else if (spriteType == SPRITE_TEXTURE) {
+		sprite->type = SPRITE_TEXTURE;
+		sprite->textureId = -1;
+	} else if (spriteType == SPRITE_GLYPH) {
+		sprite->type = SPRITE_GLYPH;
+		sprite->color.x = 0.0f;
+		sprite->color.y = 0.0f;
+		sprite->color.z = 0.0f;
+		sprite->textureId = -1;
+	} else if (spriteType == SPRITE_ANIMATED) {
+		sprite->type = SPRITE_ANIMATED;
+		sprite->animations = NULL;
+		sprite->currentAnimation = 0;
+		reset_animation(&sprite->animationCursor);
+		sprite->lipSyncPhase = -1;
+	} else {
+		error("sprite type %d not supported.", spriteType);
+	}
+	return sprite;
+}
+
+void free_sprite(Sprite *sprite)
+{
+	if (sprite->type == SPRITE_COLOR)
+	{
+	} else if (sprite->type == SPRITE_TEXTURE) {
+	} else if (sprite->type == SPRITE_GLYPH) {
+	} else if (sprite->type == SPRITE_ANIMATED) {
+		for (unsigned int i = 0; i < buf_len(sprite->animations); i++)
+		{
+			free_animation(sprite->animations[i]);
+		}
+		buf_free(sprite->animations);
+	} else {
+		error("sprite type %d not supported.", sprite->type);
+	}
+	xfree(sprite);
+}
+
+static void load_glyph(Font *font, int code)
+{
+	int leftSideBearing;
+	int advance;
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	stbtt_GetCodepointBitmapBox(font->fontInfo, code, font->scale, font->scale, &x0, &y0, &x1, &y1);
+	font->glyphs[code] = xmalloc(sizeof (*font->glyphs[code]));
+	font->glyphs[code]->width = x1 - x0;
+	font->glyphs[code]->height = y1 - y0;
+
+	font->glyphs[code]->textureId = -1;
+
+	font->glyphs[code]->yOffset = y0 + font->ascent - font->descent;
+
+	stbtt_GetCodepointHMetrics(font->fontInfo, code, &advance, &leftSideBearing);
+	font->glyphs[code]->xOffset = ceil((advance - leftSideBearing) * font->scale);
+
+	font->loaded[code] = true;
+}
+
+static void load_font(const char *fontPath, int textHeight)
+{
+	stbtt_fontinfo *fontInfo = xmalloc(sizeof (*fontInfo));
+	unsigned char *ttfBuffer = NULL;
+	for (unsigned int i = 0; i < buf_len(ttfFilesPaths); i++)
+	{
+		if (strmatch(fontPath, ttfFilesPaths[i]))
+		{
+			ttfBuffer = ttfBuffers[i];
+		}
+	}
+	if (!ttfBuffer)
+	{
+		ttfBuffer = (unsigned char *)file_to_string(fontPath);
+		buf_add(ttfBuffers, ttfBuffer);
+		buf_add(ttfFilesPaths, strclone(fontPath));
+	}
+	stbtt_InitFont(fontInfo, ttfBuffer, stbtt_GetFontOffsetForIndex(ttfBuffer, 0));
+	int ascent;
+	int descent;
+	stbtt_GetFontVMetrics(fontInfo, &ascent, &descent, NULL);
+
+	Font *font = xmalloc(sizeof (*font));
+	font->glyphs = xmalloc(0xFFFF * sizeof (*font->glyphs));
+	font->loaded = xmalloc(0xFFFF * sizeof (*font->loaded));
+	for (int i = 0; i < 0xFFFF; i++)
+	{
+		font->loaded[i] = false;
+	}
+	font->fontInfo = fontInfo;
+	font->fontPath = strclone(fontPath);
+	font->height = textHeight;
+	font->scale = stbtt_ScaleForPixelHeight(font->fontInfo, (float)textHeight);
+	font->ascent = ceil(ascent * font->scale);
+	font->descent = ceil(descent * font->scale);
+	for (int code = 0; code < 128; code++)
+	{
+		load_glyph(font, code);
+	}
+
+	buf_add(fonts, font);
+}
+
+Text *create_text()
+{
+	Text *text = xmalloc(sizeof (*text));
+	text->font = NULL;
+	text->codes = NULL;
+	text->sprites = NULL;
+	text->lineStarts = NULL;
+	text->widthLimit = -1;
+	text->position.x = 0;
+	text->position.y = 0;
+	text->nbCharToDisplay = 0;
+	text->nbMaxCharToDisplay = 0;
+	return text;
+}
+
+// the lines ending before firstChangedCode keep their sprites, the layout starts again at the first line the change can move
+static void update_text(Text *text, int firstChangedCode)
+{
+	unsigned int nbLineStarts = 0;
+	bool sameColor = text->laidOutColor.x == text->color.x && text->laidOutColor.y == text->color.y && text->laidOutColor.z == text->color.z;
+	while (nbLineStarts < buf_len(text->lineStarts) && sameColor && text->lineStarts[nbLineStarts].lastCodeIndex + 1 < firstChangedCode)
+	{
+		nbLineStarts++;
+	}
+	if (text->lineStarts)
+	{
+		_buf_header(text->lineStarts)->count = nbLineStarts;
+	}
+	TextLineStart start = nbLineStarts == 0 ? (TextLineStart){0, 0, 0, 1, 0} : text->lineStarts[nbLineStarts - 1];
+	text->width = start.width;
+	int currentLineWidth = 0;
+	int currentLine = start.line;
+	int displayedSpriteCount = start.spriteIndex;
+	text->laidOutColor = text->color;
+
+	for (unsigned int currentCodeIndex = start.codeIndex; currentCodeIndex < buf_len(text->codes); currentCodeIndex++)
+	{
+		int currentCode = text->codes[currentCodeIndex];
+
+		if (currentLineWidth == 0)
+		{
+			if (currentCode == ' ' && currentLine != 1)
+			{
+				continue;
+			}
+		}
+
+		if (!text->font->loaded[currentCode])
+		{
+			load_glyph(text->font, currentCode);
+		}
+
+		if (displayedSpriteCount == buf_len(text->sprites))
+		{
+			buf_add(text->sprites, create_sprite(SPRITE_GLYPH));
+		}
+
+		Sprite *currentSprite = text->sprites[displayedSpriteCount];
+
+		currentSprite->width = text->font->glyphs[currentCode]->width;
+		currentSprite->height = text->font->glyphs[currentCode]->height;
+		currentSprite->textureId = text->font->glyphs[currentCode]->textureId;
+		currentSprite->color = text->color;
+
+		currentSprite->position.x = text->position.x + currentLineWidth;
+		currentSprite->position.y = text->position.y + (currentLine - 1) * (text->font->ascent - text->font->descent) + text->font->glyphs[currentCode]->yOffset;
+
+		if (currentCodeIndex == buf_len(text->codes) - 1)
+		{
+			currentLineWidth += text->font->glyphs[currentCode]->xOffset + ceil(stbtt_GetCodepointKernAdvance(text->font->fontInfo, currentCode, 0) * text->font->scale);
+		} else {
+			currentLineWidth += text->font->glyphs[currentCode]->xOffset + ceil(stbtt_GetCodepointKernAdvance(text->font->fontInfo, currentCode, text->codes[currentCodeIndex + 1]) * text->font->scale);
+		}
+
+		displayedSpriteCount++;
+
+		if (text->widthLimit != -1 && currentLineWidth > text->widthLimit)
+		{
+			int oldCodeIndex = currentCodeIndex;
+			int oldSpriteCount = displayedSpriteCount;
+			int oldLineWidth = currentLineWidth;
+			bool newLine = false;
+			while (true)
+			{
+				if (currentCodeIndex == 0)
+				{
+					currentCodeIndex = oldCodeIndex;
+					displayedSpriteCount = oldSpriteCount;
+					currentLineWidth = oldLineWidth;
+					break;
+				}
+
+				if (currentCodeIndex == buf_len(text->codes) - 1)
+				{
+					currentLineWidth -= text->font->glyphs[text->codes[currentCodeIndex]]->xOffset + ceil(stbtt_GetCodepointKernAdvance(text->font->fontInfo, text->codes[currentCodeIndex], 0) * text->font->scale);
+				} else {
+					currentLineWidth -= text->font->glyphs[text->codes[currentCodeIndex]]->xOffset + ceil(stbtt_GetCodepointKernAdvance(text->font->fontInfo, text->codes[currentCodeIndex], text->codes[currentCodeIndex + 1]) * text->font->scale);
+				}
+
+				if (text->codes[currentCodeIndex] == ' ')
+				{
+					displayedSpriteCount++;
+					newLine = true;
+					break;
+				}
+
+				if (currentLineWidth <= 0)
+				{
+					currentCodeIndex = oldCodeIndex;
+					displayedSpriteCount = oldSpriteCount;
+					currentLineWidth = oldLineWidth;
+					break;
+				}
+
+				currentCodeIndex--;
+				displayedSpriteCount--;
+			}
+			if (newLine)
+			{
+				displayedSpriteCount--;
+				if (currentLineWidth > text->width)
+				{
+					text->width = currentLineWidth;
+				}
+				currentLineWidth = 0;
+				currentLine++;
+				TextLineStart lineStart = {currentCodeIndex + 1, oldCodeIndex, displayedSpriteCount, currentLine, text->width};
+				buf_add(text->lineStarts, lineStart);
+			}
+		}
+	}
+	if (currentLineWidth > text->width)
+	{
+		text->width = currentLineWidth;
+	}
+	text->height = currentLine * (text->font->ascent - text->font->descent) - 2;
+	text->nbMaxCharToDisplay = displayedSpriteCount;
+}
+
+static void set_text_width_limit_unlocked(Text *text, int limit)
+{
+	text->widthLimit = limit;
+	if (text->codes)
+	{
+		update_text(text, 0);
+	}
+}
+
+static void set_text_position_unlocked(Text *text, ivec2 position)
+{
+	text->position = position;
+	text->position.y -= 2;
+	if (text->codes)
+	{
+		update_text(text, 0);
+	}
+}
+
+static void set_text_font_unlocked(Text *text, const char *fontPath, int textHeight)
+{
+	text->font = NULL;
+	for (unsigned int i = 0; i < buf_len(fonts); i++)
+	{
+		if (strmatch(fonts[i]->fontPath, fontPath))
+		{
+			if (fonts[i]->height == textHeight)
+			{
+				text->font = fonts[i];
+				break;
+			}
+		}
+	}
+	if (!text->font)
+	{
+		if (textHeight == TEXT_SIZE_SMALL)
+		{
+			load_font(fontPath, TEXT_SIZE_SMALL);
+		} else if (textHeight == TEXT_SIZE_NORMAL) {
+			load_font(fontPath, TEXT_SIZE_NORMAL);
+		} else if (textHeight == TEXT_SIZE_BIG) {
+			load_font(fontPath, TEXT_SIZE_BIG);
+		} else if (textHeight == TEXT_SIZE_HUGE) {
+			load_font(fontPath, TEXT_SIZE_HUGE);
+		} else {
+			error("unsupported text height %d.", textHeight);
+		}
+		text->font = fonts[buf_len(fonts) - 1];
+	}
+
+	text->height = text->font->ascent - text->font->descent - 2;
+
+	if (text->codes)
+	{
+		update_text(text, 0);
+	}
+}
+
+static void set_text_string_unlocked(Text *text, const char *string)
+{
+	int *codes = string ? utf8_decode(string) : NULL;
+	// a string interpolated again only changes from its first variable on
+	int firstChangedCode = 0;
+	while (firstChangedCode < (int)buf_len(codes) && firstChangedCode < (int)buf_len(text->codes) && codes[firstChangedCode] == text->codes[firstChangedCode])
+	{
+		firstChangedCode++;
+	}
+	buf_free(text->codes);
+	text->codes = codes;
+
+	if (text->codes)
+	{
+		update_text(text, firstChangedCode);
+		text->nbCharToDisplay = text->nbMaxCharToDisplay;
+	}
+}
+
+void free_text(Text *text)
+{
+	buf_free(text->codes);
+	buf_free(text->lineStarts);
+	for (unsigned int i = 0; i < buf_len(text->sprites); i++)
+	{
+		free_sprite(text->sprites[i]);
+	}
+	buf_free(text->sprites);
+	xfree(text);
+}
+
+unsigned int get_texture_id_from_path(const char *texturePath, int *_width, int *_height)
+{
+	pthread_mutex_lock(&cachesMutex);
+	unsigned int result = get_texture_id_from_path_unlocked(texturePath, _width, _height);
+	pthread_mutex_unlock(&cachesMutex);
+	return result;
+}
+
+// without a graphics context any thread can load textures, so none is ever deferred
+void defer_textures(bool defer)
+{
+}
+
+buf(DeferredTexture) take_deferred_textures()
+{
+	return NULL;
+}
+
+unsigned int upload_deferred_texture(DeferredTexture *texture)
+{
+	error("no texture is deferred without a graphics context.");
+}
+
+void release_texture(unsigned int textureId)
+{
+	pthread_mutex_lock(&cachesMutex);
+	for (unsigned int i = 0; i < buf_len(texturesIds); i++)
+	{
+		if (texturesIds[i] == textureId)
+		{
+			texturesUsers[i]--;
+			if (texturesUsers[i] == 0)
+			{
+				buf_free(texturesPaths[i]);
+				unsigned int last = buf_len(texturesIds) - 1;
+				texturesPaths[i] = texturesPaths[last];
+				texturesIds[i] = texturesIds[last];
+				texturesWidths[i] = texturesWidths[last];
+				texturesHeigts[i] = texturesHeigts[last];
+				texturesUsers[i] = texturesUsers[last];
+				_buf_header(texturesPaths)->count--;
+				_buf_header(texturesIds)->count--;
+				_buf_header(texturesWidths)->count--;
+				_buf_header(texturesHeigts)->count--;
+				_buf_header(texturesUsers)->count--;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cachesMutex);
+}
+
+void free_deferred_texture(DeferredTexture *texture)
+{
+}
+
+void set_text_width_limit(Text *text, int limit)
+{
+	pthread_mutex_lock(&cachesMutex);
+	set_text_width_limit_unlocked(text, limit);
+	pthread_mutex_unlock(&cachesMutex);
+}
+
+void set_text_position(Text *text, ivec2 position)
+{
+	pthread_mutex_lock(&cachesMutex);
+	set_text_position_unlocked(text, position);
+	pthread_mutex_unlock(&cachesMutex);
+}
+
+void set_text_font(Text *text, const char *fontPath, int textHeight)
+{
+	pthread_mutex_lock(&cachesMutex);
+	set_text_font_unlocked(text, fontPath, textHeight);
+	pthread_mutex_unlock(&cachesMutex);
+}
+
+void set_text_string(Text *text, const char *string)
+{
+	pthread_mutex_lock(&cachesMutex);
+	set_text_string_unlocked(text, string);
+	pthread_mutex_unlock(&cachesMutex);
+}
+
+void add_sprite_to_draw_list(Sprite *sprite, DrawLayer drawLayer)
+{
+	AnimationPhase *currentAnimationPhase;
+	if (sprite->type == SPRITE_ANIMATED)
+	{
+		currentAnimationPhase = sprite->animations[sprite->currentAnimation]->animationPhases[sprite->lipSyncPhase != -1 ? sprite->lipSyncPhase : sprite->animationCursor.currentAnimationPhase];
+		if (!sprite->fixedSize)
+		{
+			if (currentAnimationPhase->responsiveHeight)
+			{
+				sprite->width = (int)(currentAnimationPhase->responsiveWidth * windowDimensions.x);
+				sprite->height = (int)(currentAnimationPhase->responsiveHeight * windowDimensions.y);
+			} else {
+				sprite->width = currentAnimationPhase->pixelWidth;
+				sprite->height = currentAnimationPhase->pixelHeight;
+			}
+		}
+		update_animation(sprite->animations[sprite->currentAnimation], &sprite->animationCursor);
+	}
+}
+
+void add_text_to_draw_list(Text *text, DrawLayer drawLayer)
+{
+}
+
+void draw_all()
+{
+}
@@ -0,0 +1,70 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../maths.h"
+#include "../stretchy_buffer.h"
+#include "../xalloc.h"
+#include "../str.h"
+#include "../animation.h"
+#include "../graphics.h"
+#include "../variable.h"
+#include "../dialog.h"
+#include "../bytecode.h"
+#include "library.h"
+
+buf(Dialog *) loadedDialogs = NULL;
+buf(buf(char)) loadedDialogsPaths = NULL;
+
+int find_loaded_dialog(const char *dialogPath)
+{
+	for (unsigned int i = 0; i < buf_len(loadedDialogsPaths); i++)
+	{
+		if (strmatch(loadedDialogsPaths[i], dialogPath))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+void load_reachable_dialogs(const char *dialogPath)
+{
+	if (find_loaded_dialog(dialogPath) != -1)
+	{
+		return;
+	}
+	Dialog *dialog = get_dialog_from_file(dialogPath);
+	// the sessions sharing the dialog ignore #preload, so the packs it names are loaded now
+	load_dialog_packs(dialog);
+	dialog->shared = true;
+	buf_add(loadedDialogs, dialog);
+	buf_add(loadedDialogsPaths, strclone(dialogPath));
+
+	for (unsigned int i = 0; i < buf_len(dialog->instructions); i++)
+	{
+		GoTo *goTo = NULL;
+		if (dialog->instructions[i].type == INSTRUCTION_GO_TO)
+		{
+			goTo = dialog->instructions[i].goTo;
+		} else if (dialog->instructions[i].type == INSTRUCTION_CHOICE) {
+			goTo = dialog->instructions[i].choice->goToCommand;
+		}
+		if (goTo && goTo->dialogFile)
+		{
+			buf(char) nextDialogPath = strmerge("Dialogs/", goTo->dialogFile);
+			load_reachable_dialogs(nextDialogPath);
+			buf_free(nextDialogPath);
+		}
+	}
+}
+
+void free_loaded_dialogs()
+{
+	for (unsigned int i = 0; i < buf_len(loadedDialogs); i++)
+	{
+		free_dialog(loadedDialogs[i]);
+		buf_free(loadedDialogsPaths[i]);
+	}
+	buf_free(loadedDialogs);
+	buf_free(loadedDialogsPaths);
+}
@@ -0,0 +1,12 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+// every dialog reachable through go tos, parsed once before any thread starts and read-only afterwards
+extern buf(Dialog *) loadedDialogs;
+extern buf(buf(char)) loadedDialogsPaths;
+
+void load_reachable_dialogs(const char *dialogPath);
+int find_loaded_dialog(const char *dialogPath);
+void free_loaded_dialogs();
+
+#endif /* end of include guard: LIBRARY_H */
@@ -0,0 +1,633 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../audio.h"
+#include "../window.h"
+#include "../maths.h"
+#include "../globals.h"
+#include "../user_input.h"
+#include "../stretchy_buffer.h"
+#include "../xalloc.h"
+#include "../error.h"
+#include "../file.h"
+#include "../str.h"
+#include "../animation.h"
+#include "../graphics.h"
+#include "../variable.h"
+#include "../dialog.h"
+#include "../bytecode.h"
+#include "../interpret.h"
+#include "../globals_dialog.h"
+#include "../save.h"
+#include "../history.h"
+#include "../binary.h"
+#include "../read_status.h"
+#include "../backlog.h"
+#include "../profile.h"
+#include "../replay.h"
+#include "../autosave.h"
+#include "../persistent.h"
+#include "../dialog_cache.h"
+#include "../preload.h"
+#include "../localization.h"
+#include "batch.h"
+#include "explorer.h"
+
+buf(buf(char)) variablesNames = NULL;
+
+// a script line is "<frame> <key>" to press a key on that frame, "<frame> dt <seconds>" to change the timestep from that frame, "<frame> wheel <offset>" to scroll on that frame
+// or "<frame> language <language>" to switch language on that frame, "-" going back to the text of the scripts
+typedef enum ScriptEventType
+{
+	SCRIPT_EVENT_KEY,
+	SCRIPT_EVENT_TIMESTEP,
+	SCRIPT_EVENT_WHEEL,
+	SCRIPT_EVENT_LANGUAGE
+} ScriptEventType;
+
+typedef struct ScriptEvent
+{
+	int frame;
+	ScriptEventType type;
+	InputKey inputKey;
+	float timestep;
+	int scrollOffset;
+	char language[32];
+} ScriptEvent;
+
+static const struct
+{
+	const char *name;
+	InputKey inputKey;
+} inputKeysNames[] =
+{
+	{"ENTER", INPUT_KEY_ENTER},
+	{"SPACE", INPUT_KEY_SPACE},
+	{"UP", INPUT_KEY_UP_ARROW},
+	{"DOWN", INPUT_KEY_DOWN_ARROW},
+	{"CLICK", INPUT_KEY_LEFT_MOUSE_BUTTON},
+	{"R", INPUT_KEY_R},
+	{"PAGEUP", INPUT_KEY_PAGE_UP},
+	{"TAB", INPUT_KEY_TAB},
+	{"RIGHTCLICK", INPUT_KEY_RIGHT_MOUSE_BUTTON},
+	{"ESCAPE", INPUT_KEY_ESCAPE}
+};
+
+static buf(ScriptEvent) scriptEvents = NULL;
+
+static InputKey get_input_key_from_name(const char *name, int line)
+{
+	for (unsigned int i = 0; i < sizeof (inputKeysNames) / sizeof (inputKeysNames[0]); i++)
+	{
+		if (strmatch(inputKeysNames[i].name, name))
+		{
+			return inputKeysNames[i].inputKey;
+		}
+	}
+	error("unknown key \"%s\" at line %d of the input script.", name, line);
+}
+
+static void load_script(const char *scriptPath)
+{
+	char *script = file_to_string(scriptPath);
+	int line = 0;
+	char *currentLine = strtok(script, "\n");
+	while (currentLine)
+	{
+		line++;
+		char *comment = strchr(currentLine, '#');
+		if (comment)
+		{
+			*comment = '\0';
+		}
+		int frame;
+		char name[32];
+		float timestep;
+		int scrollOffset;
+		if (sscanf(currentLine, "%d dt %f", &frame, &timestep) == 2)
+		{
+			buf_add(scriptEvents, ((ScriptEvent){frame, SCRIPT_EVENT_TIMESTEP, 0, timestep, 0}));
+		} else if (sscanf(currentLine, "%d wheel %d", &frame, &scrollOffset) == 2) {
+			buf_add(scriptEvents, ((ScriptEvent){frame, SCRIPT_EVENT_WHEEL, 0, 0.0f, scrollOffset}));
+		} else if (sscanf(currentLine, "%d language %31s", &frame, name) == 2) {
+			ScriptEvent scriptEvent = {frame, SCRIPT_EVENT_LANGUAGE, 0, 0.0f, 0};
+			strcpy(scriptEvent.language, name);
+			buf_add(scriptEvents, scriptEvent);
+		} else if (sscanf(currentLine, "%d %31s", &frame, name) == 2) {
+			buf_add(scriptEvents, ((ScriptEvent){frame, SCRIPT_EVENT_KEY, get_input_key_from_name(name, line), 0.0f, 0}));
+		} else if (strspn(currentLine, " \t\r") != strlen(currentLine)) {
+			error("invalid line %d in input script %s.", line, scriptPath);
+		}
+		currentLine = strtok(NULL, "\n");
+	}
+	xfree(script);
+
+	for (unsigned int i = 1; i < buf_len(scriptEvents); i++)
+	{
+		if (scriptEvents[i].frame < scriptEvents[i - 1].frame)
+		{
+			error("frames of input script %s are not in increasing order.", scriptPath);
+		}
+	}
+}
+
+static double get_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void print_usage()
+{
+	printf("usage : VisualNovelInterpreterHeadless [-d dialog] [-t timestep] [-f max frames] [-s input script] [-a frames between auto enter] [-l save to load] [-o save to write at the end] [-k read sentences file] [-p profile files prefix] [-w replay to record] [-u autosaves prefix] [-v persistent variables file] [-c dialog cache megabytes] [-g language]\n");
+	printf("        VisualNovelInterpreterHeadless -y replay to play [-f max frames] [-p profile files prefix]\n");
+	printf("        VisualNovelInterpreterHeadless -n sessions [-j threads] [-r seed] [-d dialog] [-t timestep] [-f max frames per session]\n");
+	printf("        VisualNovelInterpreterHeadless -e [-j threads] [-d dialog]\n");
+	printf("        VisualNovelInterpreterHeadless -x language to compile\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char *dialogPath = "Dialogs/start.dlg";
+	float timestep = 1.0f / 60.0f;
+	int maxFrames = 1000000;
+	const char *scriptPath = NULL;
+	int autoEnterPeriod = 0;
+	int nbSessions = 0;
+	int nbThreads = 1;
+	unsigned int seed = 1;
+	bool exploring = false;
+	const char *loadPath = NULL;
+	const char *savePath = NULL;
+	const char *readStatusPath = NULL;
+	const char *profilePrefix = NULL;
+	const char *recordPath = NULL;
+	const char *replayPath = NULL;
+	const char *autosavePrefix = NULL;
+	const char *persistentPath = NULL;
+	float dialogCacheBudget = 16.0f;
+	const char *language = NULL;
+	const char *compiledLanguage = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strmatch(argv[i], "-e"))
+		{
+			exploring = true;
+			continue;
+		}
+		if (i + 1 == argc)
+		{
+			print_usage();
+			return EXIT_FAILURE;
+		}
+		if (strmatch(argv[i], "-d"))
+		{
+			dialogPath = argv[++i];
+		} else if (strmatch(argv[i], "-t")) {
+			timestep = atof(argv[++i]);
+		} else if (strmatch(argv[i], "-f")) {
+			maxFrames = atoi(argv[++i]);
+		} else if (strmatch(argv[i], "-s")) {
+			scriptPath = argv[++i];
+		} else if (strmatch(argv[i], "-a")) {
+			autoEnterPeriod = atoi(argv[++i]);
+		} else if (strmatch(argv[i], "-n")) {
+			nbSessions = atoi(argv[++i]);
+		} else if (strmatch(argv[i], "-j")) {
+			nbThreads = atoi(argv[++i]);
+		} else if (strmatch(argv[i], "-r")) {
+			seed = strtoul(argv[++i], NULL, 10);
+		} else if (strmatch(argv[i], "-l")) {
+			loadPath = argv[++i];
+		} else if (strmatch(argv[i], "-o")) {
+			savePath = argv[++i];
+		} else if (strmatch(argv[i], "-k")) {
+			readStatusPath = argv[++i];
+		} else if (strmatch(argv[i], "-p")) {
+			profilePrefix = argv[++i];
+		} else if (strmatch(argv[i], "-w")) {
+			recordPath = argv[++i];
+		} else if (strmatch(argv[i], "-y")) {
+			replayPath = argv[++i];
+		} else if (strmatch(argv[i], "-u")) {
+			autosavePrefix = argv[++i];
+		} else if (strmatch(argv[i], "-v")) {
+			persistentPath = argv[++i];
+		} else if (strmatch(argv[i], "-c")) {
+			dialogCacheBudget = atof(argv[++i]);
+		} else if (strmatch(argv[i], "-g")) {
+			language = argv[++i];
+		} else if (strmatch(argv[i], "-x")) {
+			compiledLanguage = argv[++i];
+		} else {
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (compiledLanguage)
+	{
+		bool compiled = compile_strings_table(compiledLanguage);
+		if (compiled)
+		{
+			printf("Languages/%s.txt compiled into Languages/%s.str.\n", compiledLanguage, compiledLanguage);
+		}
+		for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+		{
+			buf_free(variablesNames[i]);
+		}
+		buf_free(variablesNames);
+		print_leaks();
+		return compiled ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (nbSessions > 0 || exploring)
+	{
+		if (nbThreads <= 0)
+		{
+			print_usage();
+			return EXIT_FAILURE;
+		}
+		init_graphics();
+		if (exploring)
+		{
+			explore_routes(dialogPath, nbThreads);
+		} else {
+			run_batch(dialogPath, nbSessions, nbThreads, timestep, maxFrames, seed);
+		}
+		for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+		{
+			buf_free(variablesNames[i]);
+		}
+		buf_free(variablesNames);
+		free_graphics();
+		print_leaks();
+		return EXIT_SUCCESS;
+	}
+
+	if (!scriptPath && autoEnterPeriod <= 0)
+	{
+		autoEnterPeriod = 2;
+	}
+	if (scriptPath)
+	{
+		load_script(scriptPath);
+	}
+
+	init_graphics();
+
+	init_audio();
+
+	Session *session = create_session();
+	session->history = create_history();
+	session->backlog = create_backlog();
+	session->preloader = create_preloader();
+	if (profilePrefix)
+	{
+		session->profile = create_profile();
+	}
+	if (autosavePrefix)
+	{
+		session->autosave = create_autosave(autosavePrefix, 3, 60.0f);
+	}
+	PersistentStore *persistentStore = NULL;
+	double persistentLoadingTime = 0.0;
+	if (persistentPath)
+	{
+		double persistentLoadingStart = get_time();
+		persistentStore = load_persistent_store(persistentPath);
+		persistentLoadingTime = get_time() - persistentLoadingStart;
+		session->persistentStore = persistentStore;
+	}
+	int nbRollbacks = 0;
+	ReadStatus *readStatus = NULL;
+	if (readStatusPath)
+	{
+		readStatus = load_read_status(readStatusPath);
+		session->readStatus = readStatus;
+	}
+	// a replay brings its dialog, its sentences read and every input
+	Replay *replay = NULL;
+	if (replayPath)
+	{
+		replay = load_replay(replayPath);
+		if (!replay)
+		{
+			error("could not play %s.", replayPath);
+		}
+		dialogPath = replay->dialogName;
+		session->readStatus = replay->readStatus;
+		loadPath = NULL;
+		language = replay->language;
+	}
+	if (language && !set_session_language(session, language))
+	{
+		error("could not switch to %s.", language);
+	}
+	int nbLanguageSwitches = 0;
+	double maxLanguageSwitchTime = 0.0;
+	// with a read sentences file, the run skips what earlier runs read as if the skip key was held
+	bool skipMode = readStatusPath != NULL;
+	int nbSkippingFrames = 0;
+
+	DialogCache *dialogCache = create_dialog_cache(dialogCacheBudget * 1024 * 1024);
+	session->dialogCache = dialogCache;
+	double loadingStart = get_time();
+	load_session_dialog(session, dialogPath);
+	if (loadPath && !load_session(session, loadPath))
+	{
+		error("could not load %s.", loadPath);
+	}
+	double loadingTime = get_time() - loadingStart;
+	int nbDialogsLoaded = 1;
+	ReplayRecorder *recorder = NULL;
+	if (recordPath)
+	{
+		recorder = create_replay_recorder(recordPath, session);
+	}
+	// the loaded save is stored with the first frame of the recording
+	ReplayAction replayAction = loadPath ? REPLAY_ACTION_LOAD : REPLAY_ACTION_NONE;
+
+	unsigned int currentScriptEvent = 0;
+	double interpretingTime = 0.0;
+	double maxInterpretingTime = 0.0;
+	double maxRollbackTime = 0.0;
+	int nbBacklogFrames = 0;
+	double backlogTime = 0.0;
+	double maxBacklogTime = 0.0;
+	double maxAutosaveTime = 0.0;
+	int frame = 0;
+	double simulatedTime = 0.0;
+	bool ended = false;
+	double runStart = get_time();
+
+	while (frame < maxFrames)
+	{
+		if (replay)
+		{
+			if (!read_replay_frame(replay))
+			{
+				break;
+			}
+			apply_replay_frame(replay, session);
+			timestep = replay->frame.deltaTime;
+			deltaTime = timestep;
+			simulatedTime += timestep;
+		} else {
+			for (int i = 0; i < INPUT_KEY_COUNT; i++)
+			{
+				session->inputKeysPressed[i] = false;
+			}
+			session->mouseScrollOffset = 0;
+
+			if (scriptPath)
+			{
+				while (currentScriptEvent < buf_len(scriptEvents) && scriptEvents[currentScriptEvent].frame <= frame)
+				{
+					ScriptEvent *scriptEvent = &scriptEvents[currentScriptEvent];
+					if (scriptEvent->type == SCRIPT_EVENT_TIMESTEP)
+					{
+						timestep = scriptEvent->timestep;
+					} else if (scriptEvent->frame == frame && scriptEvent->type == SCRIPT_EVENT_WHEEL) {
+						session->mouseScrollOffset += scriptEvent->scrollOffset;
+					} else if (scriptEvent->frame == frame && scriptEvent->type == SCRIPT_EVENT_LANGUAGE) {
+						double languageSwitchStart = get_time();
+						if (!set_session_language(session, strmatch(scriptEvent->language, "-") ? NULL : scriptEvent->language))
+						{
+							error("could not switch to %s at frame %d of the input script.", scriptEvent->language, frame);
+						}
+						maxLanguageSwitchTime = fmax(maxLanguageSwitchTime, get_time() - languageSwitchStart);
+						nbLanguageSwitches++;
+						replayAction = REPLAY_ACTION_LANGUAGE;
+					} else if (scriptEvent->frame == frame) {
+						session->inputKeysPressed[scriptEvent->inputKey] = true;
+					}
+					currentScriptEvent++;
+				}
+			} else if (frame % autoEnterPeriod == autoEnterPeriod - 1) {
+				session->inputKeysPressed[INPUT_KEY_ENTER] = true;
+			}
+			deltaTime = timestep;
+			session->deltaTime = timestep;
+			simulatedTime += timestep;
+
+			if (session->inputKeysPressed[INPUT_KEY_R])
+			{
+				strcopy(&session->nextDialogName, session->dialogName);
+				replayAction = REPLAY_ACTION_RELOAD;
+			} else if (session->inputKeysPressed[INPUT_KEY_PAGE_UP]) {
+				double rollbackStart = get_time();
+				if (rollback_session(session->history, session))
+				{
+					nbRollbacks++;
+					maxRollbackTime = fmax(maxRollbackTime, get_time() - rollbackStart);
+				}
+				replayAction = REPLAY_ACTION_ROLLBACK;
+			}
+
+			if (session->inputKeysPressed[INPUT_KEY_TAB])
+			{
+				skipMode = !skipMode;
+			}
+			session->skipping = skipMode;
+		}
+
+		if (session->nextDialogName)
+		{
+			loadingStart = get_time();
+			load_session_dialog(session, session->nextDialogName);
+			loadingTime += get_time() - loadingStart;
+			nbDialogsLoaded++;
+		}
+		nbSkippingFrames += session->skipping;
+
+		if (recorder)
+		{
+			record_replay_frame(recorder, session, replayAction);
+			replayAction = REPLAY_ACTION_NONE;
+		}
+
+		int nbAutosaves = session->autosave ? session->autosave->nbAutosaves : 0;
+		double interpretingStart = get_time();
+		bool running = update_session(session);
+		if (running)
+		{
+			draw_session(session);
+		}
+		double frameInterpretingTime = get_time() - interpretingStart;
+		if (recorder)
+		{
+			record_replay_hash(recorder, session);
+		}
+		if (replay)
+		{
+			check_replay_hash(replay, session);
+		}
+		interpretingTime += frameInterpretingTime;
+		if (session->backlog->open)
+		{
+			nbBacklogFrames++;
+			backlogTime += frameInterpretingTime;
+			maxBacklogTime = fmax(maxBacklogTime, frameInterpretingTime);
+		}
+		if (session->autosave && session->autosave->nbAutosaves != nbAutosaves)
+		{
+			maxAutosaveTime = fmax(maxAutosaveTime, frameInterpretingTime);
+		}
+		if (frameInterpretingTime > maxInterpretingTime)
+		{
+			maxInterpretingTime = frameInterpretingTime;
+		}
+		frame++;
+
+		// the game keeps updating the ended session until its window closes, so does its replay
+		if (!running)
+		{
+			ended = true;
+			if (!replay)
+			{
+				break;
+			}
+		}
+	}
+	double runTime = get_time() - runStart;
+
+	printf("---Headless run---\n");
+	printf("%s after %d frames, %.2fs simulated in %.3fs.\n", ended ? "dialog ended" : "stopped", frame, simulatedTime, runTime);
+	printf("%.0f frames/s.\n", runTime > 0.0 ? frame / runTime : 0.0);
+	printf("interpreter : %.3fus per frame on average, %.3fus at most.\n", frame ? interpretingTime / frame * 1e6 : 0.0, maxInterpretingTime * 1e6);
+	printf("%d dialogs loaded in %.3fms.\n\n", nbDialogsLoaded, loadingTime * 1e3);
+
+	printf("---Dialog cache---\n");
+	printf("%d hits, %d parsed, %d dialogs kept in %.1fKB.\n", dialogCache->nbHits, dialogCache->nbMisses, (int)buf_len(dialogCache->entries), dialogCache->memory / 1024.0);
+	printf("%d parsed ahead, %d of them used, %d dropped.\n\n", dialogCache->nbPrefetches, dialogCache->nbPrefetchHits, dialogCache->nbPrefetchesDropped);
+
+	if (session->localization || nbLanguageSwitches != 0)
+	{
+		printf("---Localization---\n");
+		printf("%s, %d sentences translated, %d switches taking %.3fus at most.\n\n", session->localization ? session->localization->language : "text of the scripts", session->localization ? (int)buf_len(session->localization->sentences) : 0, nbLanguageSwitches, maxLanguageSwitchTime * 1e6);
+	}
+
+	printf("---Preloading---\n");
+	printf("%d assets preloaded, %d needed before they were, %d unloaded.\n\n", session->preloader->nbPreloads, session->preloader->nbPreloadsLate, session->preloader->nbUnloads);
+
+	if (readStatus)
+	{
+		printf("---Skip---\n");
+		printf("%d frames skipping.\n\n", nbSkippingFrames);
+		save_read_status(readStatus, readStatusPath);
+		free_read_status(readStatus);
+	}
+
+	printf("---History---\n");
+	printf("%d points in %d bytes, %d rollbacks taking %.3fus at most.\n\n", session->history->nbPoints, (int)get_history_memory(session->history), nbRollbacks, maxRollbackTime * 1e6);
+
+	printf("---Backlog---\n");
+	printf("%d lines, %d frames open taking %.3fus on average, %.3fus at most.\n\n", (int)buf_len(session->backlog->lines), nbBacklogFrames, nbBacklogFrames ? backlogTime / nbBacklogFrames * 1e6 : 0.0, maxBacklogTime * 1e6);
+
+	if (session->autosave)
+	{
+		printf("---Autosave---\n");
+		printf("%d autosaves, their frames taking %.3fus at most.\n\n", session->autosave->nbAutosaves, maxAutosaveTime * 1e6);
+	}
+
+	bool replayMatched = true;
+	if (recorder)
+	{
+		printf("---Replay---\n");
+		printf("%d frames recorded in %s.\n\n", recorder->nbFrames, recordPath);
+		free_replay_recorder(recorder, session);
+	}
+	if (replay)
+	{
+		printf("---Replay---\n");
+		printf("%d frames of %s played, %d hashes checked, ", replay->nbFrames, replayPath, replay->nbHashesChecked);
+		if (replay->firstMismatchFrame == -1)
+		{
+			printf("the session matches the recording.\n\n");
+		} else {
+			printf("the session differs from the recording from frame %d.\n\n", replay->firstMismatchFrame);
+		}
+		replayMatched = replay->firstMismatchFrame == -1;
+		if (replay->readStatus)
+		{
+			free_read_status(replay->readStatus);
+		}
+		session->readStatus = readStatus;
+		free_replay(replay);
+	}
+
+	if (session->profile)
+	{
+		buf(char) reportPath = strclone(profilePrefix);
+		strappend(&reportPath, ".txt");
+		buf(char) flameGraphPath = strclone(profilePrefix);
+		strappend(&flameGraphPath, ".folded");
+		write_profile_report(session->profile, reportPath);
+		write_profile_flame_graph(session->profile, flameGraphPath);
+		printf("---Profile---\n");
+		printf("%d lines taking %.3fms, reported in %s and %s.\n\n", (int)buf_len(session->profile->lines), get_profile_total_time(session->profile) * 1e3, reportPath, flameGraphPath);
+		buf_free(reportPath);
+		buf_free(flameGraphPath);
+	}
+
+	// a session not updated yet has no state to save
+	if (savePath && session->state)
+	{
+		double savingStart = get_time();
+		save_session(session, savePath);
+		double savingTime = get_time() - savingStart;
+		wait_for_saves();
+		printf("---Save---\n");
+		printf("%s saved in %.3fus on the main thread, %.3fus with the write.\n\n", savePath, savingTime * 1e6, (get_time() - savingStart) * 1e6);
+	}
+
+	free_dialog_cache(dialogCache);
+
+	// the autosaves and persistent variables still being written read the variables names
+	if (session->autosave)
+	{
+		free_autosave(session->autosave);
+		session->autosave = NULL;
+	}
+	if (persistentStore)
+	{
+		flush_persistent_store(persistentStore);
+		printf("---Persistent---\n");
+		printf("%d variables loaded in %.3fus, %d batches appended to the log, %d compactions.\n\n", (int)buf_len(persistentStore->slots), persistentLoadingTime * 1e6, persistentStore->nbFlushes, persistentStore->nbCompactions);
+		free_persistent_store(persistentStore);
+		session->persistentStore = NULL;
+	}
+
+	printf("---Variables---\n");
+	int nbVariables = 0;
+	for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+	{
+		Variable *variable = get_variable_store_value(session->variables, i);
+		if (variable)
+		{
+			printf("	-%s", variablesNames[i]);
+			print_variable(variable);
+			nbVariables++;
+		}
+		buf_free(variablesNames[i]);
+	}
+	printf("%d variables.\n\n", nbVariables);
+	buf_free(variablesNames);
+	free_session(session);
+
+	buf_free(scriptEvents);
+	free_graphics();
+
+	free_audio();
+
+	print_leaks();
+
+	// a replay succeeds as long as it matches, wherever the recording stopped
+	return (replayPath ? replayMatched : ended) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
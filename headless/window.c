@@ -0,0 +1,54 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "../window.h"
+#include "../maths.h"
+#include "../globals.h"
+#include "../error.h"
+
+NO_RETURN void error(const char *format, ...)
+{
+	recover_from_error();
+	fprintf(stderr, "ERROR : ");
+	if (format)
+	{
+		va_list arguments;
+		va_start(arguments, format);
+		vfprintf(stderr, format, arguments);
+		va_end(arguments);
+		fprintf(stderr, "\n");
+	} else {
+		fprintf(stderr, "no error message.\n");
+	}
+	exit(EXIT_FAILURE);
+}
+
+void warning(const char *format, ...)
+{
+	fprintf(stderr, "WARNING : ");
+	if (format)
+	{
+		va_list arguments;
+		va_start(arguments, format);
+		vfprintf(stderr, format, arguments);
+		va_end(arguments);
+		fprintf(stderr, "\n");
+	} else {
+		fprintf(stderr, "no error message.\n");
+	}
+}
+
+float deltaTime = 0.0f;
+
+ivec2 windowDimensions = {800, 600};
+ivec2 mousePosition = {0, 0};
+ivec2 mouseOffset = {0, 0};
+int mouseScrollOffset = 0;
+bool isWindowActive = true;
+
+void set_window_name(const char *windowName)
+{
+}
@@ -0,0 +1,206 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "user_input.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "bytecode.h"
+#include "interpret.h"
+#include "save.h"
+#include "binary.h"
+#include "history.h"
+
+// runs of identical bytes shorter than this are kept inside the changed run, a new run costs more
+static const int HISTORY_MIN_SKIPPED_RUN = 8;
+
+History *create_history()
+{
+	History *history = xmalloc(sizeof (*history));
+	for (int i = 0; i < HISTORY_SIZE; i++)
+	{
+		history->points[i].keyframe = false;
+		history->points[i].data = NULL;
+		history->points[i].variables = NULL;
+	}
+	history->firstPoint = 0;
+	history->nbPoints = 0;
+	history->nbPointsSinceKeyframe = 0;
+	history->lastState = NULL;
+	return history;
+}
+
+// a delta is the new size followed by the changed runs, as offset, length and bytes
+static buf(unsigned char) create_delta(buf(unsigned char) oldState, buf(unsigned char) newState)
+{
+	buf(unsigned char) delta = NULL;
+	int oldSize = buf_len(oldState);
+	int newSize = buf_len(newState);
+	write_int(&delta, newSize);
+	int i = 0;
+	while (i < newSize)
+	{
+		if (i < oldSize && oldState[i] == newState[i])
+		{
+			i++;
+			continue;
+		}
+		int runStart = i;
+		int runEnd = i + 1;
+		int nbSameBytes = 0;
+		for (i++; i < newSize && nbSameBytes < HISTORY_MIN_SKIPPED_RUN; i++)
+		{
+			if (i < oldSize && oldState[i] == newState[i])
+			{
+				nbSameBytes++;
+			} else {
+				nbSameBytes = 0;
+				runEnd = i + 1;
+			}
+		}
+		write_int(&delta, runStart);
+		write_int(&delta, runEnd - runStart);
+		write_bytes(&delta, newState + runStart, runEnd - runStart);
+		i = runEnd;
+	}
+	return delta;
+}
+
+static void apply_delta(buf(unsigned char) *state, buf(unsigned char) delta)
+{
+	BinaryReader reader = {delta, buf_len(delta), 0, false};
+	int newSize = read_int(&reader);
+	while ((int)buf_len(*state) < newSize)
+	{
+		buf_add(*state, 0);
+	}
+	_buf_header(*state)->count = newSize;
+	while (reader.position < reader.size)
+	{
+		int runStart = read_int(&reader);
+		int runLength = read_int(&reader);
+		read_bytes(&reader, *state + runStart, runLength);
+	}
+}
+
+static HistoryPoint *get_history_point(History *history, int index)
+{
+	return &history->points[(history->firstPoint + index) % HISTORY_SIZE];
+}
+
+// the state at a point is its keyframe with the following deltas applied
+static buf(unsigned char) get_history_state(History *history, int index)
+{
+	int keyframeIndex = index;
+	while (!get_history_point(history, keyframeIndex)->keyframe)
+	{
+		keyframeIndex--;
+	}
+	buf(unsigned char) state = NULL;
+	apply_delta(&state, get_history_point(history, keyframeIndex)->data);
+	for (int i = keyframeIndex + 1; i <= index; i++)
+	{
+		apply_delta(&state, get_history_point(history, i)->data);
+	}
+	return state;
+}
+
+static void free_history_point(HistoryPoint *point)
+{
+	buf_free(point->data);
+	point->data = NULL;
+	free_variable_store(point->variables);
+	point->variables = NULL;
+}
+
+static void drop_oldest_history_point(History *history)
+{
+	free_history_point(get_history_point(history, 0));
+	history->firstPoint = (history->firstPoint + 1) % HISTORY_SIZE;
+	history->nbPoints--;
+}
+
+static void drop_newest_history_point(History *history)
+{
+	free_history_point(get_history_point(history, history->nbPoints - 1));
+	history->nbPoints--;
+}
+
+// costs the size of the scene and not of the variables, which are only snapshotted
+void record_history_point(History *history, Session *session)
+{
+	if (history->nbPoints == HISTORY_SIZE)
+	{
+		// the deltas following the dropped keyframe would have nothing to apply to
+		do
+		{
+			drop_oldest_history_point(history);
+		} while (history->nbPoints && !get_history_point(history, 0)->keyframe);
+	}
+
+	buf(unsigned char) state = serialize_session_state(session);
+	HistoryPoint *point = get_history_point(history, history->nbPoints);
+	point->variables = snapshot_variable_store(session->variables);
+	point->keyframe = !history->lastState || !history->nbPoints || history->nbPointsSinceKeyframe == HISTORY_KEYFRAME_PERIOD - 1;
+	// a keyframe is a delta from nothing, so both are applied the same way
+	point->data = create_delta(point->keyframe ? NULL : history->lastState, state);
+	history->nbPointsSinceKeyframe = point->keyframe ? 0 : history->nbPointsSinceKeyframe + 1;
+	history->nbPoints++;
+	buf_free(history->lastState);
+	history->lastState = state;
+}
+
+// goes back to the previous point, the point reached is recorded again when the session runs it
+bool rollback_session(History *history, Session *session)
+{
+	if (history->nbPoints < 2)
+	{
+		return false;
+	}
+	buf(unsigned char) state = get_history_state(history, history->nbPoints - 2);
+	VariableStore *variables = snapshot_variable_store(get_history_point(history, history->nbPoints - 2)->variables);
+	drop_newest_history_point(history);
+	drop_newest_history_point(history);
+
+	buf_free(history->lastState);
+	history->lastState = NULL;
+	history->nbPointsSinceKeyframe = 0;
+	if (history->nbPoints)
+	{
+		history->lastState = get_history_state(history, history->nbPoints - 1);
+		for (int i = history->nbPoints - 1; !get_history_point(history, i)->keyframe; i--)
+		{
+			history->nbPointsSinceKeyframe++;
+		}
+	}
+
+	bool loaded = load_session_state(session, state, buf_len(state), variables);
+	free_variable_store(variables);
+	buf_free(state);
+	return loaded;
+}
+
+size_t get_history_memory(History *history)
+{
+	size_t memory = sizeof (*history) + buf_len(history->lastState);
+	for (int i = 0; i < history->nbPoints; i++)
+	{
+		memory += buf_len(get_history_point(history, i)->data);
+	}
+	return memory;
+}
+
+void free_history(History *history)
+{
+	while (history->nbPoints)
+	{
+		drop_oldest_history_point(history);
+	}
+	buf_free(history->lastState);
+	xfree(history);
+}
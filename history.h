@@ -0,0 +1,33 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#define HISTORY_SIZE 512
+#define HISTORY_KEYFRAME_PERIOD 32
+
+// a point is the session at a sentence start or a choice
+// its state but the variables is stored whole for keyframes and as the bytes changed since the previous point otherwise
+typedef struct HistoryPoint
+{
+	bool keyframe;
+	buf(unsigned char) data;
+	// shares its chunks with the session and the other points, only the chunks written since the previous point are copied
+	VariableStore *variables;
+} HistoryPoint;
+
+// a ring of points, the oldest ones are dropped up to the next keyframe once it is full
+typedef struct History
+{
+	HistoryPoint points[HISTORY_SIZE];
+	int firstPoint;
+	int nbPoints;
+	int nbPointsSinceKeyframe;
+	buf(unsigned char) lastState;
+} History;
+
+History *create_history();
+void record_history_point(History *history, Session *session);
+bool rollback_session(History *history, Session *session);
+size_t get_history_memory(History *history);
+void free_history(History *history);
+
+#endif /* end of include guard: HISTORY_H */
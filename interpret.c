@@ -18,126 +18,309 @@
 #include "graphics.h"
 #include "variable.h"
 #include "dialog.h"
+#include "bytecode.h"
 #include "interpret.h"
-#include "globals_dialog.h"
+#include "history.h"
+#include "binary.h"
+#include "read_status.h"
+#include "backlog.h"
+#include "tween.h"
+#include "profile.h"
+#include "autosave.h"
+#include "persistent.h"
+#include "dialog_cache.h"
+#include "preload.h"
+#include "localization.h"
 #include "globals.h"
 
-static char *charactersNames[7];
-static Sprite *oldCharactersSprites[7];
-static Sprite *charactersSprites[7];
-static int currentSpeakerSpriteIndex;
-static Sprite *oldBackgroundSprite;
-static Sprite *backgroundSprite;
-static Sprite *choiceMarker;
-static Sprite *characterNameBox;
-static int characterNamePosition;
-static Sprite *sentenceBox;
-static Text *currentSpeaker;
-static Text *currentSentence;
-static buf(Text *) currentChoices;
-static buf(GoTo *) goToCommands;
-static bool choosing;
-static int nbChoices;
-static int currentChoice;
-static bool choicesDisplayed;
-static bool moving;
-static bool end;
-static bool displayedSpeakerName;
-static bool appearingBackground;
-static bool appearingCharacter;
-static bool displayDialogUI;
-static bool displaySpeakerName;
-static bool sentenceFirstUpdate;
-static float timeDuringCurrentChar;
-static float timeDuringCurrentBlip;
-static float currentCodeWaitTime;
-static float currentDisplayedCode;
-static float waitTimer;
-static buf(char) nextDialogStartKnotName;
-static AudioSource *music;
-static AudioSource *oldMusic;
-static AudioSource *sound;
-static AudioSource *oldSound;
-static AudioSource *blipSound;
-static bool fadingMusic;
-static bool fadingSound;
-static int textScrollOffset;
-
-void init_dialog_ui()
+
+ExecutionState *create_execution_state(const Dialog *dialog)
+{
+	ExecutionState *executionState = xmalloc(sizeof (*executionState));
+	executionState->programCounter = 0;
+	executionState->currentCue = NULL;
+	executionState->end = false;
+	executionState->conditionsCaches = NULL;
+	for (int i = 0; i < dialog->nbConditions; i++)
+	{
+		buf_add(executionState->conditionsCaches, ((ConditionCache){NULL, false, false}));
+	}
+	executionState->interpolationsCaches = NULL;
+	for (int i = 0; i < dialog->nbInterpolations; i++)
+	{
+		buf_add(executionState->interpolationsCaches, ((InterpolationCache){NULL, NULL, NULL}));
+	}
+	executionState->coloredNames = NULL;
+	executionState->namesColors = NULL;
+	for (int i = 0; i < 7; i++)
+	{
+		executionState->charactersNames[i] = NULL;
+	}
+	executionState->currentSpeakerSpriteIndex = -1;
+	executionState->characterNamePosition = 0;
+	executionState->choicesInstructions = NULL;
+	executionState->choosing = false;
+	executionState->nbChoices = 0;
+	executionState->currentChoice = 0;
+	executionState->tweens = NULL;
+	executionState->awaitingCommand = false;
+	executionState->displayDialogUI = false;
+	executionState->displaySpeakerName = false;
+	executionState->sentenceFirstUpdate = true;
+	executionState->revealTime = 0.0f;
+	executionState->interpolatedTimeline = (RevealTimeline){NULL, NULL, NULL};
+	executionState->waitTimer = 0.0f;
+	executionState->textScrollOffset = 0;
+	return executionState;
+}
+
+void free_execution_state(ExecutionState *executionState)
+{
+	for (unsigned int i = 0; i < buf_len(executionState->conditionsCaches); i++)
+	{
+		buf_free(executionState->conditionsCaches[i].dependenciesVersions);
+	}
+	buf_free(executionState->conditionsCaches);
+	for (unsigned int i = 0; i < buf_len(executionState->interpolationsCaches); i++)
+	{
+		buf_free(executionState->interpolationsCaches[i].variablesVersions);
+		buf_free(executionState->interpolationsCaches[i].string);
+		buf_free(executionState->interpolationsCaches[i].literalsStarts);
+	}
+	buf_free(executionState->interpolationsCaches);
+	for (unsigned int i = 0; i < buf_len(executionState->coloredNames); i++)
+	{
+		buf_free(executionState->coloredNames[i]);
+	}
+	buf_free(executionState->coloredNames);
+	buf_free(executionState->namesColors);
+	buf_free(executionState->choicesInstructions);
+	buf_free(executionState->tweens);
+	free_reveal_timeline(&executionState->interpolatedTimeline);
+	xfree(executionState);
+}
+
+Session *create_session()
 {
-	nextDialogStartKnotName = NULL;
+	Session *session = xmalloc(sizeof (*session));
+	session->dialog = NULL;
+	session->dialogName = NULL;
+	session->nextDialogName = NULL;
+	session->nextDialogStartKnotName = NULL;
+	session->dialogChanged = false;
+	session->variables = create_variable_store();
+	session->state = NULL;
+	session->deltaTime = 0.0f;
+	for (int i = 0; i < INPUT_KEY_COUNT; i++)
+	{
+		session->inputKeysPressed[i] = false;
+	}
+	session->mouseScrollOffset = 0;
 
-	currentSentence = create_text();
-	set_text_font(currentSentence, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_NORMAL);
-	currentSentence->color = COLOR_WHITE;
+	session->currentSentence = create_text();
+	set_text_font(session->currentSentence, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_NORMAL);
+	session->currentSentence->color = COLOR_WHITE;
 
-	currentSpeaker = create_text();
-	set_text_font(currentSpeaker, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_BIG);
-	currentSpeaker->color = COLOR_WHITE;
+	session->currentSpeaker = create_text();
+	set_text_font(session->currentSpeaker, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_BIG);
+	session->currentSpeaker->color = COLOR_WHITE;
 
-	sentenceBox = create_sprite(SPRITE_COLOR);
-	sentenceBox->color = COLOR_BLACK;
-	sentenceBox->opacity = 0.75f;
+	session->sentenceBox = create_sprite(SPRITE_COLOR);
+	session->sentenceBox->color = COLOR_BLACK;
+	session->sentenceBox->opacity = 0.75f;
 
-	characterNameBox = create_sprite(SPRITE_COLOR);
-	characterNameBox->color = COLOR_BLACK;
-	characterNameBox->opacity = 0.75f;
+	session->characterNameBox = create_sprite(SPRITE_COLOR);
+	session->characterNameBox->color = COLOR_BLACK;
+	session->characterNameBox->opacity = 0.75f;
 
-	choiceMarker = create_sprite(SPRITE_COLOR);
-	choiceMarker->color = COLOR_WHITE;
+	session->choiceMarker = create_sprite(SPRITE_COLOR);
+	session->choiceMarker->color = COLOR_WHITE;
 
-	oldBackgroundSprite = create_sprite(SPRITE_ANIMATED);
-	oldBackgroundSprite->fixedSize = true;
-	backgroundSprite = create_sprite(SPRITE_ANIMATED);
-	backgroundSprite->fixedSize = true;
+	session->oldBackgroundSprite = create_sprite(SPRITE_ANIMATED);
+	session->oldBackgroundSprite->fixedSize = true;
+	session->backgroundSprite = create_sprite(SPRITE_ANIMATED);
+	session->backgroundSprite->fixedSize = true;
 
 	for (int i = 0; i < 7; i++)
 	{
-		charactersNames[i] = NULL;
-		oldCharactersSprites[i] = create_sprite(SPRITE_ANIMATED);
-		oldCharactersSprites[i]->fixedSize = false;
-		charactersSprites[i] = create_sprite(SPRITE_ANIMATED);
-		charactersSprites[i]->fixedSize = false;
+		session->oldCharactersSprites[i] = create_sprite(SPRITE_ANIMATED);
+		session->oldCharactersSprites[i]->fixedSize = false;
+		session->charactersSprites[i] = create_sprite(SPRITE_ANIMATED);
+		session->charactersSprites[i]->fixedSize = false;
+	}
+	session->currentChoices = NULL;
+
+	reset_session_ui(session);
+
+	session->music = NULL;
+	session->oldMusic = NULL;
+	session->musicName = NULL;
+	session->sound = NULL;
+	session->oldSound = NULL;
+	session->soundName = NULL;
+
+	session->blipSound = create_audio_source("Sounds/blip normal.wav");
+	session->voice = create_voice_channel();
+	session->preloader = NULL;
+	session->localization = NULL;
+	session->history = NULL;
+	session->readStatus = NULL;
+	session->skipping = false;
+	session->backlog = NULL;
+	session->profile = NULL;
+	session->autosave = NULL;
+	session->persistentStore = NULL;
+	session->dialogCache = NULL;
+	session->leftDialogs = NULL;
+	session->currentKnot = -1;
+	return session;
+}
+
+void set_session_dialog(Session *session, Dialog *dialog, const char *dialogName)
+{
+	session->dialog = dialog;
+	if (session->dialogName != dialogName)
+	{
+		strcopy(&session->dialogName, dialogName);
+	}
+	buf_free(session->nextDialogName);
+	session->nextDialogName = NULL;
+	session->dialogChanged = true;
+	session->currentKnot = -1;
+	if (session->profile)
+	{
+		// the new dialog may be allocated where the previous one was
+		session->profile->dialog = NULL;
 	}
-	currentChoices = NULL;
-	goToCommands = NULL;
+	if (session->persistentStore)
+	{
+		apply_persistent_variables(session->persistentStore, session->variables);
+	}
+}
+
+// acquired when the session has a dialog cache, parsed otherwise
+Dialog *open_session_dialog(Session *session, const char *dialogName)
+{
+	return session->dialogCache ? acquire_dialog(session->dialogCache, dialogName) : get_dialog_from_file(dialogName);
+}
+
+// for a dialog opened but not run
+void close_session_dialog(Session *session, Dialog *dialog)
+{
+	if (session->dialogCache)
+	{
+		release_dialog(session->dialogCache, dialog);
+	} else {
+		free_dialog(dialog);
+	}
+}
 
-	currentSpeakerSpriteIndex = -1;
+// the dialog left is closed once none of its packs is shown
+void switch_session_dialog(Session *session, Dialog *dialog, const char *dialogName)
+{
+	Dialog *previousDialog = session->dialog;
+	set_session_dialog(session, dialog, dialogName);
+	if (previousDialog)
+	{
+		buf_add(session->leftDialogs, previousDialog);
+	}
+}
 
-	reset_dialog_ui();
+void load_session_dialog(Session *session, const char *dialogName)
+{
+	// opened before the previous one is closed, so reloading an unchanged dialog finds it still cached and the textures both use are not loaded again
+	switch_session_dialog(session, open_session_dialog(session, dialogName), dialogName);
+}
 
-	waitTimer = 0.0f;
+static bool is_dialog_shown(Session *session, Dialog *dialog)
+{
+	Sprite *sprites[2 + 2 * 7] = {session->backgroundSprite, session->oldBackgroundSprite};
+	for (int i = 0; i < 7; i++)
+	{
+		sprites[2 + 2 * i] = session->charactersSprites[i];
+		sprites[3 + 2 * i] = session->oldCharactersSprites[i];
+	}
+	for (int i = 0; i < 2 + 2 * 7; i++)
+	{
+		for (unsigned int j = 0; sprites[i]->animations && j < buf_len(dialog->backgroundPacks); j++)
+		{
+			if (sprites[i]->animations == dialog->backgroundPacks[j])
+			{
+				return true;
+			}
+		}
+		for (unsigned int j = 0; sprites[i]->animations && j < buf_len(dialog->charactersAnimations); j++)
+		{
+			if (sprites[i]->animations == dialog->charactersAnimations[j])
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
 
-	music = NULL;
-	oldMusic = NULL;
-	sound = NULL;
-	oldSound = NULL;
+// called each frame while a dialog left is still shown, the sprites using it being cleared by the new dialog
+static void release_left_dialogs(Session *session)
+{
+	unsigned int nbLeftDialogs = 0;
+	for (unsigned int i = 0; i < buf_len(session->leftDialogs); i++)
+	{
+		Dialog *dialog = session->leftDialogs[i];
+		if (dialog != session->dialog && is_dialog_shown(session, dialog))
+		{
+			session->leftDialogs[nbLeftDialogs++] = dialog;
+		} else if (session->dialogCache || dialog != session->dialog) {
+			close_session_dialog(session, dialog);
+		}
+	}
+	if (session->leftDialogs)
+	{
+		_buf_header(session->leftDialogs)->count = nbLeftDialogs;
+	}
+}
 
-	blipSound = create_audio_source("Sounds/blip normal.wav");
+static void place_current_speaker(Session *session)
+{
+	ExecutionState *state = session->state;
+	ivec2 currentSpeakerPosition;
+	if (state->characterNamePosition == 1)
+	{
+		currentSpeakerPosition.x = 0.015f * windowDimensions.x;
+	} else {
+		currentSpeakerPosition.x = windowDimensions.x * 0.985f - session->currentSpeaker->width;
+	}
+	currentSpeakerPosition.y = windowDimensions.y * 0.8f - session->currentSpeaker->height - 8;
+	set_text_position(session->currentSpeaker, currentSpeakerPosition);
+	session->characterNameBox->position.x = session->currentSpeaker->position.x - 2;
+	session->characterNameBox->position.y = session->currentSpeaker->position.y - session->currentSpeaker->font->descent + 6;
+	session->characterNameBox->width = session->currentSpeaker->width + 4;
+	session->characterNameBox->height = session->currentSpeaker->height + session->currentSpeaker->font->descent + 4;
 }
 
-void reset_dialog_ui()
+void reset_session_ui(Session *session)
 {
-	set_text_position(currentSentence, (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y - 4});
-	set_text_width_limit(currentSentence, 0.97f * windowDimensions.x);
+	ExecutionState *state = session->state;
+	set_text_position(session->currentSentence, (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y - 4});
+	set_text_width_limit(session->currentSentence, 0.97f * windowDimensions.x);
 
-	sentenceBox->position.y = 0.8f * windowDimensions.y;
-	sentenceBox->width = windowDimensions.x;
-	sentenceBox->height = 0.2f * windowDimensions.y;
+	session->sentenceBox->position.y = 0.8f * windowDimensions.y;
+	session->sentenceBox->width = windowDimensions.x;
+	session->sentenceBox->height = 0.2f * windowDimensions.y;
 
-	choiceMarker->position.x = 0.005f * windowDimensions.x;
-	choiceMarker->width = 0.005f * windowDimensions.x;
-	choiceMarker->height = choiceMarker->width;
+	session->choiceMarker->position.x = 0.005f * windowDimensions.x;
+	session->choiceMarker->width = 0.005f * windowDimensions.x;
+	session->choiceMarker->height = session->choiceMarker->width;
 
-	oldBackgroundSprite->width = windowDimensions.x;
-	oldBackgroundSprite->height = windowDimensions.y;
+	session->oldBackgroundSprite->width = windowDimensions.x;
+	session->oldBackgroundSprite->height = windowDimensions.y;
 
-	backgroundSprite->width = windowDimensions.x;
-	backgroundSprite->height = windowDimensions.y;
+	session->backgroundSprite->width = windowDimensions.x;
+	session->backgroundSprite->height = windowDimensions.y;
 
 	for (int position = 0; position < 7; position++)
 	{
-		Sprite *characterSprite = charactersSprites[position];
+		Sprite *characterSprite = session->charactersSprites[position];
 		if (!characterSprite->animations)
 		{
 			continue;
@@ -153,24 +336,29 @@ void reset_dialog_ui()
 		}
 	}
 
-	if (currentSpeakerSpriteIndex != -1)
+	if (!state)
+	{
+		return;
+	}
+
+	if (state->currentSpeakerSpriteIndex != -1)
 	{
-		Sprite *currentSpeakerSprite = charactersSprites[currentSpeakerSpriteIndex];
-		if (currentSpeakerSprite->currentAnimation != -1 && currentSpeakerSprite->animations[currentSpeakerSprite->currentAnimation]->currentAnimationPhase != -1)
+		Sprite *currentSpeakerSprite = session->charactersSprites[state->currentSpeakerSpriteIndex];
+		if (currentSpeakerSprite->animations && currentSpeakerSprite->currentAnimation != -1 && currentSpeakerSprite->animationCursor.currentAnimationPhase != -1)
 		{
-			AnimationPhase *currentAnimationPhase = currentSpeakerSprite->animations[currentSpeakerSprite->currentAnimation]->animationPhases[currentSpeakerSprite->animations[currentSpeakerSprite->currentAnimation]->currentAnimationPhase];
+			AnimationPhase *currentAnimationPhase = currentSpeakerSprite->animations[currentSpeakerSprite->currentAnimation]->animationPhases[currentSpeakerSprite->animationCursor.currentAnimationPhase];
 			if (currentAnimationPhase->responsive)
 			{
-				currentSpeakerSprite->position.x = (windowDimensions.x * currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->responsiveWidth * windowDimensions.x / 2);
+				currentSpeakerSprite->position.x = (windowDimensions.x * state->currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->responsiveWidth * windowDimensions.x / 2);
 				currentSpeakerSprite->position.y = windowDimensions.y - (currentAnimationPhase->responsiveHeight * windowDimensions.y);
 			} else {
-				currentSpeakerSprite->position.x = (windowDimensions.x * currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->pixelWidth / 2);
+				currentSpeakerSprite->position.x = (windowDimensions.x * state->currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->pixelWidth / 2);
 				currentSpeakerSprite->position.y = windowDimensions.y - currentAnimationPhase->pixelHeight;
 			}
 		}
 	}
 
-	for (int i = 0; i < nbChoices; i++)
+	for (int i = 0; i < state->nbChoices; i++)
 	{
 		int x = 0.015f * windowDimensions.x;
 		int y;
@@ -178,1063 +366,1088 @@ void reset_dialog_ui()
 		{
 			y = 0.8f * windowDimensions.y + 2;
 		} else {
-			y = currentChoices[i - 1]->position.y + currentChoices[i - 1]->height + 4;
+			y = session->currentChoices[i - 1]->position.y + session->currentChoices[i - 1]->height + 4;
 		}
-		set_text_position(currentChoices[i], (ivec2){x, y});
-		set_text_width_limit(currentChoices[i], 0.985f * windowDimensions.x);
-		if (currentChoice == i)
+		set_text_position(session->currentChoices[i], (ivec2){x, y});
+		set_text_width_limit(session->currentChoices[i], 0.985f * windowDimensions.x);
+		if (state->currentChoice == i)
 		{
-			choiceMarker->position.y = y + ((currentChoices[currentChoice]->height - choiceMarker->height) / 2) - currentChoices[currentChoice]->font->descent + 2;
+			session->choiceMarker->position.y = y + ((session->currentChoices[state->currentChoice]->height - session->choiceMarker->height) / 2) - session->currentChoices[state->currentChoice]->font->descent + 2;
 		}
 	}
 
-	ivec2 currentSpeakerPosition;
-	if (characterNamePosition == 1)
-	{
-		currentSpeakerPosition.x = 0.015f * windowDimensions.x;
-	} else {
-		currentSpeakerPosition.x = windowDimensions.x * 0.985f - currentSpeaker->width;
-	}
-	currentSpeakerPosition.y = windowDimensions.y * 0.8f - currentSpeaker->height - 8;
-	set_text_position(currentSpeaker, currentSpeakerPosition);
-	characterNameBox->position.x = currentSpeaker->position.x - 2;
-	characterNameBox->position.y = currentSpeaker->position.y - currentSpeaker->font->descent + 6;
-	characterNameBox->width = currentSpeaker->width + 4;
-	characterNameBox->height = currentSpeaker->height + currentSpeaker->font->descent + 4;
+	place_current_speaker(session);
 }
 
-void free_dialog_ui()
+void free_session(Session *session)
 {
-	free_text(currentSentence);
-	free_text(currentSpeaker);
-	free_sprite(sentenceBox);
-	free_sprite(characterNameBox);
-	free_sprite(choiceMarker);
-	for (unsigned int i = 0; i < buf_len(currentChoices); i++)
-	{
-		free_text(currentChoices[i]);
-	}
-	buf_free(currentChoices);
-	buf_free(goToCommands);
-	oldBackgroundSprite->animations = NULL;
-	backgroundSprite->animations = NULL;
-	free_sprite(oldBackgroundSprite);
-	free_sprite(backgroundSprite);
+	free_text(session->currentSentence);
+	free_text(session->currentSpeaker);
+	free_sprite(session->sentenceBox);
+	free_sprite(session->characterNameBox);
+	free_sprite(session->choiceMarker);
+	for (unsigned int i = 0; i < buf_len(session->currentChoices); i++)
+	{
+		free_text(session->currentChoices[i]);
+	}
+	buf_free(session->currentChoices);
+	if (session->state)
+	{
+		free_execution_state(session->state);
+	}
+	session->oldBackgroundSprite->animations = NULL;
+	session->backgroundSprite->animations = NULL;
+	free_sprite(session->oldBackgroundSprite);
+	free_sprite(session->backgroundSprite);
 	for (int i = 0; i < 7; i++)
 	{
-		oldCharactersSprites[i]->animations = NULL;
-		free_sprite(oldCharactersSprites[i]);
-		charactersSprites[i]->animations = NULL;
-		free_sprite(charactersSprites[i]);
+		session->oldCharactersSprites[i]->animations = NULL;
+		free_sprite(session->oldCharactersSprites[i]);
+		session->charactersSprites[i]->animations = NULL;
+		free_sprite(session->charactersSprites[i]);
 	}
 
-	if (music)
+	if (session->music)
 	{
-		stop_audio_source(music);
-		xfree(music);
+		stop_audio_source(session->music);
+		xfree(session->music);
 	}
 
-	if (oldMusic)
+	if (session->oldMusic)
 	{
-		stop_audio_source(oldMusic);
-		xfree(oldMusic);
+		stop_audio_source(session->oldMusic);
+		xfree(session->oldMusic);
 	}
 
-	if (sound)
+	if (session->sound)
 	{
-		stop_audio_source(sound);
-		xfree(sound);
+		stop_audio_source(session->sound);
+		xfree(session->sound);
 	}
 
-	if (oldSound)
+	if (session->oldSound)
 	{
-		stop_audio_source(oldSound);
-		xfree(oldSound);
+		stop_audio_source(session->oldSound);
+		xfree(session->oldSound);
 	}
 
-	stop_audio_source(blipSound);
-	xfree(blipSound);
+	stop_audio_source(session->blipSound);
+	xfree(session->blipSound);
+	free_voice_channel(session->voice);
+
+	buf_free(session->musicName);
+	buf_free(session->soundName);
+	if (session->history)
+	{
+		free_history(session->history);
+	}
+	if (session->backlog)
+	{
+		free_backlog(session->backlog);
+	}
+	if (session->profile)
+	{
+		free_profile(session->profile);
+	}
+	if (session->autosave)
+	{
+		free_autosave(session->autosave);
+	}
+	if (session->preloader)
+	{
+		free_preloader(session->preloader);
+	}
+	if (session->localization)
+	{
+		free_localization(session->localization);
+	}
+	// with a dialog cache, the dialogs left are freed with the cache
+	for (unsigned int i = 0; !session->dialogCache && i < buf_len(session->leftDialogs); i++)
+	{
+		free_dialog(session->leftDialogs[i]);
+	}
+	buf_free(session->leftDialogs);
+	free_variable_store(session->variables);
+	buf_free(session->dialogName);
+	buf_free(session->nextDialogName);
+	buf_free(session->nextDialogStartKnotName);
+	xfree(session);
 }
 
-static bool update_go_to(GoTo *goTo)
+static void go_to(Session *session, GoTo *goTo, int target)
 {
+	ExecutionState *state = session->state;
 	if (goTo->dialogFile)
 	{
-		end = true;
-		moving = true;
-		strcopy(&nextDialogName, "Dialogs/");
-		strappend(&nextDialogName, goTo->dialogFile);
-		strcopy(&nextDialogStartKnotName, goTo->knotToGo);
+		state->end = true;
+		strcopy(&session->nextDialogName, "Dialogs/");
+		strappend(&session->nextDialogName, goTo->dialogFile);
+		strcopy(&session->nextDialogStartKnotName, goTo->knotToGo);
+	} else if (target == -1) {
+		error("could not find knot labeled %s in %s.", goTo->knotToGo, session->dialogName);
 	} else {
-		if (strmatch(goTo->knotToGo, "end"))
+		state->programCounter = target;
+	}
+}
+
+// fades and waits are collapsed when skipping, they finish on their next update
+static const float SKIP_DELTA_TIME = 1000.0f;
+
+static float get_delta_time(Session *session)
+{
+	return session->skipping ? SKIP_DELTA_TIME : session->deltaTime;
+}
+
+static void update_assign(Session *session, Assignment *assign)
+{
+	Variable *value = resolve_logic_expression(session->variables, assign->logicExpression);
+	PersistentStore *store = session->persistentStore;
+	if (store && assign->persistent)
+	{
+		set_persistent_variable(store, assign->variableSlot, value);
+	} else if (store && is_variable_persistent(store, assign->variableSlot)) {
+		// a plain assignment only gives a default to a variable assigned persistently
+		free_variable(value);
+		value = get_persistent_variable(store, assign->variableSlot);
+	}
+	set_variable(session->variables, assign->variableSlot, value);
+}
+
+static int get_character_x(Sprite *characterSprite, int position)
+{
+	AnimationPhase *firstAnimationPhase = characterSprite->animations[characterSprite->currentAnimation]->animationPhases[0];
+	if (firstAnimationPhase->responsive)
+	{
+		return (windowDimensions.x * position / 6.0f) - (firstAnimationPhase->responsiveWidth * windowDimensions.x / 2);
+	}
+	return (windowDimensions.x * position / 6.0f) - (firstAnimationPhase->pixelWidth / 2);
+}
+
+// the packs the dialog left out are the preloader's, one still being preloaded is waited for and one not preloaded is loaded at once
+// a session without a preloader ignores #preload, its dialogs load every pack themselves
+buf(Animation *) get_session_pack(Session *session, Dialog *dialog, AssetType type, int index)
+{
+	buf(Animation *) pack = (type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations)[index];
+	if (pack)
+	{
+		return pack;
+	} else if (!session->preloader) {
+		return load_dialog_pack(dialog, type, index);
+	}
+	const char *name = (type == ASSET_BACKGROUND ? dialog->backgroundPacksNames : dialog->charactersNames)[index];
+	finish_preload(session->preloader, dialog, type, name);
+	pack = find_preloaded_pack(session->preloader, type, name);
+	if (!pack)
+	{
+		if (session->profile)
 		{
-			end = true;
-			moving = true;
-		} else {
-			bool foundGoToDestination = false;
-			for (int i = 0; buf_len(interpretingDialog->knots); i++)
+			count_profile_asset_load(session->profile);
+		}
+		pack = load_preloader_pack(session->preloader, type, name);
+	}
+	return pack;
+}
+
+// a sprite still showing a pack of a dialog left takes the pack of the same name of the new dialog, whose textures are the same
+// the pack left stays shown if the new dialog has none with the animation played
+static void move_sprite_to_dialog(Session *session, Sprite *sprite, AssetType type)
+{
+	for (unsigned int i = 0; sprite->animations && i < buf_len(session->leftDialogs); i++)
+	{
+		Dialog *dialog = session->leftDialogs[i];
+		buf(buf(Animation *)) packs = type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations;
+		for (unsigned int j = 0; j < buf_len(packs); j++)
+		{
+			if (sprite->animations != packs[j])
 			{
-				if (strmatch(interpretingDialog->knots[i]->name, goTo->knotToGo))
-				{
-					interpretingDialog->currentKnot = i;
-					moving = true;
-					foundGoToDestination = true;
-					break;
-				}
+				continue;
 			}
-			if (!foundGoToDestination)
+			int index = find_dialog_asset(session->dialog, type, (type == ASSET_BACKGROUND ? dialog->backgroundPacksNames : dialog->charactersNames)[j]);
+			if (index == -1)
 			{
-				error("could not find knot labeled %s in %s.", goTo->knotToGo, interpretingDialogName);
+				return;
 			}
+			buf(Animation *) pack = get_session_pack(session, session->dialog, type, index);
+			const Animation *animation = sprite->animations[sprite->currentAnimation];
+			if ((unsigned int)sprite->currentAnimation < buf_len(pack) && strmatch(pack[sprite->currentAnimation]->name, animation->name)
+				&& buf_len(pack[sprite->currentAnimation]->animationPhases) == buf_len(animation->animationPhases))
+			{
+				sprite->animations = pack;
+			}
+			return;
 		}
 	}
-	return true;
 }
 
-static bool update_assign(Assignment *assign)
+static AudioSource *get_session_audio_source(Session *session, AssetType type, const char *name, const char *path)
 {
-	bool foundVariable = false;
-	for (unsigned int i = 0; i < buf_len(variablesNames); i++)
+	AudioSource *audioSource = NULL;
+	if (session->preloader)
+	{
+		finish_preload(session->preloader, session->dialog, type, name);
+		audioSource = take_preloaded_audio_source(session->preloader, path);
+	}
+	if (!audioSource)
 	{
-		if (strmatch(assign->identifier, variablesNames[i]))
+		audioSource = create_audio_source(path);
+		if (session->profile)
 		{
-			free_variable(variablesValues[i]);
-			variablesValues[i] = resolve_logic_expression(assign->logicExpression);
-			foundVariable = true;
+			count_profile_asset_load(session->profile);
 		}
 	}
-	if (!foundVariable)
+	return audioSource;
+}
+
+// a pack still shown stays
+static void unload_session_asset(Session *session, AssetType type, const char *name)
+{
+	if (type == ASSET_BACKGROUND || type == ASSET_CHARACTER)
 	{
-		buf_add(variablesNames, strclone(assign->identifier));
-		buf_add(variablesValues, resolve_logic_expression(assign->logicExpression));
+		buf(Animation *) pack = find_preloaded_pack(session->preloader, type, name);
+		bool shown = pack && (session->backgroundSprite->animations == pack || session->oldBackgroundSprite->animations == pack);
+		for (int i = 0; i < 7; i++)
+		{
+			shown |= pack && (session->charactersSprites[i]->animations == pack || session->oldCharactersSprites[i]->animations == pack);
+		}
+		if (shown)
+		{
+			warning("in %s, %s is still shown, it is not unloaded.", session->dialogName, name);
+			return;
+		}
 	}
-	return true;
+	unload_asset(session->preloader, session->dialog, type, name);
 }
 
-static bool update_command(Command *command)
+// applies the command and starts its transitions, the instruction owner waits for the ones it owns
+static void start_command(Session *session, Command *command, int owner)
 {
+	ExecutionState *state = session->state;
 	if (command->type == COMMAND_SET_BACKGROUND)
 	{
-		displayDialogUI = false;
-		if (!appearingBackground)
+		state->displayDialogUI = false;
+		const char *backgroundName = command->arguments[0]->string;
+		const char *animationName = command->arguments[1]->string;
+		bool foundPack = false;
+		for (unsigned int i = 0; i < buf_len(session->dialog->backgroundPacksNames); i++)
 		{
-			const char *backgroundName = command->arguments[0]->string;
-			const char *animationName = command->arguments[1]->string;
-			bool foundPack = false;
-			for (unsigned int i = 0; i < buf_len(interpretingDialog->backgroundPacksNames); i++)
+			if (strmatch(backgroundName, session->dialog->backgroundPacksNames[i]))
 			{
-				if (strmatch(backgroundName, interpretingDialog->backgroundPacksNames[i]))
+				cancel_tweens(session, TWEEN_TARGET_BACKGROUND, 0);
+				if (session->backgroundSprite->animations)
 				{
-					if (backgroundSprite->animations)
-					{
-						oldBackgroundSprite->animations = backgroundSprite->animations;
-						oldBackgroundSprite->currentAnimation = backgroundSprite->currentAnimation;
-					}
-					backgroundSprite->animations = interpretingDialog->backgroundPacks[i];
-					foundPack = true;
-					bool foundAnimation = false;
-					for (unsigned int j = 0; j < buf_len(backgroundSprite->animations); j++)
+					cancel_tweens(session, TWEEN_TARGET_OLD_BACKGROUND, 0);
+					session->oldBackgroundSprite->animations = session->backgroundSprite->animations;
+					session->oldBackgroundSprite->currentAnimation = session->backgroundSprite->currentAnimation;
+					session->oldBackgroundSprite->animationCursor = session->backgroundSprite->animationCursor;
+					session->oldBackgroundSprite->opacity = session->backgroundSprite->opacity;
+				}
+				session->backgroundSprite->animations = get_session_pack(session, session->dialog, ASSET_BACKGROUND, i);
+				foundPack = true;
+				bool foundAnimation = false;
+				for (unsigned int j = 0; j < buf_len(session->backgroundSprite->animations); j++)
+				{
+					if (strmatch(animationName, session->backgroundSprite->animations[j]->name))
 					{
-						if (strmatch(animationName, backgroundSprite->animations[j]->name))
+						session->backgroundSprite->currentAnimation = j;
+						reset_animation(&session->backgroundSprite->animationCursor);
+						if (session->backgroundSprite->animations == session->oldBackgroundSprite->animations && session->oldBackgroundSprite->currentAnimation == j)
 						{
-							backgroundSprite->currentAnimation = j;
-							backgroundSprite->animations[j]->currentAnimationPhase = 0;
-							if (backgroundSprite->animations == oldBackgroundSprite->animations && oldBackgroundSprite->currentAnimation == j && oldBackgroundSprite->animations[j]->currentAnimationPhase == 0)
-							{
-								oldBackgroundSprite->animations = NULL;
-								return true;
-							}
-							foundAnimation = true;
-							break;
+							session->oldBackgroundSprite->animations = NULL;
+							start_tween(session, TWEEN_TARGET_BACKGROUND, 0, TWEEN_PROPERTY_OPACITY, 1.0f, 1.0f, EASING_LINEAR, TWEEN_END_NONE, owner);
+							return;
 						}
+						foundAnimation = true;
+						break;
 					}
-					if (!foundAnimation)
-					{
-						error("background %s of background pack %s does not exist.", animationName, backgroundName);
-					}
-					break;
-				}
-			}
-			if (!foundPack)
-			{
-				error("background pack %s does not exist.", backgroundName);
-			}
-			backgroundSprite->opacity = 0.0f;
-			appearingBackground = true;
-			return false;
-		} else {
-			if (backgroundSprite->opacity >= 1.0f)
-			{
-				if (oldBackgroundSprite->animations)
-				{
-					oldBackgroundSprite->opacity = 1.0f;
-					oldBackgroundSprite->animations = NULL;
 				}
-				backgroundSprite->opacity = 1.0f;
-				appearingBackground = false;
-			} else {
-				if (oldBackgroundSprite->animations)
+				if (!foundAnimation)
 				{
-					oldBackgroundSprite->opacity -= deltaTime;
+					error("background %s of background pack %s does not exist.", animationName, backgroundName);
 				}
-				backgroundSprite->opacity += deltaTime;
-				return false;
+				break;
 			}
 		}
-	} else if (command->type == COMMAND_CLEAR_BACKGROUND) {
-		if (backgroundSprite->opacity > 0.0f)
+		if (!foundPack)
 		{
-			backgroundSprite->opacity -= deltaTime;
-			return false;
-		} else {
-			backgroundSprite->opacity = 1.0f;
-			backgroundSprite->animations = NULL;
+			error("background pack %s does not exist.", backgroundName);
 		}
+		start_tween(session, TWEEN_TARGET_OLD_BACKGROUND, 0, TWEEN_PROPERTY_OPACITY, 0.0f, 1.0f, EASING_LINEAR, TWEEN_END_HIDE, owner);
+		session->backgroundSprite->opacity = 0.0f;
+		start_tween(session, TWEEN_TARGET_BACKGROUND, 0, TWEEN_PROPERTY_OPACITY, 1.0f, 1.0f, EASING_LINEAR, TWEEN_END_NONE, owner);
+	} else if (command->type == COMMAND_CLEAR_BACKGROUND) {
+		start_tween(session, TWEEN_TARGET_BACKGROUND, 0, TWEEN_PROPERTY_OPACITY, 0.0f, 1.0f, EASING_LINEAR, TWEEN_END_HIDE, owner);
 	} else if (command->type == COMMAND_SET_CHARACTER) {
 		int position = command->arguments[0]->numeric;
-		Sprite *characterSprite = charactersSprites[position];
-		Sprite *oldCharacterSprite = oldCharactersSprites[position];
-		if (!appearingCharacter)
-		{
-			const char *characterName = command->arguments[1]->string;
-			const char *animationName = command->arguments[2]->string;
-			bool foundCharacter = false;
-			for (unsigned int i = 0; i < buf_len(interpretingDialog->charactersNames); i++)
+		Sprite *characterSprite = session->charactersSprites[position];
+		Sprite *oldCharacterSprite = session->oldCharactersSprites[position];
+		const char *characterName = command->arguments[1]->string;
+		const char *animationName = command->arguments[2]->string;
+		bool foundCharacter = false;
+		for (unsigned int i = 0; i < buf_len(session->dialog->charactersNames); i++)
+		{
+			if (strmatch(characterName, session->dialog->charactersNames[i]))
 			{
-				if (strmatch(characterName, interpretingDialog->charactersNames[i]))
+				state->charactersNames[position] = session->dialog->charactersNames[i];
+				cancel_tweens(session, TWEEN_TARGET_CHARACTER, position);
+				if (characterSprite->animations)
 				{
-					charactersNames[position] = interpretingDialog->charactersNames[i];
-					if (characterSprite->animations)
-					{
-						oldCharacterSprite->animations = characterSprite->animations;
-						oldCharacterSprite->position = characterSprite->position;
-						oldCharacterSprite->currentAnimation = characterSprite->currentAnimation;
-						oldCharacterSprite->animations[oldCharacterSprite->currentAnimation]->currentAnimationPhase = 0;
-					}
-					characterSprite->animations = interpretingDialog->charactersAnimations[i];
-					bool foundAnimation = false;
-					for (unsigned int j = 0; j < buf_len(characterSprite->animations); j++)
+					cancel_tweens(session, TWEEN_TARGET_OLD_CHARACTER, position);
+					oldCharacterSprite->animations = characterSprite->animations;
+					oldCharacterSprite->position = characterSprite->position;
+					oldCharacterSprite->currentAnimation = characterSprite->currentAnimation;
+					oldCharacterSprite->animationCursor = characterSprite->animationCursor;
+					oldCharacterSprite->animationCursor.currentAnimationPhase = 0;
+					oldCharacterSprite->opacity = characterSprite->opacity;
+				}
+				characterSprite->animations = get_session_pack(session, session->dialog, ASSET_CHARACTER, i);
+				bool foundAnimation = false;
+				for (unsigned int j = 0; j < buf_len(characterSprite->animations); j++)
+				{
+					if (strmatch(animationName, characterSprite->animations[j]->name))
 					{
-						Animation *currentAnimation = characterSprite->animations[j];
-						if (strmatch(animationName, currentAnimation->name))
+						characterSprite->currentAnimation = j;
+						characterSprite->position.x = get_character_x(characterSprite, position);
+						AnimationPhase *firstAnimationPhase = characterSprite->animations[j]->animationPhases[0];
+						if (firstAnimationPhase->responsive)
 						{
-							if (currentAnimation->animationPhases[0]->responsive)
-							{
-								characterSprite->position.x = (windowDimensions.x * position / 6.0f) - (currentAnimation->animationPhases[0]->responsiveWidth * windowDimensions.x / 2);
-								characterSprite->position.y = windowDimensions.y - (currentAnimation->animationPhases[0]->responsiveHeight * windowDimensions.y);
-							} else {
-								characterSprite->position.x = (windowDimensions.x * position / 6.0f) - (currentAnimation->animationPhases[0]->pixelWidth / 2);
-								characterSprite->position.y = windowDimensions.y - currentAnimation->animationPhases[0]->pixelHeight;
-							}
-							characterSprite->currentAnimation = j;
-							characterSprite->animations[characterSprite->currentAnimation]->currentAnimationPhase = 0;
-							if (characterSprite->animations == oldCharacterSprite->animations && oldCharacterSprite->currentAnimation == j && oldCharacterSprite->animations[j]->currentAnimationPhase == 0)
-							{
-								oldCharacterSprite->animations = NULL;
-								return true;
-							}
-							foundAnimation = true;
-							break;
+							characterSprite->position.y = windowDimensions.y - (firstAnimationPhase->responsiveHeight * windowDimensions.y);
+						} else {
+							characterSprite->position.y = windowDimensions.y - firstAnimationPhase->pixelHeight;
 						}
+						reset_animation(&characterSprite->animationCursor);
+						if (characterSprite->animations == oldCharacterSprite->animations && oldCharacterSprite->currentAnimation == j)
+						{
+							oldCharacterSprite->animations = NULL;
+							start_tween(session, TWEEN_TARGET_CHARACTER, position, TWEEN_PROPERTY_OPACITY, 1.0f, 0.5f, EASING_LINEAR, TWEEN_END_NONE, owner);
+							return;
+						}
+						foundAnimation = true;
+						break;
 					}
-					if (!foundAnimation)
-					{
-						error("animation %s of character %s does not exist.", animationName, characterName);
-					}
-					foundCharacter = true;
-					break;
-				}
-			}
-			if (!foundCharacter)
-			{
-				error("character %s does not exist.", characterName);
-			}
-			characterSprite->opacity = 0.0f;
-			appearingCharacter = true;
-			return false;
-		} else {
-			if (characterSprite->opacity >= 1.0f)
-			{
-				if (oldCharacterSprite->animations)
-				{
-					oldCharacterSprite->opacity = 1.0f;
-					oldCharacterSprite->animations = NULL;
 				}
-				characterSprite->opacity = 1.0f;
-				appearingCharacter = false;
-			} else {
-				if (oldCharacterSprite->animations)
+				if (!foundAnimation)
 				{
-					oldCharacterSprite->opacity -= deltaTime * 2;
+					error("animation %s of character %s does not exist.", animationName, characterName);
 				}
-				characterSprite->opacity += deltaTime * 2;
-				return false;
+				foundCharacter = true;
+				break;
 			}
 		}
-	} else if (command->type == COMMAND_CLEAR_CHARACTER_POSITION) {
-		int position = command->arguments[0]->numeric;
-		Sprite *characterSprite = charactersSprites[position];
-		if (characterSprite->opacity > 0.0f)
+		if (!foundCharacter)
 		{
-			characterSprite->opacity -= deltaTime * 2;
-			return false;
-		} else {
-			characterSprite->opacity = 1.0f;
-			characterSprite->animations = NULL;
-			charactersNames[position] = NULL;
+			error("character %s does not exist.", characterName);
 		}
+		start_tween(session, TWEEN_TARGET_OLD_CHARACTER, position, TWEEN_PROPERTY_OPACITY, 0.0f, 0.5f, EASING_LINEAR, TWEEN_END_HIDE, owner);
+		characterSprite->opacity = 0.0f;
+		start_tween(session, TWEEN_TARGET_CHARACTER, position, TWEEN_PROPERTY_OPACITY, 1.0f, 0.5f, EASING_LINEAR, TWEEN_END_NONE, owner);
+	} else if (command->type == COMMAND_CLEAR_CHARACTER_POSITION) {
+		start_tween(session, TWEEN_TARGET_CHARACTER, command->arguments[0]->numeric, TWEEN_PROPERTY_OPACITY, 0.0f, 0.5f, EASING_LINEAR, TWEEN_END_HIDE, owner);
 	} else if (command->type == COMMAND_CLEAR_CHARACTER_POSITIONS) {
-		bool fading = false;
 		for (int i = 0; i < 7; i++)
 		{
-			if (charactersSprites[i]->animations)
-			{
-				if (charactersSprites[i]->opacity > 0.0f)
-				{
-					charactersSprites[i]->opacity -= deltaTime * 2;
-					fading = true;
-				} else {
-					charactersSprites[i]->opacity = 1.0f;
-					charactersSprites[i]->animations = NULL;
-					charactersNames[i] = NULL;
-				}
-			}
+			start_tween(session, TWEEN_TARGET_CHARACTER, i, TWEEN_PROPERTY_OPACITY, 0.0f, 0.5f, EASING_LINEAR, TWEEN_END_HIDE, owner);
 		}
-		if (fading)
+	} else if (command->type == COMMAND_MOVE_CHARACTER) {
+		int position = command->arguments[0]->numeric;
+		int newPosition = command->arguments[1]->numeric;
+		Sprite *characterSprite = session->charactersSprites[position];
+		if (position != newPosition && characterSprite->animations)
 		{
-			return false;
+			// the character at the new position leaves at once
+			cancel_tweens(session, TWEEN_TARGET_CHARACTER, newPosition);
+			session->charactersSprites[newPosition]->animations = NULL;
+			session->charactersSprites[newPosition]->opacity = 1.0f;
+			session->charactersSprites[position] = session->charactersSprites[newPosition];
+			session->charactersSprites[newPosition] = characterSprite;
+			state->charactersNames[newPosition] = state->charactersNames[position];
+			state->charactersNames[position] = NULL;
+			if (state->currentSpeakerSpriteIndex == position)
+			{
+				state->currentSpeakerSpriteIndex = newPosition;
+			}
+			move_tweens(session, TWEEN_TARGET_CHARACTER, position, newPosition);
+			start_tween(session, TWEEN_TARGET_CHARACTER, newPosition, TWEEN_PROPERTY_POSITION_X, get_character_x(characterSprite, newPosition), 0.5f, EASING_IN_OUT, TWEEN_END_NONE, owner);
 		}
 	} else if (command->type == COMMAND_PLAY_MUSIC) {
-		if (!fadingMusic)
+		bool foundMusic = false;
+		const char *musicName = command->arguments[0]->string;
+		for (unsigned int i = 0; i < buf_len(session->dialog->musicsNames); i++)
 		{
-			bool foundMusic = false;
-			const char *musicName = command->arguments[0]->string;
-			for (unsigned int i = 0; i < buf_len(interpretingDialog->musicsNames); i++)
+			if (strmatch(musicName, session->dialog->musicsNames[i]))
 			{
-				if (strmatch(musicName, interpretingDialog->musicsNames[i]))
+				if (session->music)
 				{
-					if (music)
+					if (session->oldMusic)
 					{
-						oldMusic = music;
+						cancel_tweens(session, TWEEN_TARGET_OLD_MUSIC, 0);
+						stop_audio_source(session->oldMusic);
+						xfree(session->oldMusic);
 					}
-					buf(char) newMusicName = strclone("Musics/");
-					strappend(&newMusicName, musicName);
-					music = create_audio_source(newMusicName);
-					buf_free(newMusicName);
-					foundMusic = true;
-					break;
-				}
-			}
-			if (!foundMusic)
-			{
-				error("music %s does not exist.", musicName);
-			}
-			fadingMusic = true;
-			music->volume = 0.0f;
-			music->playing = true;
-			return false;
-		} else {
-			if (music->volume >= 1.0f)
-			{
-				if (oldMusic)
-				{
-					stop_audio_source(oldMusic);
-					xfree(oldMusic);
-					oldMusic = NULL;
-				}
-				music->volume = 1.0f;
-				fadingMusic = false;
-			} else {
-				if (oldMusic)
-				{
-					oldMusic->volume -= deltaTime * 1.0f;
+					cancel_tweens(session, TWEEN_TARGET_MUSIC, 0);
+					session->oldMusic = session->music;
+					start_tween(session, TWEEN_TARGET_OLD_MUSIC, 0, TWEEN_PROPERTY_VOLUME, 0.0f, 1.0f, EASING_LINEAR, TWEEN_END_STOP, owner);
 				}
-				music->volume += deltaTime * 1.0f;
-				return false;
+				buf(char) newMusicName = strclone("Musics/");
+				strappend(&newMusicName, musicName);
+				session->music = get_session_audio_source(session, ASSET_MUSIC, musicName, newMusicName);
+				buf_free(newMusicName);
+				strcopy(&session->musicName, musicName);
+				foundMusic = true;
+				break;
 			}
 		}
+		if (!foundMusic)
+		{
+			error("music %s does not exist.", musicName);
+		}
+		session->music->volume = 0.0f;
+		session->music->playing = true;
+		start_tween(session, TWEEN_TARGET_MUSIC, 0, TWEEN_PROPERTY_VOLUME, 1.0f, 1.0f, EASING_LINEAR, TWEEN_END_NONE, owner);
 	} else if (command->type == COMMAND_STOP_MUSIC) {
-		stop_audio_source(music);
-		xfree(music);
-		music = NULL;
+		cancel_tweens(session, TWEEN_TARGET_MUSIC, 0);
+		stop_audio_source(session->music);
+		xfree(session->music);
+		session->music = NULL;
+		buf_free(session->musicName);
+		session->musicName = NULL;
 	} else if (command->type == COMMAND_SET_MUSIC_VOLUME) {
-		music->volume = command->arguments[0]->numeric;
+		cancel_tweens(session, TWEEN_TARGET_MUSIC, 0);
+		session->music->volume = command->arguments[0]->numeric;
 	} else if (command->type == COMMAND_PLAY_SOUND) {
-		if (!fadingSound)
+		bool foundSound = false;
+		const char *soundName = command->arguments[0]->string;
+		for (unsigned int i = 0; i < buf_len(session->dialog->soundsNames); i++)
 		{
-			bool foundSound = false;
-			const char *soundName = command->arguments[0]->string;
-			for (unsigned int i = 0; i < buf_len(interpretingDialog->soundsNames); i++)
+			if (strmatch(soundName, session->dialog->soundsNames[i]))
 			{
-				if (strmatch(soundName, interpretingDialog->soundsNames[i]))
+				if (session->sound)
 				{
-					if (sound)
+					if (session->oldSound)
 					{
-						oldSound = sound;
+						cancel_tweens(session, TWEEN_TARGET_OLD_SOUND, 0);
+						stop_audio_source(session->oldSound);
+						xfree(session->oldSound);
 					}
-					buf(char) newSoundName = strclone("Sounds/");
-					strappend(&newSoundName, soundName);
-					sound = create_audio_source(newSoundName);
-					buf_free(newSoundName);
-					foundSound = true;
-					break;
+					cancel_tweens(session, TWEEN_TARGET_SOUND, 0);
+					session->oldSound = session->sound;
+					start_tween(session, TWEEN_TARGET_OLD_SOUND, 0, TWEEN_PROPERTY_VOLUME, 0.0f, 1.0f, EASING_LINEAR, TWEEN_END_STOP, owner);
 				}
-			}
-			if (!foundSound)
-			{
-				error("sound %s does not exist.", soundName);
-			}
-			fadingSound = true;
-			sound->volume = 0.0f;
-			sound->playing = true;
-			return false;
-		} else {
-			if (sound->volume >= 1.0f)
-			{
-				if (oldSound)
-				{
-					stop_audio_source(oldSound);
-					xfree(oldSound);
-					oldSound = NULL;
-				}
-				sound->volume = 1.0f;
-				fadingSound = false;
-			} else {
-				if (oldSound)
-				{
-					oldSound->volume -= deltaTime * 1.0f;
-				}
-				sound->volume += deltaTime * 1.0f;
-				return false;
+				buf(char) newSoundName = strclone("Sounds/");
+				strappend(&newSoundName, soundName);
+				session->sound = get_session_audio_source(session, ASSET_SOUND, soundName, newSoundName);
+				buf_free(newSoundName);
+				strcopy(&session->soundName, soundName);
+				foundSound = true;
+				break;
 			}
 		}
+		if (!foundSound)
+		{
+			error("sound %s does not exist.", soundName);
+		}
+		session->sound->volume = 0.0f;
+		session->sound->playing = true;
+		start_tween(session, TWEEN_TARGET_SOUND, 0, TWEEN_PROPERTY_VOLUME, 1.0f, 1.0f, EASING_LINEAR, TWEEN_END_NONE, owner);
 	} else if (command->type == COMMAND_STOP_SOUND) {
-		stop_audio_source(sound);
-		xfree(sound);
-		sound = NULL;
+		cancel_tweens(session, TWEEN_TARGET_SOUND, 0);
+		stop_audio_source(session->sound);
+		xfree(session->sound);
+		session->sound = NULL;
+		buf_free(session->soundName);
+		session->soundName = NULL;
 	} else if (command->type == COMMAND_SET_SOUND_VOLUME) {
-		sound->volume = command->arguments[0]->numeric;
-	} else if (command->type == COMMAND_HIDE_UI) {
-		displayDialogUI = false;
-	} else if (command->type == COMMAND_WAIT) {
-		if (waitTimer == 0.0f)
+		cancel_tweens(session, TWEEN_TARGET_SOUND, 0);
+		session->sound->volume = command->arguments[0]->numeric;
+	} else if (command->type == COMMAND_PRELOAD) {
+		if (session->preloader)
 		{
-			waitTimer = command->arguments[0]->numeric;
+			preload_asset(session->preloader, session->dialog, get_asset_type(command->arguments[0]->string), command->arguments[1]->string);
 		}
-		waitTimer -= deltaTime;
-		if (waitTimer <= 0.0f)
+	} else if (command->type == COMMAND_UNLOAD) {
+		if (session->preloader)
 		{
-			waitTimer = 0.0f;
-		} else {
-			return false;
+			unload_session_asset(session, get_asset_type(command->arguments[0]->string), command->arguments[1]->string);
 		}
+	} else if (command->type == COMMAND_HIDE_UI) {
+		state->displayDialogUI = false;
+	} else if (command->type == COMMAND_WAIT_TRANSITIONS) {
+		return;
 	} else if (command->type == COMMAND_SET_WINDOW_NAME) {
 		set_window_name(command->arguments[0]->string);
-		return true;
 	} else if (command->type == COMMAND_SET_SPEAKER_NAME_COLOR) {
 		bool foundColoredName = false;
 		const char *nameToColor = command->arguments[0]->string;
 		vec3 newNameColor = {command->arguments[1]->numeric, command->arguments[2]->numeric, command->arguments[3]->numeric};
-		for (unsigned int i = 0; i < buf_len(interpretingDialog->coloredNames); i++)
+		for (unsigned int i = 0; i < buf_len(state->coloredNames); i++)
 		{
-			if (strmatch(nameToColor, interpretingDialog->coloredNames[i]))
+			if (strmatch(nameToColor, state->coloredNames[i]))
 			{
-				interpretingDialog->namesColors[i] = newNameColor;
+				state->namesColors[i] = newNameColor;
 				foundColoredName = true;
 				break;
 			}
 		}
 		if (!foundColoredName)
 		{
-			buf_add(interpretingDialog->coloredNames, strclone(nameToColor));
-			buf_add(interpretingDialog->namesColors, newNameColor);
+			buf_add(state->coloredNames, strclone(nameToColor));
+			buf_add(state->namesColors, newNameColor);
 		}
 	} else {
 		error("unknown command type %d", command->type);
 	}
-	return true;
 }
 
-const float WAIT_TIME_NORMAL_CHARACTER = 0.02f;
-const float WAIT_TIME_COMMA = 0.15f;
-const float WAIT_TIME_DOT = 0.4f;
-
-static bool update_sentence(Sentence *sentence)
+// commands wait for their transitions unless marked nowait, #wait_transitions waits for every transition
+static bool update_command(Session *session, Command *command)
 {
-	Sprite *currentSpeakerSprite = NULL;
-	Animation *currentAnimation = NULL;
-	AnimationPhase *currentAnimationPhase = NULL;
-
-	if (currentSpeakerSpriteIndex != -1)
+	ExecutionState *state = session->state;
+	if (!state->awaitingCommand)
 	{
-		currentSpeakerSprite = charactersSprites[currentSpeakerSpriteIndex];
-		currentAnimation = currentSpeakerSprite->animations[currentSpeakerSprite->currentAnimation];
-		currentAnimationPhase = currentAnimation->animationPhases[currentAnimation->currentAnimationPhase];
+		start_command(session, command, command->await ? state->programCounter : -1);
 	}
-
-	if (sentenceFirstUpdate)
+	if (session->skipping)
 	{
-		textScrollOffset = 0;
-		sentenceFirstUpdate = false;
-		timeDuringCurrentChar = 0.0f;
-		timeDuringCurrentBlip = 0.0f;
-		currentCodeWaitTime = 0.0f;
-		set_text_string(currentSentence, sentence->string);
-		currentSentence->nbCharToDisplay = 0;
-		currentDisplayedCode = currentSentence->codes[0];
-		if (currentDisplayedCode == '.')
-		{
-			currentCodeWaitTime = WAIT_TIME_DOT;
-		} else if (currentDisplayedCode == ',') {
-			currentCodeWaitTime = WAIT_TIME_COMMA;
-		} else {
-			currentCodeWaitTime = WAIT_TIME_NORMAL_CHARACTER;
-		}
-		if (currentSpeakerSpriteIndex != -1)
-		{
-			currentAnimation->animationState = ANIMATION_STATE_PLAY;
-		}
+		update_tweens(session, SKIP_DELTA_TIME);
 	}
+	state->awaitingCommand = command->type == COMMAND_WAIT_TRANSITIONS ? buf_len(state->tweens) != 0 : has_tweens(session, state->programCounter);
+	return !state->awaitingCommand;
+}
 
-	if (currentSentence->nbCharToDisplay < currentSentence->nbMaxCharToDisplay)
+static bool update_wait(Session *session, float duration)
+{
+	ExecutionState *state = session->state;
+	if (state->waitTimer == 0.0f)
 	{
-		if (is_input_key_pressed(INPUT_KEY_SPACE))
-		{
-			currentSentence->nbCharToDisplay = currentSentence->nbMaxCharToDisplay;
-		} else {
-			timeDuringCurrentChar += deltaTime;
-			while (timeDuringCurrentChar > currentCodeWaitTime)
-			{
-				currentSentence->nbCharToDisplay++;
-				if (currentSentence->nbCharToDisplay == currentSentence->nbMaxCharToDisplay)
-				{
-					break;
-				}
-				timeDuringCurrentChar -= currentCodeWaitTime;
+		state->waitTimer = duration;
+	}
+	state->waitTimer -= get_delta_time(session);
+	if (state->waitTimer <= 0.0f)
+	{
+		state->waitTimer = 0.0f;
+		return true;
+	}
+	return false;
+}
 
-				currentDisplayedCode = currentSentence->codes[currentSentence->nbCharToDisplay - 1];
-				if ((currentDisplayedCode == '.' || currentDisplayedCode == '?' || currentDisplayedCode == '!' || currentDisplayedCode == ';') && currentSentence->nbCharToDisplay < currentSentence->nbMaxCharToDisplay - 1)
-				{
-					currentCodeWaitTime = WAIT_TIME_DOT;
-					if (currentAnimation && currentAnimation->animationState == ANIMATION_STATE_PLAY)
-					{
-						currentAnimation->animationState = ANIMATION_STATE_STOPPING;
-					}
-				} else if (currentDisplayedCode == ',' && currentSentence->nbCharToDisplay < currentSentence->nbMaxCharToDisplay - 1) {
-					currentCodeWaitTime = WAIT_TIME_COMMA;
-					if (currentAnimation && currentAnimation->animationState == ANIMATION_STATE_PLAY)
-					{
-						currentAnimation->animationState = ANIMATION_STATE_STOPPING;
-					}
-				} else {
-					currentCodeWaitTime = WAIT_TIME_NORMAL_CHARACTER;
-					if (currentAnimation)
-					{
-						currentAnimation->animationState = ANIMATION_STATE_PLAY;
-					}
-				}
-			}
-			if (currentCodeWaitTime == WAIT_TIME_NORMAL_CHARACTER)
-			{
-				timeDuringCurrentBlip += deltaTime;
-				if (timeDuringCurrentBlip >= 0.075f)
-				{
-					timeDuringCurrentBlip = 0.0f;
-					reset_audio_source(blipSound);
-					blipSound->playing = true;
-				}
-			}
-			else
-			{
-				timeDuringCurrentBlip = 0.0f;
-			}
-		}
+static Sentence *get_sentence_translation(Session *session, Sentence *sentence)
+{
+	return session->localization ? get_translated_sentence(session->localization, sentence) : NULL;
+}
 
-		if (currentSentence->nbCharToDisplay == currentSentence->nbMaxCharToDisplay)
-		{
-			if (currentSpeakerSpriteIndex != -1)
-			{
-				currentAnimation->animationState = ANIMATION_STATE_STOPPING;
-			}
-		}
-	} else if (is_input_key_pressed(INPUT_KEY_ENTER) || sentence->autoSkip) {
-		sentenceFirstUpdate = true;
-		set_text_string(currentSentence, NULL);
-		if (currentSpeakerSpriteIndex != -1)
-		{
-			reset_animation(currentAnimation);
-		}
-		return true;
+static const char *get_sentence_string(Session *session, Sentence *sentence)
+{
+	ExecutionState *state = session->state;
+	Sentence *translation = get_sentence_translation(session, sentence);
+	if (translation && translation->interpolation)
+	{
+		InterpolationCache *interpolationCache = &session->localization->interpolationCache;
+		buf_free(interpolationCache->string);
+		interpolationCache->string = NULL;
+		update_interpolation(session->variables, translation->interpolation, interpolationCache);
+		return interpolationCache->string;
+	} else if (translation) {
+		return translation->string;
+	} else if (sentence->interpolation) {
+		InterpolationCache *interpolationCache = &state->interpolationsCaches[sentence->interpolation->index];
+		update_interpolation(session->variables, sentence->interpolation, interpolationCache);
+		return interpolationCache->string;
+	}
+	return sentence->string;
+}
+
+// the name as written in the script is still the one matched against the characters and the colored names
+static const char *get_speaker_name(Session *session, Cue *cue)
+{
+	const char *translation = session->localization ? get_translated_string(session->localization, cue->characterNameId) : NULL;
+	return translation ? translation : cue->characterName;
+}
+
+static const char *get_speaker_string(Session *session)
+{
+	ExecutionState *state = session->state;
+	if (!state->currentCue || !state->displaySpeakerName)
+	{
+		return NULL;
 	}
+	if (state->currentCue->characterNameInterpolation)
+	{
+		return state->interpolationsCaches[state->currentCue->characterNameInterpolation->index].string;
+	}
+	return get_speaker_name(session, state->currentCue);
+}
 
-	if (currentSpeakerSpriteIndex != -1)
+// interpolated sentences are compiled once their string is known, right after get_sentence_string
+static RevealTimeline *get_sentence_timeline(Session *session, Sentence *sentence, bool compile)
+{
+	ExecutionState *state = session->state;
+	Sentence *translation = get_sentence_translation(session, sentence);
+	if (translation && !translation->interpolation)
 	{
-		if (currentAnimationPhase->responsive)
+		return &translation->timeline;
+	} else if (translation) {
+		if (compile)
 		{
-			currentSpeakerSprite->position.x = (windowDimensions.x * currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->responsiveWidth * windowDimensions.x / 2);
-			currentSpeakerSprite->position.y = windowDimensions.y - (currentAnimationPhase->responsiveHeight * windowDimensions.y);
-		} else {
-			currentSpeakerSprite->position.x = (windowDimensions.x * currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->pixelWidth / 2);
-			currentSpeakerSprite->position.y = windowDimensions.y - currentAnimationPhase->pixelHeight;
+			InterpolationCache *interpolationCache = &session->localization->interpolationCache;
+			compile_reveal_timeline(&state->interpolatedTimeline, interpolationCache->string, translation->revealTags, interpolationCache->literalsStarts);
 		}
+		return &state->interpolatedTimeline;
+	} else if (!sentence->interpolation)
+	{
+		return &sentence->timeline;
 	}
-	return false;
+	if (compile)
+	{
+		InterpolationCache *interpolationCache = &state->interpolationsCaches[sentence->interpolation->index];
+		compile_reveal_timeline(&state->interpolatedTimeline, interpolationCache->string, sentence->revealTags, interpolationCache->literalsStarts);
+	}
+	return &state->interpolatedTimeline;
 }
 
-static bool update_cue_expression(CueExpression *cueExpression);
+// the clips of the next voiced lines are decoded while this one plays, until a choice
+static const int VOICE_LOOKAHEAD = 3;
+static const int VOICE_LOOKAHEAD_INSTRUCTIONS = 256;
+// the voice level from which the mouth is wide open
+static const float VOICE_LEVEL_OPEN_MOUTH = 0.2f;
 
-static bool update_cue_condition(CueCondition *cueCondition)
+static void play_sentence_voice(Session *session, Sentence *sentence)
 {
-	if (!cueCondition->resolved)
+	ExecutionState *state = session->state;
+	if (!sentence->voiceName)
 	{
-		Variable *variable = resolve_logic_expression(cueCondition->logicExpression);
-		if (variable->type == VARIABLE_NUMERIC)
-		{
-			cueCondition->result = (bool)variable->numeric;
-		} else if (variable->type == VARIABLE_STRING) {
-			if (buf_len(variable->string) == 1)
-			{
-				if (variable->string[0] == '\0')
-				{
-					cueCondition->result = false;
-				} else {
-					cueCondition->result = true;
-				}
-			} else {
-				cueCondition->result = false;
-			}
-		} else {
-			error("unknown logic expression type %d.", variable->type);
-		}
-		free_variable(variable);
-		cueCondition->resolved = true;
+		stop_voice(session->voice);
+		return;
 	}
-	if (cueCondition->result)
+	buf(char) voicePath = strclone("Voices/");
+	strappend(&voicePath, sentence->voiceName);
+	play_voice(session->voice, voicePath);
+
+	int nbVoices = 0;
+	int instructionIndex = state->programCounter + 1;
+	for (int i = 0; i < VOICE_LOOKAHEAD_INSTRUCTIONS && nbVoices < VOICE_LOOKAHEAD; i++)
 	{
-		if ((unsigned int)cueCondition->currentExpression == buf_len(cueCondition->cueExpressionsIf))
-		{
-			cueCondition->currentExpression = 0;
-			return true;
-		}
-		if (update_cue_expression(cueCondition->cueExpressionsIf[cueCondition->currentExpression]))
-		{
-			if (moving)
-			{
-				cueCondition->currentExpression = 0;
-				return true;
-			} else {
-				cueCondition->currentExpression++;
-			}
-		}
-	} else {
-		if ((unsigned int)cueCondition->currentExpression == buf_len(cueCondition->cueExpressionsElse))
+		Instruction *instruction = &session->dialog->instructions[instructionIndex];
+		if (instruction->type == INSTRUCTION_SAY && instruction->sentence->voiceName)
 		{
-			cueCondition->currentExpression = 0;
-			return true;
+			strcopy(&voicePath, "Voices/");
+			strappend(&voicePath, instruction->sentence->voiceName);
+			prefetch_voice(session->voice, voicePath);
+			nbVoices++;
 		}
-		if (update_cue_expression(cueCondition->cueExpressionsElse[cueCondition->currentExpression]))
+		if (instruction->type == INSTRUCTION_END || instruction->type == INSTRUCTION_CHOOSE || (instruction->type == INSTRUCTION_GO_TO && instruction->target == -1))
 		{
-			if (moving)
-			{
-				cueCondition->currentExpression = 0;
-				return true;
-			} else {
-				cueCondition->currentExpression++;
-			}
+			break;
+		} else if (instruction->type == INSTRUCTION_JUMP || instruction->type == INSTRUCTION_GO_TO) {
+			instructionIndex = instruction->target;
+		} else {
+			instructionIndex++;
 		}
 	}
-	return false;
+	buf_free(voicePath);
 }
 
-static bool update_cue_expression(CueExpression *cueExpression)
+// the phases of a speaking animation go from the closed mouth to the open one
+static int get_lip_sync_phase(Sprite *sprite, float voiceLevel)
 {
-	if (cueExpression->type == CUE_EXPRESSION_SENTENCE)
-	{
-		return update_sentence(cueExpression->sentence);
-	} else if (cueExpression->type == CUE_EXPRESSION_CHOICE) {
-		textScrollOffset = 0;
-		choosing = true;
-	} else if (cueExpression->type == CUE_EXPRESSION_CUE_CONDITION) {
-		return update_cue_condition(cueExpression->cueCondition);
-	} else if (cueExpression->type == CUE_EXPRESSION_GO_TO) {
-		return update_go_to(cueExpression->goTo);
-	} else if (cueExpression->type == CUE_EXPRESSION_ASSIGNMENT) {
-		return update_assign(cueExpression->assignment);
-	} else if (cueExpression->type == CUE_EXPRESSION_COMMAND) {
-		return update_command(cueExpression->command);
-	} else {
-		error("unknown cue expression type %d.", cueExpression->type);
+	int nbPhases = buf_len(sprite->animations[sprite->currentAnimation]->animationPhases);
+	int phase = (int)(voiceLevel / VOICE_LEVEL_OPEN_MOUTH * (nbPhases - 1) + 0.5f);
+	if (phase > nbPhases - 1)
+	{
+		phase = nbPhases - 1;
 	}
-	return false;
+	return phase;
 }
 
-static void display_choice(CueExpression *cueExpression)
+static bool update_sentence(Session *session, Sentence *sentence)
 {
-	if (cueExpression->type == CUE_EXPRESSION_CHOICE)
+	ExecutionState *state = session->state;
+	Sprite *currentSpeakerSprite = NULL;
+	AnimationCursor *currentAnimationCursor = NULL;
+	AnimationPhase *currentAnimationPhase = NULL;
+
+	if (state->currentSpeakerSpriteIndex != -1)
 	{
-		if ((unsigned int)nbChoices == buf_len(currentChoices))
-		{
-			buf_add(currentChoices, create_text());
-			set_text_font(currentChoices[nbChoices], "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_NORMAL);
-			set_text_width_limit(currentChoices[nbChoices], 0.985f * windowDimensions.x);
-			currentChoices[nbChoices]->position.x = 0.015f * windowDimensions.x;
-			if (nbChoices == 0)
-			{
-				currentChoices[nbChoices]->position.y = 0.8f * windowDimensions.y + 2;
-			}
-			currentChoices[nbChoices]->color = COLOR_WHITE;
-		}
-		if (nbChoices != 0)
+		currentSpeakerSprite = session->charactersSprites[state->currentSpeakerSpriteIndex];
+		currentAnimationCursor = &currentSpeakerSprite->animationCursor;
+		currentAnimationPhase = currentSpeakerSprite->animations[currentSpeakerSprite->currentAnimation]->animationPhases[currentAnimationCursor->currentAnimationPhase];
+	}
+
+	RevealTimeline *timeline;
+	if (state->sentenceFirstUpdate)
+	{
+		if (session->history)
 		{
-			currentChoices[nbChoices]->position.y = currentChoices[nbChoices - 1]->position.y + currentChoices[nbChoices - 1]->height + 4;
+			record_history_point(session->history, session);
 		}
-		set_text_string(currentChoices[nbChoices], cueExpression->choice->sentence->string);
-		buf_add(goToCommands, cueExpression->choice->goToCommand);
-		nbChoices++;
-	} else if (cueExpression->type == CUE_EXPRESSION_CUE_CONDITION) {
-		if (!cueExpression->cueCondition->resolved)
+		if (session->skipping)
 		{
-			Variable *variable = resolve_logic_expression(cueExpression->cueCondition->logicExpression);
-			if (variable->type == VARIABLE_NUMERIC)
+			if (session->readStatus && is_sentence_read(session->readStatus, session->dialogName, sentence->stringId))
 			{
-				cueExpression->cueCondition->result = (bool)variable->numeric;
-			} else if (variable->type == VARIABLE_STRING) {
-				if (buf_len(variable->string) == 1)
+				// a skipped sentence is never laid out nor revealed, but it is still logged and cuts the voice of the previous one
+				if (session->backlog)
 				{
-					if (variable->string[0] == '\0')
-					{
-						cueExpression->cueCondition->result = false;
-					} else {
-						cueExpression->cueCondition->result = true;
-					}
-				} else {
-					cueExpression->cueCondition->result = false;
+					add_backlog_line(session->backlog, get_speaker_string(session), get_sentence_string(session, sentence));
 				}
-			} else {
-				error("unknown logic expression type %d.");
+				stop_voice(session->voice);
+				return true;
 			}
-			free_variable(variable);
-			cueExpression->cueCondition->resolved = true;
+			session->skipping = false;
 		}
-		if (cueExpression->cueCondition->result)
+		state->textScrollOffset = 0;
+		state->sentenceFirstUpdate = false;
+		state->revealTime = 0.0f;
+		play_sentence_voice(session, sentence);
+		set_text_string(session->currentSentence, get_sentence_string(session, sentence));
+		session->currentSentence->nbCharToDisplay = 0;
+		timeline = get_sentence_timeline(session, sentence, true);
+	} else {
+		timeline = get_sentence_timeline(session, sentence, false);
+	}
+
+	if (session->currentSentence->nbCharToDisplay < session->currentSentence->nbMaxCharToDisplay)
+	{
+		// the reveal only looks its elapsed time up in the timeline, so any frame rate gives the same result
+		float previousRevealTime = state->revealTime;
+		if (session->inputKeysPressed[INPUT_KEY_SPACE])
 		{
-			for (unsigned int i = cueExpression->cueCondition->currentExpression; i < buf_len(cueExpression->cueCondition->cueExpressionsIf); i++)
+			float revealEnd = timeline->charactersTimes[buf_len(timeline->charactersTimes) - 1];
+			if (state->revealTime < revealEnd)
 			{
-				display_choice(cueExpression->cueCondition->cueExpressionsIf[cueExpression->cueCondition->currentExpression]);
+				state->revealTime = revealEnd;
 			}
+			session->currentSentence->nbCharToDisplay = session->currentSentence->nbMaxCharToDisplay;
 		} else {
-			for (unsigned int i = cueExpression->cueCondition->currentExpression; i < buf_len(cueExpression->cueCondition->cueExpressionsElse); i++)
+			state->revealTime += session->deltaTime;
+			int nbRevealedCharacters = count_reveal_times(timeline->charactersTimes, state->revealTime);
+			if (nbRevealedCharacters > session->currentSentence->nbMaxCharToDisplay)
+			{
+				nbRevealedCharacters = session->currentSentence->nbMaxCharToDisplay;
+			}
+			session->currentSentence->nbCharToDisplay = nbRevealedCharacters;
+			if (count_reveal_times(timeline->blipsTimes, state->revealTime) > count_reveal_times(timeline->blipsTimes, previousRevealTime))
 			{
-				display_choice(cueExpression->cueCondition->cueExpressionsElse[cueExpression->cueCondition->currentExpression]);
+				reset_audio_source(session->blipSound);
+				session->blipSound->playing = true;
 			}
 		}
-	} else {
-		error("got sentence or command after entering choice mode.");
-	}
-}
 
-static bool update_cue(Cue *cue)
-{
-	if (!choosing)
-	{
-		if (!displayedSpeakerName)
+		// a voiced sentence moves the mouth with the voice instead
+		if (currentAnimationCursor && !sentence->voiceName)
 		{
-			displayDialogUI = true;
-			displayedSpeakerName = true;
-			currentSpeakerSpriteIndex = -1;
-			if (cue->characterName)
+			int nbMouthTimes = count_reveal_times(timeline->mouthTimes, state->revealTime);
+			if (previousRevealTime == 0.0f || nbMouthTimes != count_reveal_times(timeline->mouthTimes, previousRevealTime))
 			{
-				displaySpeakerName = true;
-				if (cue->setCharacterCommandInDeclaration)
-				{
-					update_command(cue->cueExpressions[0]->command);
-				}
-				for (int i = 0; i < 7; i++)
-				{
-					if (charactersNames[i])
-					{
-						if (strmatch(cue->characterName, charactersNames[i]))
-						{
-							currentSpeakerSpriteIndex = i;
-							break;
-						}
-					}
-				}
-				set_text_string(currentSpeaker, cue->characterName);
-				vec3 nameColor = {-1.0f};
-				for (unsigned int i = 0; i < buf_len(interpretingDialog->coloredNames); i++)
-				{
-					if (strmatch(cue->characterName, interpretingDialog->coloredNames[i]))
-					{
-						nameColor = interpretingDialog->namesColors[i];
-					}
-				}
-				if (nameColor.x != -1.0f)
-				{
-					currentSpeaker->color = nameColor;
-				}
-				ivec2 currentSpeakerPosition;
-				characterNamePosition = cue->characterNamePosition;
-				if (characterNamePosition == 1)
+				if (nbMouthTimes % 2 == 1)
 				{
-					currentSpeakerPosition.x = 0.015f * windowDimensions.x;
-				} else {
-					currentSpeakerPosition.x = windowDimensions.x * 0.985f - currentSpeaker->width;
+					currentAnimationCursor->animationState = ANIMATION_STATE_PLAY;
+				} else if (currentAnimationCursor->animationState == ANIMATION_STATE_PLAY) {
+					currentAnimationCursor->animationState = ANIMATION_STATE_STOPPING;
 				}
-				currentSpeakerPosition.y = windowDimensions.y * 0.8f - currentSpeaker->height - 8;
-				set_text_position(currentSpeaker, currentSpeakerPosition);
-				characterNameBox->position.x = currentSpeaker->position.x - 2;
-				characterNameBox->position.y = currentSpeaker->position.y - currentSpeaker->font->descent + 6;
-				characterNameBox->width = currentSpeaker->width + 4;
-				characterNameBox->height = currentSpeaker->height + currentSpeaker->font->descent + 4;
-			} else {
-				displaySpeakerName = false;
 			}
 		}
 
-		if (cue->setCharacterCommandInDeclaration && appearingCharacter && cue->currentExpression == 0)
+		if (session->currentSentence->nbCharToDisplay == session->currentSentence->nbMaxCharToDisplay)
 		{
-			if (!update_command(cue->cueExpressions[0]->command))
+			if (state->currentSpeakerSpriteIndex != -1)
 			{
-				return false;
-			} else {
-				cue->currentExpression = 1;
+				currentAnimationCursor->animationState = ANIMATION_STATE_STOPPING;
 			}
 		}
-
-		if ((unsigned int)cue->currentExpression == buf_len(cue->cueExpressions))
+	} else if (session->inputKeysPressed[INPUT_KEY_ENTER] || sentence->autoSkip) {
+		if (session->readStatus)
 		{
-			cue->currentExpression = 0;
-			displayedSpeakerName = false;
-			set_text_string(currentSpeaker, NULL);
-			currentSpeaker->color = COLOR_WHITE;
-			return true;
+			mark_sentence_read(session->readStatus, session->dialogName, sentence->stringId);
 		}
-
-		if (update_cue_expression(cue->cueExpressions[cue->currentExpression]))
+		if (session->backlog)
 		{
-			cue->currentExpression++;
-			if (moving)
-			{
-				cue->currentExpression = 0;
-				displayedSpeakerName = false;
-				set_text_string(currentSpeaker, NULL);
-				currentSpeaker->color = COLOR_WHITE;
-				return true;
-			}
+			add_backlog_line(session->backlog, get_speaker_string(session), get_sentence_string(session, sentence));
 		}
-	} else {
-		if (!choicesDisplayed)
+		state->sentenceFirstUpdate = true;
+		stop_voice(session->voice);
+		set_text_string(session->currentSentence, NULL);
+		if (state->currentSpeakerSpriteIndex != -1)
 		{
-			nbChoices = 0;
-			for (unsigned int i = cue->currentExpression; i < buf_len(cue->cueExpressions); i++)
-			{
-				display_choice(cue->cueExpressions[i]);
-			}
-			choicesDisplayed = true;
+			reset_animation(currentAnimationCursor);
 		}
-		if (is_input_key_pressed(INPUT_KEY_DOWN_ARROW))
+		return true;
+	}
+
+	if (currentSpeakerSprite && sentence->voiceName)
+	{
+		currentSpeakerSprite->lipSyncPhase = get_lip_sync_phase(currentSpeakerSprite, get_voice_level(session->voice));
+	}
+
+	if (state->currentSpeakerSpriteIndex != -1)
+	{
+		if (currentAnimationPhase->responsive)
 		{
-			currentChoice++;
-			if ((unsigned int)currentChoice == buf_len(currentChoices))
-			{
-				currentChoice = 0;
-			}
-		} else if (is_input_key_pressed(INPUT_KEY_UP_ARROW)) {
-			currentChoice--;
-			if (currentChoice == -1)
-			{
-				currentChoice = buf_len(currentChoices) - 1;
-			}
-		} else if (is_input_key_pressed(INPUT_KEY_ENTER)) {
-			update_go_to(goToCommands[currentChoice]);
-			buf_free(goToCommands);
-			for (unsigned int i = 0; i < buf_len(currentChoices); i++)
-			{
-				set_text_string(currentChoices[i], NULL);
-			}
-			goToCommands = NULL;
-			cue->currentExpression = 0;
-			choosing = false;
-			choicesDisplayed = false;
-			currentChoice = 0;
-			displayedSpeakerName = false;
-			set_text_string(currentSpeaker, NULL);
-			currentSpeaker->color = COLOR_WHITE;
-			return true;
+			currentSpeakerSprite->position.x = (windowDimensions.x * state->currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->responsiveWidth * windowDimensions.x / 2);
+			currentSpeakerSprite->position.y = windowDimensions.y - (currentAnimationPhase->responsiveHeight * windowDimensions.y);
+		} else {
+			currentSpeakerSprite->position.x = (windowDimensions.x * state->currentSpeakerSpriteIndex / 6.0f) - (currentAnimationPhase->pixelWidth / 2);
+			currentSpeakerSprite->position.y = windowDimensions.y - currentAnimationPhase->pixelHeight;
 		}
-		choiceMarker->position.y = currentChoices[currentChoice]->position.y + ((currentChoices[currentChoice]->height - choiceMarker->height) / 2) - currentChoices[currentChoice]->font->descent + 2;
 	}
 	return false;
 }
 
-static bool update_knot_expression(KnotExpression *knotExpression);
+static void display_speaker_name(Session *session, Cue *cue)
+{
+	ExecutionState *state = session->state;
+	if (cue->characterNameInterpolation)
+	{
+		InterpolationCache *interpolationCache = &state->interpolationsCaches[cue->characterNameInterpolation->index];
+		update_interpolation(session->variables, cue->characterNameInterpolation, interpolationCache);
+		set_text_string(session->currentSpeaker, interpolationCache->string);
+	} else {
+		set_text_string(session->currentSpeaker, get_speaker_name(session, cue));
+	}
+	vec3 nameColor = {-1.0f};
+	for (unsigned int i = 0; i < buf_len(state->coloredNames); i++)
+	{
+		if (strmatch(cue->characterName, state->coloredNames[i]))
+		{
+			nameColor = state->namesColors[i];
+		}
+	}
+	if (nameColor.x != -1.0f)
+	{
+		session->currentSpeaker->color = nameColor;
+	}
+	state->characterNamePosition = cue->characterNamePosition;
+	place_current_speaker(session);
+}
 
-static bool update_knot_condition(KnotCondition *knotCondition)
+static void start_cue(Session *session, Cue *cue)
 {
-	if (!knotCondition->resolved)
+	ExecutionState *state = session->state;
+	state->currentCue = cue;
+	state->displayDialogUI = true;
+	state->currentSpeakerSpriteIndex = -1;
+	if (cue->characterName)
 	{
-		Variable *variable = resolve_logic_expression(knotCondition->logicExpression);
-		if (variable->type == VARIABLE_NUMERIC)
+		state->displaySpeakerName = true;
+		if (cue->setCharacterCommandInDeclaration)
+		{
+			// the command instruction following this one waits for the fade in
+			start_command(session, cue->cueExpressions[0]->command, state->programCounter + 1);
+			state->awaitingCommand = true;
+		}
+		for (int i = 0; i < 7; i++)
 		{
-			knotCondition->result = (bool)variable->numeric;
-		} else if (variable->type == VARIABLE_STRING) {
-			if (buf_len(variable->string) == 1)
+			if (state->charactersNames[i])
 			{
-				if (variable->string[0] == '\0')
+				if (strmatch(cue->characterName, state->charactersNames[i]))
 				{
-					knotCondition->result = false;
-				} else {
-					knotCondition->result = true;
+					state->currentSpeakerSpriteIndex = i;
+					break;
 				}
-			} else {
-				knotCondition->result = false;
 			}
-		} else {
-			error("unknown logic expression type %d.");
 		}
-		free_variable(variable);
-		knotCondition->resolved = true;
+		display_speaker_name(session, cue);
+	} else {
+		state->displaySpeakerName = false;
 	}
-	if (knotCondition->result)
+}
+
+static void end_cue(Session *session)
+{
+	ExecutionState *state = session->state;
+	state->currentCue = NULL;
+	set_text_string(session->currentSpeaker, NULL);
+	session->currentSpeaker->color = COLOR_WHITE;
+}
+
+static void add_choice(Session *session, Instruction *instruction)
+{
+	ExecutionState *state = session->state;
+	if (!state->choosing)
 	{
-		if ((unsigned int)knotCondition->currentExpression == buf_len(knotCondition->knotExpressionsIf))
+		state->choosing = true;
+		state->textScrollOffset = 0;
+		state->nbChoices = 0;
+	}
+	if ((unsigned int)state->nbChoices == buf_len(session->currentChoices))
+	{
+		buf_add(session->currentChoices, create_text());
+		set_text_font(session->currentChoices[state->nbChoices], "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_NORMAL);
+		set_text_width_limit(session->currentChoices[state->nbChoices], 0.985f * windowDimensions.x);
+		session->currentChoices[state->nbChoices]->position.x = 0.015f * windowDimensions.x;
+		if (state->nbChoices == 0)
 		{
-			knotCondition->currentExpression = 0;
-			return true;
+			session->currentChoices[state->nbChoices]->position.y = 0.8f * windowDimensions.y + 2;
 		}
-		if (update_knot_expression(knotCondition->knotExpressionsIf[knotCondition->currentExpression]))
+		session->currentChoices[state->nbChoices]->color = COLOR_WHITE;
+	}
+	if (state->nbChoices != 0)
+	{
+		session->currentChoices[state->nbChoices]->position.y = session->currentChoices[state->nbChoices - 1]->position.y + session->currentChoices[state->nbChoices - 1]->height + 4;
+	}
+	set_text_string(session->currentChoices[state->nbChoices], get_sentence_string(session, instruction->choice->sentence));
+	buf_add(state->choicesInstructions, instruction);
+	state->nbChoices++;
+}
+
+static void update_choices(Session *session)
+{
+	ExecutionState *state = session->state;
+	if (session->inputKeysPressed[INPUT_KEY_DOWN_ARROW])
+	{
+		state->currentChoice++;
+		if (state->currentChoice == state->nbChoices)
 		{
-			if (moving)
-			{
-				knotCondition->currentExpression = 0;
-				return true;
-			} else {
-				knotCondition->currentExpression++;
-			}
+			state->currentChoice = 0;
 		}
-	} else {
-		if ((unsigned int)knotCondition->currentExpression == buf_len(knotCondition->knotExpressionsElse))
+	} else if (session->inputKeysPressed[INPUT_KEY_UP_ARROW]) {
+		state->currentChoice--;
+		if (state->currentChoice == -1)
 		{
-			knotCondition->currentExpression = 0;
-			return true;
+			state->currentChoice = state->nbChoices - 1;
 		}
-		if (update_knot_expression(knotCondition->knotExpressionsElse[knotCondition->currentExpression]))
+	} else if (session->inputKeysPressed[INPUT_KEY_ENTER]) {
+		if (session->history)
 		{
-			if (moving)
-			{
-				knotCondition->currentExpression = 0;
-				return true;
-			} else {
-				knotCondition->currentExpression++;
-			}
+			record_history_point(session->history, session);
 		}
+		if (session->autosave)
+		{
+			request_autosave(session->autosave, session);
+		}
+		Instruction *choiceInstruction = state->choicesInstructions[state->currentChoice];
+		buf_clear(state->choicesInstructions);
+		for (unsigned int i = 0; i < buf_len(session->currentChoices); i++)
+		{
+			set_text_string(session->currentChoices[i], NULL);
+		}
+		state->choosing = false;
+		state->currentChoice = 0;
+		end_cue(session);
+		go_to(session, choiceInstruction->choice->goToCommand, choiceInstruction->target);
+		return;
 	}
-	return false;
+	session->choiceMarker->position.y = session->currentChoices[state->currentChoice]->position.y + ((session->currentChoices[state->currentChoice]->height - session->choiceMarker->height) / 2) - session->currentChoices[state->currentChoice]->font->descent + 2;
 }
 
-static bool update_knot_expression(KnotExpression *knotExpression)
+// bounds the work done in a frame by a script looping without ever waiting
+static const int MAX_INSTRUCTIONS_PER_FRAME = 1024;
+
+// returns false when the program has to wait for the next frame
+static bool execute_instruction(Session *session, Instruction *instruction)
 {
-	if (knotExpression->type == KNOT_EXPRESSION_CUE)
-	{
-		return update_cue(knotExpression->cue);
-	} else if (knotExpression->type == KNOT_EXPRESSION_KNOT_CONDITION) {
-		return update_knot_condition(knotExpression->knotCondition);
-	} else if (knotExpression->type == KNOT_EXPRESSION_GO_TO) {
-		return update_go_to(knotExpression->goTo);
-	} else if (knotExpression->type == KNOT_EXPRESSION_ASSIGNMENT) {
-		return update_assign(knotExpression->assignment);
-	} else if (knotExpression->type == KNOT_EXPRESSION_COMMAND) {
-		return update_command(knotExpression->command);
+	ExecutionState *state = session->state;
+	if (instruction->type == INSTRUCTION_SPEAKER)
+	{
+		start_cue(session, instruction->cue);
+	} else if (instruction->type == INSTRUCTION_SPEAKER_END) {
+		end_cue(session);
+	} else if (instruction->type == INSTRUCTION_SAY) {
+		// the key ending a sentence must not be seen by the next one, skipped sentences go on in the same frame
+		if (update_sentence(session, instruction->sentence))
+		{
+			state->programCounter++;
+			return session->skipping;
+		}
+		return false;
+	} else if (instruction->type == INSTRUCTION_CHOICE) {
+		add_choice(session, instruction);
+	} else if (instruction->type == INSTRUCTION_CHOOSE) {
+		if (state->choosing)
+		{
+			// choices are always left to the player
+			session->skipping = false;
+			update_choices(session);
+			return false;
+		}
+	} else if (instruction->type == INSTRUCTION_COMMAND) {
+		if (!update_command(session, instruction->command))
+		{
+			return false;
+		}
+	} else if (instruction->type == INSTRUCTION_WAIT) {
+		if (!update_wait(session, instruction->duration))
+		{
+			return false;
+		}
+	} else if (instruction->type == INSTRUCTION_ASSIGN) {
+		update_assign(session, instruction->assignment);
+	} else if (instruction->type == INSTRUCTION_JUMP) {
+		state->programCounter = instruction->target;
+		return true;
+	} else if (instruction->type == INSTRUCTION_JUMP_IF_FALSE) {
+		if (!resolve_condition(session->variables, instruction->condition.logicExpression, instruction->condition.dependencies, &state->conditionsCaches[instruction->condition.index]))
+		{
+			state->programCounter = instruction->target;
+			return true;
+		}
+	} else if (instruction->type == INSTRUCTION_GO_TO) {
+		go_to(session, instruction->goTo, instruction->target);
+		return !state->end;
+	} else if (instruction->type == INSTRUCTION_END) {
+		state->end = true;
+		return false;
 	} else {
-		error("unknown knot expression type %d", knotExpression->type);
+		error("unknown instruction type %d.", instruction->type);
 	}
-	return false;
+	state->programCounter++;
+	return true;
 }
 
-static bool update_knot(Knot *knot)
+static bool dialog_box_overflows(Session *session)
 {
-	if ((unsigned int)knot->currentExpression == buf_len(knot->knotExpressions))
+	ExecutionState *state = session->state;
+	if (!state || !state->displayDialogUI)
 	{
-		knot->currentExpression = 0;
-		return true;
-	} else {
-		if (update_knot_expression(knot->knotExpressions[knot->currentExpression]))
-		{
-			if (moving)
-			{
-				knot->currentExpression = 0;
-				moving = false;
-			} else {
-				knot->currentExpression++;
-			}
-		}
 		return false;
 	}
+	if (!state->choosing)
+	{
+		return session->currentSentence->height > session->sentenceBox->height - 4;
+	}
+	return state->nbChoices != 0 && session->currentChoices[state->nbChoices - 1]->position.y + session->currentChoices[state->nbChoices - 1]->height > session->sentenceBox->height - 4;
 }
 
-bool interpret_current_dialog()
+bool update_session(Session *session)
 {
-	if (dialogChanged)
+	if (session->dialogChanged)
 	{
-		dialogChanged = false;
-		backgroundSprite->animations = NULL;
-		oldBackgroundSprite->animations = NULL;
-		for (int i = 0; i < 7; i++)
+		session->dialogChanged = false;
+		// the sprites and the audio stay as the dialog left them, with their transitions, until the new one changes them
+		buf(Tween) tweens = NULL;
+		const char *charactersNames[7] = {NULL};
+		if (session->state)
 		{
-			charactersNames[i] = NULL;
-			oldCharactersSprites[i]->animations = NULL;
-			charactersSprites[i]->animations = NULL;
-		}
-		currentSpeakerSpriteIndex = -1;
-		if (sound)
-		{
-			stop_audio_source(sound);
-			xfree(sound);
+			tweens = session->state->tweens;
+			session->state->tweens = NULL;
+			for (int i = 0; i < 7; i++)
+			{
+				charactersNames[i] = session->state->charactersNames[i];
+			}
+			free_execution_state(session->state);
 		}
-		sound = NULL;
-		if (oldSound)
+		session->state = create_execution_state(session->dialog);
+		for (unsigned int i = 0; i < buf_len(tweens); i++)
 		{
-			stop_audio_source(oldSound);
-			xfree(oldSound);
+			tweens[i].owner = -1;
 		}
-		oldSound = NULL;
-		if (music)
+		session->state->tweens = tweens;
+		for (int i = 0; i < 7; i++)
 		{
-			stop_audio_source(music);
-			xfree(music);
+			int index = charactersNames[i] ? find_dialog_asset(session->dialog, ASSET_CHARACTER, charactersNames[i]) : -1;
+			session->state->charactersNames[i] = index != -1 ? session->dialog->charactersNames[index] : NULL;
 		}
-		music = NULL;
-		if (oldMusic)
+		move_sprite_to_dialog(session, session->backgroundSprite, ASSET_BACKGROUND);
+		move_sprite_to_dialog(session, session->oldBackgroundSprite, ASSET_BACKGROUND);
+		for (int i = 0; i < 7; i++)
 		{
-			stop_audio_source(oldMusic);
-			xfree(oldMusic);
+			move_sprite_to_dialog(session, session->charactersSprites[i], ASSET_CHARACTER);
+			move_sprite_to_dialog(session, session->oldCharactersSprites[i], ASSET_CHARACTER);
 		}
-		oldMusic = NULL;
-		choosing = false;
-		nbChoices = 0;
-		currentChoice = 0;
-		choicesDisplayed = false;
-		buf_free(goToCommands);
-		goToCommands = NULL;
-		moving = false;
-		end = false;
-		displayedSpeakerName = false;
-		appearingBackground = false;
-		appearingCharacter = false;
-		displayDialogUI = false;
-		displaySpeakerName = false;
-		sentenceFirstUpdate = true;
-		fadingSound = false;
-		fadingMusic = false;
-		textScrollOffset = 0;
 
-		if (nextDialogStartKnotName)
+		if (session->nextDialogStartKnotName)
 		{
 			int knotIndex = -1;
-			for (unsigned int i = 0; i < buf_len(interpretingDialog->knots); i++)
+			for (unsigned int i = 0; i < buf_len(session->dialog->knots); i++)
 			{
-				if (strmatch(interpretingDialog->knots[i]->name, nextDialogStartKnotName))
+				if (strmatch(session->dialog->knots[i]->name, session->nextDialogStartKnotName))
 				{
 					knotIndex = i;
 					break;
@@ -1242,114 +1455,277 @@ bool interpret_current_dialog()
 			}
 			if (knotIndex == -1)
 			{
-				error("could not find knot labeled %s in %s.", nextDialogStartKnotName, interpretingDialogName);
+				error("could not find knot labeled %s in %s.", session->nextDialogStartKnotName, session->dialogName);
 			} else {
-				interpretingDialog->currentKnot = knotIndex;
+				session->state->programCounter = session->dialog->knots[knotIndex]->firstInstruction;
 			}
 
-			buf_free(nextDialogStartKnotName);
-			nextDialogStartKnotName = NULL;
+			buf_free(session->nextDialogStartKnotName);
+			session->nextDialogStartKnotName = NULL;
 		}
 	}
 
-	if ((unsigned int)interpretingDialog->currentKnot == buf_len(interpretingDialog->knots))
+	ExecutionState *state = session->state;
+	// set again while a voiced sentence is shown
+	for (int i = 0; i < 7; i++)
 	{
-		return false;
+		session->charactersSprites[i]->lipSyncPhase = -1;
+	}
+	// the dialog waits while the backlog is open, the wheel opens it unless it scrolls an overflowing dialog box
+	if (session->backlog && update_backlog(session->backlog, session->mouseScrollOffset, session->inputKeysPressed[INPUT_KEY_RIGHT_MOUSE_BUTTON] || session->inputKeysPressed[INPUT_KEY_ESCAPE], !dialog_box_overflows(session)))
+	{
+		return true;
 	}
 
-	if (update_knot(interpretingDialog->knots[interpretingDialog->currentKnot]))
+	if (state->currentCue && state->displaySpeakerName && state->currentCue->characterNameInterpolation)
 	{
-		interpretingDialog->currentKnot++;
+		InterpolationCache *interpolationCache = &state->interpolationsCaches[state->currentCue->characterNameInterpolation->index];
+		if (update_interpolation(session->variables, state->currentCue->characterNameInterpolation, interpolationCache))
+		{
+			set_text_string(session->currentSpeaker, interpolationCache->string);
+			place_current_speaker(session);
+		}
 	}
 
-	if (end)
+	for (int i = 0; i < MAX_INSTRUCTIONS_PER_FRAME; i++)
 	{
-		end = false;
-		if (!nextDialogName)
+		Instruction *instruction = &session->dialog->instructions[state->programCounter];
+		if (instruction->knot != session->currentKnot)
 		{
-			return false;
-		} else {
-			interpretingDialog->currentKnot = 0;
+			session->currentKnot = instruction->knot;
+			if (session->dialogCache && instruction->knot != -1)
+			{
+				prefetch_knot_dialogs(session->dialogCache, session->dialog, instruction->knot);
+			}
+		}
+		if (session->profile)
+		{
+			begin_profile_instruction(session->profile, session);
+		}
+		bool executing = execute_instruction(session, instruction);
+		if (session->profile)
+		{
+			end_profile_instruction(session->profile);
+		}
+		if (!executing)
+		{
+			if (session->skipping && !state->end && (instruction->type == INSTRUCTION_COMMAND || instruction->type == INSTRUCTION_WAIT))
+			{
+				continue;
+			}
+			break;
 		}
 	}
 
-	if (oldBackgroundSprite->animations)
+	// after the instructions, so tweens override the positions the sentence sets for its speaker
+	update_tweens(session, get_delta_time(session));
+
+	if (session->autosave)
 	{
-		add_sprite_to_draw_list(oldBackgroundSprite, DRAW_LAYER_BACKGROUND);
+		update_autosave(session->autosave, session);
 	}
-	if (backgroundSprite->animations)
+	if (session->persistentStore)
 	{
-		add_sprite_to_draw_list(backgroundSprite, DRAW_LAYER_BACKGROUND);
+		update_persistent_store(session->persistentStore);
 	}
-	for (int i = 0; i < 7; i++)
+	if (session->dialogCache)
 	{
-		if (oldCharactersSprites[i]->animations)
-		{
-			add_sprite_to_draw_list(oldCharactersSprites[i], DRAW_LAYER_FOREGROUND);
-		}
-		if (charactersSprites[i]->animations)
+		update_dialog_cache(session->dialogCache);
+	}
+	update_voice_channel(session->voice);
+	if (session->preloader)
+	{
+		update_preloader(session->preloader, session->dialog);
+	}
+	if (session->leftDialogs)
+	{
+		release_left_dialogs(session);
+	}
+
+	if (state->end)
+	{
+		state->end = false;
+		if (!session->nextDialogName)
 		{
-			add_sprite_to_draw_list(charactersSprites[i], DRAW_LAYER_FOREGROUND);
+			return false;
+		} else {
+			state->programCounter = 0;
 		}
 	}
 
-	if (displayDialogUI)
+	if (state->displayDialogUI)
 	{
-		add_sprite_to_draw_list(sentenceBox, DRAW_LAYER_UI);
-		if (!choosing && currentSentence->height > sentenceBox->height - 4 && mouseScrollOffset != 0)
+		if (!state->choosing && dialog_box_overflows(session) && session->mouseScrollOffset != 0)
 		{
-			textScrollOffset += mouseScrollOffset;
-			if (textScrollOffset > 0)
+			state->textScrollOffset += session->mouseScrollOffset;
+			if (state->textScrollOffset > 0)
 			{
-				textScrollOffset = 0;
+				state->textScrollOffset = 0;
 			}
-			if (textScrollOffset < (currentSentence->font->ascent - currentSentence->font->descent) - 4 - currentSentence->height)
+			if (state->textScrollOffset < (session->currentSentence->font->ascent - session->currentSentence->font->descent) - 4 - session->currentSentence->height)
 			{
-				textScrollOffset = (currentSentence->font->ascent - currentSentence->font->descent) - 4 - currentSentence->height;
+				state->textScrollOffset = (session->currentSentence->font->ascent - session->currentSentence->font->descent) - 4 - session->currentSentence->height;
 			}
-			set_text_position(currentSentence, (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y - 4 + textScrollOffset});
-		} else if (choosing && nbChoices != 0 && currentChoices[nbChoices - 1]->position.y + currentChoices[nbChoices - 1]->height > sentenceBox->height - 4 && mouseScrollOffset != 0) {
-			textScrollOffset += mouseScrollOffset;
-			if (textScrollOffset > 0)
+			set_text_position(session->currentSentence, (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y - 4 + state->textScrollOffset});
+		} else if (state->choosing && dialog_box_overflows(session) && session->mouseScrollOffset != 0) {
+			state->textScrollOffset += session->mouseScrollOffset;
+			if (state->textScrollOffset > 0)
 			{
-				textScrollOffset = 0;
+				state->textScrollOffset = 0;
 			}
 			int choicesHeight = 0;
-			for (int i = 0; i < nbChoices; i++)
+			for (int i = 0; i < state->nbChoices; i++)
 			{
-				choicesHeight += currentChoices[i]->height;
+				choicesHeight += session->currentChoices[i]->height;
 			}
-			if (textScrollOffset < currentChoices[nbChoices - 1]->height - 4 - choicesHeight)
+			if (state->textScrollOffset < session->currentChoices[state->nbChoices - 1]->height - 4 - choicesHeight)
 			{
-				textScrollOffset = currentChoices[nbChoices - 1]->height - 4 - choicesHeight;
+				state->textScrollOffset = session->currentChoices[state->nbChoices - 1]->height - 4 - choicesHeight;
 			}
 			int choiceYOffset = 0;
-			for (int i = 0; i < nbChoices; i++)
+			for (int i = 0; i < state->nbChoices; i++)
 			{
-				set_text_position(currentChoices[i], (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y + choiceYOffset - 4 + textScrollOffset});
-				if (currentChoice == i)
+				set_text_position(session->currentChoices[i], (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y + choiceYOffset - 4 + state->textScrollOffset});
+				if (state->currentChoice == i)
 				{
-					choiceMarker->position.y = currentChoices[currentChoice]->position.y + ((currentChoices[currentChoice]->height - choiceMarker->height) / 2) - currentChoices[currentChoice]->font->descent + 2;
+					session->choiceMarker->position.y = session->currentChoices[state->currentChoice]->position.y + ((session->currentChoices[state->currentChoice]->height - session->choiceMarker->height) / 2) - session->currentChoices[state->currentChoice]->font->descent + 2;
 				}
-				choiceYOffset += currentChoices[i]->height + 4;
+				choiceYOffset += session->currentChoices[i]->height + 4;
 			}
 		}
-		if (!choosing)
+	}
+	return true;
+}
+
+// only adds the session to the draw lists, so sessions running on other threads never call it
+void draw_session(Session *session)
+{
+	ExecutionState *state = session->state;
+	if (session->oldBackgroundSprite->animations)
+	{
+		add_sprite_to_draw_list(session->oldBackgroundSprite, DRAW_LAYER_BACKGROUND);
+	}
+	if (session->backgroundSprite->animations)
+	{
+		add_sprite_to_draw_list(session->backgroundSprite, DRAW_LAYER_BACKGROUND);
+	}
+	for (int i = 0; i < 7; i++)
+	{
+		if (session->oldCharactersSprites[i]->animations)
+		{
+			add_sprite_to_draw_list(session->oldCharactersSprites[i], DRAW_LAYER_FOREGROUND);
+		}
+		if (session->charactersSprites[i]->animations)
 		{
-			add_text_to_draw_list(currentSentence, DRAW_LAYER_UI_SCISSOR);
+			add_sprite_to_draw_list(session->charactersSprites[i], DRAW_LAYER_FOREGROUND);
+		}
+	}
+
+	if (session->backlog && session->backlog->open)
+	{
+		draw_backlog(session->backlog);
+	} else if (state->displayDialogUI) {
+		add_sprite_to_draw_list(session->sentenceBox, DRAW_LAYER_UI);
+		if (!state->choosing)
+		{
+			add_text_to_draw_list(session->currentSentence, DRAW_LAYER_UI_SCISSOR);
 		} else {
-			add_sprite_to_draw_list(choiceMarker, DRAW_LAYER_UI_SCISSOR);
-			for (int i = 0; i < nbChoices; i++)
+			add_sprite_to_draw_list(session->choiceMarker, DRAW_LAYER_UI_SCISSOR);
+			for (int i = 0; i < state->nbChoices; i++)
 			{
-				add_text_to_draw_list(currentChoices[i], DRAW_LAYER_UI_SCISSOR);
+				add_text_to_draw_list(session->currentChoices[i], DRAW_LAYER_UI_SCISSOR);
 			}
 		}
 
-		if (displaySpeakerName)
+		if (state->displaySpeakerName)
+		{
+			add_sprite_to_draw_list(session->characterNameBox, DRAW_LAYER_UI);
+			add_text_to_draw_list(session->currentSpeaker, DRAW_LAYER_UI);
+		}
+	}
+}
+
+// rebuilds the texts on screen from the execution state, after it was loaded from a save
+void restore_session_display(Session *session, int nbCharToDisplay)
+{
+	ExecutionState *state = session->state;
+	Instruction *instruction = &session->dialog->instructions[state->programCounter];
+	if (instruction->type == INSTRUCTION_SAY && !state->sentenceFirstUpdate)
+	{
+		set_text_string(session->currentSentence, get_sentence_string(session, instruction->sentence));
+		session->currentSentence->nbCharToDisplay = nbCharToDisplay;
+		get_sentence_timeline(session, instruction->sentence, true);
+	} else {
+		set_text_string(session->currentSentence, NULL);
+	}
+
+	set_text_string(session->currentSpeaker, NULL);
+	session->currentSpeaker->color = COLOR_WHITE;
+	if (state->currentCue && state->currentCue->characterName)
+	{
+		display_speaker_name(session, state->currentCue);
+	}
+
+	for (unsigned int i = 0; i < buf_len(session->currentChoices); i++)
+	{
+		set_text_string(session->currentChoices[i], NULL);
+	}
+	buf(Instruction *) choicesInstructions = state->choicesInstructions;
+	int currentChoice = state->currentChoice;
+	int textScrollOffset = state->textScrollOffset;
+	state->choicesInstructions = NULL;
+	state->choosing = false;
+	for (unsigned int i = 0; i < buf_len(choicesInstructions); i++)
+	{
+		add_choice(session, choicesInstructions[i]);
+	}
+	buf_free(choicesInstructions);
+	state->currentChoice = currentChoice;
+	state->textScrollOffset = textScrollOffset;
+
+	reset_session_ui(session);
+	if (!state->choosing)
+	{
+		set_text_position(session->currentSentence, (ivec2){0.015f * windowDimensions.x, 0.8f * windowDimensions.y - 4 + state->textScrollOffset});
+	}
+}
+
+// NULL goes back to the text of the scripts, the text on screen is laid out again at once and a sentence being revealed goes on from the same time
+bool set_session_language(Session *session, const char *language)
+{
+	Localization *localization = NULL;
+	if (language)
+	{
+		localization = load_localization(language);
+		if (!localization)
+		{
+			return false;
+		}
+	}
+	if (session->localization)
+	{
+		free_localization(session->localization);
+	}
+	session->localization = localization;
+	// a dialog not started yet shows nothing
+	if (!session->state || session->dialogChanged)
+	{
+		return true;
+	}
+
+	ExecutionState *state = session->state;
+	bool revealed = session->currentSentence->nbCharToDisplay == session->currentSentence->nbMaxCharToDisplay;
+	restore_session_display(session, 0);
+	Instruction *instruction = &session->dialog->instructions[state->programCounter];
+	if (instruction->type == INSTRUCTION_SAY && !state->sentenceFirstUpdate)
+	{
+		RevealTimeline *timeline = get_sentence_timeline(session, instruction->sentence, false);
+		int nbRevealedCharacters = count_reveal_times(timeline->charactersTimes, state->revealTime);
+		if (revealed || nbRevealedCharacters > session->currentSentence->nbMaxCharToDisplay)
 		{
-			add_sprite_to_draw_list(characterNameBox, DRAW_LAYER_UI);
-			add_text_to_draw_list(currentSpeaker, DRAW_LAYER_UI);
+			nbRevealedCharacters = session->currentSentence->nbMaxCharToDisplay;
 		}
+		session->currentSentence->nbCharToDisplay = nbRevealedCharacters;
 	}
 	return true;
 }
@@ -1,9 +1,111 @@
 #ifndef INTERPRET_H
 #define INTERPRET_H
 
-void init_dialog_ui();
-void reset_dialog_ui();
-void free_dialog_ui();
-bool interpret_current_dialog();
+// everything the interpreter changes while running a dialog, the dialog itself stays read-only
+typedef struct ExecutionState
+{
+	int programCounter;
+	Cue *currentCue;
+	bool end;
+	buf(ConditionCache) conditionsCaches;
+	buf(InterpolationCache) interpolationsCaches;
+	buf(buf(char)) coloredNames;
+	buf(vec3) namesColors;
+	const char *charactersNames[7];
+	int currentSpeakerSpriteIndex;
+	int characterNamePosition;
+	buf(Instruction *) choicesInstructions;
+	bool choosing;
+	int nbChoices;
+	int currentChoice;
+	// transitions running concurrently, the command instruction owning some of them waits for them
+	buf(struct Tween) tweens;
+	bool awaitingCommand;
+	bool displayDialogUI;
+	bool displaySpeakerName;
+	bool sentenceFirstUpdate;
+	// time since the current sentence started to appear
+	float revealTime;
+	// timeline of the current sentence when it is interpolated
+	RevealTimeline interpolatedTimeline;
+	float waitTimer;
+	int textScrollOffset;
+} ExecutionState;
+
+ExecutionState *create_execution_state(const Dialog *dialog);
+void free_execution_state(ExecutionState *executionState);
+
+// one playthrough, sessions only share the dialogs they run, which they never modify
+typedef struct Session
+{
+	Dialog *dialog;
+	buf(char) dialogName;
+	// set when the dialog goes to another file, the owner of the session then loads it and calls set_session_dialog
+	buf(char) nextDialogName;
+	buf(char) nextDialogStartKnotName;
+	bool dialogChanged;
+	VariableStore *variables;
+	ExecutionState *state;
+	float deltaTime;
+	bool inputKeysPressed[INPUT_KEY_COUNT];
+	int mouseScrollOffset;
+	Sprite *oldCharactersSprites[7];
+	Sprite *charactersSprites[7];
+	Sprite *oldBackgroundSprite;
+	Sprite *backgroundSprite;
+	Sprite *choiceMarker;
+	Sprite *characterNameBox;
+	Sprite *sentenceBox;
+	Text *currentSpeaker;
+	Text *currentSentence;
+	buf(Text *) currentChoices;
+	AudioSource *music;
+	AudioSource *oldMusic;
+	buf(char) musicName;
+	AudioSource *sound;
+	AudioSource *oldSound;
+	buf(char) soundName;
+	AudioSource *blipSound;
+	VoiceChannel *voice;
+	// loads the assets of #preload ahead and releases the ones of #unload, none by default
+	// without it both commands are ignored, so the sessions sharing dialogs never change them
+	struct Preloader *preloader;
+	// the translations shown instead of the text of the scripts, none by default
+	struct Localization *localization;
+	// records the points rollback_session goes back to, none by default
+	struct History *history;
+	// shared by the sessions of a player and owned by the caller, none by default
+	struct ReadStatus *readStatus;
+	// set by the caller to skip the sentences already read, the interpreter clears it on an unread sentence or a choice
+	bool skipping;
+	// past lines shown with the mouse wheel, none by default
+	struct Backlog *backlog;
+	// cost of the script lines run, none by default
+	struct Profile *profile;
+	// saves the session periodically and before each choice, none by default
+	struct Autosave *autosave;
+	// variables kept across playthroughs, shared by the sessions of a player and owned by the caller, none by default
+	struct PersistentStore *persistentStore;
+	// dialogs kept once left, owned by the caller, none by default
+	struct DialogCache *dialogCache;
+	// dialogs left whose packs are still shown, freed or released once none is
+	buf(Dialog *) leftDialogs;
+	// knot of the last instruction run, entering another one parses ahead the dialogs it can go to
+	int currentKnot;
+} Session;
+
+Session *create_session();
+void set_session_dialog(Session *session, Dialog *dialog, const char *dialogName);
+Dialog *open_session_dialog(Session *session, const char *dialogName);
+void close_session_dialog(Session *session, Dialog *dialog);
+void switch_session_dialog(Session *session, Dialog *dialog, const char *dialogName);
+void load_session_dialog(Session *session, const char *dialogName);
+buf(Animation *) get_session_pack(Session *session, Dialog *dialog, AssetType type, int index);
+void reset_session_ui(Session *session);
+bool update_session(Session *session);
+void draw_session(Session *session);
+void restore_session_display(Session *session, int nbCharToDisplay);
+bool set_session_language(Session *session, const char *language);
+void free_session(Session *session);
 
 #endif /* end of include guard: INTERPRET_H */
@@ -12,15 +12,15 @@
 #include "token.h"
 #include "lex.h"
 
-static const char *filePath;
-static char *fileString;
+static __thread const char *filePath;
+static __thread char *fileString;
 
-static int currentLine = 1;
-static int currentIndentationLevel = 0;
-static int currentCharIndex = 0;
-static int currentCommentDepth = 0;
+static __thread int currentLine = 1;
+static __thread int currentIndentationLevel = 0;
+static __thread int currentCharIndex = 0;
+static __thread int currentCommentDepth = 0;
 
-static buf(DialogToken *) dialogTokens;
+static __thread buf(DialogToken *) dialogTokens;
 
 typedef enum LexMode
 {
@@ -28,9 +28,9 @@ typedef enum LexMode
 	LEX_MODE_CODE
 } LexMode;
 
-static LexMode currentLexMode = LEX_MODE_TEXT;
+static __thread LexMode currentLexMode = LEX_MODE_TEXT;
 
-static buf(AnimationToken *)animationTokens;
+static __thread buf(AnimationToken *)animationTokens;
 
 static void step_in_source()
 {
@@ -124,7 +124,7 @@ static buf(char) get_sentence()
 
 #define stack(a) buf(a)
 
-static stack(int) multilineCommentsLines = NULL;
+static __thread stack(int) multilineCommentsLines = NULL;
 
 static void stack_push(stack(int) *stack, int value)
 {
@@ -248,6 +248,9 @@ static DialogToken *get_next_dialog_token()
 			} else if (strmatch(command, "assign")) {
 				token->type = DIALOG_TOKEN_ASSIGN;
 				buf_free(command);
+			} else if (strmatch(command, "assign_persistent")) {
+				token->type = DIALOG_TOKEN_ASSIGN_PERSISTENT;
+				buf_free(command);
 			} else {
 				token->type = DIALOG_TOKEN_COMMAND;
 				token->string = command;
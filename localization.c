@@ -0,0 +1,297 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maths.h"
+#include "error.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "file.h"
+#include "animation.h"
+#include "variable.h"
+#include "dialog.h"
+#include "binary.h"
+#include "localization.h"
+
+// a strings table is the magic, the version, the number of strings and the size of the strings, then the entries sorted by id and the strings
+// the source of a table is a line as written in the scripts, its translation on the next line, then an empty line
+static const char STRINGS_TABLE_MAGIC[4] = {'V', 'N', 'I', 'L'};
+static const int STRINGS_TABLE_VERSION = 1;
+static const size_t STRINGS_TABLE_HEADER_SIZE = 16;
+
+typedef struct StringsTableEntry
+{
+	unsigned long long id;
+	unsigned int offset;
+	// line of the translation in the source of the table
+	int line;
+} StringsTableEntry;
+
+typedef struct SourceString
+{
+	StringsTableEntry entry;
+	const char *original;
+	int originalLine;
+	const char *translation;
+} SourceString;
+
+static buf(char) get_language_path(const char *language, const char *extension)
+{
+	buf(char) path = strclone("Languages/");
+	strnappend(&path, 2, language, extension);
+	return path;
+}
+
+static int compare_source_strings(const void *a, const void *b)
+{
+	const SourceString *stringA = a;
+	const SourceString *stringB = b;
+	if (stringA->entry.id != stringB->entry.id)
+	{
+		return stringA->entry.id < stringB->entry.id ? -1 : 1;
+	}
+	return stringA->originalLine - stringB->originalLine;
+}
+
+// compiles Languages/<language>.txt into Languages/<language>.str, false if there is no source
+bool compile_strings_table(const char *language)
+{
+	buf(char) sourcePath = get_language_path(language, ".txt");
+	if (!check_file(sourcePath))
+	{
+		warning("could not find %s.", sourcePath);
+		buf_free(sourcePath);
+		return false;
+	}
+	char *source = file_to_string(sourcePath);
+	buf(SourceString) strings = NULL;
+	const char *original = NULL;
+	int originalLine = 0;
+	bool translated = false;
+	int line = 0;
+	char *currentLine = strncmp(source, "\xEF\xBB\xBF", 3) ? source : source + 3;
+	while (currentLine)
+	{
+		line++;
+		char *nextLine = strchr(currentLine, '\n');
+		if (nextLine)
+		{
+			*nextLine = '\0';
+			nextLine++;
+		}
+		size_t length = strlen(currentLine);
+		if (length != 0 && currentLine[length - 1] == '\r')
+		{
+			currentLine[--length] = '\0';
+		}
+		if (length == 0)
+		{
+			if (original && !translated)
+			{
+				error("in %s at line %d, expected the translation of \"%s\".", sourcePath, line, original);
+			}
+			original = NULL;
+			translated = false;
+		} else if (!original) {
+			original = currentLine;
+			originalLine = line;
+		} else if (!translated) {
+			// the reveal tags are checked here rather than when the translation is shown
+			free_sentence(parse_translated_sentence(currentLine, sourcePath, line));
+			buf_add(strings, ((SourceString){{strhash(original), 0, line}, original, originalLine, currentLine}));
+			translated = true;
+		} else {
+			error("in %s at line %d, expected an empty line after the translation of \"%s\".", sourcePath, line, original);
+		}
+		currentLine = nextLine;
+	}
+	if (original && !translated)
+	{
+		error("in %s at line %d, expected the translation of \"%s\".", sourcePath, line, original);
+	}
+
+	unsigned int nbStrings = buf_len(strings);
+	if (nbStrings != 0)
+	{
+		qsort(strings, nbStrings, sizeof (*strings), compare_source_strings);
+	}
+	buf(unsigned char) stringsData = NULL;
+	for (unsigned int i = 0; i < nbStrings; i++)
+	{
+		if (i != 0 && strings[i].entry.id == strings[i - 1].entry.id)
+		{
+			if (strmatch(strings[i].original, strings[i - 1].original))
+			{
+				error("in %s at line %d, \"%s\" is already translated at line %d.", sourcePath, strings[i].originalLine, strings[i].original, strings[i - 1].originalLine);
+			}
+			error("in %s at line %d, \"%s\" has the same id as \"%s\" at line %d, one of them has to be reworded.", sourcePath, strings[i].originalLine, strings[i].original, strings[i - 1].original, strings[i - 1].originalLine);
+		}
+		strings[i].entry.offset = buf_len(stringsData);
+		write_bytes(&stringsData, strings[i].translation, strlen(strings[i].translation) + 1);
+	}
+
+	buf(unsigned char) data = NULL;
+	write_bytes(&data, STRINGS_TABLE_MAGIC, sizeof (STRINGS_TABLE_MAGIC));
+	write_int(&data, STRINGS_TABLE_VERSION);
+	write_int(&data, nbStrings);
+	write_int(&data, buf_len(stringsData));
+	for (unsigned int i = 0; i < nbStrings; i++)
+	{
+		write_bytes(&data, &strings[i].entry, sizeof (strings[i].entry));
+	}
+	write_bytes(&data, stringsData, buf_len(stringsData));
+
+	// a game running may have the table mapped, so it is replaced rather than written over
+	buf(char) tablePath = get_language_path(language, ".str");
+	buf(char) temporaryPath = strmerge(tablePath, ".tmp");
+	if (!write_file_durably(temporaryPath, data, buf_len(data)) || !replace_file(temporaryPath, tablePath))
+	{
+		error("could not write %s.", tablePath);
+	}
+	buf_free(temporaryPath);
+	buf_free(tablePath);
+	buf_free(data);
+	buf_free(stringsData);
+	buf_free(strings);
+	xfree(source);
+	buf_free(sourcePath);
+	return true;
+}
+
+// NULL if the table of the language is missing or damaged
+Localization *load_localization(const char *language)
+{
+	buf(char) tablePath = get_language_path(language, ".str");
+	size_t size;
+	const unsigned char *data = map_file(tablePath, &size);
+	if (!data)
+	{
+		warning("could not find the strings table %s.", tablePath);
+		buf_free(tablePath);
+		return NULL;
+	}
+	BinaryReader reader = {data, size, 0, false};
+	char magic[sizeof (STRINGS_TABLE_MAGIC)];
+	read_bytes(&reader, magic, sizeof (magic));
+	int version = read_int(&reader);
+	int nbStrings = read_int(&reader);
+	int stringsSize = read_int(&reader);
+	bool valid = !reader.failed && !memcmp(magic, STRINGS_TABLE_MAGIC, sizeof (STRINGS_TABLE_MAGIC));
+	valid = valid && version == STRINGS_TABLE_VERSION && nbStrings >= 0 && stringsSize >= 0;
+	valid = valid && size == STRINGS_TABLE_HEADER_SIZE + nbStrings * sizeof (StringsTableEntry) + stringsSize && (stringsSize == 0 || data[size - 1] == '\0');
+	if (!valid)
+	{
+		warning("%s is not a strings table of version %d.", tablePath, STRINGS_TABLE_VERSION);
+		unmap_file(data, size);
+		buf_free(tablePath);
+		return NULL;
+	}
+	buf_free(tablePath);
+
+	Localization *localization = xmalloc(sizeof (*localization));
+	localization->language = strclone(language);
+	localization->sourcePath = get_language_path(language, ".txt");
+	localization->data = data;
+	localization->size = size;
+	localization->nbStrings = nbStrings;
+	localization->sentencesIds = NULL;
+	localization->sentences = NULL;
+	localization->interpolationCache = (InterpolationCache){NULL, NULL, NULL};
+	return localization;
+}
+
+// the entries are read in place, the mapping being aligned on a page and the header on the entries
+static const StringsTableEntry *find_entry(Localization *localization, unsigned long long id)
+{
+	const StringsTableEntry *entries = (const StringsTableEntry *)(localization->data + STRINGS_TABLE_HEADER_SIZE);
+	int low = 0;
+	int high = localization->nbStrings;
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (entries[middle].id < id)
+		{
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low == localization->nbStrings || entries[low].id != id)
+	{
+		return NULL;
+	}
+	size_t stringsStart = STRINGS_TABLE_HEADER_SIZE + localization->nbStrings * sizeof (*entries);
+	if (entries[low].offset >= localization->size - stringsStart)
+	{
+		return NULL;
+	}
+	return &entries[low];
+}
+
+static const char *get_entry_string(Localization *localization, const StringsTableEntry *entry)
+{
+	return (const char *)localization->data + STRINGS_TABLE_HEADER_SIZE + localization->nbStrings * sizeof (*entry) + entry->offset;
+}
+
+// NULL if the string has no translation
+const char *get_translated_string(Localization *localization, unsigned long long id)
+{
+	const StringsTableEntry *entry = find_entry(localization, id);
+	return entry ? get_entry_string(localization, entry) : NULL;
+}
+
+// NULL if the sentence has no translation, the translation is parsed the first time it is shown
+Sentence *get_translated_sentence(Localization *localization, const Sentence *sentence)
+{
+	int low = 0;
+	int high = buf_len(localization->sentencesIds);
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (localization->sentencesIds[middle] < sentence->stringId)
+		{
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if ((unsigned int)low < buf_len(localization->sentencesIds) && localization->sentencesIds[low] == sentence->stringId)
+	{
+		return localization->sentences[low];
+	}
+	const StringsTableEntry *entry = find_entry(localization, sentence->stringId);
+	if (!entry)
+	{
+		return NULL;
+	}
+	Sentence *translation = parse_translated_sentence(get_entry_string(localization, entry), localization->sourcePath, entry->line);
+	buf_add(localization->sentencesIds, 0);
+	buf_add(localization->sentences, NULL);
+	for (int i = buf_len(localization->sentences) - 1; i > low; i--)
+	{
+		localization->sentencesIds[i] = localization->sentencesIds[i - 1];
+		localization->sentences[i] = localization->sentences[i - 1];
+	}
+	localization->sentencesIds[low] = sentence->stringId;
+	localization->sentences[low] = translation;
+	return translation;
+}
+
+void free_localization(Localization *localization)
+{
+	for (unsigned int i = 0; i < buf_len(localization->sentences); i++)
+	{
+		free_sentence(localization->sentences[i]);
+	}
+	buf_free(localization->sentences);
+	buf_free(localization->sentencesIds);
+	buf_free(localization->interpolationCache.variablesVersions);
+	buf_free(localization->interpolationCache.string);
+	buf_free(localization->interpolationCache.literalsStarts);
+	unmap_file(localization->data, localization->size);
+	buf_free(localization->sourcePath);
+	buf_free(localization->language);
+	xfree(localization);
+}
@@ -0,0 +1,27 @@
+#ifndef LOCALIZATION_H
+#define LOCALIZATION_H
+
+// the translations of a language, from a strings table sorted by id that is mapped rather than read
+// only the pages of the strings looked up are loaded, the sentences shown are parsed once until the language changes
+typedef struct Localization
+{
+	buf(char) language;
+	// the source of the table, where its errors are reported
+	buf(char) sourcePath;
+	const unsigned char *data;
+	size_t size;
+	int nbStrings;
+	// the translated sentences parsed, sorted by id
+	buf(unsigned long long) sentencesIds;
+	buf(Sentence *) sentences;
+	// shared by the interpolated translations, so built again each time one is shown
+	InterpolationCache interpolationCache;
+} Localization;
+
+bool compile_strings_table(const char *language);
+Localization *load_localization(const char *language);
+const char *get_translated_string(Localization *localization, unsigned long long id);
+Sentence *get_translated_sentence(Localization *localization, const Sentence *sentence);
+void free_localization(Localization *localization);
+
+#endif /* end of include guard: LOCALIZATION_H */
@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "audio.h"
 #include "window.h"
@@ -9,26 +10,46 @@
 #include "user_input.h"
 #include "stretchy_buffer.h"
 #include "xalloc.h"
+#include "file.h"
 #include "str.h"
-#include "interpret.h"
 #include "animation.h"
 #include "graphics.h"
 #include "variable.h"
 #include "dialog.h"
+#include "bytecode.h"
+#include "interpret.h"
 #include "globals_dialog.h"
+#include "save.h"
+#include "history.h"
+#include "binary.h"
+#include "read_status.h"
+#include "backlog.h"
+#include "replay.h"
+#include "autosave.h"
+#include "persistent.h"
+#include "dialog_cache.h"
+#include "preload.h"
 
-Dialog *interpretingDialog = NULL;
-buf(char) interpretingDialogName = NULL;
-buf(char) nextDialogName = NULL;
-bool dialogChanged = true;
 buf(buf(char)) variablesNames = NULL;
-buf(Variable *) variablesValues = NULL;
 
 static float timeDuringCurrentSecond = 0.0f;
 static Text *fpsDisplayText;
 static Sprite *fpsDisplayBox;
 static char *fpsDisplayString;
 static int fpsNumber = 0;
+static Session *session;
+static ReadStatus *readStatus;
+static int readStatusAutosaves = 0;
+static PersistentStore *persistentStore;
+// going back to a hub dialog should not parse it again
+static const long long DIALOG_CACHE_BUDGET = 16 * 1024 * 1024;
+static DialogCache *dialogCache;
+static bool skipMode = false;
+// every run is recorded, so that a tester can send the replay of a stutter along with the report
+static ReplayRecorder *replayRecorder;
+// the languages the L key goes through after the text of the scripts, one per line in Languages/languages.txt
+static buf(buf(char)) languages = NULL;
+static int currentLanguage = -1;
 
 int main(int argc, char** argv)
 {
@@ -38,6 +59,8 @@ int main(int argc, char** argv)
 
 	init_graphics();
 
+	init_audio();
+
 	fpsDisplayText = create_text();
 	set_text_position(fpsDisplayText, (ivec2){0, -4});
 	set_text_font(fpsDisplayText, "Fonts/OpenSans-Regular.ttf", TEXT_SIZE_SMALL);
@@ -48,10 +71,28 @@ int main(int argc, char** argv)
 	fpsDisplayBox->color = COLOR_BLACK;
 	fpsDisplayBox->height = fpsDisplayText->height;
 
-	init_dialog_ui();
-	interpretingDialogName = strclone("Dialogs/start.dlg");
-
-	interpretingDialog = get_dialog_from_file(interpretingDialogName);
+	session = create_session();
+	session->history = create_history();
+	session->backlog = create_backlog();
+	session->autosave = create_autosave("autosave", 3, 60.0f);
+	session->preloader = create_preloader();
+	readStatus = load_read_status("read.dat");
+	session->readStatus = readStatus;
+	persistentStore = load_persistent_store("persistent.dat");
+	session->persistentStore = persistentStore;
+	if (check_file("Languages/languages.txt"))
+	{
+		char *languagesList = file_to_string("Languages/languages.txt");
+		for (char *language = strtok(languagesList, "\r\n"); language; language = strtok(NULL, "\r\n"))
+		{
+			buf_add(languages, strclone(language));
+		}
+		xfree(languagesList);
+	}
+	dialogCache = create_dialog_cache(DIALOG_CACHE_BUDGET);
+	session->dialogCache = dialogCache;
+	load_session_dialog(session, "Dialogs/start.dlg");
+	replayRecorder = create_replay_recorder("replay.vnp", session);
 
 	while (true)
 	{
@@ -75,43 +116,90 @@ int main(int argc, char** argv)
 			fpsNumber = 0;
 		}
 
+		ReplayAction replayAction = REPLAY_ACTION_NONE;
 		if (is_input_key_pressed(INPUT_KEY_R))
 		{
-			buf_free(nextDialogName);
-			nextDialogName = interpretingDialogName;
+			strcopy(&session->nextDialogName, session->dialogName);
+			replayAction = REPLAY_ACTION_RELOAD;
 		} else if (is_input_key_pressed(INPUT_KEY_1)) {
 			set_window_mode(WINDOW_MODE_WINDOWED);
-			reset_dialog_ui();
+			reset_session_ui(session);
+			replayAction = REPLAY_ACTION_RESET_UI;
 		} else if (is_input_key_pressed(INPUT_KEY_2)) {
 			set_window_mode(WINDOW_MODE_BORDERLESS);
-			reset_dialog_ui();
+			reset_session_ui(session);
+			replayAction = REPLAY_ACTION_RESET_UI;
 		} else if (is_input_key_pressed(INPUT_KEY_3)) {
 			set_window_mode(WINDOW_MODE_FULLSCREEN);
-			reset_dialog_ui();
+			reset_session_ui(session);
+			replayAction = REPLAY_ACTION_RESET_UI;
 		} else if (is_input_key_pressed(INPUT_KEY_ADD)) {
 			resize_window(windowDimensions.x + 8, windowDimensions.y + 6);
-			reset_dialog_ui();
+			reset_session_ui(session);
+			replayAction = REPLAY_ACTION_RESET_UI;
 		} else if (is_input_key_pressed(INPUT_KEY_SUBTRACT)) {
 			resize_window(windowDimensions.x - 8, windowDimensions.y - 6);
-			reset_dialog_ui();
+			reset_session_ui(session);
+			replayAction = REPLAY_ACTION_RESET_UI;
+		} else if (is_input_key_pressed(INPUT_KEY_F5)) {
+			save_session(session, "quicksave.sav");
+		} else if (is_input_key_pressed(INPUT_KEY_F9)) {
+			if (load_session(session, "quicksave.sav"))
+			{
+				replayAction = REPLAY_ACTION_LOAD;
+			}
+		} else if (is_input_key_pressed(INPUT_KEY_F8)) {
+			if (load_latest_autosave(session->autosave, session))
+			{
+				replayAction = REPLAY_ACTION_LOAD;
+			}
+		} else if (is_input_key_pressed(INPUT_KEY_PAGE_UP)) {
+			rollback_session(session->history, session);
+			replayAction = REPLAY_ACTION_ROLLBACK;
+		} else if (is_input_key_pressed(INPUT_KEY_TAB)) {
+			skipMode = !skipMode;
+		} else if (is_input_key_pressed(INPUT_KEY_L) && buf_len(languages) != 0) {
+			currentLanguage = currentLanguage + 1 == (int)buf_len(languages) ? -1 : currentLanguage + 1;
+			set_session_language(session, currentLanguage == -1 ? NULL : languages[currentLanguage]);
+			replayAction = REPLAY_ACTION_LANGUAGE;
 		}
 
-		if (nextDialogName)
+		// the sentences read are also saved with each autosave and on every dialog switch, so a crash loses few of them
+		if (readStatus->changed && (session->nextDialogName || session->autosave->nbAutosaves != readStatusAutosaves))
 		{
-			free_dialog(interpretingDialog);
-			interpretingDialog = get_dialog_from_file(nextDialogName);
-			if (interpretingDialogName != nextDialogName)
-			{
-				strcopy(&interpretingDialogName, nextDialogName);
-				buf_free(nextDialogName);
-			}
-			nextDialogName = NULL;
-			dialogChanged = true;
+			save_read_status(readStatus, "read.dat");
+			readStatusAutosaves = session->autosave->nbAutosaves;
+		}
+		if (session->nextDialogName)
+		{
+			load_session_dialog(session, session->nextDialogName);
 		}
-		if (!interpret_current_dialog())
+		session->deltaTime = deltaTime;
+		for (int i = 0; i < INPUT_KEY_COUNT; i++)
 		{
+			session->inputKeysPressed[i] = is_input_key_pressed(i);
+		}
+		session->mouseScrollOffset = mouseScrollOffset;
+		session->skipping = skipMode || is_input_key_down(INPUT_KEY_CONTROL_LEFT);
+		if (replayRecorder)
+		{
+			record_replay_frame(replayRecorder, session, replayAction);
+		}
+		if (update_session(session))
+		{
+			draw_session(session);
+		} else {
 			ask_window_to_close();
 		}
+		if (replayRecorder)
+		{
+			record_replay_hash(replayRecorder, session);
+		}
+		// skipping stops on the first unread sentence or choice
+		if (!session->skipping)
+		{
+			skipMode = false;
+		}
 
 		add_sprite_to_draw_list(fpsDisplayBox, DRAW_LAYER_UI);
 		add_text_to_draw_list(fpsDisplayText, DRAW_LAYER_UI);
@@ -120,27 +208,47 @@ int main(int argc, char** argv)
 
 		swap_window_buffers();
 	}
-	free_dialog(interpretingDialog);
-	free_dialog_ui();
+	if (replayRecorder)
+	{
+		free_replay_recorder(replayRecorder, session);
+	}
+	wait_for_saves();
+	save_read_status(readStatus, "read.dat");
+	free_read_status(readStatus);
+	free_dialog_cache(dialogCache);
+	for (unsigned int i = 0; i < buf_len(languages); i++)
+	{
+		buf_free(languages[i]);
+	}
+	buf_free(languages);
+
+	// the autosaves and persistent variables still being written read the variables names
+	free_autosave(session->autosave);
+	session->autosave = NULL;
+	free_persistent_store(persistentStore);
+	session->persistentStore = NULL;
 
 	printf("---Variables---\n");
-	for (unsigned int i = 0; i < buf_len(variablesValues); i++)
+	int nbVariables = 0;
+	for (unsigned int i = 0; i < buf_len(variablesNames); i++)
 	{
-		printf("	-%s", variablesNames[i]);
+		Variable *variable = get_variable_store_value(session->variables, i);
+		if (variable)
+		{
+			printf("	-%s", variablesNames[i]);
+			print_variable(variable);
+			nbVariables++;
+		}
 		buf_free(variablesNames[i]);
-		print_variable(variablesValues[i]);
-		free_variable(variablesValues[i]);
 	}
-	printf("%d variables.\n\n", buf_len(variablesValues));
+	printf("%d variables.\n\n", nbVariables);
 	buf_free(variablesNames);
-	buf_free(variablesValues);
+	free_session(session);
 
 	xfree(fpsDisplayString);
 	free_text(fpsDisplayText);
 	free_sprite(fpsDisplayBox);
 
-	buf_free(interpretingDialogName);
-	buf_free(nextDialogName);
 	free_graphics();
 
 	free_audio();
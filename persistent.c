@@ -0,0 +1,353 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "error.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "file.h"
+#include "thread.h"
+#include "animation.h"
+#include "variable.h"
+#include "dialog.h"
+#include "globals_dialog.h"
+#include "binary.h"
+#include "persistent.h"
+
+// the snapshot is the magic, the version, the size and checksum of the payload, then the sequence of the last assignment it holds and the variables by name
+// the log is a list of records, each one the size and checksum of its payload then the sequence of the assignment and a variable, a torn record ends it
+static const char PERSISTENT_MAGIC[4] = {'V', 'N', 'I', 'V'};
+static const int PERSISTENT_VERSION = 2;
+static const size_t PERSISTENT_HEADER_SIZE = 16;
+static const size_t PERSISTENT_RECORD_HEADER_SIZE = 8;
+
+static void write_variable(buf(unsigned char) *data, int variableSlot, Variable *variable)
+{
+	write_string(data, variablesNames[variableSlot]);
+	write_int(data, variable->type);
+	if (variable->type == VARIABLE_NUMERIC)
+	{
+		write_double(data, variable->numeric);
+	} else {
+		write_string(data, variable->string);
+	}
+}
+
+static void store_variable(PersistentStore *store, int variableSlot, Variable *variable)
+{
+	if (!is_variable_persistent(store, variableSlot))
+	{
+		buf_add(store->slots, variableSlot);
+	}
+	set_variable_store_value(store->variables, variableSlot, variable);
+}
+
+static void read_variable(BinaryReader *reader, PersistentStore *store)
+{
+	buf(char) name = read_string(reader);
+	Variable *variable = xmalloc(sizeof (*variable));
+	variable->type = read_int(reader);
+	variable->string = NULL;
+	variable->numeric = 0.0;
+	if (variable->type == VARIABLE_NUMERIC)
+	{
+		variable->numeric = read_double(reader);
+	} else if (variable->type == VARIABLE_STRING) {
+		variable->string = read_string(reader);
+	} else {
+		reader->failed = true;
+	}
+	if (!name || (variable->type == VARIABLE_STRING && !variable->string))
+	{
+		reader->failed = true;
+	}
+	if (reader->failed)
+	{
+		free_variable(variable);
+	} else {
+		store_variable(store, get_variable_slot(name), variable);
+	}
+	buf_free(name);
+}
+
+static void load_snapshot(PersistentStore *store)
+{
+	size_t size;
+	const unsigned char *data = map_file(store->snapshotPath, &size);
+	if (!data)
+	{
+		return;
+	}
+	BinaryReader reader = {data, size, 0, false};
+	char magic[4];
+	read_bytes(&reader, magic, sizeof (magic));
+	int version = read_int(&reader);
+	int payloadSize = read_int(&reader);
+	unsigned int checksum = read_int(&reader);
+	bool valid = !reader.failed && !memcmp(magic, PERSISTENT_MAGIC, sizeof (magic)) && version == PERSISTENT_VERSION;
+	valid = valid && payloadSize >= 0 && (size_t)payloadSize == size - PERSISTENT_HEADER_SIZE && checksum == get_checksum(data + PERSISTENT_HEADER_SIZE, payloadSize);
+	if (valid)
+	{
+		store->sequence = read_int(&reader);
+		int nbVariables = read_int(&reader);
+		for (int i = 0; i < nbVariables && !reader.failed; i++)
+		{
+			read_variable(&reader, store);
+		}
+	}
+	if (!valid || reader.failed)
+	{
+		warning("%s is damaged, some persistent variables may be lost.", store->snapshotPath);
+	}
+	unmap_file(data, size);
+}
+
+// a crash can leave the last record partly written, or the whole log if it came before the log was emptied after a snapshot
+// the records a snapshot holds are skipped, and the next compaction drops them along with the log
+static void load_log(PersistentStore *store)
+{
+	unsigned int snapshotSequence = store->sequence;
+	size_t size;
+	const unsigned char *data = map_file(store->logPath, &size);
+	if (!data)
+	{
+		return;
+	}
+	BinaryReader reader = {data, size, 0, false};
+	while (reader.position < size)
+	{
+		int payloadSize = read_int(&reader);
+		unsigned int checksum = read_int(&reader);
+		if (reader.failed || payloadSize <= 0 || (size_t)payloadSize > size - reader.position || checksum != get_checksum(data + reader.position, payloadSize))
+		{
+			store->nbLogRecords = PERSISTENT_COMPACTION_PERIOD;
+			break;
+		}
+		BinaryReader recordReader = {data + reader.position, payloadSize, 0, false};
+		unsigned int sequence = read_int(&recordReader);
+		reader.position += payloadSize;
+		if (sequence <= snapshotSequence)
+		{
+			store->nbLogRecords = PERSISTENT_COMPACTION_PERIOD;
+			continue;
+		}
+		read_variable(&recordReader, store);
+		store->sequence = sequence;
+		store->nbLogRecords++;
+	}
+	unmap_file(data, size);
+}
+
+PersistentStore *load_persistent_store(const char *snapshotPath)
+{
+	PersistentStore *store = xmalloc(sizeof (*store));
+	store->snapshotPath = strclone(snapshotPath);
+	store->logPath = strmerge(snapshotPath, ".log");
+	store->variables = create_variable_store();
+	store->slots = NULL;
+	store->nbLogRecords = 0;
+	store->compactionThreshold = PERSISTENT_COMPACTION_PERIOD;
+	store->sequence = 0;
+	store->pendingLog = NULL;
+	store->writingLog = NULL;
+	store->writingSnapshot = NULL;
+	store->nbSnapshotRecords = 0;
+	store->snapshotWritten = false;
+	store->thread = NULL;
+	store->writing = 0;
+	store->nbFlushes = 0;
+	store->nbCompactions = 0;
+	load_snapshot(store);
+	load_log(store);
+	return store;
+}
+
+bool is_variable_persistent(PersistentStore *store, int variableSlot)
+{
+	return get_variable_store_value(store->variables, variableSlot) != NULL;
+}
+
+Variable *get_persistent_variable(PersistentStore *store, int variableSlot)
+{
+	return clone_variable(get_variable_store_value(store->variables, variableSlot));
+}
+
+static bool variables_match(Variable *a, Variable *b)
+{
+	if (a->type != b->type)
+	{
+		return false;
+	}
+	return a->type == VARIABLE_NUMERIC ? a->numeric == b->numeric : strmatch(a->string, b->string);
+}
+
+// the session keeps its own copy, so saves and rollbacks never bring back an older value
+void apply_persistent_variables(PersistentStore *store, VariableStore *variables)
+{
+	for (unsigned int i = 0; i < buf_len(store->slots); i++)
+	{
+		Variable *variable = get_variable_store_value(store->variables, store->slots[i]);
+		Variable *current = get_variable_store_value(variables, store->slots[i]);
+		if (!current || !variables_match(current, variable))
+		{
+			set_variable_store_value(variables, store->slots[i], clone_variable(variable));
+		}
+	}
+}
+
+// the log is only emptied once the snapshot replaced the previous one on disk, until then the records keep going in the log
+static void write_persistent_store(void *argument)
+{
+	PersistentStore *store = argument;
+	bool snapshotWritten = false;
+	if (store->writingSnapshot)
+	{
+		buf(char) temporaryPath = strmerge(store->snapshotPath, ".tmp");
+		if (write_file_durably(temporaryPath, store->writingSnapshot, buf_len(store->writingSnapshot)) && replace_file(temporaryPath, store->snapshotPath))
+		{
+			sync_directory(store->snapshotPath);
+			snapshotWritten = true;
+			// every record of the log is in the snapshot now
+			if (!write_file_durably(store->logPath, "", 0))
+			{
+				warning("could not empty %s.", store->logPath);
+			}
+		} else {
+			warning("could not write %s.", store->snapshotPath);
+		}
+		buf_free(temporaryPath);
+		buf_free(store->writingSnapshot);
+		store->writingSnapshot = NULL;
+	}
+	if (!snapshotWritten && buf_len(store->writingLog) != 0 && !append_file_durably(store->logPath, store->writingLog, buf_len(store->writingLog)))
+	{
+		warning("could not write %s.", store->logPath);
+	}
+	buf_clear(store->writingLog);
+	store->snapshotWritten = snapshotWritten;
+	__atomic_store_n(&store->writing, 0, __ATOMIC_RELEASE);
+}
+
+static buf(unsigned char) write_snapshot(PersistentStore *store)
+{
+	buf(unsigned char) data = NULL;
+	write_bytes(&data, PERSISTENT_MAGIC, sizeof (PERSISTENT_MAGIC));
+	write_int(&data, PERSISTENT_VERSION);
+	write_int(&data, 0);
+	write_int(&data, 0);
+	write_int(&data, store->sequence);
+	write_int(&data, buf_len(store->slots));
+	for (unsigned int i = 0; i < buf_len(store->slots); i++)
+	{
+		write_variable(&data, store->slots[i], get_variable_store_value(store->variables, store->slots[i]));
+	}
+	int payloadSize = buf_len(data) - PERSISTENT_HEADER_SIZE;
+	unsigned int checksum = get_checksum(data + PERSISTENT_HEADER_SIZE, payloadSize);
+	memcpy(data + 8, &payloadSize, sizeof (payloadSize));
+	memcpy(data + 12, &checksum, sizeof (checksum));
+	return data;
+}
+
+// the records a written snapshot holds leave the log, a failed one leaves them there
+static void join_persistent_writes(PersistentStore *store)
+{
+	join_thread(store->thread);
+	store->thread = NULL;
+	if (store->nbSnapshotRecords)
+	{
+		if (store->snapshotWritten)
+		{
+			store->nbLogRecords -= store->nbSnapshotRecords;
+			store->compactionThreshold = PERSISTENT_COMPACTION_PERIOD;
+			store->nbCompactions++;
+		} else {
+			store->compactionThreshold = store->nbLogRecords + PERSISTENT_COMPACTION_PERIOD;
+		}
+		store->nbSnapshotRecords = 0;
+	}
+}
+
+// joins the worker once it is done and hands it what was assigned since, never waits for it
+static void dispatch_persistent_writes(PersistentStore *store)
+{
+	if (store->thread && !__atomic_load_n(&store->writing, __ATOMIC_ACQUIRE))
+	{
+		join_persistent_writes(store);
+	}
+	if (store->thread)
+	{
+		return;
+	}
+	if (store->nbLogRecords >= store->compactionThreshold)
+	{
+		store->writingSnapshot = write_snapshot(store);
+		store->nbSnapshotRecords = store->nbLogRecords;
+	} else if (buf_len(store->pendingLog) != 0) {
+		store->nbFlushes++;
+	} else {
+		return;
+	}
+	// the pending records go along with a snapshot too, in case it cannot be written
+	buf(unsigned char) writingLog = store->writingLog;
+	store->writingLog = store->pendingLog;
+	store->pendingLog = writingLog;
+	store->writing = 1;
+	store->thread = create_thread(write_persistent_store, store);
+}
+
+void set_persistent_variable(PersistentStore *store, int variableSlot, Variable *variable)
+{
+	Variable *current = get_variable_store_value(store->variables, variableSlot);
+	if (current && variables_match(current, variable))
+	{
+		return;
+	}
+	store_variable(store, variableSlot, clone_variable(variable));
+
+	size_t recordStart = buf_len(store->pendingLog);
+	write_int(&store->pendingLog, 0);
+	write_int(&store->pendingLog, 0);
+	write_int(&store->pendingLog, ++store->sequence);
+	write_variable(&store->pendingLog, variableSlot, variable);
+	int payloadSize = buf_len(store->pendingLog) - recordStart - PERSISTENT_RECORD_HEADER_SIZE;
+	unsigned int checksum = get_checksum(store->pendingLog + recordStart + PERSISTENT_RECORD_HEADER_SIZE, payloadSize);
+	memcpy(store->pendingLog + recordStart, &payloadSize, sizeof (payloadSize));
+	memcpy(store->pendingLog + recordStart + 4, &checksum, sizeof (checksum));
+	store->nbLogRecords++;
+	dispatch_persistent_writes(store);
+}
+
+// called every frame by the interpreter, so assignments made while the worker was busy go in the next batch
+void update_persistent_store(PersistentStore *store)
+{
+	dispatch_persistent_writes(store);
+}
+
+// waits for every assignment made to be written
+void flush_persistent_store(PersistentStore *store)
+{
+	while (store->thread || buf_len(store->pendingLog) != 0 || store->nbLogRecords >= store->compactionThreshold)
+	{
+		if (store->thread)
+		{
+			join_persistent_writes(store);
+		}
+		dispatch_persistent_writes(store);
+	}
+}
+
+void free_persistent_store(PersistentStore *store)
+{
+	flush_persistent_store(store);
+	buf_free(store->snapshotPath);
+	buf_free(store->logPath);
+	free_variable_store(store->variables);
+	buf_free(store->slots);
+	buf_free(store->pendingLog);
+	buf_free(store->writingLog);
+	xfree(store);
+}
@@ -0,0 +1,47 @@
+#ifndef PERSISTENT_H
+#define PERSISTENT_H
+
+// the log is folded into the snapshot once it holds that many assignments
+#define PERSISTENT_COMPACTION_PERIOD 256
+
+// variables assigned with #assign_persistent, kept across playthroughs and launches
+// the values are loaded from a snapshot then the log of the assignments made since, both mapped
+// assignments are appended to the log in batches by a worker, which also rewrites the snapshot when the log grows too long
+typedef struct PersistentStore
+{
+	buf(char) snapshotPath;
+	buf(char) logPath;
+	VariableStore *variables;
+	// the slots set in variables
+	buf(int) slots;
+	// records appended to the log or pending since the last snapshot
+	int nbLogRecords;
+	// a failed snapshot is tried again only after that many more records
+	int compactionThreshold;
+	// of the last assignment, so a log left behind by a crash is not replayed over a newer snapshot
+	unsigned int sequence;
+	// records encoded while the worker is busy
+	buf(unsigned char) pendingLog;
+	// only touched by the worker while it runs, the log records go in the log unless the snapshot holding them was written
+	buf(unsigned char) writingLog;
+	buf(unsigned char) writingSnapshot;
+	// records the snapshot being written holds, and whether the worker wrote it, read once it is joined
+	int nbSnapshotRecords;
+	bool snapshotWritten;
+	struct Thread *thread;
+	// cleared by the worker once done, so the main thread joins it without waiting
+	int writing;
+	int nbFlushes;
+	int nbCompactions;
+} PersistentStore;
+
+PersistentStore *load_persistent_store(const char *snapshotPath);
+bool is_variable_persistent(PersistentStore *store, int variableSlot);
+Variable *get_persistent_variable(PersistentStore *store, int variableSlot);
+void set_persistent_variable(PersistentStore *store, int variableSlot, Variable *variable);
+void apply_persistent_variables(PersistentStore *store, VariableStore *variables);
+void update_persistent_store(PersistentStore *store);
+void flush_persistent_store(PersistentStore *store);
+void free_persistent_store(PersistentStore *store);
+
+#endif /* end of include guard: PERSISTENT_H */
@@ -0,0 +1,394 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "error.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "preload.h"
+#include "thread.h"
+
+// an asset loaded by the worker, handed over on the main thread
+typedef struct PreloadJob
+{
+	AssetType type;
+	buf(char) name;
+	buf(char) path;
+	buf(Animation *) pack;
+	buf(DeferredTexture) textures;
+	AudioSource *audioSource;
+	// an #unload ran while the worker was loading it
+	bool cancelled;
+	// cleared by the worker once done, so the main thread joins it without waiting
+	int loading;
+} PreloadJob;
+
+Preloader *create_preloader()
+{
+	Preloader *preloader = xmalloc(sizeof (*preloader));
+	preloader->queue = NULL;
+	preloader->job = NULL;
+	preloader->thread = NULL;
+	preloader->packsTypes = NULL;
+	preloader->packsNames = NULL;
+	preloader->packs = NULL;
+	preloader->audioSourcesPaths = NULL;
+	preloader->audioSources = NULL;
+	preloader->nbPreloads = 0;
+	preloader->nbPreloadsLate = 0;
+	preloader->nbUnloads = 0;
+	return preloader;
+}
+
+static void preload_worker(void *argument)
+{
+	PreloadJob *job = argument;
+	if (job->type == ASSET_BACKGROUND || job->type == ASSET_CHARACTER)
+	{
+		defer_textures(true);
+		job->pack = get_animations_from_file(job->path, job->name);
+		defer_textures(false);
+		job->textures = take_deferred_textures();
+	} else {
+		job->audioSource = create_audio_source(job->path);
+	}
+	__atomic_store_n(&job->loading, 0, __ATOMIC_RELEASE);
+}
+
+static void free_preload_job(PreloadJob *job)
+{
+	for (unsigned int i = 0; i < buf_len(job->textures); i++)
+	{
+		free_deferred_texture(&job->textures[i]);
+	}
+	buf_free(job->textures);
+	free_pack(job->pack);
+	if (job->audioSource)
+	{
+		stop_audio_source(job->audioSource);
+		xfree(job->audioSource);
+	}
+	buf_free(job->name);
+	buf_free(job->path);
+	xfree(job);
+}
+
+static int find_audio_source(Preloader *preloader, const char *path)
+{
+	for (unsigned int i = 0; i < buf_len(preloader->audioSourcesPaths); i++)
+	{
+		if (strmatch(preloader->audioSourcesPaths[i], path))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int find_pack(Preloader *preloader, AssetType type, const char *name)
+{
+	for (unsigned int i = 0; i < buf_len(preloader->packs); i++)
+	{
+		if (preloader->packsTypes[i] == type && strmatch(preloader->packsNames[i], name))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+// NULL if the pack was neither preloaded nor loaded by load_preloader_pack, or was unloaded since
+buf(Animation *) find_preloaded_pack(Preloader *preloader, AssetType type, const char *name)
+{
+	int index = find_pack(preloader, type, name);
+	return index == -1 ? NULL : preloader->packs[index];
+}
+
+const char *find_preloaded_pack_name(Preloader *preloader, AssetType type, buf(Animation *) pack)
+{
+	for (unsigned int i = 0; i < buf_len(preloader->packs); i++)
+	{
+		if (preloader->packsTypes[i] == type && preloader->packs[i] == pack)
+		{
+			return preloader->packsNames[i];
+		}
+	}
+	return NULL;
+}
+
+static void add_pack(Preloader *preloader, AssetType type, const char *name, buf(Animation *) pack)
+{
+	buf_add(preloader->packsTypes, type);
+	buf_add(preloader->packsNames, strclone(name));
+	buf_add(preloader->packs, pack);
+}
+
+// for a pack the dialog left out, shown before it was preloaded
+buf(Animation *) load_preloader_pack(Preloader *preloader, AssetType type, const char *name)
+{
+	buf(Animation *) pack = find_preloaded_pack(preloader, type, name);
+	if (!pack)
+	{
+		buf(char) path = get_asset_path(type, name);
+		pack = get_animations_from_file(path, name);
+		buf_free(path);
+		add_pack(preloader, type, name, pack);
+	}
+	return pack;
+}
+
+// a pack is kept only if the dialog still names it, did not load it along with it and it was not loaded in the meantime
+static void adopt_preload_job(Preloader *preloader, Dialog *dialog, PreloadJob *job)
+{
+	if (job->cancelled)
+	{
+		return;
+	}
+	if (job->type == ASSET_BACKGROUND || job->type == ASSET_CHARACTER)
+	{
+		int index = find_dialog_asset(dialog, job->type, job->name);
+		if (index == -1 || (job->type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations)[index] || find_pack(preloader, job->type, job->name) != -1)
+		{
+			return;
+		}
+		buf(unsigned int) texturesIds = NULL;
+		for (unsigned int i = 0; i < buf_len(job->textures); i++)
+		{
+			buf_add(texturesIds, upload_deferred_texture(&job->textures[i]));
+		}
+		patch_pack_textures(job->pack, texturesIds);
+		buf_free(texturesIds);
+		buf_free(job->textures);
+		job->textures = NULL;
+		add_pack(preloader, job->type, job->name, job->pack);
+		job->pack = NULL;
+	} else {
+		buf_add(preloader->audioSourcesPaths, job->path);
+		buf_add(preloader->audioSources, job->audioSource);
+		job->path = NULL;
+		job->audioSource = NULL;
+	}
+	preloader->nbPreloads++;
+}
+
+// waits for the worker if it is still loading
+static void finish_preload_job(Preloader *preloader, Dialog *dialog)
+{
+	join_thread(preloader->thread);
+	preloader->thread = NULL;
+	adopt_preload_job(preloader, dialog, preloader->job);
+	free_preload_job(preloader->job);
+	preloader->job = NULL;
+}
+
+static void remove_queued_job(Preloader *preloader, int index)
+{
+	free_preload_job(preloader->queue[index]);
+	for (unsigned int i = index + 1; i < buf_len(preloader->queue); i++)
+	{
+		preloader->queue[i - 1] = preloader->queue[i];
+	}
+	_buf_header(preloader->queue)->count--;
+}
+
+static bool is_asset_loaded(Preloader *preloader, Dialog *dialog, AssetType type, const char *name, const char *path)
+{
+	if (type == ASSET_BACKGROUND || type == ASSET_CHARACTER)
+	{
+		int index = find_dialog_asset(dialog, type, name);
+		return index == -1 || (type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations)[index] || find_pack(preloader, type, name) != -1;
+	}
+	return find_audio_source(preloader, path) != -1;
+}
+
+// the packs a new dialog does not name are left out
+static void start_next_preload_job(Preloader *preloader, Dialog *dialog)
+{
+	while (!preloader->job && buf_len(preloader->queue) != 0)
+	{
+		PreloadJob *job = preloader->queue[0];
+		if (is_asset_loaded(preloader, dialog, job->type, job->name, job->path))
+		{
+			remove_queued_job(preloader, 0);
+			continue;
+		}
+		for (unsigned int i = 1; i < buf_len(preloader->queue); i++)
+		{
+			preloader->queue[i - 1] = preloader->queue[i];
+		}
+		_buf_header(preloader->queue)->count--;
+		job->loading = 1;
+		preloader->job = job;
+		preloader->thread = create_thread(preload_worker, job);
+	}
+}
+
+static bool job_matches(PreloadJob *job, AssetType type, const char *name)
+{
+	return job->type == type && strmatch(job->name, name);
+}
+
+void preload_asset(Preloader *preloader, Dialog *dialog, AssetType type, const char *name)
+{
+	if (preloader->job && job_matches(preloader->job, type, name))
+	{
+		// preloaded again after an #unload
+		preloader->job->cancelled = false;
+		return;
+	}
+	buf(char) path = get_asset_path(type, name);
+	bool queued = false;
+	for (unsigned int i = 0; i < buf_len(preloader->queue); i++)
+	{
+		queued |= job_matches(preloader->queue[i], type, name);
+	}
+	if (queued || is_asset_loaded(preloader, dialog, type, name, path))
+	{
+		buf_free(path);
+		return;
+	}
+
+	PreloadJob *job = xmalloc(sizeof (*job));
+	job->type = type;
+	job->name = strclone(name);
+	job->path = path;
+	job->pack = NULL;
+	job->textures = NULL;
+	job->audioSource = NULL;
+	job->cancelled = false;
+	job->loading = 0;
+	buf_add(preloader->queue, job);
+	start_next_preload_job(preloader, dialog);
+}
+
+// before the asset is used, a job still loading it is waited for and one only queued is left to the caller
+void finish_preload(Preloader *preloader, Dialog *dialog, AssetType type, const char *name)
+{
+	if (preloader->job && job_matches(preloader->job, type, name))
+	{
+		if (__atomic_load_n(&preloader->job->loading, __ATOMIC_ACQUIRE))
+		{
+			preloader->nbPreloadsLate++;
+		}
+		finish_preload_job(preloader, dialog);
+		start_next_preload_job(preloader, dialog);
+	}
+	for (unsigned int i = 0; i < buf_len(preloader->queue); i++)
+	{
+		if (job_matches(preloader->queue[i], type, name))
+		{
+			preloader->nbPreloadsLate++;
+			remove_queued_job(preloader, i);
+			return;
+		}
+	}
+}
+
+// the caller owns the source taken
+AudioSource *take_preloaded_audio_source(Preloader *preloader, const char *path)
+{
+	int index = find_audio_source(preloader, path);
+	if (index == -1)
+	{
+		return NULL;
+	}
+	AudioSource *audioSource = preloader->audioSources[index];
+	buf_free(preloader->audioSourcesPaths[index]);
+	unsigned int last = buf_len(preloader->audioSources) - 1;
+	preloader->audioSourcesPaths[index] = preloader->audioSourcesPaths[last];
+	preloader->audioSources[index] = preloader->audioSources[last];
+	_buf_header(preloader->audioSourcesPaths)->count--;
+	_buf_header(preloader->audioSources)->count--;
+	return audioSource;
+}
+
+// the caller makes sure no sprite shows the pack, the packs loaded along with the dialog stay with it
+void unload_asset(Preloader *preloader, Dialog *dialog, AssetType type, const char *name)
+{
+	if (preloader->job && job_matches(preloader->job, type, name))
+	{
+		preloader->job->cancelled = true;
+	}
+	for (unsigned int i = 0; i < buf_len(preloader->queue); i++)
+	{
+		if (job_matches(preloader->queue[i], type, name))
+		{
+			remove_queued_job(preloader, i);
+			break;
+		}
+	}
+
+	if (type == ASSET_BACKGROUND || type == ASSET_CHARACTER)
+	{
+		int index = find_pack(preloader, type, name);
+		if (index != -1)
+		{
+			free_pack(preloader->packs[index]);
+			buf_free(preloader->packsNames[index]);
+			unsigned int last = buf_len(preloader->packs) - 1;
+			preloader->packsTypes[index] = preloader->packsTypes[last];
+			preloader->packsNames[index] = preloader->packsNames[last];
+			preloader->packs[index] = preloader->packs[last];
+			_buf_header(preloader->packsTypes)->count--;
+			_buf_header(preloader->packsNames)->count--;
+			_buf_header(preloader->packs)->count--;
+			preloader->nbUnloads++;
+		}
+	} else {
+		buf(char) path = get_asset_path(type, name);
+		AudioSource *audioSource = take_preloaded_audio_source(preloader, path);
+		if (audioSource)
+		{
+			stop_audio_source(audioSource);
+			xfree(audioSource);
+			preloader->nbUnloads++;
+		}
+		buf_free(path);
+	}
+}
+
+void update_preloader(Preloader *preloader, Dialog *dialog)
+{
+	if (preloader->job && !__atomic_load_n(&preloader->job->loading, __ATOMIC_ACQUIRE))
+	{
+		finish_preload_job(preloader, dialog);
+	}
+	start_next_preload_job(preloader, dialog);
+}
+
+void free_preloader(Preloader *preloader)
+{
+	if (preloader->job)
+	{
+		join_thread(preloader->thread);
+		free_preload_job(preloader->job);
+	}
+	for (unsigned int i = 0; i < buf_len(preloader->queue); i++)
+	{
+		free_preload_job(preloader->queue[i]);
+	}
+	buf_free(preloader->queue);
+	for (unsigned int i = 0; i < buf_len(preloader->packs); i++)
+	{
+		free_pack(preloader->packs[i]);
+		buf_free(preloader->packsNames[i]);
+	}
+	buf_free(preloader->packsTypes);
+	buf_free(preloader->packsNames);
+	buf_free(preloader->packs);
+	for (unsigned int i = 0; i < buf_len(preloader->audioSources); i++)
+	{
+		stop_audio_source(preloader->audioSources[i]);
+		xfree(preloader->audioSources[i]);
+		buf_free(preloader->audioSourcesPaths[i]);
+	}
+	buf_free(preloader->audioSources);
+	buf_free(preloader->audioSourcesPaths);
+	xfree(preloader);
+}
@@ -0,0 +1,37 @@
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+// the assets #preload asks for are loaded by a worker, one at a time, without stopping the dialog
+// the packs a dialog leaves out are kept here until unloaded, so the dialogs stay read only, musics and sounds are kept opened until played or unloaded
+typedef struct Preloader
+{
+	// the assets waiting for the worker, in the order they were asked for
+	buf(struct PreloadJob *) queue;
+	// the one the worker loads
+	struct PreloadJob *job;
+	struct Thread *thread;
+	// the packs loaded, by kind and name, whichever dialog asked for them
+	buf(AssetType) packsTypes;
+	buf(buf(char)) packsNames;
+	buf(buf(Animation *)) packs;
+	// the musics and sounds opened, by path
+	buf(buf(char)) audioSourcesPaths;
+	buf(AudioSource *) audioSources;
+	int nbPreloads;
+	// shown or played before the worker got to them, so loaded at once
+	int nbPreloadsLate;
+	int nbUnloads;
+} Preloader;
+
+Preloader *create_preloader();
+void preload_asset(Preloader *preloader, Dialog *dialog, AssetType type, const char *name);
+void finish_preload(Preloader *preloader, Dialog *dialog, AssetType type, const char *name);
+buf(Animation *) find_preloaded_pack(Preloader *preloader, AssetType type, const char *name);
+const char *find_preloaded_pack_name(Preloader *preloader, AssetType type, buf(Animation *) pack);
+buf(Animation *) load_preloader_pack(Preloader *preloader, AssetType type, const char *name);
+AudioSource *take_preloaded_audio_source(Preloader *preloader, const char *path);
+void unload_asset(Preloader *preloader, Dialog *dialog, AssetType type, const char *name);
+void update_preloader(Preloader *preloader, Dialog *dialog);
+void free_preloader(Preloader *preloader);
+
+#endif /* end of include guard: PRELOAD_H */
@@ -0,0 +1,239 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "audio.h"
+#include "maths.h"
+#include "user_input.h"
+#include "stretchy_buffer.h"
+#include "str.h"
+#include "error.h"
+#include "xalloc.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "bytecode.h"
+#include "interpret.h"
+#include "profile.h"
+
+static double get_clock()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	if (!frequency.QuadPart)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+	LARGE_INTEGER clock;
+	QueryPerformanceCounter(&clock);
+	return (double)clock.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec clock;
+	clock_gettime(CLOCK_MONOTONIC, &clock);
+	return clock.tv_sec + clock.tv_nsec * 1e-9;
+#endif
+}
+
+Profile *create_profile()
+{
+	Profile *profile = xmalloc(sizeof (*profile));
+	profile->dialogsNames = NULL;
+	profile->knotsNames = NULL;
+	profile->lines = NULL;
+	profile->dialog = NULL;
+	profile->dialogIndex = -1;
+	profile->instructionsLines = NULL;
+	profile->currentLine = -1;
+	profile->startTime = 0.0;
+	profile->startAllocations = 0;
+	return profile;
+}
+
+static int get_name_index(buf(buf(char)) *names, const char *name)
+{
+	for (unsigned int i = 0; i < buf_len(*names); i++)
+	{
+		if (strmatch((*names)[i], name))
+		{
+			return i;
+		}
+	}
+	buf_add(*names, strclone(name));
+	return buf_len(*names) - 1;
+}
+
+static void set_profile_dialog(Profile *profile, Session *session)
+{
+	profile->dialog = session->dialog;
+	profile->dialogIndex = get_name_index(&profile->dialogsNames, session->dialogName);
+	buf_clear(profile->instructionsLines);
+	for (unsigned int i = 0; i < buf_len(session->dialog->instructions); i++)
+	{
+		buf_add(profile->instructionsLines, -1);
+	}
+}
+
+static int get_profile_line(Profile *profile, Instruction *instruction)
+{
+	for (unsigned int i = 0; i < buf_len(profile->lines); i++)
+	{
+		if (profile->lines[i].dialog == profile->dialogIndex && profile->lines[i].line == instruction->line)
+		{
+			return i;
+		}
+	}
+	int knot = get_name_index(&profile->knotsNames, profile->dialog->knots[instruction->knot]->name);
+	buf_add(profile->lines, ((ProfileLine){profile->dialogIndex, instruction->line, knot, 0, 0.0, 0, 0}));
+	return buf_len(profile->lines) - 1;
+}
+
+// the instruction at the program counter is about to run
+void begin_profile_instruction(Profile *profile, Session *session)
+{
+	if (profile->dialog != session->dialog)
+	{
+		set_profile_dialog(profile, session);
+	}
+	int programCounter = session->state->programCounter;
+	Instruction *instruction = &session->dialog->instructions[programCounter];
+	if (instruction->knot == -1)
+	{
+		profile->currentLine = -1;
+		return;
+	}
+	if (profile->instructionsLines[programCounter] == -1)
+	{
+		profile->instructionsLines[programCounter] = get_profile_line(profile, instruction);
+	}
+	profile->currentLine = profile->instructionsLines[programCounter];
+	profile->startAllocations = get_allocations_count();
+	profile->startTime = get_clock();
+}
+
+void end_profile_instruction(Profile *profile)
+{
+	if (profile->currentLine == -1)
+	{
+		return;
+	}
+	ProfileLine *line = &profile->lines[profile->currentLine];
+	line->time += get_clock() - profile->startTime;
+	line->allocations += get_allocations_count() - profile->startAllocations;
+	line->nbUpdates++;
+	profile->currentLine = -1;
+}
+
+// called by the loaders, counted for the line running if any
+void count_profile_asset_load(Profile *profile)
+{
+	if (profile->currentLine != -1)
+	{
+		profile->lines[profile->currentLine].assetLoads++;
+	}
+}
+
+double get_profile_total_time(Profile *profile)
+{
+	double totalTime = 0.0;
+	for (unsigned int i = 0; i < buf_len(profile->lines); i++)
+	{
+		totalTime += profile->lines[i].time;
+	}
+	return totalTime;
+}
+
+static int compare_profile_lines(const void *a, const void *b)
+{
+	const ProfileLine *lineA = a;
+	const ProfileLine *lineB = b;
+	if (lineA->time != lineB->time)
+	{
+		return lineA->time < lineB->time ? 1 : -1;
+	}
+	if (lineA->dialog != lineB->dialog)
+	{
+		return lineA->dialog - lineB->dialog;
+	}
+	return lineA->line - lineB->line;
+}
+
+// lines from the most to the least time spent
+void write_profile_report(Profile *profile, const char *reportPath)
+{
+	FILE *file = fopen(reportPath, "w");
+	if (!file)
+	{
+		warning("could not open %s to write the profile report.", reportPath);
+		return;
+	}
+	unsigned int nbLines = buf_len(profile->lines);
+	ProfileLine *sortedLines = xmalloc(sizeof (*sortedLines) * (nbLines ? nbLines : 1));
+	for (unsigned int i = 0; i < nbLines; i++)
+	{
+		sortedLines[i] = profile->lines[i];
+	}
+	qsort(sortedLines, nbLines, sizeof (*sortedLines), compare_profile_lines);
+
+	double totalTime = get_profile_total_time(profile);
+	fprintf(file, "%u lines, %.3fms in total.\n", nbLines, totalTime * 1e3);
+	fprintf(file, "%12s %7s %8s %12s %6s  %s\n", "time (us)", "share", "updates", "allocations", "loads", "location");
+	for (unsigned int i = 0; i < nbLines; i++)
+	{
+		ProfileLine *line = &sortedLines[i];
+		fprintf(file, "%12.3f %6.2f%% %8u %12llu %6u  %s:%d (%s)\n", line->time * 1e6, totalTime > 0.0 ? line->time / totalTime * 100.0 : 0.0, line->nbUpdates, line->allocations, line->assetLoads, profile->dialogsNames[line->dialog], line->line, profile->knotsNames[line->knot]);
+	}
+	xfree(sortedLines);
+	if (fclose(file))
+	{
+		warning("could not write the profile report in %s.", reportPath);
+	}
+}
+
+// one "dialog;knot;line N microseconds" stack per line, the folded format flame graph tools read
+void write_profile_flame_graph(Profile *profile, const char *flameGraphPath)
+{
+	FILE *file = fopen(flameGraphPath, "w");
+	if (!file)
+	{
+		warning("could not open %s to write the profile flame graph.", flameGraphPath);
+		return;
+	}
+	for (unsigned int i = 0; i < buf_len(profile->lines); i++)
+	{
+		ProfileLine *line = &profile->lines[i];
+		unsigned long long microseconds = line->time * 1e6 + 0.5;
+		if (microseconds != 0)
+		{
+			fprintf(file, "%s;%s;line %d %llu\n", profile->dialogsNames[line->dialog], profile->knotsNames[line->knot], line->line, microseconds);
+		}
+	}
+	if (fclose(file))
+	{
+		warning("could not write the profile flame graph in %s.", flameGraphPath);
+	}
+}
+
+void free_profile(Profile *profile)
+{
+	for (unsigned int i = 0; i < buf_len(profile->dialogsNames); i++)
+	{
+		buf_free(profile->dialogsNames[i]);
+	}
+	buf_free(profile->dialogsNames);
+	for (unsigned int i = 0; i < buf_len(profile->knotsNames); i++)
+	{
+		buf_free(profile->knotsNames[i]);
+	}
+	buf_free(profile->knotsNames);
+	buf_free(profile->lines);
+	buf_free(profile->instructionsLines);
+	xfree(profile);
+}
@@ -0,0 +1,41 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// what the instructions of a source line cost over a session, a line updated over several frames is counted once per frame
+typedef struct ProfileLine
+{
+	int dialog;
+	int line;
+	int knot;
+	unsigned int nbUpdates;
+	double time;
+	unsigned long long allocations;
+	unsigned int assetLoads;
+} ProfileLine;
+
+// attributes the wall time, allocations and asset loads of the instructions a session runs to their source lines
+typedef struct Profile
+{
+	buf(buf(char)) dialogsNames;
+	buf(buf(char)) knotsNames;
+	buf(ProfileLine) lines;
+	// the dialog running and the profile line of each of its instructions, -1 until the instruction runs
+	const Dialog *dialog;
+	int dialogIndex;
+	buf(int) instructionsLines;
+	// line of the instruction running, -1 between instructions
+	int currentLine;
+	double startTime;
+	unsigned long long startAllocations;
+} Profile;
+
+Profile *create_profile();
+void begin_profile_instruction(Profile *profile, Session *session);
+void end_profile_instruction(Profile *profile);
+void count_profile_asset_load(Profile *profile);
+double get_profile_total_time(Profile *profile);
+void write_profile_report(Profile *profile, const char *reportPath);
+void write_profile_flame_graph(Profile *profile, const char *flameGraphPath);
+void free_profile(Profile *profile);
+
+#endif /* end of include guard: PROFILE_H */
@@ -0,0 +1,207 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "error.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "file.h"
+#include "binary.h"
+#include "read_status.h"
+
+static const char READ_STATUS_MAGIC[4] = {'V', 'N', 'I', 'R'};
+static const int READ_STATUS_VERSION = 2;
+
+static int find_dialog(ReadStatus *readStatus, const char *dialogName, bool add)
+{
+	if (readStatus->currentDialog != -1 && strmatch(readStatus->dialogsNames[readStatus->currentDialog], dialogName))
+	{
+		return readStatus->currentDialog;
+	}
+	for (unsigned int i = 0; i < buf_len(readStatus->dialogsNames); i++)
+	{
+		if (strmatch(readStatus->dialogsNames[i], dialogName))
+		{
+			readStatus->currentDialog = i;
+			return i;
+		}
+	}
+	if (!add)
+	{
+		return -1;
+	}
+	buf_add(readStatus->dialogsNames, strclone(dialogName));
+	buf_add(readStatus->readSentences, NULL);
+	readStatus->currentDialog = buf_len(readStatus->dialogsNames) - 1;
+	return readStatus->currentDialog;
+}
+
+// index of the first id not below stringId
+static int find_sentence(buf(unsigned long long) readSentences, unsigned long long stringId)
+{
+	int low = 0;
+	int high = buf_len(readSentences);
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+		if (readSentences[middle] < stringId)
+		{
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+ReadStatus *create_read_status()
+{
+	ReadStatus *readStatus = xmalloc(sizeof (*readStatus));
+	readStatus->dialogsNames = NULL;
+	readStatus->readSentences = NULL;
+	readStatus->currentDialog = -1;
+	readStatus->changed = false;
+	return readStatus;
+}
+
+// a missing file gives an empty read status, as on the first launch
+ReadStatus *load_read_status(const char *readStatusPath)
+{
+	size_t size;
+	const unsigned char *data = map_file(readStatusPath, &size);
+	if (!data)
+	{
+		return create_read_status();
+	}
+	BinaryReader reader = {data, size, 0, false};
+	char magic[4];
+	read_bytes(&reader, magic, sizeof (magic));
+	int version = read_int(&reader);
+	ReadStatus *readStatus = NULL;
+	if (!reader.failed && !memcmp(magic, READ_STATUS_MAGIC, sizeof (magic)) && version == READ_STATUS_VERSION)
+	{
+		readStatus = read_read_status(&reader);
+	} else {
+		readStatus = create_read_status();
+		reader.failed = true;
+	}
+	if (reader.failed)
+	{
+		warning("%s is corrupted, the sentences read are only partly restored.", readStatusPath);
+	}
+	unmap_file(data, size);
+	return readStatus;
+}
+
+void write_read_status(buf(unsigned char) *data, ReadStatus *readStatus)
+{
+	write_int(data, buf_len(readStatus->dialogsNames));
+	for (unsigned int i = 0; i < buf_len(readStatus->dialogsNames); i++)
+	{
+		write_string(data, readStatus->dialogsNames[i]);
+		write_int(data, buf_len(readStatus->readSentences[i]));
+		write_bytes(data, readStatus->readSentences[i], buf_len(readStatus->readSentences[i]) * sizeof (*readStatus->readSentences[i]));
+	}
+}
+
+// the dialogs before a damaged one are kept, the reader is then failed
+ReadStatus *read_read_status(BinaryReader *reader)
+{
+	ReadStatus *readStatus = create_read_status();
+	int nbDialogs = read_int(reader);
+	for (int i = 0; i < nbDialogs && !reader->failed; i++)
+	{
+		buf(char) name = read_string(reader);
+		int nbSentences = read_int(reader);
+		if (!name || nbSentences < 0 || (size_t)nbSentences > (reader->size - reader->position) / sizeof (unsigned long long))
+		{
+			reader->failed = true;
+			buf_free(name);
+			break;
+		}
+		buf(unsigned long long) readSentences = NULL;
+		for (int j = 0; j < nbSentences; j++)
+		{
+			unsigned long long stringId;
+			read_bytes(reader, &stringId, sizeof (stringId));
+			// the ids are kept sorted for the lookups
+			if (j != 0 && stringId <= readSentences[j - 1])
+			{
+				reader->failed = true;
+			}
+			buf_add(readSentences, stringId);
+		}
+		if (reader->failed)
+		{
+			buf_free(name);
+			buf_free(readSentences);
+			break;
+		}
+		buf_add(readStatus->dialogsNames, name);
+		buf_add(readStatus->readSentences, readSentences);
+	}
+	return readStatus;
+}
+
+bool is_sentence_read(ReadStatus *readStatus, const char *dialogName, unsigned long long stringId)
+{
+	int dialogIndex = find_dialog(readStatus, dialogName, false);
+	if (dialogIndex == -1)
+	{
+		return false;
+	}
+	buf(unsigned long long) readSentences = readStatus->readSentences[dialogIndex];
+	int index = find_sentence(readSentences, stringId);
+	return (unsigned int)index < buf_len(readSentences) && readSentences[index] == stringId;
+}
+
+void mark_sentence_read(ReadStatus *readStatus, const char *dialogName, unsigned long long stringId)
+{
+	int dialogIndex = find_dialog(readStatus, dialogName, true);
+	buf(unsigned long long) *readSentences = &readStatus->readSentences[dialogIndex];
+	int index = find_sentence(*readSentences, stringId);
+	if ((unsigned int)index < buf_len(*readSentences) && (*readSentences)[index] == stringId)
+	{
+		return;
+	}
+	buf_add(*readSentences, 0);
+	for (int i = buf_len(*readSentences) - 1; i > index; i--)
+	{
+		(*readSentences)[i] = (*readSentences)[i - 1];
+	}
+	(*readSentences)[index] = stringId;
+	readStatus->changed = true;
+}
+
+// the file is only replaced once the new one is on disk, so a crash keeps the previous sentences read
+bool save_read_status(ReadStatus *readStatus, const char *readStatusPath)
+{
+	buf(unsigned char) data = NULL;
+	write_bytes(&data, READ_STATUS_MAGIC, sizeof (READ_STATUS_MAGIC));
+	write_int(&data, READ_STATUS_VERSION);
+	write_read_status(&data, readStatus);
+	buf(char) temporaryPath = strmerge(readStatusPath, ".tmp");
+	bool saved = write_file_durably(temporaryPath, data, buf_len(data)) && replace_file(temporaryPath, readStatusPath);
+	if (saved)
+	{
+		readStatus->changed = false;
+	} else {
+		warning("could not save the sentences read in %s.", readStatusPath);
+	}
+	buf_free(temporaryPath);
+	buf_free(data);
+	return saved;
+}
+
+void free_read_status(ReadStatus *readStatus)
+{
+	for (unsigned int i = 0; i < buf_len(readStatus->dialogsNames); i++)
+	{
+		buf_free(readStatus->dialogsNames[i]);
+		buf_free(readStatus->readSentences[i]);
+	}
+	buf_free(readStatus->dialogsNames);
+	buf_free(readStatus->readSentences);
+	xfree(readStatus);
+}
@@ -0,0 +1,25 @@
+#ifndef READ_STATUS_H
+#define READ_STATUS_H
+
+// the string ids of the sentences of every dialog the player went past, sorted
+// a string id hashes the sentence as written, so a mark stays on its sentence when lines are added or moved around it
+typedef struct ReadStatus
+{
+	buf(buf(char)) dialogsNames;
+	buf(buf(unsigned long long)) readSentences;
+	// the last dialog looked up, as lines of a dialog are checked one after the other
+	int currentDialog;
+	// set when a sentence is marked, cleared once saved
+	bool changed;
+} ReadStatus;
+
+ReadStatus *create_read_status();
+ReadStatus *load_read_status(const char *readStatusPath);
+void write_read_status(buf(unsigned char) *data, ReadStatus *readStatus);
+ReadStatus *read_read_status(BinaryReader *reader);
+bool is_sentence_read(ReadStatus *readStatus, const char *dialogName, unsigned long long stringId);
+void mark_sentence_read(ReadStatus *readStatus, const char *dialogName, unsigned long long stringId);
+bool save_read_status(ReadStatus *readStatus, const char *readStatusPath);
+void free_read_status(ReadStatus *readStatus);
+
+#endif /* end of include guard: READ_STATUS_H */
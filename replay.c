@@ -0,0 +1,361 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "globals.h"
+#include "error.h"
+#include "user_input.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "str.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "interpret.h"
+#include "save.h"
+#include "history.h"
+#include "binary.h"
+#include "read_status.h"
+#include "replay.h"
+#include "localization.h"
+
+// a replay is the magic, the version, the dialog name, the language and the sentences read, then a record per frame
+// a frame record starts with a byte of the fields that follow, a hash record is a single byte of REPLAY_RECORD_HASH and the hash
+static const char REPLAY_MAGIC[4] = {'V', 'N', 'I', 'P'};
+static const int REPLAY_VERSION = 4;
+
+enum
+{
+	REPLAY_RECORD_DELTA_TIME = 1,
+	REPLAY_RECORD_KEYS = 2,
+	REPLAY_RECORD_SCROLL = 4,
+	REPLAY_RECORD_SKIPPING = 8,
+	REPLAY_RECORD_ACTION = 16,
+	REPLAY_RECORD_HASH = 128
+};
+
+static void flush_record(ReplayRecorder *recorder)
+{
+	fwrite(recorder->record, 1, buf_len(recorder->record), recorder->file);
+	buf_clear(recorder->record);
+}
+
+ReplayRecorder *create_replay_recorder(const char *replayPath, Session *session)
+{
+	FILE *file = fopen(replayPath, "wb");
+	if (!file)
+	{
+		warning("could not open %s to record the replay.", replayPath);
+		return NULL;
+	}
+	ReplayRecorder *recorder = xmalloc(sizeof (*recorder));
+	recorder->file = file;
+	recorder->replayPath = strclone(replayPath);
+	recorder->record = NULL;
+	recorder->nbFrames = 0;
+	recorder->deltaTime = 0.0f;
+
+	buf(unsigned char) *record = &recorder->record;
+	write_bytes(record, REPLAY_MAGIC, sizeof (REPLAY_MAGIC));
+	write_int(record, REPLAY_VERSION);
+	write_string(record, session->dialogName);
+	write_string(record, session->localization ? session->localization->language : "");
+	write_int(record, session->readStatus != NULL);
+	if (session->readStatus)
+	{
+		write_read_status(record, session->readStatus);
+	}
+	flush_record(recorder);
+	return recorder;
+}
+
+// called once the session received its inputs, right before update_session
+void record_replay_frame(ReplayRecorder *recorder, Session *session, ReplayAction action)
+{
+	unsigned char keys[INPUT_KEY_COUNT];
+	unsigned char nbKeys = 0;
+	for (int i = 0; i < INPUT_KEY_COUNT; i++)
+	{
+		if (session->inputKeysPressed[i])
+		{
+			keys[nbKeys++] = i;
+		}
+	}
+	unsigned char fields = 0;
+	fields |= session->deltaTime != recorder->deltaTime ? REPLAY_RECORD_DELTA_TIME : 0;
+	fields |= nbKeys != 0 ? REPLAY_RECORD_KEYS : 0;
+	fields |= session->mouseScrollOffset != 0 ? REPLAY_RECORD_SCROLL : 0;
+	fields |= session->skipping ? REPLAY_RECORD_SKIPPING : 0;
+	fields |= action != REPLAY_ACTION_NONE ? REPLAY_RECORD_ACTION : 0;
+
+	buf(unsigned char) *record = &recorder->record;
+	write_bytes(record, &fields, 1);
+	if (fields & REPLAY_RECORD_DELTA_TIME)
+	{
+		write_float(record, session->deltaTime);
+		recorder->deltaTime = session->deltaTime;
+	}
+	if (fields & REPLAY_RECORD_KEYS)
+	{
+		write_bytes(record, &nbKeys, 1);
+		write_bytes(record, keys, nbKeys);
+	}
+	if (fields & REPLAY_RECORD_SCROLL)
+	{
+		write_int(record, session->mouseScrollOffset);
+	}
+	if (fields & REPLAY_RECORD_ACTION)
+	{
+		unsigned char actionByte = action;
+		write_bytes(record, &actionByte, 1);
+		if (action == REPLAY_ACTION_LOAD)
+		{
+			buf(unsigned char) data = serialize_session(session);
+			write_int(record, buf_len(data));
+			write_bytes(record, data, buf_len(data));
+			buf_free(data);
+		} else if (action == REPLAY_ACTION_RESET_UI) {
+			write_int(record, windowDimensions.x);
+			write_int(record, windowDimensions.y);
+		} else if (action == REPLAY_ACTION_LANGUAGE) {
+			write_string(record, session->localization ? session->localization->language : "");
+		}
+	}
+	flush_record(recorder);
+	recorder->nbFrames++;
+}
+
+static void write_hash(ReplayRecorder *recorder, Session *session)
+{
+	unsigned char record = REPLAY_RECORD_HASH;
+	unsigned int hash = get_session_hash(session);
+	write_bytes(&recorder->record, &record, 1);
+	write_bytes(&recorder->record, &hash, sizeof (hash));
+	flush_record(recorder);
+	fflush(recorder->file);
+}
+
+// called right after update_session, the file is flushed with each hash so a crash loses little of the recording
+void record_replay_hash(ReplayRecorder *recorder, Session *session)
+{
+	if (recorder->nbFrames % REPLAY_HASH_PERIOD == 0 && session->state)
+	{
+		write_hash(recorder, session);
+	}
+}
+
+// the session as it ended is hashed too, before its dialog is freed
+void free_replay_recorder(ReplayRecorder *recorder, Session *session)
+{
+	if (recorder->nbFrames % REPLAY_HASH_PERIOD != 0 && session->state)
+	{
+		write_hash(recorder, session);
+	}
+	if (fclose(recorder->file))
+	{
+		warning("could not write the replay %s.", recorder->replayPath);
+	}
+	buf_free(recorder->replayPath);
+	buf_free(recorder->record);
+	xfree(recorder);
+}
+
+// appends the next bytes of the reader to the buffer, a negative size fails the reader
+static void read_block(BinaryReader *reader, buf(unsigned char) *data, int size)
+{
+	if (size < 0 || reader->failed || reader->size - reader->position < (size_t)size)
+	{
+		reader->failed = true;
+		return;
+	}
+	write_bytes(data, reader->data + reader->position, size);
+	reader->position += size;
+}
+
+// NULL if the file is missing or is not a replay
+Replay *load_replay(const char *replayPath)
+{
+	FILE *file = fopen(replayPath, "rb");
+	if (!file)
+	{
+		warning("could not open the replay %s.", replayPath);
+		return NULL;
+	}
+	Replay *replay = xmalloc(sizeof (*replay));
+	replay->data = NULL;
+	replay->dialogName = NULL;
+	replay->language = NULL;
+	replay->readStatus = NULL;
+	replay->frame.language = NULL;
+	replay->frame.sessionData = NULL;
+	replay->frame.deltaTime = 0.0f;
+	replay->nbFrames = 0;
+	replay->nbHashesChecked = 0;
+	replay->firstMismatchFrame = -1;
+	unsigned char chunk[4096];
+	size_t nbBytesRead;
+	while ((nbBytesRead = fread(chunk, 1, sizeof (chunk), file)) > 0)
+	{
+		write_bytes(&replay->data, chunk, nbBytesRead);
+	}
+	fclose(file);
+	replay->reader = (BinaryReader){replay->data, buf_len(replay->data), 0, false};
+
+	BinaryReader *reader = &replay->reader;
+	char magic[4];
+	read_bytes(reader, magic, sizeof (magic));
+	bool valid = !memcmp(magic, REPLAY_MAGIC, sizeof (magic)) && read_int(reader) == REPLAY_VERSION;
+	valid = valid && (replay->dialogName = read_string(reader)) && (replay->language = read_string(reader));
+	if (valid && read_int(reader))
+	{
+		replay->readStatus = read_read_status(reader);
+	}
+	valid = valid && !reader->failed;
+	if (valid && buf_len(replay->language) == 1)
+	{
+		buf_free(replay->language);
+		replay->language = NULL;
+	}
+	if (!valid)
+	{
+		warning("%s is not a replay of version %d.", replayPath, REPLAY_VERSION);
+		if (replay->readStatus)
+		{
+			free_read_status(replay->readStatus);
+		}
+		free_replay(replay);
+		return NULL;
+	}
+	return replay;
+}
+
+// false once the replay is over, a frame cut by the end of the file is dropped
+bool read_replay_frame(Replay *replay)
+{
+	ReplayFrame *frame = &replay->frame;
+	BinaryReader *reader = &replay->reader;
+	unsigned char fields;
+	read_bytes(reader, &fields, 1);
+	if (reader->failed)
+	{
+		return false;
+	}
+	if (fields & REPLAY_RECORD_DELTA_TIME)
+	{
+		frame->deltaTime = read_float(reader);
+	}
+	for (int i = 0; i < INPUT_KEY_COUNT; i++)
+	{
+		frame->inputKeysPressed[i] = false;
+	}
+	bool valid = !reader->failed;
+	if (valid && (fields & REPLAY_RECORD_KEYS))
+	{
+		unsigned char nbKeys;
+		read_bytes(reader, &nbKeys, 1);
+		valid = !reader->failed;
+		for (int i = 0; valid && i < nbKeys; i++)
+		{
+			unsigned char key;
+			read_bytes(reader, &key, 1);
+			valid = !reader->failed && key < INPUT_KEY_COUNT;
+			frame->inputKeysPressed[valid ? key : 0] = valid;
+		}
+	}
+	frame->mouseScrollOffset = 0;
+	if (valid && (fields & REPLAY_RECORD_SCROLL))
+	{
+		frame->mouseScrollOffset = read_int(reader);
+		valid = !reader->failed;
+	}
+	frame->skipping = fields & REPLAY_RECORD_SKIPPING;
+	frame->action = REPLAY_ACTION_NONE;
+	buf_free(frame->sessionData);
+	frame->sessionData = NULL;
+	if (valid && (fields & REPLAY_RECORD_ACTION))
+	{
+		unsigned char action;
+		read_bytes(reader, &action, 1);
+		valid = !reader->failed && action <= REPLAY_ACTION_LANGUAGE;
+		frame->action = valid ? action : REPLAY_ACTION_NONE;
+		if (valid && action == REPLAY_ACTION_LOAD)
+		{
+			read_block(reader, &frame->sessionData, read_int(reader));
+		} else if (valid && action == REPLAY_ACTION_RESET_UI) {
+			frame->windowDimensions.x = read_int(reader);
+			frame->windowDimensions.y = read_int(reader);
+		} else if (valid && action == REPLAY_ACTION_LANGUAGE) {
+			buf_free(frame->language);
+			valid = (frame->language = read_string(reader)) != NULL;
+		}
+		valid = valid && !reader->failed;
+	}
+	frame->hashed = false;
+	if (valid && reader->position < reader->size && reader->data[reader->position] == REPLAY_RECORD_HASH)
+	{
+		reader->position++;
+		read_bytes(reader, &frame->hash, sizeof (frame->hash));
+		frame->hashed = !reader->failed;
+	}
+	if (!valid)
+	{
+		return false;
+	}
+	replay->nbFrames++;
+	return true;
+}
+
+// does what the main loop did before updating the session, the owner of the session still switches dialogs
+void apply_replay_frame(Replay *replay, Session *session)
+{
+	ReplayFrame *frame = &replay->frame;
+	if (frame->action == REPLAY_ACTION_RELOAD)
+	{
+		strcopy(&session->nextDialogName, session->dialogName);
+	} else if (frame->action == REPLAY_ACTION_ROLLBACK && session->history) {
+		rollback_session(session->history, session);
+	} else if (frame->action == REPLAY_ACTION_LOAD) {
+		load_session_from_memory(session, frame->sessionData, buf_len(frame->sessionData), "the replay");
+	} else if (frame->action == REPLAY_ACTION_RESET_UI) {
+		windowDimensions = frame->windowDimensions;
+		reset_session_ui(session);
+	} else if (frame->action == REPLAY_ACTION_LANGUAGE) {
+		set_session_language(session, buf_len(frame->language) > 1 ? frame->language : NULL);
+	}
+	session->deltaTime = frame->deltaTime;
+	for (int i = 0; i < INPUT_KEY_COUNT; i++)
+	{
+		session->inputKeysPressed[i] = frame->inputKeysPressed[i];
+	}
+	session->mouseScrollOffset = frame->mouseScrollOffset;
+	session->skipping = frame->skipping;
+}
+
+// called right after update_session, the first frame the session differs from the recording is kept
+void check_replay_hash(Replay *replay, Session *session)
+{
+	if (!replay->frame.hashed)
+	{
+		return;
+	}
+	replay->nbHashesChecked++;
+	if (replay->firstMismatchFrame == -1 && get_session_hash(session) != replay->frame.hash)
+	{
+		replay->firstMismatchFrame = replay->nbFrames - 1;
+	}
+}
+
+// the read status is left to whoever took it
+void free_replay(Replay *replay)
+{
+	buf_free(replay->data);
+	buf_free(replay->dialogName);
+	buf_free(replay->language);
+	buf_free(replay->frame.language);
+	buf_free(replay->frame.sessionData);
+	xfree(replay);
+}
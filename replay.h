@@ -0,0 +1,73 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#define REPLAY_HASH_PERIOD 60
+
+// what the main loop did to the session before updating it, besides its inputs
+typedef enum ReplayAction
+{
+	REPLAY_ACTION_NONE,
+	REPLAY_ACTION_RELOAD,
+	REPLAY_ACTION_ROLLBACK,
+	// a save was loaded, the session is stored as loaded since the save file may be gone
+	REPLAY_ACTION_LOAD,
+	// the window changed, its dimensions are stored
+	REPLAY_ACTION_RESET_UI,
+	// the language changed, its name is stored
+	REPLAY_ACTION_LANGUAGE
+} ReplayAction;
+
+// writes what a session receives every frame, and a hash of the session every REPLAY_HASH_PERIOD frames
+typedef struct ReplayRecorder
+{
+	FILE *file;
+	buf(char) replayPath;
+	// the record being written, kept to reuse its memory
+	buf(unsigned char) record;
+	int nbFrames;
+	float deltaTime;
+} ReplayRecorder;
+
+ReplayRecorder *create_replay_recorder(const char *replayPath, Session *session);
+void record_replay_frame(ReplayRecorder *recorder, Session *session, ReplayAction action);
+void record_replay_hash(ReplayRecorder *recorder, Session *session);
+void free_replay_recorder(ReplayRecorder *recorder, Session *session);
+
+// one frame of a replay, the hash is the one of the session after the frame
+typedef struct ReplayFrame
+{
+	float deltaTime;
+	bool inputKeysPressed[INPUT_KEY_COUNT];
+	int mouseScrollOffset;
+	bool skipping;
+	ReplayAction action;
+	ivec2 windowDimensions;
+	// NULL for the text of the scripts
+	buf(char) language;
+	buf(unsigned char) sessionData;
+	bool hashed;
+	unsigned int hash;
+} ReplayFrame;
+
+typedef struct Replay
+{
+	buf(unsigned char) data;
+	BinaryReader reader;
+	buf(char) dialogName;
+	// the language when the recording started, NULL for the text of the scripts
+	buf(char) language;
+	// the sentences read when the recording started, NULL if the session had no read status
+	ReadStatus *readStatus;
+	ReplayFrame frame;
+	int nbFrames;
+	int nbHashesChecked;
+	int firstMismatchFrame;
+} Replay;
+
+Replay *load_replay(const char *replayPath);
+bool read_replay_frame(Replay *replay);
+void check_replay_hash(Replay *replay, Session *session);
+void apply_replay_frame(Replay *replay, Session *session);
+void free_replay(Replay *replay);
+
+#endif /* end of include guard: REPLAY_H */
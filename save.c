@@ -0,0 +1,773 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "error.h"
+#include "user_input.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "file.h"
+#include "str.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "bytecode.h"
+#include "interpret.h"
+#include "globals_dialog.h"
+#include "thread.h"
+#include "persistent.h"
+#include "tween.h"
+#include "backlog.h"
+#include "binary.h"
+#include "preload.h"
+#include "save.h"
+
+// a save is the magic, the version, the size and checksum of the payload, then the payload
+// pointers are saved as indices in the dialog, packs and variables by name, as a sprite may show the pack of a dialog left and slots depend on the order dialogs were parsed
+static const char SAVE_MAGIC[4] = {'V', 'N', 'I', 'S'};
+static const unsigned int SAVE_VERSION = 5;
+static const size_t SAVE_HEADER_SIZE = 16;
+
+typedef struct SaveWriting
+{
+	buf(unsigned char) data;
+	buf(char) savePath;
+} SaveWriting;
+
+static Thread *saveThread = NULL;
+
+// an index read from a save is checked against the dialog before being used
+static int read_index(BinaryReader *reader, int count)
+{
+	int index = read_int(reader);
+	if (index < -1 || index >= count)
+	{
+		reader->failed = true;
+		return -1;
+	}
+	return index;
+}
+
+static const char *find_pack_name(Dialog *dialog, AssetType type, buf(Animation *) pack)
+{
+	buf(buf(Animation *)) packs = type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations;
+	for (unsigned int i = 0; i < buf_len(packs); i++)
+	{
+		if (packs[i] == pack)
+		{
+			return (type == ASSET_BACKGROUND ? dialog->backgroundPacksNames : dialog->charactersNames)[i];
+		}
+	}
+	return NULL;
+}
+
+// NULL if the dialog does not have it loaded, the pack is the same whichever dialog loaded it
+static buf(Animation *) find_loaded_pack(Dialog *dialog, AssetType type, const char *name)
+{
+	int index = find_dialog_asset(dialog, type, name);
+	return index == -1 ? NULL : (type == ASSET_BACKGROUND ? dialog->backgroundPacks : dialog->charactersAnimations)[index];
+}
+
+static void write_sprite(buf(unsigned char) *data, Session *session, Sprite *sprite, AssetType type)
+{
+	const char *packName = sprite->animations ? find_pack_name(session->dialog, type, sprite->animations) : NULL;
+	for (unsigned int i = 0; sprite->animations && !packName && i < buf_len(session->leftDialogs); i++)
+	{
+		packName = find_pack_name(session->leftDialogs[i], type, sprite->animations);
+	}
+	if (sprite->animations && !packName && session->preloader)
+	{
+		packName = find_preloaded_pack_name(session->preloader, type, sprite->animations);
+	}
+	write_string(data, packName);
+	write_int(data, sprite->currentAnimation);
+	write_int(data, sprite->animationCursor.currentAnimationPhase);
+	write_double(data, sprite->animationCursor.timeDuringCurrentAnimationPhase);
+	write_int(data, sprite->animationCursor.animationState);
+	write_float(data, sprite->opacity);
+	write_int(data, sprite->position.x);
+	write_int(data, sprite->position.y);
+}
+
+// a pack unloaded since is loaded again
+// one the dialog does not name was carried from a dialog left, it is taken from a dialog the session still has opened and hidden if none has it
+static void read_sprite(BinaryReader *reader, Session *session, Sprite *sprite, Dialog *dialog, AssetType type)
+{
+	buf(char) packName = read_string(reader);
+	int index = packName ? find_dialog_asset(dialog, type, packName) : -1;
+	sprite->animations = NULL;
+	if (index != -1)
+	{
+		sprite->animations = get_session_pack(session, dialog, type, index);
+	} else if (packName) {
+		sprite->animations = find_loaded_pack(session->dialog, type, packName);
+		for (unsigned int i = 0; !sprite->animations && i < buf_len(session->leftDialogs); i++)
+		{
+			sprite->animations = find_loaded_pack(session->leftDialogs[i], type, packName);
+		}
+		if (!sprite->animations && session->preloader)
+		{
+			sprite->animations = find_preloaded_pack(session->preloader, type, packName);
+		}
+	}
+	buf_free(packName);
+	sprite->currentAnimation = read_int(reader);
+	sprite->animationCursor.currentAnimationPhase = read_int(reader);
+	sprite->animationCursor.timeDuringCurrentAnimationPhase = read_double(reader);
+	sprite->animationCursor.animationState = read_int(reader);
+	sprite->opacity = read_float(reader);
+	sprite->position.x = read_int(reader);
+	sprite->position.y = read_int(reader);
+	if (sprite->animations && (sprite->currentAnimation < 0 || sprite->currentAnimation >= (int)buf_len(sprite->animations) || sprite->animationCursor.currentAnimationPhase < -1 || sprite->animationCursor.currentAnimationPhase >= (int)buf_len(sprite->animations[sprite->currentAnimation]->animationPhases)))
+	{
+		reader->failed = true;
+	}
+	if (reader->failed)
+	{
+		sprite->animations = NULL;
+	}
+}
+
+// the audio thread stops the sources that reached their end, so hashes leave that out
+static void write_audio_source(buf(unsigned char) *data, AudioSource *audioSource, const char *name, bool hashing)
+{
+	write_string(data, audioSource ? name : NULL);
+	if (audioSource)
+	{
+		write_float(data, audioSource->volume);
+		write_int(data, hashing || audioSource->playing);
+	}
+}
+
+// opened only once the whole save is read and valid
+typedef struct SavedAudioSource
+{
+	buf(char) name;
+	float volume;
+	bool playing;
+} SavedAudioSource;
+
+// a save read and checked against its dialog, the session is left untouched until it is applied
+typedef struct SaveContents
+{
+	ExecutionState *state;
+	int nbCharToDisplay;
+	int nbBacklogLines;
+	// the old background, the background, then the old character and the character of each position
+	Sprite sprites[2 + 2 * 7];
+	SavedAudioSource music;
+	SavedAudioSource sound;
+	VariableStore *variables;
+	// the variables of a history point, restored rather than read
+	VariableStore *variablesSnapshot;
+} SaveContents;
+
+static void read_audio_source(BinaryReader *reader, SavedAudioSource *audioSource, const char *directory, buf(buf(char)) names)
+{
+	audioSource->name = read_string(reader);
+	if (!audioSource->name)
+	{
+		return;
+	}
+	audioSource->volume = read_float(reader);
+	audioSource->playing = read_int(reader);
+	bool known = false;
+	for (unsigned int i = 0; i < buf_len(names); i++)
+	{
+		known |= strmatch(names[i], audioSource->name);
+	}
+	buf(char) path = strmerge(directory, audioSource->name);
+	// a music still playing from a dialog left is not named by the dialog
+	if (!known && !check_file(path))
+	{
+		reader->failed = true;
+	}
+	buf_free(path);
+}
+
+static AudioSource *open_saved_audio_source(SavedAudioSource *savedAudioSource, buf(char) *name, const char *directory)
+{
+	buf_free(*name);
+	*name = savedAudioSource->name;
+	savedAudioSource->name = NULL;
+	if (!*name)
+	{
+		return NULL;
+	}
+	buf(char) path = strmerge(directory, *name);
+	AudioSource *audioSource = create_audio_source(path);
+	buf_free(path);
+	audioSource->volume = savedAudioSource->volume;
+	audioSource->playing = savedAudioSource->playing;
+	return audioSource;
+}
+
+static void stop_session_audio_source(AudioSource **audioSource)
+{
+	if (*audioSource)
+	{
+		stop_audio_source(*audioSource);
+		xfree(*audioSource);
+		*audioSource = NULL;
+	}
+}
+
+// everything but the variables
+static buf(unsigned char) write_session_state(Session *session, bool hashing)
+{
+	Dialog *dialog = session->dialog;
+	ExecutionState *state = session->state;
+	buf(unsigned char) data = NULL;
+	write_bytes(&data, SAVE_MAGIC, sizeof (SAVE_MAGIC));
+	write_int(&data, SAVE_VERSION);
+	write_int(&data, 0);
+	write_int(&data, 0);
+
+	write_string(&data, session->dialogName);
+	// a dialog edited since the save would not match the saved indices
+	write_int(&data, buf_len(dialog->instructions));
+
+	write_int(&data, state->programCounter);
+	int cueInstruction = -1;
+	for (unsigned int i = 0; state->currentCue && i < buf_len(dialog->instructions); i++)
+	{
+		if (dialog->instructions[i].type == INSTRUCTION_SPEAKER && dialog->instructions[i].cue == state->currentCue)
+		{
+			cueInstruction = i;
+			break;
+		}
+	}
+	write_int(&data, cueInstruction);
+	write_int(&data, state->end);
+	for (int i = 0; i < 7; i++)
+	{
+		int characterIndex = -1;
+		for (unsigned int j = 0; state->charactersNames[i] && j < buf_len(dialog->charactersNames); j++)
+		{
+			if (dialog->charactersNames[j] == state->charactersNames[i])
+			{
+				characterIndex = j;
+				break;
+			}
+		}
+		write_int(&data, characterIndex);
+	}
+	write_int(&data, buf_len(state->coloredNames));
+	for (unsigned int i = 0; i < buf_len(state->coloredNames); i++)
+	{
+		write_string(&data, state->coloredNames[i]);
+		write_float(&data, state->namesColors[i].x);
+		write_float(&data, state->namesColors[i].y);
+		write_float(&data, state->namesColors[i].z);
+	}
+	write_int(&data, state->currentSpeakerSpriteIndex);
+	write_int(&data, state->characterNamePosition);
+	write_int(&data, buf_len(state->choicesInstructions));
+	for (unsigned int i = 0; i < buf_len(state->choicesInstructions); i++)
+	{
+		write_int(&data, state->choicesInstructions[i] - dialog->instructions);
+	}
+	write_int(&data, state->currentChoice);
+	write_int(&data, buf_len(state->tweens));
+	for (unsigned int i = 0; i < buf_len(state->tweens); i++)
+	{
+		Tween *tween = &state->tweens[i];
+		write_int(&data, tween->target);
+		write_int(&data, tween->index);
+		write_int(&data, tween->property);
+		write_int(&data, tween->easing);
+		write_int(&data, tween->end);
+		write_float(&data, tween->from);
+		write_float(&data, tween->to);
+		write_float(&data, tween->duration);
+		write_float(&data, tween->time);
+		write_int(&data, tween->owner);
+	}
+	write_int(&data, state->awaitingCommand);
+	write_int(&data, state->displayDialogUI);
+	write_int(&data, state->displaySpeakerName);
+	write_int(&data, state->sentenceFirstUpdate);
+	write_float(&data, state->revealTime);
+	write_float(&data, state->waitTimer);
+	write_int(&data, state->textScrollOffset);
+	write_int(&data, session->currentSentence->nbCharToDisplay);
+	// the lines logged after this point are dropped when it is loaded, so they are not logged twice once run again
+	write_int(&data, session->backlog ? (int)buf_len(session->backlog->lines) : 0);
+
+	write_sprite(&data, session, session->oldBackgroundSprite, ASSET_BACKGROUND);
+	write_sprite(&data, session, session->backgroundSprite, ASSET_BACKGROUND);
+	for (int i = 0; i < 7; i++)
+	{
+		write_sprite(&data, session, session->oldCharactersSprites[i], ASSET_CHARACTER);
+		write_sprite(&data, session, session->charactersSprites[i], ASSET_CHARACTER);
+	}
+	write_audio_source(&data, session->music, session->musicName, hashing);
+	write_audio_source(&data, session->sound, session->soundName, hashing);
+	return data;
+}
+
+static void write_variables(buf(unsigned char) *data, VariableStore *variables, char **names, int nbNames)
+{
+	int nbVariables = 0;
+	for (int i = 0; i < nbNames; i++)
+	{
+		nbVariables += get_variable_store_value(variables, i) != NULL;
+	}
+	write_int(data, nbVariables);
+	for (int i = 0; i < nbNames; i++)
+	{
+		Variable *variable = get_variable_store_value(variables, i);
+		if (variable)
+		{
+			write_string(data, names[i]);
+			write_int(data, variable->type);
+			if (variable->type == VARIABLE_NUMERIC)
+			{
+				write_double(data, variable->numeric);
+			} else {
+				write_string(data, variable->string);
+			}
+		}
+	}
+}
+
+static void write_payload_header(buf(unsigned char) data)
+{
+	int payloadSize = buf_len(data) - SAVE_HEADER_SIZE;
+	unsigned int checksum = get_checksum(data + SAVE_HEADER_SIZE, payloadSize);
+	memcpy(data + 8, &payloadSize, sizeof (payloadSize));
+	memcpy(data + 12, &checksum, sizeof (checksum));
+}
+
+static buf(unsigned char) write_session(Session *session, bool hashing)
+{
+	buf(unsigned char) data = write_session_state(session, hashing);
+	write_variables(&data, session->variables, variablesNames, buf_len(variablesNames));
+	write_payload_header(data);
+	return data;
+}
+
+buf(unsigned char) serialize_session(Session *session)
+{
+	return write_session(session, false);
+}
+
+// the state is written right away and the variables shared until they change, so the costly part can run on another thread
+struct SessionSnapshot
+{
+	buf(unsigned char) data;
+	VariableStore *variables;
+	// the names list grows when dialogs are parsed, the names themselves stay
+	char **variablesNames;
+	int nbVariablesNames;
+};
+
+SessionSnapshot *snapshot_session(Session *session)
+{
+	SessionSnapshot *snapshot = xmalloc(sizeof (*snapshot));
+	snapshot->data = write_session_state(session, false);
+	snapshot->variables = snapshot_variable_store(session->variables);
+	snapshot->nbVariablesNames = buf_len(variablesNames);
+	snapshot->variablesNames = xmalloc(sizeof (*snapshot->variablesNames) * (snapshot->nbVariablesNames + 1));
+	memcpy(snapshot->variablesNames, variablesNames, sizeof (*snapshot->variablesNames) * snapshot->nbVariablesNames);
+	return snapshot;
+}
+
+// gives the same data serialize_session did when the snapshot was taken, and frees the snapshot
+buf(unsigned char) serialize_session_snapshot(SessionSnapshot *snapshot)
+{
+	buf(unsigned char) data = snapshot->data;
+	write_variables(&data, snapshot->variables, snapshot->variablesNames, snapshot->nbVariablesNames);
+	write_payload_header(data);
+	snapshot->data = NULL;
+	free_session_snapshot(snapshot);
+	return data;
+}
+
+void free_session_snapshot(SessionSnapshot *snapshot)
+{
+	buf_free(snapshot->data);
+	free_variable_store(snapshot->variables);
+	xfree(snapshot->variablesNames);
+	xfree(snapshot);
+}
+
+static void get_session_sprites(Session *session, Sprite **sprites)
+{
+	sprites[0] = session->oldBackgroundSprite;
+	sprites[1] = session->backgroundSprite;
+	for (int i = 0; i < 7; i++)
+	{
+		sprites[2 + 2 * i] = session->oldCharactersSprites[i];
+		sprites[3 + 2 * i] = session->charactersSprites[i];
+	}
+}
+
+static void free_save_contents(SaveContents *contents)
+{
+	if (contents->state)
+	{
+		free_execution_state(contents->state);
+	}
+	buf_free(contents->music.name);
+	buf_free(contents->sound.name);
+	if (contents->variables)
+	{
+		free_variable_store(contents->variables);
+	}
+}
+
+// the sprites start as copies of the session ones, for what a save does not keep, and the variables are read only without a snapshot of them
+// false if the save does not match the dialog or is corrupted, the preloader may have loaded packs but nothing else changed
+static bool read_save(SaveContents *contents, Session *session, Dialog *dialog, const char *dialogName, const unsigned char *data, size_t size, VariableStore *variablesSnapshot)
+{
+	BinaryReader reader = {data, size, SAVE_HEADER_SIZE, false};
+
+	buf(char) savedDialogName = read_string(&reader);
+	bool sameDialog = savedDialogName && strmatch(savedDialogName, dialogName);
+	buf_free(savedDialogName);
+	if (!sameDialog || read_int(&reader) != (int)buf_len(dialog->instructions))
+	{
+		warning("the save does not match %s, it was probably edited since.", dialogName);
+		return false;
+	}
+
+	contents->state = create_execution_state(dialog);
+	contents->music.name = NULL;
+	contents->sound.name = NULL;
+	contents->variables = variablesSnapshot ? NULL : create_variable_store();
+	contents->variablesSnapshot = variablesSnapshot;
+	ExecutionState *state = contents->state;
+	int nbInstructions = buf_len(dialog->instructions);
+
+	state->programCounter = read_index(&reader, nbInstructions);
+	int cueInstruction = read_index(&reader, nbInstructions);
+	if (cueInstruction != -1 && dialog->instructions[cueInstruction].type == INSTRUCTION_SPEAKER)
+	{
+		state->currentCue = dialog->instructions[cueInstruction].cue;
+	}
+	state->end = read_int(&reader);
+	for (int i = 0; i < 7; i++)
+	{
+		int characterIndex = read_index(&reader, buf_len(dialog->charactersNames));
+		state->charactersNames[i] = characterIndex == -1 ? NULL : dialog->charactersNames[characterIndex];
+	}
+	int nbColoredNames = read_int(&reader);
+	for (int i = 0; i < nbColoredNames && !reader.failed; i++)
+	{
+		buf(char) coloredName = read_string(&reader);
+		vec3 nameColor;
+		nameColor.x = read_float(&reader);
+		nameColor.y = read_float(&reader);
+		nameColor.z = read_float(&reader);
+		if (coloredName)
+		{
+			buf_add(state->coloredNames, coloredName);
+			buf_add(state->namesColors, nameColor);
+		}
+	}
+	state->currentSpeakerSpriteIndex = read_index(&reader, 7);
+	state->characterNamePosition = read_int(&reader);
+	int nbChoices = read_int(&reader);
+	for (int i = 0; i < nbChoices && !reader.failed; i++)
+	{
+		int choiceInstruction = read_index(&reader, nbInstructions);
+		if (choiceInstruction == -1 || dialog->instructions[choiceInstruction].type != INSTRUCTION_CHOICE)
+		{
+			reader.failed = true;
+			break;
+		}
+		buf_add(state->choicesInstructions, &dialog->instructions[choiceInstruction]);
+	}
+	state->currentChoice = read_int(&reader);
+	int nbTweens = read_int(&reader);
+	for (int i = 0; i < nbTweens && !reader.failed; i++)
+	{
+		Tween tween;
+		tween.target = read_index(&reader, TWEEN_TARGET_OLD_SOUND + 1);
+		tween.index = read_index(&reader, 7);
+		tween.property = read_index(&reader, TWEEN_PROPERTY_POSITION_X + 1);
+		tween.easing = read_index(&reader, EASING_IN_OUT + 1);
+		tween.end = read_index(&reader, TWEEN_END_STOP + 1);
+		tween.from = read_float(&reader);
+		tween.to = read_float(&reader);
+		tween.duration = read_float(&reader);
+		tween.time = read_float(&reader);
+		tween.owner = read_int(&reader);
+		if ((int)tween.target == -1 || tween.index == -1 || (int)tween.property == -1 || (int)tween.easing == -1 || (int)tween.end == -1)
+		{
+			reader.failed = true;
+			break;
+		}
+		buf_add(state->tweens, tween);
+	}
+	state->awaitingCommand = read_int(&reader);
+	state->displayDialogUI = read_int(&reader);
+	state->displaySpeakerName = read_int(&reader);
+	state->sentenceFirstUpdate = read_int(&reader);
+	state->revealTime = read_float(&reader);
+	state->waitTimer = read_float(&reader);
+	state->textScrollOffset = read_int(&reader);
+	contents->nbCharToDisplay = read_int(&reader);
+	contents->nbBacklogLines = read_int(&reader);
+
+	Sprite *sessionSprites[2 + 2 * 7];
+	get_session_sprites(session, sessionSprites);
+	for (int i = 0; i < 2 + 2 * 7; i++)
+	{
+		contents->sprites[i] = *sessionSprites[i];
+		read_sprite(&reader, session, &contents->sprites[i], dialog, i < 2 ? ASSET_BACKGROUND : ASSET_CHARACTER);
+	}
+
+	read_audio_source(&reader, &contents->music, "Musics/", dialog->musicsNames);
+	read_audio_source(&reader, &contents->sound, "Sounds/", dialog->soundsNames);
+
+	int nbVariables = variablesSnapshot ? 0 : read_int(&reader);
+	for (int i = 0; i < nbVariables && !reader.failed; i++)
+	{
+		buf(char) variableName = read_string(&reader);
+		Variable *variable = xmalloc(sizeof (*variable));
+		variable->type = read_int(&reader);
+		variable->string = NULL;
+		variable->numeric = 0.0;
+		if (variable->type == VARIABLE_NUMERIC)
+		{
+			variable->numeric = read_double(&reader);
+		} else {
+			variable->string = read_string(&reader);
+		}
+		if (!variableName || reader.failed || (variable->type == VARIABLE_STRING && !variable->string))
+		{
+			reader.failed = true;
+			free_variable(variable);
+		} else {
+			set_variable_store_value(contents->variables, get_variable_slot(variableName), variable);
+		}
+		buf_free(variableName);
+	}
+
+	if (reader.failed || reader.position != size)
+	{
+		warning("the save of %s is corrupted.", dialogName);
+		free_save_contents(contents);
+		return false;
+	}
+	return true;
+}
+
+// the session runs the dialog the contents were read against
+static void apply_save(Session *session, SaveContents *contents)
+{
+	if (session->state)
+	{
+		free_execution_state(session->state);
+	}
+	session->state = contents->state;
+	contents->state = NULL;
+	session->dialogChanged = false;
+	buf_free(session->nextDialogName);
+	session->nextDialogName = NULL;
+	buf_free(session->nextDialogStartKnotName);
+	session->nextDialogStartKnotName = NULL;
+
+	Sprite *sessionSprites[2 + 2 * 7];
+	get_session_sprites(session, sessionSprites);
+	for (int i = 0; i < 2 + 2 * 7; i++)
+	{
+		*sessionSprites[i] = contents->sprites[i];
+	}
+
+	// the old sources fading out are not saved, their tweens are dropped on the next update
+	stop_session_audio_source(&session->oldMusic);
+	stop_session_audio_source(&session->music);
+	stop_session_audio_source(&session->oldSound);
+	stop_session_audio_source(&session->sound);
+	session->music = open_saved_audio_source(&contents->music, &session->musicName, "Musics/");
+	session->sound = open_saved_audio_source(&contents->sound, &session->soundName, "Sounds/");
+
+	if (contents->variablesSnapshot)
+	{
+		restore_variable_store(session->variables, contents->variablesSnapshot);
+	} else {
+		free_variable_store(session->variables);
+		session->variables = contents->variables;
+		contents->variables = NULL;
+	}
+	// saves made before a persistent assignment hold the older value
+	if (session->persistentStore)
+	{
+		apply_persistent_variables(session->persistentStore, session->variables);
+	}
+
+	if (session->backlog)
+	{
+		truncate_backlog(session->backlog, contents->nbBacklogLines);
+	}
+	restore_session_display(session, contents->nbCharToDisplay);
+	free_save_contents(contents);
+}
+
+// the session has to run the saved dialog already, load_session takes care of it
+bool deserialize_session(Session *session, const unsigned char *data, size_t size)
+{
+	SaveContents contents;
+	if (!read_save(&contents, session, session->dialog, session->dialogName, data, size, NULL))
+	{
+		return false;
+	}
+	apply_save(session, &contents);
+	return true;
+}
+
+static void write_save(void *saveWriting)
+{
+	SaveWriting *writing = saveWriting;
+	FILE *file = fopen(writing->savePath, "wb");
+	if (!file)
+	{
+		warning("could not open %s to save.", writing->savePath);
+	} else {
+		if (fwrite(writing->data, 1, buf_len(writing->data), file) != buf_len(writing->data))
+		{
+			warning("could not write the save %s.", writing->savePath);
+		}
+		fclose(file);
+	}
+	buf_free(writing->data);
+	buf_free(writing->savePath);
+	xfree(writing);
+}
+
+// the session is serialized right away, the file is written on a background thread
+void save_session(Session *session, const char *savePath)
+{
+	SaveWriting *writing = xmalloc(sizeof (*writing));
+	writing->data = serialize_session(session);
+	writing->savePath = strclone(savePath);
+	wait_for_saves();
+	saveThread = create_thread(write_save, writing);
+}
+
+// waits for the save being written, if any
+void wait_for_saves()
+{
+	if (saveThread)
+	{
+		join_thread(saveThread);
+		saveThread = NULL;
+	}
+}
+
+// checksum of everything a save keeps, two sessions in the same state have the same hash
+unsigned int get_session_hash(Session *session)
+{
+	buf(unsigned char) data = write_session(session, true);
+	unsigned int hash = get_checksum(data, buf_len(data));
+	buf_free(data);
+	return hash;
+}
+
+// a save of another dialog is read against that dialog before the session switches to it, so a save that turns out invalid leaves the session where it was
+static bool load_save(Session *session, const unsigned char *data, size_t size, VariableStore *variablesSnapshot, const char *saveName)
+{
+	BinaryReader reader = {data, size, SAVE_HEADER_SIZE, false};
+	buf(char) dialogName = read_string(&reader);
+	if (!dialogName)
+	{
+		warning("the save %s is corrupted.", saveName);
+		return false;
+	}
+	Dialog *dialog = session->dialog;
+	if (!strmatch(dialogName, session->dialogName))
+	{
+		// parsing a missing dialog would stop the game
+		if (!check_file(dialogName))
+		{
+			warning("the save %s is of %s, which does not exist anymore.", saveName, dialogName);
+			buf_free(dialogName);
+			return false;
+		}
+		dialog = open_session_dialog(session, dialogName);
+	}
+	SaveContents contents;
+	bool valid = read_save(&contents, session, dialog, dialogName, data, size, variablesSnapshot);
+	if (dialog != session->dialog)
+	{
+		if (valid)
+		{
+			switch_session_dialog(session, dialog, dialogName);
+		} else {
+			close_session_dialog(session, dialog);
+		}
+	}
+	if (valid)
+	{
+		apply_save(session, &contents);
+	}
+	buf_free(dialogName);
+	return valid;
+}
+
+bool load_session_from_memory(Session *session, const unsigned char *data, size_t size, const char *saveName)
+{
+	int version = 0;
+	int payloadSize = 0;
+	unsigned int checksum = 0;
+	if (size >= SAVE_HEADER_SIZE)
+	{
+		memcpy(&version, data + 4, sizeof (version));
+		memcpy(&payloadSize, data + 8, sizeof (payloadSize));
+		memcpy(&checksum, data + 12, sizeof (checksum));
+	}
+	if (size < SAVE_HEADER_SIZE || memcmp(data, SAVE_MAGIC, sizeof (SAVE_MAGIC)))
+	{
+		warning("%s is not a save.", saveName);
+		return false;
+	} else if (version != (int)SAVE_VERSION) {
+		warning("the save %s has version %d, only version %d is supported.", saveName, version, SAVE_VERSION);
+		return false;
+	} else if (payloadSize != (int)(size - SAVE_HEADER_SIZE) || checksum != get_checksum(data + SAVE_HEADER_SIZE, payloadSize)) {
+		warning("the save %s is truncated or corrupted.", saveName);
+		return false;
+	}
+	return load_save(session, data, size, NULL, saveName);
+}
+
+// everything but the variables, for the history which keeps them as snapshots
+buf(unsigned char) serialize_session_state(Session *session)
+{
+	return write_session_state(session, false);
+}
+
+// the state comes from serialize_session_state in this run, so it is not checked like a save
+bool load_session_state(Session *session, const unsigned char *data, size_t size, VariableStore *variables)
+{
+	return load_save(session, data, size, variables, "history");
+}
+
+bool load_session(Session *session, const char *savePath)
+{
+	wait_for_saves();
+	FILE *file = fopen(savePath, "rb");
+	if (!file)
+	{
+		warning("could not open the save %s.", savePath);
+		return false;
+	}
+	buf(unsigned char) data = NULL;
+	unsigned char chunk[4096];
+	size_t nbBytesRead;
+	while ((nbBytesRead = fread(chunk, 1, sizeof (chunk), file)) > 0)
+	{
+		write_bytes(&data, chunk, nbBytesRead);
+	}
+	fclose(file);
+
+	bool loaded = load_session_from_memory(session, data, buf_len(data), savePath);
+	buf_free(data);
+	return loaded;
+}
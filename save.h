@@ -0,0 +1,19 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+typedef struct SessionSnapshot SessionSnapshot;
+
+buf(unsigned char) serialize_session(Session *session);
+SessionSnapshot *snapshot_session(Session *session);
+buf(unsigned char) serialize_session_snapshot(SessionSnapshot *snapshot);
+void free_session_snapshot(SessionSnapshot *snapshot);
+bool deserialize_session(Session *session, const unsigned char *data, size_t size);
+void save_session(Session *session, const char *savePath);
+bool load_session_from_memory(Session *session, const unsigned char *data, size_t size, const char *saveName);
+buf(unsigned char) serialize_session_state(Session *session);
+bool load_session_state(Session *session, const unsigned char *data, size_t size, VariableStore *variables);
+bool load_session(Session *session, const char *savePath);
+void wait_for_saves();
+unsigned int get_session_hash(Session *session);
+
+#endif /* end of include guard: SAVE_H */
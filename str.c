@@ -111,6 +111,18 @@ bool strmatch(const char *a, const char *b)
 	return !strcmp(a, b);
 }
 
+// 64 bits FNV-1a, the same string always gets the same hash
+unsigned long long strhash(const char *string)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (const unsigned char *character = (const unsigned char *)string; *character != '\0'; character++)
+	{
+		hash ^= *character;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 #define MAXUNICODE 0x10FFFF
 
 buf(int) utf8_decode(const char *string)
@@ -9,6 +9,7 @@ buf(char) strappend(buf(char) *destination, const char *suffix);
 buf(char) strnappend(buf(char) *destination, int appendListLength, ...);
 buf(char) strmerge(const char *prefix, const char *suffix);
 bool strmatch(const char *a, const char *b);
+unsigned long long strhash(const char *string);
 buf(int) utf8_decode(const char *string);
 buf(unsigned short) codepoint_to_utf16(const int *codepoints);
 
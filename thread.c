@@ -0,0 +1,111 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "error.h"
+#include "xalloc.h"
+#include "thread.h"
+
+struct Thread
+{
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	void (*function)(void *);
+	void *argument;
+};
+
+struct Mutex
+{
+#ifdef _WIN32
+	CRITICAL_SECTION criticalSection;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+#ifdef _WIN32
+static DWORD WINAPI run_thread(LPVOID data)
+#else
+static void *run_thread(void *data)
+#endif
+{
+	Thread *thread = data;
+	thread->function(thread->argument);
+	return 0;
+}
+
+Thread *create_thread(void (*function)(void *), void *argument)
+{
+	Thread *thread = xmalloc(sizeof (*thread));
+	thread->function = function;
+	thread->argument = argument;
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, run_thread, thread, 0, NULL);
+	if (!thread->handle)
+#else
+	if (pthread_create(&thread->handle, NULL, run_thread, thread))
+#endif
+	{
+		error("could not create a thread.");
+	}
+	return thread;
+}
+
+// waits for the thread to finish and frees it
+void join_thread(Thread *thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+	xfree(thread);
+}
+
+Mutex *create_mutex()
+{
+	Mutex *mutex = xmalloc(sizeof (*mutex));
+#ifdef _WIN32
+	InitializeCriticalSection(&mutex->criticalSection);
+#else
+	pthread_mutex_init(&mutex->mutex, NULL);
+#endif
+	return mutex;
+}
+
+void lock_mutex(Mutex *mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection(&mutex->criticalSection);
+#else
+	pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void unlock_mutex(Mutex *mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&mutex->criticalSection);
+#else
+	pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+void free_mutex(Mutex *mutex)
+{
+#ifdef _WIN32
+	DeleteCriticalSection(&mutex->criticalSection);
+#else
+	pthread_mutex_destroy(&mutex->mutex);
+#endif
+	xfree(mutex);
+}
@@ -0,0 +1,15 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+
+Thread *create_thread(void (*function)(void *), void *argument);
+void join_thread(Thread *thread);
+
+Mutex *create_mutex();
+void lock_mutex(Mutex *mutex);
+void unlock_mutex(Mutex *mutex);
+void free_mutex(Mutex *mutex);
+
+#endif /* end of include guard: THREAD_H */
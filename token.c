@@ -19,6 +19,7 @@ const char *dialogTokenDescriptions[] =
 	[DIALOG_TOKEN_IF] = "if \"#if\"",
 	[DIALOG_TOKEN_ELSE] = "else \"#else\"",
 	[DIALOG_TOKEN_ASSIGN] = "assign \"#assign\"",
+	[DIALOG_TOKEN_ASSIGN_PERSISTENT] = "persistent assign \"#assign_persistent\"",
 	[DIALOG_TOKEN_COMMAND] = "command \"#\"",
 	[DIALOG_TOKEN_GO_TO] = "go to \"->\"",
 
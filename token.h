@@ -12,6 +12,7 @@ typedef enum DialogTokenType
 	DIALOG_TOKEN_IF,
 	DIALOG_TOKEN_ELSE,
 	DIALOG_TOKEN_ASSIGN,
+	DIALOG_TOKEN_ASSIGN_PERSISTENT,
 	DIALOG_TOKEN_COMMAND,
 	DIALOG_TOKEN_GO_TO,
 
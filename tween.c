@@ -0,0 +1,219 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "audio.h"
+#include "maths.h"
+#include "user_input.h"
+#include "stretchy_buffer.h"
+#include "xalloc.h"
+#include "animation.h"
+#include "graphics.h"
+#include "variable.h"
+#include "dialog.h"
+#include "interpret.h"
+#include "tween.h"
+
+float ease(Easing easing, float t)
+{
+	if (easing == EASING_IN)
+	{
+		return t * t;
+	} else if (easing == EASING_OUT) {
+		return t * (2.0f - t);
+	} else if (easing == EASING_IN_OUT) {
+		return t < 0.5f ? 2.0f * t * t : -1.0f + (4.0f - 2.0f * t) * t;
+	}
+	return t;
+}
+
+static Sprite *get_tween_sprite(Session *session, TweenTarget target, int index)
+{
+	Sprite *sprite = NULL;
+	if (target == TWEEN_TARGET_BACKGROUND)
+	{
+		sprite = session->backgroundSprite;
+	} else if (target == TWEEN_TARGET_OLD_BACKGROUND) {
+		sprite = session->oldBackgroundSprite;
+	} else if (target == TWEEN_TARGET_CHARACTER) {
+		sprite = session->charactersSprites[index];
+	} else if (target == TWEEN_TARGET_OLD_CHARACTER) {
+		sprite = session->oldCharactersSprites[index];
+	}
+	return sprite && sprite->animations ? sprite : NULL;
+}
+
+static AudioSource **get_tween_audio_source(Session *session, TweenTarget target)
+{
+	if (target == TWEEN_TARGET_MUSIC)
+	{
+		return &session->music;
+	} else if (target == TWEEN_TARGET_OLD_MUSIC) {
+		return &session->oldMusic;
+	} else if (target == TWEEN_TARGET_SOUND) {
+		return &session->sound;
+	} else if (target == TWEEN_TARGET_OLD_SOUND) {
+		return &session->oldSound;
+	}
+	return NULL;
+}
+
+// returns false when the target is gone, after a save without the old audio sources was loaded for instance
+static bool get_tween_value(Session *session, const Tween *tween, float *value)
+{
+	Sprite *sprite = get_tween_sprite(session, tween->target, tween->index);
+	AudioSource **audioSource = get_tween_audio_source(session, tween->target);
+	if (sprite && tween->property == TWEEN_PROPERTY_OPACITY)
+	{
+		*value = sprite->opacity;
+	} else if (sprite && tween->property == TWEEN_PROPERTY_POSITION_X) {
+		*value = sprite->position.x;
+	} else if (audioSource && *audioSource && tween->property == TWEEN_PROPERTY_VOLUME) {
+		*value = (*audioSource)->volume;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static void set_tween_value(Session *session, const Tween *tween, float value)
+{
+	Sprite *sprite = get_tween_sprite(session, tween->target, tween->index);
+	AudioSource **audioSource = get_tween_audio_source(session, tween->target);
+	if (tween->property == TWEEN_PROPERTY_OPACITY)
+	{
+		sprite->opacity = value;
+	} else if (tween->property == TWEEN_PROPERTY_POSITION_X) {
+		sprite->position.x = roundf(value);
+	} else if (tween->property == TWEEN_PROPERTY_VOLUME) {
+		(*audioSource)->volume = value;
+	}
+}
+
+static void end_tween(Session *session, const Tween *tween)
+{
+	if (tween->end == TWEEN_END_HIDE)
+	{
+		Sprite *sprite = get_tween_sprite(session, tween->target, tween->index);
+		sprite->opacity = 1.0f;
+		sprite->animations = NULL;
+		if (tween->target == TWEEN_TARGET_CHARACTER)
+		{
+			session->state->charactersNames[tween->index] = NULL;
+		}
+	} else if (tween->end == TWEEN_END_STOP) {
+		AudioSource **audioSource = get_tween_audio_source(session, tween->target);
+		stop_audio_source(*audioSource);
+		xfree(*audioSource);
+		*audioSource = NULL;
+		if (tween->target == TWEEN_TARGET_MUSIC)
+		{
+			buf_free(session->musicName);
+			session->musicName = NULL;
+		} else if (tween->target == TWEEN_TARGET_SOUND) {
+			buf_free(session->soundName);
+			session->soundName = NULL;
+		}
+	}
+}
+
+// removes the tweens matching the target, index -1 matches every index
+static void remove_tweens(Session *session, TweenTarget target, int index, int property)
+{
+	ExecutionState *state = session->state;
+	unsigned int nbTweens = 0;
+	for (unsigned int i = 0; i < buf_len(state->tweens); i++)
+	{
+		Tween *tween = &state->tweens[i];
+		if (tween->target != target || (index != -1 && tween->index != index) || (property != -1 && (int)tween->property != property))
+		{
+			state->tweens[nbTweens++] = *tween;
+		}
+	}
+	if (state->tweens)
+	{
+		_buf_header(state->tweens)->count = nbTweens;
+	}
+}
+
+// opacity and volume range over [0, 1], their tweens last duration for the whole range and less for a part of it
+void start_tween(Session *session, TweenTarget target, int index, TweenProperty property, float to, float duration, Easing easing, TweenEnd end, int owner)
+{
+	Tween tween = {target, index, property, easing, end, 0.0f, to, duration, 0.0f, owner};
+	remove_tweens(session, target, index, property);
+	if (!get_tween_value(session, &tween, &tween.from))
+	{
+		return;
+	}
+	if (property != TWEEN_PROPERTY_POSITION_X)
+	{
+		tween.duration *= fabsf(to - tween.from);
+	}
+	if (tween.duration <= 0.0f)
+	{
+		set_tween_value(session, &tween, to);
+		end_tween(session, &tween);
+		return;
+	}
+	buf_add(session->state->tweens, tween);
+}
+
+// every tween runs concurrently, the finished ones are removed in order so the execution state stays deterministic
+void update_tweens(Session *session, float deltaTime)
+{
+	ExecutionState *state = session->state;
+	unsigned int nbTweens = 0;
+	for (unsigned int i = 0; i < buf_len(state->tweens); i++)
+	{
+		Tween tween = state->tweens[i];
+		float value;
+		if (!get_tween_value(session, &tween, &value))
+		{
+			continue;
+		}
+		tween.time += deltaTime;
+		if (tween.time >= tween.duration)
+		{
+			set_tween_value(session, &tween, tween.to);
+			end_tween(session, &tween);
+		} else {
+			set_tween_value(session, &tween, tween.from + (tween.to - tween.from) * ease(tween.easing, tween.time / tween.duration));
+			state->tweens[nbTweens++] = tween;
+		}
+	}
+	if (state->tweens)
+	{
+		_buf_header(state->tweens)->count = nbTweens;
+	}
+}
+
+void cancel_tweens(Session *session, TweenTarget target, int index)
+{
+	remove_tweens(session, target, index, -1);
+}
+
+// follows a character moved to another position
+void move_tweens(Session *session, TweenTarget target, int index, int newIndex)
+{
+	ExecutionState *state = session->state;
+	for (unsigned int i = 0; i < buf_len(state->tweens); i++)
+	{
+		if (state->tweens[i].target == target && state->tweens[i].index == index)
+		{
+			state->tweens[i].index = newIndex;
+		}
+	}
+}
+
+bool has_tweens(Session *session, int owner)
+{
+	ExecutionState *state = session->state;
+	for (unsigned int i = 0; i < buf_len(state->tweens); i++)
+	{
+		if (state->tweens[i].owner == owner)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,65 @@
+#ifndef TWEEN_H
+#define TWEEN_H
+
+typedef enum Easing
+{
+	EASING_LINEAR,
+	EASING_IN,
+	EASING_OUT,
+	EASING_IN_OUT
+} Easing;
+
+typedef enum TweenTarget
+{
+	TWEEN_TARGET_BACKGROUND,
+	TWEEN_TARGET_OLD_BACKGROUND,
+	TWEEN_TARGET_CHARACTER,
+	TWEEN_TARGET_OLD_CHARACTER,
+	TWEEN_TARGET_MUSIC,
+	TWEEN_TARGET_OLD_MUSIC,
+	TWEEN_TARGET_SOUND,
+	TWEEN_TARGET_OLD_SOUND
+} TweenTarget;
+
+typedef enum TweenProperty
+{
+	TWEEN_PROPERTY_OPACITY,
+	TWEEN_PROPERTY_VOLUME,
+	TWEEN_PROPERTY_POSITION_X
+} TweenProperty;
+
+// what happens to the target once its tween finishes
+typedef enum TweenEnd
+{
+	TWEEN_END_NONE,
+	// the sprite is cleared
+	TWEEN_END_HIDE,
+	// the audio source is stopped and freed
+	TWEEN_END_STOP
+} TweenEnd;
+
+// targets are named rather than pointed to, so tweens are plain data saved with the execution state
+typedef struct Tween
+{
+	TweenTarget target;
+	// character position of the character targets
+	int index;
+	TweenProperty property;
+	Easing easing;
+	TweenEnd end;
+	float from;
+	float to;
+	float duration;
+	float time;
+	// instruction awaiting the tween, -1 when nothing waits for it
+	int owner;
+} Tween;
+
+float ease(Easing easing, float t);
+void start_tween(Session *session, TweenTarget target, int index, TweenProperty property, float to, float duration, Easing easing, TweenEnd end, int owner);
+void update_tweens(Session *session, float deltaTime);
+void cancel_tweens(Session *session, TweenTarget target, int index);
+void move_tweens(Session *session, TweenTarget target, int index, int newIndex);
+bool has_tweens(Session *session, int owner);
+
+#endif /* end of include guard: TWEEN_H */
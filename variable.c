@@ -6,8 +6,24 @@
 #include "error.h"
 #include "stretchy_buffer.h"
 #include "xalloc.h"
+#include "str.h"
 #include "variable.h"
 
+Variable *clone_variable(Variable *variable)
+{
+	Variable *clone = xmalloc(sizeof (*clone));
+	clone->type = variable->type;
+	if (clone->type == VARIABLE_NUMERIC)
+	{
+		clone->numeric = variable->numeric;
+	} else if (clone->type == VARIABLE_STRING) {
+		clone->string = strclone(variable->string);
+	} else {
+		error("unknown variable type %d.", variable->type);
+	}
+	return clone;
+}
+
 void print_variable(Variable *variable)
 {
 	if (variable->type == VARIABLE_NUMERIC)
@@ -29,3 +45,145 @@ void free_variable(Variable *variable)
 	}
 	xfree(variable);
 }
+
+// A snapshot only shares the chunks table, a write copies the table then the written chunk if they are shared.
+// References are counted atomically, as snapshots of a store can be handed to other threads.
+
+static VariableChunk *create_variable_chunk()
+{
+	VariableChunk *chunk = xmalloc(sizeof (*chunk));
+	chunk->references = 1;
+	for (int i = 0; i < VARIABLE_CHUNK_SIZE; i++)
+	{
+		chunk->values[i] = NULL;
+		chunk->versions[i] = 0;
+	}
+	return chunk;
+}
+
+static void release_variable_chunk(VariableChunk *chunk)
+{
+	if (__atomic_sub_fetch(&chunk->references, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		for (int i = 0; i < VARIABLE_CHUNK_SIZE; i++)
+		{
+			if (chunk->values[i])
+			{
+				free_variable(chunk->values[i]);
+			}
+		}
+		xfree(chunk);
+	}
+}
+
+static void release_variable_table(VariableTable *table)
+{
+	if (__atomic_sub_fetch(&table->references, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		for (unsigned int i = 0; i < buf_len(table->chunks); i++)
+		{
+			release_variable_chunk(table->chunks[i]);
+		}
+		buf_free(table->chunks);
+		xfree(table);
+	}
+}
+
+VariableStore *create_variable_store()
+{
+	VariableStore *store = xmalloc(sizeof (*store));
+	store->table = xmalloc(sizeof (*store->table));
+	store->table->references = 1;
+	store->table->chunks = NULL;
+	store->writesCount = 0;
+	return store;
+}
+
+VariableStore *snapshot_variable_store(VariableStore *store)
+{
+	VariableStore *snapshot = xmalloc(sizeof (*snapshot));
+	snapshot->table = store->table;
+	__atomic_add_fetch(&snapshot->table->references, 1, __ATOMIC_RELAXED);
+	snapshot->writesCount = store->writesCount;
+	return snapshot;
+}
+
+void restore_variable_store(VariableStore *store, VariableStore *snapshot)
+{
+	__atomic_add_fetch(&snapshot->table->references, 1, __ATOMIC_RELAXED);
+	release_variable_table(store->table);
+	store->table = snapshot->table;
+}
+
+Variable *get_variable_store_value(VariableStore *store, int slot)
+{
+	unsigned int chunkIndex = slot / VARIABLE_CHUNK_SIZE;
+	if (chunkIndex >= buf_len(store->table->chunks))
+	{
+		return NULL;
+	}
+	return store->table->chunks[chunkIndex]->values[slot % VARIABLE_CHUNK_SIZE];
+}
+
+unsigned int get_variable_store_version(VariableStore *store, int slot)
+{
+	unsigned int chunkIndex = slot / VARIABLE_CHUNK_SIZE;
+	if (chunkIndex >= buf_len(store->table->chunks))
+	{
+		return 0;
+	}
+	return store->table->chunks[chunkIndex]->versions[slot % VARIABLE_CHUNK_SIZE];
+}
+
+void set_variable_store_value(VariableStore *store, int slot, Variable *variable)
+{
+	if (__atomic_load_n(&store->table->references, __ATOMIC_ACQUIRE) > 1)
+	{
+		VariableTable *table = xmalloc(sizeof (*table));
+		table->references = 1;
+		table->chunks = NULL;
+		for (unsigned int i = 0; i < buf_len(store->table->chunks); i++)
+		{
+			__atomic_add_fetch(&store->table->chunks[i]->references, 1, __ATOMIC_RELAXED);
+			buf_add(table->chunks, store->table->chunks[i]);
+		}
+		release_variable_table(store->table);
+		store->table = table;
+	}
+
+	unsigned int chunkIndex = slot / VARIABLE_CHUNK_SIZE;
+	while (chunkIndex >= buf_len(store->table->chunks))
+	{
+		buf_add(store->table->chunks, create_variable_chunk());
+	}
+
+	VariableChunk *chunk = store->table->chunks[chunkIndex];
+	if (__atomic_load_n(&chunk->references, __ATOMIC_ACQUIRE) > 1)
+	{
+		VariableChunk *chunkCopy = create_variable_chunk();
+		for (int i = 0; i < VARIABLE_CHUNK_SIZE; i++)
+		{
+			if (chunk->values[i])
+			{
+				chunkCopy->values[i] = clone_variable(chunk->values[i]);
+			}
+			chunkCopy->versions[i] = chunk->versions[i];
+		}
+		release_variable_chunk(chunk);
+		store->table->chunks[chunkIndex] = chunkCopy;
+		chunk = chunkCopy;
+	}
+
+	if (chunk->values[slot % VARIABLE_CHUNK_SIZE])
+	{
+		free_variable(chunk->values[slot % VARIABLE_CHUNK_SIZE]);
+	}
+	chunk->values[slot % VARIABLE_CHUNK_SIZE] = variable;
+	chunk->versions[slot % VARIABLE_CHUNK_SIZE] = ++store->writesCount;
+}
+
+void free_variable_store(VariableStore *store)
+{
+	release_variable_table(store->table);
+	xfree(store);
+}
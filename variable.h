@@ -14,7 +14,38 @@ typedef struct Variable
 	double numeric;
 } Variable;
 
+Variable *clone_variable(Variable *variable);
 void print_variable(Variable *variable);
 void free_variable(Variable *variable);
 
+#define VARIABLE_CHUNK_SIZE 64
+
+typedef struct VariableChunk
+{
+	int references;
+	Variable *values[VARIABLE_CHUNK_SIZE];
+	unsigned int versions[VARIABLE_CHUNK_SIZE];
+} VariableChunk;
+
+typedef struct VariableTable
+{
+	int references;
+	buf(VariableChunk *) chunks;
+} VariableTable;
+
+typedef struct VariableStore
+{
+	VariableTable *table;
+	// stamps every write, so versions of a store only grow even across snapshots
+	unsigned int writesCount;
+} VariableStore;
+
+VariableStore *create_variable_store();
+VariableStore *snapshot_variable_store(VariableStore *store);
+void restore_variable_store(VariableStore *store, VariableStore *snapshot);
+Variable *get_variable_store_value(VariableStore *store, int slot);
+unsigned int get_variable_store_version(VariableStore *store, int slot);
+void set_variable_store_value(VariableStore *store, int slot, Variable *variable);
+void free_variable_store(VariableStore *store);
+
 #endif /* end of include guard: VARIABLE_H */
\ No newline at end of file
@@ -22,6 +22,7 @@ static HWND window;
 
 NO_RETURN void error(const char *format, ...)
 {
+	recover_from_error();
 	char buffer[1024] = "ERROR : ";
 	if (format)
 	{
@@ -1,88 +1,202 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stddef.h>
 
 #include "error.h"
 #include "xalloc.h"
 
-typedef struct Leak
+// every block starts with its header, so freeing it needs no lookup
+typedef struct BlockHeader
 {
-	void *ptr;
+	struct BlockHeader *previous;
+	struct BlockHeader *next;
+	size_t size;
 	const char *file;
 	int line;
 	bool stretchy;
-} Leak;
+	unsigned int scope;
+} BlockHeader;
 
-static Leak leaks[1000000];
-static unsigned int nbLeaks = 0;
+// rounded up so the blocks stay aligned as malloc returns them
+#define BLOCK_HEADER_SIZE ((sizeof (BlockHeader) + 15) & ~(size_t)15)
+#define NB_SHARDS 64
+
+// sessions can be interpreted on several threads, so the blocks are listed in shards picked by address, each behind its own lock
+typedef struct Shard
+{
+	BlockHeader *first;
+	volatile int lock;
+	// a shard per cache line, so threads locking different ones do not contend
+	char padding[64 - sizeof (BlockHeader *) - sizeof (int)];
+} Shard;
+
+static Shard shards[NB_SHARDS];
+
+// allocations and reallocations of the calling thread, so a session only counts its own ones
+static __thread unsigned long long allocationsCount = 0;
+// bytes allocated minus bytes freed by the calling thread, so the cost of building something can be measured
+static __thread long long allocatedBytes = 0;
+// tags the allocations of the calling thread, so a piece of work given up can free what it built
+static __thread unsigned int allocationsScope = 0;
+static unsigned int nbAllocationsScopes = 0;
+
+static Shard *get_shard(BlockHeader *header)
+{
+	uintptr_t address = (uintptr_t)header;
+	return &shards[((address >> 4) ^ (address >> 12)) % NB_SHARDS];
+}
+
+static void lock_shard(Shard *shard)
+{
+	while (__sync_lock_test_and_set(&shard->lock, 1))
+	{
+	}
+}
+
+static void unlock_shard(Shard *shard)
+{
+	__sync_lock_release(&shard->lock);
+}
+
+static void unlink_block_unlocked(Shard *shard, BlockHeader *header)
+{
+	if (header->previous)
+	{
+		header->previous->next = header->next;
+	} else {
+		shard->first = header->next;
+	}
+	if (header->next)
+	{
+		header->next->previous = header->previous;
+	}
+}
+
+static void link_block(BlockHeader *header)
+{
+	Shard *shard = get_shard(header);
+	lock_shard(shard);
+	header->previous = NULL;
+	header->next = shard->first;
+	if (shard->first)
+	{
+		shard->first->previous = header;
+	}
+	shard->first = header;
+	unlock_shard(shard);
+}
+
+static void unlink_block(BlockHeader *header)
+{
+	Shard *shard = get_shard(header);
+	lock_shard(shard);
+	unlink_block_unlocked(shard, header);
+	unlock_shard(shard);
+}
 
 void *_xmalloc(size_t size, const char *file, int line, bool stretchy)
 {
-	void *result = malloc(size);
-	if (!result)
+	BlockHeader *header = malloc(BLOCK_HEADER_SIZE + size);
+	allocationsCount++;
+	if (!header)
 	{
 		error("could not allocate memory.");
-	} else {
-		Leak leak = {result, file, line, stretchy};
-		leaks[nbLeaks++] = leak;
-		if (nbLeaks == 1000000)
-		{
-			error("too much allocations.");
-		}
-		return result;
 	}
+	header->size = size;
+	header->file = file;
+	header->line = line;
+	header->stretchy = stretchy;
+	header->scope = allocationsScope;
+	allocatedBytes += size;
+	link_block(header);
+	return (unsigned char *)header + BLOCK_HEADER_SIZE;
 }
 
+// the block keeps where it was first allocated
 void *xrealloc(void *ptr, size_t size, const char *file, int line)
 {
-	void *result = realloc(ptr, size);
-	if (!result)
+	if (!ptr)
+	{
+		return _xmalloc(size, file, line, false);
+	}
+	BlockHeader *header = (BlockHeader *)((unsigned char *)ptr - BLOCK_HEADER_SIZE);
+	size_t oldSize = header->size;
+	// unlinked first, the block may move and its shard is walked by other threads
+	unlink_block(header);
+	BlockHeader *newHeader = realloc(header, BLOCK_HEADER_SIZE + size);
+	allocationsCount++;
+	if (!newHeader)
 	{
 		error("could not allocate memory.");
-	} else {
-		if (result != ptr)
-		{
-			for (size_t i = 0; i < nbLeaks; i++)
-			{
-				if (leaks[i].ptr == ptr)
-				{
-					leaks[i].ptr = result;
-					break;
-				}
-			}
-		}
-		return result;
 	}
+	newHeader->size = size;
+	allocatedBytes += (long long)size - (long long)oldSize;
+	link_block(newHeader);
+	return (unsigned char *)newHeader + BLOCK_HEADER_SIZE;
 }
 
 void xfree(void *ptr)
 {
 	if (ptr)
 	{
-		for (size_t i = 0; i < nbLeaks; i++)
+		BlockHeader *header = (BlockHeader *)((unsigned char *)ptr - BLOCK_HEADER_SIZE);
+		unlink_block(header);
+		allocatedBytes -= header->size;
+		free(header);
+	}
+}
+
+unsigned long long get_allocations_count()
+{
+	return allocationsCount;
+}
+
+long long get_allocated_bytes()
+{
+	return allocatedBytes;
+}
+
+void begin_allocations_scope()
+{
+	allocationsScope = __sync_add_and_fetch(&nbAllocationsScopes, 1);
+}
+
+void end_allocations_scope(bool freeAllocations)
+{
+	for (int i = 0; freeAllocations && i < NB_SHARDS; i++)
+	{
+		Shard *shard = &shards[i];
+		lock_shard(shard);
+		BlockHeader *header = shard->first;
+		while (header)
 		{
-			if (leaks[i].ptr == ptr)
+			BlockHeader *next = header->next;
+			if (header->scope == allocationsScope)
 			{
-				leaks[i] = leaks[nbLeaks - 1];
-				nbLeaks--;
-				break;
+				unlink_block_unlocked(shard, header);
+				allocatedBytes -= header->size;
+				free(header);
 			}
+			header = next;
 		}
+		unlock_shard(shard);
 	}
-	free(ptr);
+	allocationsScope = 0;
 }
 
 void print_leaks()
 {
 	int leaksCount = 0;
 	printf("--- Memory leaks ---\n");
-	for (size_t i = 0; i < nbLeaks; i++)
+	for (int i = 0; i < NB_SHARDS; i++)
 	{
-		if (leaks[i].ptr)
+		lock_shard(&shards[i]);
+		for (BlockHeader *header = shards[i].first; header; header = header->next)
 		{
-			printf("	-%s:%d &%d", leaks[i].file, leaks[i].line, (int)leaks[i].ptr);
-			if (leaks[i].stretchy)
+			printf("	-%s:%d &%p", header->file, header->line, (void *)((unsigned char *)header + BLOCK_HEADER_SIZE));
+			if (header->stretchy)
 			{
 				printf(" BUF");
 			}
@@ -90,6 +204,7 @@ void print_leaks()
 			fflush(stdout);
 			leaksCount++;
 		}
+		unlock_shard(&shards[i]);
 	}
 	printf("%d memory leaks.\n", leaksCount);
 }
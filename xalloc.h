@@ -6,5 +6,9 @@ void *_xmalloc(size_t size, const char *file, int line, bool stretchy);
 void *xrealloc(void *p, size_t size, const char *file, int line);
 void xfree(void *ptr);
 void print_leaks();
+unsigned long long get_allocations_count();
+long long get_allocated_bytes();
+void begin_allocations_scope();
+void end_allocations_scope(bool freeAllocations);
 
 #endif /* end of include guard: XALLOC_H */